@@ -0,0 +1,91 @@
+"""PyAudio Benchmark: Per-block cost of reading a stream from asyncio.
+
+Reads blocks of input from a stream with a capture buffer in an asyncio
+coroutine, either with Stream.aread (which waits on the event loop for the
+stream's readiness file descriptor) or with Stream.read in the loop's default
+executor (which hops to a worker thread and back for every block).
+
+Reports, for each approach:
+  - the process CPU time per block, while keeping up with the device;
+  - the time to read a block that is already buffered, i.e., the latency
+    that the approach itself adds to every block.
+
+With --mode both (the default), runs the two approaches one after the other
+in the same process, so that they can be compared directly.
+"""
+
+import argparse
+import asyncio
+import statistics
+import sys
+import time
+
+import pyaudio
+
+
+parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+parser.add_argument('--rate', type=int, default=48000)
+parser.add_argument('--frames-per-buffer', type=int, default=256)
+parser.add_argument('--channels', type=int,
+                    default=1 if sys.platform == 'darwin' else 2)
+parser.add_argument('--seconds', type=float, default=5.0)
+parser.add_argument('--mode', choices=['aread', 'executor', 'both'],
+                    default='both')
+args = parser.parse_args()
+
+CAPTURE_BUFFER_SECONDS = 1.0
+
+
+async def read_block(stream, mode):
+    if mode == 'aread':
+        return await stream.aread(args.frames_per_buffer)
+    return await asyncio.get_running_loop().run_in_executor(
+        None, stream.read, args.frames_per_buffer)
+
+
+async def measure(p, mode):
+    stream = p.open(format=pyaudio.paInt16,
+                    channels=args.channels,
+                    rate=args.rate,
+                    input=True,
+                    frames_per_buffer=args.frames_per_buffer,
+                    capture_buffer_seconds=CAPTURE_BUFFER_SECONDS)
+    # Start the executor's worker thread, outside of the measurement.
+    await read_block(stream, mode)
+
+    num_blocks = int(args.seconds * args.rate / args.frames_per_buffer)
+    start_cpu = time.process_time()
+    for _ in range(num_blocks):
+        await read_block(stream, mode)
+    elapsed_cpu = time.process_time() - start_cpu
+
+    # Let the capture buffer fill halfway, then drain it block by block.
+    await asyncio.sleep(CAPTURE_BUFFER_SECONDS / 2)
+    ready_times = []
+    while stream.get_read_available() >= args.frames_per_buffer:
+        start = time.perf_counter()
+        await read_block(stream, mode)
+        ready_times.append(time.perf_counter() - start)
+
+    lost_frames = stream.get_capture_lost_frames()
+    stream.close()
+
+    print(f"== {mode}")
+    print(f"blocks: {num_blocks}")
+    print(f"process cpu per block: {elapsed_cpu / num_blocks * 1e6:.2f} us")
+    if ready_times:
+        ready_times.sort()
+        print(f"buffered block read, median: "
+              f"{statistics.median(ready_times) * 1e6:.2f} us")
+        print(f"buffered block read, 99th percentile: "
+              f"{ready_times[int(len(ready_times) * 0.99)] * 1e6:.2f} us")
+    print(f"lost frames: {lost_frames}")
+
+
+p = pyaudio.PyAudio()
+loop = asyncio.new_event_loop()
+modes = ['aread', 'executor'] if args.mode == 'both' else [args.mode]
+for mode in modes:
+    loop.run_until_complete(measure(p, mode))
+loop.close()
+p.terminate()
@@ -0,0 +1,113 @@
+"""PyAudio Benchmark: Per-period overhead of callback mode.
+
+Opens a full-duplex callback stream with a small period and a trivial
+callback, so that nearly all of the time spent per period is PyAudio's own
+overhead: acquiring the GIL, building the callback's arguments, calling it,
+and parsing its result.
+
+Reports the number of callbacks, the process CPU time per callback, and the
+CPU load reported by PortAudio. Then, in process, calls the same callback in
+a loop with its arguments built the way PyAudio used to build them (a new
+bytes object and time_info dict per period) and the way it builds them now
+(reused objects), and reports both per-call times and their difference.
+"""
+
+import argparse
+import sys
+import time
+
+import pyaudio
+
+
+parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+parser.add_argument('--rate', type=int, default=48000)
+parser.add_argument('--frames-per-buffer', type=int, default=64)
+parser.add_argument('--channels', type=int,
+                    default=1 if sys.platform == 'darwin' else 2)
+parser.add_argument('--seconds', type=float, default=5.0)
+parser.add_argument('--reuse-input-buffer', action='store_true',
+                    help='Pass reuse_input_buffer=True to open().')
+parser.add_argument('--callback-batch-periods', type=int, default=1,
+                    help='Pass callback_batch_periods to open().')
+parser.add_argument('--baseline-calls', type=int, default=200000,
+                    help='Number of calls per in-process baseline loop.')
+args = parser.parse_args()
+
+num_callbacks = 0
+out_data = b'\0' * (args.frames_per_buffer * args.callback_batch_periods *
+                    args.channels * 2)
+
+
+def callback(in_data, frame_count, time_info, status):
+    global num_callbacks
+    num_callbacks += 1
+    return (out_data, pyaudio.paContinue)
+
+
+def time_argument_building(reuse, in_data, frame_count):
+    """Returns the seconds per call of a loop that calls callback() with
+    arguments built per period (as PyAudio used to) or reused (as it does
+    now)."""
+    time_info = {'input_buffer_adc_time': 0.0,
+                 'current_time': 0.0,
+                 'output_buffer_dac_time': 0.0}
+    view = memoryview(in_data)
+    start = time.perf_counter()
+    for _ in range(args.baseline_calls):
+        if reuse:
+            callback(view, frame_count, time_info, 0)
+        else:
+            callback(bytes(in_data), frame_count,
+                     {'input_buffer_adc_time': 0.0,
+                      'current_time': 0.0,
+                      'output_buffer_dac_time': 0.0}, 0)
+    return (time.perf_counter() - start) / args.baseline_calls
+
+
+p = pyaudio.PyAudio()
+open_kwargs = {}
+if args.reuse_input_buffer:
+    open_kwargs['reuse_input_buffer'] = True
+if args.callback_batch_periods != 1:
+    open_kwargs['callback_batch_periods'] = args.callback_batch_periods
+stream = p.open(format=pyaudio.paInt16,
+                channels=args.channels,
+                rate=args.rate,
+                input=True,
+                output=True,
+                frames_per_buffer=args.frames_per_buffer,
+                stream_callback=callback,
+                start=False,
+                **open_kwargs)
+
+cpu_loads = []
+start_cpu = time.process_time()
+stream.start_stream()
+start = time.monotonic()
+while stream.is_active() and time.monotonic() - start < args.seconds:
+    time.sleep(0.1)
+    cpu_loads.append(stream.get_cpu_load())
+stream.stop_stream()
+elapsed_cpu = time.process_time() - start_cpu
+
+stream.close()
+p.terminate()
+
+num_periods = num_callbacks * args.callback_batch_periods
+print(f"callbacks: {num_callbacks}")
+if num_callbacks:
+    print(f"process cpu per callback: "
+          f"{elapsed_cpu / num_callbacks * 1e6:.2f} us")
+    print(f"process cpu per period: "
+          f"{elapsed_cpu / num_periods * 1e6:.2f} us")
+if cpu_loads:
+    print(f"mean portaudio cpu load: "
+          f"{sum(cpu_loads) / len(cpu_loads) * 100:.2f}%")
+
+frame_count = args.frames_per_buffer * args.callback_batch_periods
+in_data = b'\0' * (frame_count * args.channels * 2)
+old_time = time_argument_building(False, in_data, frame_count)
+new_time = time_argument_building(True, in_data, frame_count)
+print(f"baseline per call, old argument building: {old_time * 1e6:.3f} us")
+print(f"baseline per call, reused arguments: {new_time * 1e6:.3f} us")
+print(f"difference: {(old_time - new_time) * 1e6:.3f} us")
@@ -0,0 +1,71 @@
+"""PyAudio Benchmark: Throughput of sample format conversions.
+
+Converts a buffer of samples between every pair of the sample formats that
+streams convert between (see the `device_format` parameter of
+PyAudio.Stream), with pyaudio.convert_format, which runs the same native
+kernels that streams run on every period, block, or callback.
+
+Reports, for each pair, the median conversion throughput in millions of
+samples per second, and the real-time factor for a 48 kHz stereo stream (how
+many such streams one core could convert). This compares the pairs against
+each other, e.g., integer widenings against float conversions, which round
+and clip, and each pair against the budget of a real-time stream.
+"""
+
+import argparse
+import array
+import math
+import statistics
+import time
+
+import pyaudio
+
+
+FORMATS = {
+    'float32': pyaudio.paFloat32,
+    'int32': pyaudio.paInt32,
+    'int24': pyaudio.paInt24,
+    'int16': pyaudio.paInt16,
+    'int8': pyaudio.paInt8,
+    'uint8': pyaudio.paUInt8,
+}
+
+parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+parser.add_argument('--samples', type=int, default=1 << 20)
+parser.add_argument('--repeat', type=int, default=20)
+parser.add_argument('--from-format', choices=FORMATS, action='append',
+                    help='Source format (repeatable; default: all)')
+parser.add_argument('--to-format', choices=FORMATS, action='append',
+                    help='Target format (repeatable; default: all)')
+args = parser.parse_args()
+
+
+def make_samples(fmt):
+    # A full-scale sine, in float32, converted to the source format.
+    sine = array.array('f', (0.9 * math.sin(i * 0.01)
+                             for i in range(args.samples)))
+    return pyaudio.convert_format(sine, pyaudio.paFloat32, fmt)
+
+
+def measure(from_name, to_name):
+    data = make_samples(FORMATS[from_name])
+    from_fmt = FORMATS[from_name]
+    to_fmt = FORMATS[to_name]
+    pyaudio.convert_format(data, from_fmt, to_fmt)
+
+    times = []
+    for _ in range(args.repeat):
+        start = time.perf_counter()
+        pyaudio.convert_format(data, from_fmt, to_fmt)
+        times.append(time.perf_counter() - start)
+
+    samples_per_second = args.samples / statistics.median(times)
+    print(f"{from_name:>8} -> {to_name:<8} "
+          f"{samples_per_second / 1e6:9.1f} Msamples/s "
+          f"{samples_per_second / (48000 * 2):9.0f}x real time")
+
+
+for from_name in args.from_format or FORMATS:
+    for to_name in args.to_format or FORMATS:
+        if from_name != to_name:
+            measure(from_name, to_name)
@@ -0,0 +1,63 @@
+"""PyAudio Benchmark: Per-block cost of a full-duplex blocking loop.
+
+Runs a full-duplex blocking stream as a wire, either with
+``stream.write(stream.read(n))`` (two calls, two trips without the GIL, and a
+new bytes object per block) or with ``stream.process(block, block)`` (one
+call, one trip, and one reused buffer).
+
+Reports, for each approach, the number of blocks and the process CPU time per
+block. By default, it runs both loops against the same stream settings, back
+to back, so that the difference is the cost of the extra call and bytes
+object; --mode runs only one of them.
+"""
+
+import argparse
+import sys
+import time
+
+import pyaudio
+
+
+parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+parser.add_argument('--rate', type=int, default=48000)
+parser.add_argument('--frames-per-buffer', type=int, default=64)
+parser.add_argument('--channels', type=int,
+                    default=1 if sys.platform == 'darwin' else 2)
+parser.add_argument('--seconds', type=float, default=5.0)
+parser.add_argument('--mode', choices=['read-write', 'process', 'both'],
+                    default='both')
+args = parser.parse_args()
+
+
+def measure(p, mode):
+    stream = p.open(format=pyaudio.paInt16,
+                    channels=args.channels,
+                    rate=args.rate,
+                    input=True,
+                    output=True,
+                    frames_per_buffer=args.frames_per_buffer)
+    block = bytearray(args.frames_per_buffer * args.channels * 2)
+    num_blocks = int(args.seconds * args.rate / args.frames_per_buffer)
+
+    start_cpu = time.process_time()
+    if mode == 'process':
+        for _ in range(num_blocks):
+            stream.process(block, block, exception_on_overflow=False)
+    else:
+        for _ in range(num_blocks):
+            stream.write(stream.read(args.frames_per_buffer,
+                                     exception_on_overflow=False))
+    elapsed_cpu = time.process_time() - start_cpu
+    stream.close()
+
+    print(f"== {mode}")
+    print(f"blocks: {num_blocks}")
+    print(f"process cpu per block: {elapsed_cpu / num_blocks * 1e6:.2f} us")
+
+
+p = pyaudio.PyAudio()
+modes = (['read-write', 'process'] if args.mode == 'both'
+         else [args.mode])
+for mode in modes:
+    measure(p, mode)
+p.terminate()
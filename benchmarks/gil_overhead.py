@@ -0,0 +1,105 @@
+"""PyAudio Benchmark: Cost of entering Python from the audio thread.
+
+Opens an output callback stream with a small period and a trivial callback,
+and measures the CPU time that PortAudio's audio thread spends per period,
+using the thread's own CPU clock. Besides PortAudio's own work, that time
+covers acquiring and releasing the GIL, including any Python thread state
+bookkeeping for the audio thread, which Python does not otherwise know about.
+
+Also reports whether the callback thread kept one Python thread state across
+periods (thread-local data survives from one period to the next only if it
+did).
+
+Runs the measurement in a child process against the PyAudio on sys.path.
+With --baseline-path, also runs the measurement in a child process against
+a baseline build of PyAudio, compiled with PYAUDIO_GILSTATE_ENSURE defined
+(e.g., with CFLAGS=-DPYAUDIO_GILSTATE_ENSURE and pip install --target),
+which uses the plain PyGILState_Ensure path that creates and destroys a
+thread state every period. Reports both and their difference.
+"""
+
+import argparse
+import os
+import subprocess
+import sys
+import threading
+import time
+
+import pyaudio
+
+
+parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+parser.add_argument('--rate', type=int, default=48000)
+parser.add_argument('--frames-per-buffer', type=int, default=32)
+parser.add_argument('--channels', type=int,
+                    default=1 if sys.platform == 'darwin' else 2)
+parser.add_argument('--seconds', type=float, default=5.0)
+parser.add_argument('--baseline-path',
+                    help='Directory holding a PyAudio build with '
+                    'PYAUDIO_GILSTATE_ENSURE defined, to compare against.')
+parser.add_argument('--child', action='store_true',
+                    help='Run one measurement and nothing else.')
+args = parser.parse_args()
+
+if not args.child:
+    cpu_per_period = {}
+    builds = [('persistent thread state', None)]
+    if args.baseline_path:
+        builds.append(('PyGILState_Ensure', args.baseline_path))
+    for name, path in builds:
+        env = dict(os.environ)
+        if path:
+            env['PYTHONPATH'] = os.pathsep.join(
+                [path] + [p for p in [env.get('PYTHONPATH')] if p])
+        output = subprocess.run(
+            [sys.executable, __file__, '--child'] + sys.argv[1:],
+            env=env, check=True, stdout=subprocess.PIPE,
+            universal_newlines=True).stdout
+        print(f"{name}:")
+        for line in output.splitlines():
+            print(f"  {line}")
+            if line.startswith('audio thread cpu per period:'):
+                cpu_per_period[name] = float(line.split()[-2])
+    if len(cpu_per_period) == 2:
+        difference = (cpu_per_period['PyGILState_Ensure'] -
+                      cpu_per_period['persistent thread state'])
+        print(f"difference per period: {difference:.2f} us")
+    sys.exit()
+
+out_data = b'\0' * (args.frames_per_buffer * args.channels * 2)
+local = threading.local()
+thread_times = []
+num_thread_states = 0
+
+
+def callback(in_data, frame_count, time_info, status):
+    global num_thread_states
+    thread_times.append(time.thread_time())
+    if not hasattr(local, 'seen'):
+        local.seen = True
+        num_thread_states += 1
+    return (out_data, pyaudio.paContinue)
+
+
+p = pyaudio.PyAudio()
+stream = p.open(format=pyaudio.paInt16,
+                channels=args.channels,
+                rate=args.rate,
+                output=True,
+                frames_per_buffer=args.frames_per_buffer,
+                stream_callback=callback)
+
+start = time.monotonic()
+while stream.is_active() and time.monotonic() - start < args.seconds:
+    time.sleep(0.1)
+stream.stop_stream()
+stream.close()
+p.terminate()
+
+# Skip the first period, whose CPU time includes stream startup.
+num_periods = len(thread_times) - 2
+print(f"periods: {len(thread_times)}")
+if num_periods > 0:
+    cpu_per_period = (thread_times[-1] - thread_times[1]) / num_periods
+    print(f"audio thread cpu per period: {cpu_per_period * 1e6:.2f} us")
+print(f"python thread states used: {num_thread_states}")
@@ -0,0 +1,64 @@
+"""PyAudio Benchmark: Throughput of sample-rate conversions.
+
+Resamples a buffer of mono float32 samples for common pairs of device and
+application rates (see the `app_rate` parameter of PyAudio.Stream), at each
+quality tier, with pyaudio.resample, which runs the same native filter that
+streams run on every period, block, or callback.
+
+Reports, for each pair and tier, the median throughput in millions of input
+frames per second on one core, per channel, and the real-time factor (how
+many such mono streams one core could resample). Cost scales with the number
+of channels. This compares the quality tiers, whose filters differ in length,
+against each other for each pair of rates, and against the budget of a
+real-time stream.
+"""
+
+import argparse
+import array
+import math
+import statistics
+import time
+
+import pyaudio
+
+
+RATES = [
+    (48000, 16000),
+    (44100, 16000),
+    (44100, 48000),
+    (48000, 44100),
+    (16000, 48000),
+]
+
+parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+parser.add_argument('--seconds', type=float, default=10,
+                    help='Length of the input, in seconds')
+parser.add_argument('--repeat', type=int, default=5)
+parser.add_argument('--quality', choices=['low', 'medium', 'high'],
+                    action='append',
+                    help='Quality tier (repeatable; default: all)')
+args = parser.parse_args()
+
+
+def measure(from_rate, to_rate, quality):
+    frames = int(args.seconds * from_rate)
+    data = array.array('f', (0.9 * math.sin(2 * math.pi * 440 * i / from_rate)
+                             for i in range(frames)))
+    pyaudio.resample(data, pyaudio.paFloat32, 1, from_rate, to_rate, quality)
+
+    times = []
+    for _ in range(args.repeat):
+        start = time.perf_counter()
+        pyaudio.resample(data, pyaudio.paFloat32, 1, from_rate, to_rate,
+                         quality)
+        times.append(time.perf_counter() - start)
+
+    frames_per_second = frames / statistics.median(times)
+    print(f"{from_rate:>6} -> {to_rate:<6} {quality:<6} "
+          f"{frames_per_second / 1e6:9.2f} Mframes/s "
+          f"{frames_per_second / from_rate:9.0f}x real time")
+
+
+for from_rate, to_rate in RATES:
+    for quality in args.quality or ['low', 'medium', 'high']:
+        measure(from_rate, to_rate, quality)
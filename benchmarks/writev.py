@@ -0,0 +1,66 @@
+"""PyAudio Benchmark: Per-chunk cost of playing many small chunks.
+
+Plays audio that arrives as a list of small chunks (e.g., decoded packets) on
+a stream whose playback queue holds all of it, so that no write waits for the
+device, either with one ``stream.write(chunk)`` call per chunk (a trip from
+Python to C, and without the GIL, per chunk) or with one
+``stream.writev(chunks)`` call per list (one trip per list).
+
+Reports, for each approach, the number of chunks and the process CPU time per
+chunk. By default, it plays the same chunks both ways in one run, so that the
+difference is the per-chunk trip into C; --mode plays them only one way.
+"""
+
+import argparse
+import sys
+import time
+
+import pyaudio
+
+
+parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+parser.add_argument('--rate', type=int, default=48000)
+parser.add_argument('--chunk-frames', type=int, default=120)
+parser.add_argument('--chunks-per-write', type=int, default=50)
+parser.add_argument('--channels', type=int,
+                    default=1 if sys.platform == 'darwin' else 2)
+parser.add_argument('--seconds', type=float, default=5.0)
+parser.add_argument('--mode', choices=['write', 'writev', 'both'],
+                    default='both')
+args = parser.parse_args()
+
+
+def measure(p, mode):
+    stream = p.open(format=pyaudio.paInt16,
+                    channels=args.channels,
+                    rate=args.rate,
+                    output=True,
+                    playback_queue_seconds=args.seconds + 1)
+    chunks = [bytes(args.chunk_frames * args.channels * 2)
+              for _ in range(args.chunks_per_write)]
+    num_writes = max(1, int(args.seconds * args.rate /
+                            (args.chunk_frames * args.chunks_per_write)))
+
+    start_cpu = time.process_time()
+    if mode == 'writev':
+        for _ in range(num_writes):
+            stream.writev(chunks)
+    else:
+        for _ in range(num_writes):
+            for chunk in chunks:
+                stream.write(chunk)
+    elapsed_cpu = time.process_time() - start_cpu
+    stream.drain()
+    stream.close()
+
+    num_chunks = num_writes * args.chunks_per_write
+    print(f"== {mode}")
+    print(f"chunks: {num_chunks}")
+    print(f"process cpu per chunk: {elapsed_cpu / num_chunks * 1e6:.2f} us")
+
+
+p = pyaudio.PyAudio()
+modes = ['write', 'writev'] if args.mode == 'both' else [args.mode]
+for mode in modes:
+    measure(p, mode)
+p.terminate()
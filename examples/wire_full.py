@@ -7,19 +7,24 @@ import pyaudio
 
 RECORD_SECONDS = 5
 CHUNK = 1024
+WIDTH = 2
+CHANNELS = 1 if sys.platform == 'darwin' else 2
 RATE = 44100
 
 p = pyaudio.PyAudio()
-stream = p.open(format=p.get_format_from_width(2),
-                channels=1 if sys.platform == 'darwin' else 2,
+stream = p.open(format=p.get_format_from_width(WIDTH),
+                channels=CHANNELS,
                 rate=RATE,
                 input=True,
                 output=True,
                 frames_per_buffer=CHUNK)
 
+# Each call plays the previous block, and records the next one into the same
+# buffer.
+block = bytearray(CHUNK * CHANNELS * WIDTH)
 print('* recording')
 for i in range(0, int(RATE / CHUNK * RECORD_SECONDS)):
-    stream.write(stream.read(CHUNK))
+    stream.process(block, block)
 print('* done')
 
 stream.close()
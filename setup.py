@@ -50,14 +50,32 @@ WIN_VCPKG_PATH = os.environ.get("VCPKG_PATH", None)
 def setup_extension():
     pyaudio_module_sources = [
         'src/pyaudio/main.c',
+        'src/pyaudio/convert.c',
         'src/pyaudio/device_api.c',
         'src/pyaudio/host_api.c',
         'src/pyaudio/init.c',
         'src/pyaudio/mac_core_stream_info.c',
         'src/pyaudio/misc.c',
+        'src/pyaudio/mix.c',
+        'src/pyaudio/ops.c',
+        'src/pyaudio/resample.c',
+        'src/pyaudio/ring_buffer.c',
         'src/pyaudio/stream.c',
+        'src/pyaudio/stream_async.c',
+        'src/pyaudio/stream_batch.c',
+        'src/pyaudio/stream_capture.c',
+        'src/pyaudio/stream_convert.c',
+        'src/pyaudio/stream_decoupled.c',
         'src/pyaudio/stream_io.c',
         'src/pyaudio/stream_lifecycle.c',
+        'src/pyaudio/stream_mix.c',
+        'src/pyaudio/stream_planar.c',
+        'src/pyaudio/stream_playback.c',
+        'src/pyaudio/stream_resample.c',
+        'src/pyaudio/stream_subinterpreter.c',
+        'src/pyaudio/sync.c',
+        'src/pyaudio/thread_state.c',
+        'src/pyaudio/time_info.c',
     ]
     include_dirs = []
     external_libraries = ["portaudio"]
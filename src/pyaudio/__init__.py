@@ -39,7 +39,11 @@ Overview
      :py:class:`PaMacCoreStreamInfo`
 
 **Stream Conversion Convenience Functions**
-  :py:func:`get_sample_size`, :py:func:`get_format_from_width`
+  :py:func:`get_sample_size`, :py:func:`get_format_from_width`,
+  :py:func:`convert_format`, :py:func:`resample`, :py:func:`mix_channels`
+
+**Sample Operations (in place of audioop)**
+  :py:mod:`pyaudio.ops`
 
 **PortAudio version**
   :py:func:`get_portaudio_version`, :py:func:`get_portaudio_version_text`
@@ -50,7 +54,7 @@ Overview
 **Portaudio Sample Formats**
   :py:data:`paFloat32`, :py:data:`paInt32`, :py:data:`paInt24`,
   :py:data:`paInt16`, :py:data:`paInt8`, :py:data:`paUInt8`,
-  :py:data:`paCustomFormat`
+  :py:data:`paCustomFormat`, :py:data:`paNonInterleaved`
 
 .. |PaHostAPI| replace:: :ref:`PortAudio Host API <PaHostAPI>`
 .. _PaHostAPI:
@@ -104,7 +108,10 @@ __author__ = "Hubert Pham"
 __version__ = "0.2.14"
 __docformat__ = "restructuredtext en"
 
+import atexit
 import locale
+import numbers
+import threading
 import warnings
 
 try:
@@ -123,6 +130,17 @@ paInt16 = pa.paInt16  #: 16 bit int
 paInt8 = pa.paInt8  #: 8 bit int
 paUInt8 = pa.paUInt8  #: 8 bit unsigned int
 paCustomFormat = pa.paCustomFormat  #: a custom data format
+#: flag for planar samples (see the `non_interleaved` parameter of
+#: :py:func:`PyAudio.Stream.__init__`)
+paNonInterleaved = pa.paNonInterleaved
+
+# The formats that streams convert between, in order of preference when
+# negotiating a device format.
+_CONVERTIBLE_FORMATS = (paFloat32, paInt32, paInt24, paInt16, paInt8, paUInt8)
+
+# Quality tiers of the sample-rate converter, by name (see the
+# `resample_quality` parameter of PyAudio.Stream.__init__).
+_RESAMPLE_QUALITIES = {'low': 0, 'medium': 1, 'high': 2}
 
 # HostAPI TypeId
 
@@ -228,6 +246,115 @@ def get_format_from_width(width, unsigned=True):
     raise ValueError(f"Invalid width: {width}")
 
 
+def convert_format(data, from_format, to_format):
+    """Converts samples from one sample format to another.
+
+    Uses the same native conversions as streams opened with a `device_format`
+    (see :py:func:`PyAudio.Stream.__init__`). Integer samples map to floats
+    in [-1.0, 1.0) by scaling by 2^(bits - 1); conversions to floats and back
+    are exact, and conversions from floats round to the nearest integer and
+    clip to the range of the format.
+
+    :param data: The samples: ``bytes``, or any C-contiguous buffer-protocol
+       object.
+    :param from_format: The |PaSampleFormat| of `data`.
+    :param to_format: The |PaSampleFormat| to convert to.
+    :raises ValueError: if either format is not one of :py:data:`paFloat32`,
+       :py:data:`paInt32`, :py:data:`paInt24`, :py:data:`paInt16`,
+       :py:data:`paInt8` or :py:data:`paUInt8`, or if `data` does not hold a
+       whole number of samples.
+    :rtype: bytes
+    """
+    return pa.convert_format(data, from_format, to_format)
+
+
+def resample(data, format, channels, from_rate, to_rate, quality='medium'):
+    """Converts samples from one sample rate to another.
+
+    Uses the same native polyphase filter as streams opened with an
+    `app_rate` (see :py:func:`PyAudio.Stream.__init__`), and returns the
+    whole signal: output frame ``k`` is the input at time ``k / to_rate``,
+    and the output spans as long as the input, ``ceil(n * to_rate /
+    from_rate)`` frames for ``n`` input frames.
+
+    :param data: The interleaved samples: ``bytes``, or any C-contiguous
+       buffer-protocol object.
+    :param format: The |PaSampleFormat| of `data`, and of the result.
+    :param channels: The number of channels.
+    :param from_rate: The sample rate of `data`.
+    :param to_rate: The sample rate to convert to.
+    :param quality: ``'low'``, ``'medium'`` or ``'high'`` (see the
+       `resample_quality` parameter of :py:func:`PyAudio.Stream.__init__`).
+    :raises ValueError: if `format` is not one of :py:data:`paFloat32`,
+       :py:data:`paInt32`, :py:data:`paInt24`, :py:data:`paInt16`,
+       :py:data:`paInt8` or :py:data:`paUInt8`, if `quality` is not a
+       quality tier, or if `data` does not hold a whole number of frames.
+    :rtype: bytes
+    """
+    if quality not in _RESAMPLE_QUALITIES:
+        raise ValueError(f"Invalid resample quality: {quality!r}")
+    return pa.resample(data, format, channels, from_rate, to_rate,
+                       _RESAMPLE_QUALITIES[quality])
+
+
+def _flatten_channel_matrix(channel_matrix, num_columns=None):
+    """Return (rows, columns, gains) for a channel matrix: a list of input
+    channel indices, one per output channel, or a list of rows of gains, one
+    row per output channel and one gain per input channel. `gains` is the
+    row-major matrix, as a flat list. Index lists have `num_columns` columns,
+    if given, and otherwise one more than the largest index."""
+    rows = list(channel_matrix)
+    if not rows:
+        raise ValueError("channel_matrix must not be empty")
+
+    if all(isinstance(row, numbers.Integral) for row in rows):
+        if min(rows) < 0:
+            raise ValueError("Invalid channel index in channel_matrix")
+        if num_columns is None:
+            num_columns = max(rows) + 1
+        elif max(rows) >= num_columns:
+            raise ValueError("Invalid channel index in channel_matrix")
+        gains = [0.0] * (len(rows) * num_columns)
+        for i, channel in enumerate(rows):
+            gains[i * num_columns + channel] = 1.0
+        return len(rows), num_columns, gains
+
+    rows = [[float(gain) for gain in row] for row in rows]
+    if num_columns is None:
+        num_columns = len(rows[0])
+    if num_columns < 1 or any(len(row) != num_columns for row in rows):
+        raise ValueError("channel_matrix rows must all have one gain per "
+                         "input channel")
+    return len(rows), num_columns, [gain for row in rows for gain in row]
+
+
+def mix_channels(data, format, channels, channel_matrix):
+    """Routes and mixes frames from one set of channels to another.
+
+    Uses the same native mixing as streams opened with a `channel_matrix`
+    (see :py:func:`PyAudio.Stream.__init__`): output channel ``i`` of each
+    frame is the sum of input channel ``j`` times ``channel_matrix[i][j]``.
+    Matrices that only select channels copy samples exactly; others mix in
+    float32.
+
+    :param data: The interleaved samples: ``bytes``, or any C-contiguous
+       buffer-protocol object.
+    :param format: The |PaSampleFormat| of `data`, and of the result.
+    :param channels: The number of channels in `data`.
+    :param channel_matrix: A list of rows of gains, one row per output
+       channel and one gain per input channel, or a list of input channel
+       indices, one per output channel.
+    :raises ValueError: if `format` is not one of :py:data:`paFloat32`,
+       :py:data:`paInt32`, :py:data:`paInt24`, :py:data:`paInt16`,
+       :py:data:`paInt8` or :py:data:`paUInt8`, if `channel_matrix` does not
+       have `channels` columns, or if `data` does not hold a whole number of
+       frames.
+    :rtype: bytes
+    """
+    rows, _, gains = _flatten_channel_matrix(channel_matrix, channels)
+    return pa.mix_channels(data, format, channels, rows, gains)
+
+
 # Versioning
 
 def get_portaudio_version():
@@ -246,6 +373,12 @@ def get_portaudio_version_text():
     return pa.get_version_text()
 
 
+def _set_result_unless_done(future):
+    # Wakes up a coroutine that awaits future, at most once.
+    if not future.done():
+        future.set_result(None)
+
+
 class PyAudio:
     """Python interface to PortAudio.
 
@@ -271,7 +404,9 @@ class PyAudio:
       :py:func:`get_device_info_by_index`
 
     **Stream Format Conversion**
-      :py:func:`get_sample_size`, :py:func:`get_format_from_width`
+      :py:func:`get_sample_size`, :py:func:`get_format_from_width`,
+      :py:func:`convert_format`, :py:func:`resample`,
+      :py:func:`mix_channels`
 
     **Details**
     """
@@ -284,15 +419,21 @@ class PyAudio:
 
         **Stream Info**
           :py:func:`get_input_latency`, :py:func:`get_output_latency`,
-          :py:func:`get_time`, :py:func:`get_cpu_load`
+          :py:func:`get_time`, :py:func:`get_cpu_load`,
+          :py:func:`get_device_format`
 
         **Stream Management**
           :py:func:`start_stream`, :py:func:`stop_stream`, :py:func:`is_active`,
           :py:func:`is_stopped`
 
         **Input Output**
-          :py:func:`write`, :py:func:`read`, :py:func:`get_read_available`,
-          :py:func:`get_write_available`
+          :py:func:`write`, :py:func:`writev`, :py:func:`read`,
+          :py:func:`get_read_available`, :py:func:`get_write_available`,
+          :py:func:`get_capture_lost_frames`, :py:func:`get_queued_frames`,
+          :py:func:`drain`, :py:func:`process`, :py:func:`get_xrun_counts`
+
+        **Input Output in Coroutines**
+          :py:func:`aread`, :py:func:`awrite`
         """
         def __init__(self,
                      PA_manager,
@@ -307,7 +448,19 @@ class PyAudio:
                      start=True,
                      input_host_api_specific_stream_info=None,
                      output_host_api_specific_stream_info=None,
-                     stream_callback=None):
+                     stream_callback=None,
+                     reuse_input_buffer=False,
+                     output_in_place=False,
+                     decoupled_callback_periods=0,
+                     callback_batch_periods=1,
+                     callback_in_subinterpreter=False,
+                     capture_buffer_seconds=0,
+                     playback_queue_seconds=0,
+                     device_format=None,
+                     non_interleaved=False,
+                     app_rate=None,
+                     resample_quality='medium',
+                     channel_matrix=None):
             """Initialize an audio stream.
 
             Do not call directly. Use :py:func:`PyAudio.open`.
@@ -316,8 +469,8 @@ class PyAudio:
 
             :param PA_manager: A reference to the managing :py:class:`PyAudio`
                 instance
-            :param rate: Sampling rate
-            :param channels: Number of channels
+            :param rate: Sampling rate of the device (see `app_rate`)
+            :param channels: Number of channels (see `channel_matrix`)
             :param format: Sampling size and format. See |PaSampleFormat|.
             :param input: Specifies whether this is an input stream.
                 Defaults to ``False``.
@@ -360,14 +513,16 @@ class PyAudio:
 
                    callback(in_data,      # input data if input=True; else None
                             frame_count,  # number of frames
-                            time_info,    # dictionary
+                            time_info,    # read-only mapping
                             status_flags) # PaCallbackFlags
 
-                ``time_info`` is a dictionary with the following keys:
-                ``input_buffer_adc_time``, ``current_time``, and
-                ``output_buffer_dac_time``; see the PortAudio
-                documentation for their meanings.  ``status_flags`` is one
-                of |PaCallbackFlags|.
+                ``time_info`` is a read-only, dictionary-like object with
+                the following keys: ``input_buffer_adc_time``,
+                ``current_time``, and ``output_buffer_dac_time``; see the
+                PortAudio documentation for their meanings. The values are
+                also available as attributes (e.g.,
+                ``time_info.current_time``). ``status_flags`` is one of
+                |PaCallbackFlags|.
 
                 The callback must return a tuple:
 
@@ -375,9 +530,14 @@ class PyAudio:
 
                     (out_data, flag)
 
-                ``out_data`` is a byte array whose length should be the
-                (``frame_count * channels * bytes-per-channel``) if
-                ``output=True`` or ``None`` if ``output=False``.  ``flag``
+                ``out_data`` holds the samples for playback if
+                ``output=True``, or is ``None`` if ``output=False``. It may
+                be any C-contiguous object that supports the buffer protocol
+                (e.g., ``bytes``, ``bytearray``, ``memoryview``,
+                ``array.array``, or a NumPy array) whose items are either
+                bytes or samples of the stream's format, and should hold
+                ``frame_count * channels * bytes-per-channel`` bytes.
+                ``flag``
                 must be either :py:data:`paContinue`, :py:data:`paComplete` or
                 :py:data:`paAbort` (one of |PaCallbackReturnCodes|).
                 When ``output=True`` and ``out_data`` does not contain at
@@ -388,10 +548,15 @@ class PyAudio:
                 thread (from the main thread).  Exceptions that occur in
                 the ``stream_callback`` will:
 
-                1. print a traceback on standard error to aid debugging,
-                2. queue the exception to be thrown (at some point) in
-                   the main thread, and
-                3. return `paAbort` to PortAudio to stop the stream.
+                1. be saved in the stream, to be raised by the next call
+                   to a stream method (e.g.,
+                   :py:func:`PyAudio.Stream.is_active`), or returned by
+                   :py:func:`PyAudio.Stream.get_error`,
+                2. return `paAbort` to PortAudio to stop the stream, and
+                3. if still unhandled when the stream closes, print a
+                   traceback on standard error.
+
+                Only the first exception is kept until it is handled.
 
                 **Note:** Do not call :py:func:`PyAudio.Stream.read` or
                 :py:func:`PyAudio.Stream.write` if using non-blocking operation.
@@ -399,20 +564,206 @@ class PyAudio:
                 **See:** PortAudio's callback signature for additional
                 details: http://portaudio.com/docs/v19-doxydocs/portaudio_8h.html#a8a60fb2a5ec9cbade3f54a9c978e2710
 
+            :param reuse_input_buffer: For input streams in callback mode,
+                pass ``in_data`` to `stream_callback` as a read-only
+                ``memoryview`` over a buffer that the stream allocates once
+                and reuses for every period, instead of as a new ``bytes``
+                object. This avoids an allocation per period. (Before Python
+                3.8, the ``memoryview`` is writable, but callbacks still must
+                not modify it.) If the callback keeps a reference to
+                ``in_data``, or to anything derived from it (e.g., a slice or
+                a NumPy array), the stream switches to a new buffer, so that
+                the kept samples never change; such callbacks do not benefit
+                from this option. Defaults to ``False``.
+            :param output_in_place: Selects an alternate `stream_callback`
+                signature, in which the callback writes its output samples
+                into a buffer that the stream allocates once and reuses for
+                every period, instead of returning them:
+
+                .. code-block:: python
+
+                   callback(in_data,      # input data if input=True; else None
+                            out_data,     # writable memoryview if output=True;
+                                          # else None
+                            frame_count,  # number of frames
+                            time_info,    # read-only mapping
+                            status_flags) # PaCallbackFlags
+
+                ``out_data`` holds exactly ``frame_count`` frames, and its
+                initial contents are unspecified, so the callback must fill
+                it completely. The callback returns only the ``flag`` (one of
+                |PaCallbackReturnCodes|). The stream then copies the samples
+                to PortAudio's output buffer. Writes to ``out_data`` after
+                the callback returns are not played; if the callback keeps a
+                reference to it, the stream switches to a new buffer.
+                Defaults to ``False``.
+            :param decoupled_callback_periods: If positive, run
+                `stream_callback` on a dedicated Python thread instead of
+                PortAudio's real-time audio thread. The audio thread then only
+                exchanges samples with the callback through lock-free ring
+                buffers, and never waits for the Python interpreter, so other
+                busy Python threads cannot cause it to miss a deadline. The
+                callback may fall behind by up to this many periods before
+                audio drops out (reported to the callback as
+                :py:data:`paInputOverflow` or :py:data:`paOutputUnderflow`).
+                In exchange, this adds ``decoupled_callback_periods *
+                frames_per_buffer`` frames of output latency, which
+                :py:func:`get_output_latency` includes. Requires
+                `stream_callback` and a fixed `frames_per_buffer`.
+                Defaults to ``0`` (call `stream_callback` on the audio
+                thread).
+            :param callback_batch_periods: Call `stream_callback` once every
+                this many periods of `frames_per_buffer` frames, with
+                ``frame_count = callback_batch_periods * frames_per_buffer``,
+                so that the device can keep a small buffer without entering
+                Python every period. The stream collects the input, and plays
+                back the output, of each call in native buffers. The first
+                input frames of each call are up to ``callback_batch_periods
+                - 1`` periods old; on full-duplex streams, output starts
+                playing one period after the callback returns. Both are
+                included in :py:func:`get_input_latency` and
+                :py:func:`get_output_latency`. Requires `stream_callback` and
+                a fixed `frames_per_buffer`, and cannot be combined with
+                `decoupled_callback_periods`. Defaults to ``1`` (call
+                `stream_callback` every period).
+            :param callback_in_subinterpreter: Run `stream_callback` in a
+                subinterpreter with its own GIL, which the stream creates
+                (Python 3.12 or later). The audio thread then never waits for
+                the main interpreter's GIL, so busy Python threads cannot
+                delay the callback. `stream_callback` must then be a string of
+                the form ``'module:function'``, naming a callback that the
+                subinterpreter imports (using the main interpreter's
+                ``sys.path``). The callback shares no Python objects with the
+                main interpreter, and any extension modules that it imports
+                must support subinterpreters with their own GIL. Exceptions
+                that the callback raises reach the main interpreter as the
+                same built-in exception type (or :py:exc:`RuntimeError`),
+                with the callback's traceback as a note. Cannot be
+                combined with `decoupled_callback_periods` or
+                `callback_batch_periods`. Defaults to ``False``.
+            :param capture_buffer_seconds: If positive, capture input in the
+                background into a buffer of this many seconds, and serve
+                :py:func:`read` and :py:func:`get_read_available` from that
+                buffer. PortAudio's audio thread fills the buffer without
+                waiting for the Python interpreter, so the reading thread may
+                stall for up to this long without losing input. If the
+                buffer fills up anyway, new input is dropped, the next read
+                reports an overflow, and
+                :py:func:`get_capture_lost_frames` counts the dropped
+                frames. Requires an input-only stream without
+                `stream_callback`. Defaults to ``0`` (read from the device
+                directly).
+            :param playback_queue_seconds: If positive, queue output for
+                playback in a buffer of this many seconds: :py:func:`write`
+                copies the samples into the buffer and returns as soon as
+                they fit, and PortAudio's audio thread plays the buffer out
+                without waiting for the Python interpreter. Use
+                :py:func:`get_queued_frames` or :py:func:`get_write_available`
+                for backpressure, and :py:func:`drain` to wait for the queue
+                to play out; :py:func:`close` discards queued frames.
+                Requires an output-only stream without `stream_callback`.
+                Defaults to ``0`` (write to the device directly).
+            :param device_format: The |PaSampleFormat| to open the device
+                with, if it differs from `format`, which remains the format
+                of every sample that the stream reads, writes, or passes to
+                and from `stream_callback`. Native code converts between the
+                two (see :py:func:`convert_format`), on PortAudio's audio
+                thread for callbacks and in the calling thread for blocking
+                reads and writes. Specify ``'auto'`` to use `format` if the
+                devices support it, and otherwise the first of
+                :py:data:`paFloat32`, :py:data:`paInt32`,
+                :py:data:`paInt24`, :py:data:`paInt16`, :py:data:`paInt8`
+                and :py:data:`paUInt8` that they support (see
+                :py:func:`get_device_format`). Defaults to ``None`` (the
+                same as `format`).
+            :param non_interleaved: Whether the stream reads, writes, and
+                passes to and from `stream_callback` planar samples: in each
+                buffer, all samples of the first channel, then all samples
+                of the second channel, and so on, instead of frames. Each
+                channel's plane spans the whole buffer, so a buffer of
+                ``n`` frames holds channel ``c`` at samples ``c * n`` to
+                ``(c + 1) * n``; when a call transfers fewer frames than the
+                buffer holds (e.g., :py:func:`write_nowait`), it transfers
+                the first frames of each plane. The device still uses
+                interleaved samples, and native code interleaves them.
+                Setting :py:data:`paNonInterleaved` in `format` has the same
+                effect. Defaults to ``False``.
+            :param app_rate: The sampling rate at which the stream reads,
+                writes, and passes frames to and from `stream_callback`, if
+                it differs from `rate`, which remains the device's rate.
+                Native code resamples between the two with a polyphase
+                windowed-sinc filter (see :py:func:`resample`), on
+                PortAudio's audio thread for callbacks and in the calling
+                thread for blocking reads and writes. Frame counts, such as
+                `frame_count`, the `num_frames` of :py:func:`read`, and
+                :py:func:`get_read_available`, are then at `app_rate`, and
+                callbacks may receive a different number of frames each
+                period. The filter delays each direction by a few
+                milliseconds, which :py:func:`get_input_latency` and
+                :py:func:`get_output_latency` include; a full-duplex
+                callback's output also waits for the input's filter.
+                Blocking writes hold back the last few frames until the next
+                write. Requires `format` to be one of :py:data:`paFloat32`,
+                :py:data:`paInt32`, :py:data:`paInt24`, :py:data:`paInt16`,
+                :py:data:`paInt8` or :py:data:`paUInt8`, and cannot be
+                combined with `decoupled_callback_periods` or
+                `callback_batch_periods`. Defaults to ``None`` (the same as
+                `rate`).
+            :param resample_quality: The filter for `app_rate`: ``'low'``
+                (about 50 dB of stopband attenuation, passing 85% of the
+                lower Nyquist frequency), ``'medium'`` (80 dB, 92%), or
+                ``'high'`` (100 dB, 96%). Higher quality costs more CPU and
+                latency. Defaults to ``'medium'``.
+            :param channel_matrix: Routes the device's channels to the
+                stream's `channels` channels: a list of `channels` rows of
+                gains, with one gain per device channel, or a list of
+                `channels` device channel indices, which selects those
+                channels. The device opens with as many channels as the
+                matrix has columns (or one more than the largest index).
+                Native code applies the matrix on input, so that stream
+                channel ``i`` is the sum of device channel ``j`` times
+                ``channel_matrix[i][j]``, and its transpose on output, so
+                that a selection plays each stream channel on its device
+                channel and silence on the rest (see
+                :py:func:`mix_channels`). Selections copy samples exactly,
+                and other matrices mix in float32, in the device format.
+                Requires `device_format` to be one of :py:data:`paFloat32`,
+                :py:data:`paInt32`, :py:data:`paInt24`, :py:data:`paInt16`,
+                :py:data:`paInt8` or :py:data:`paUInt8`. Defaults to
+                ``None`` (the device has `channels` channels).
+
             :raise ValueError: Neither input nor output are set True.
             """
             if not (input or output):
                 raise ValueError("Must specify an input or output " + "stream.")
 
+            if format & paNonInterleaved:
+                format &= ~paNonInterleaved
+                non_interleaved = True
+
             self._parent = PA_manager
             self._is_input = input
             self._is_output = output
             self._is_running = start
             self._rate = rate
             self._channels = channels
+            self._device_channels = channels
+            channel_gains = None
+            if channel_matrix is not None:
+                rows, self._device_channels, channel_gains = (
+                    _flatten_channel_matrix(channel_matrix))
+                if rows != channels:
+                    raise ValueError("channel_matrix must have one row per "
+                                     "channel")
             self._format = format
             self._frames_per_buffer = frames_per_buffer
 
+            if device_format == 'auto':
+                device_format = self._negotiate_device_format(
+                    input_device_index, output_device_index)
+            self._device_format = (format if device_format is None
+                                   else device_format)
+
             arguments = {
                 'rate': rate,
                 'channels': channels,
@@ -437,9 +788,63 @@ class PyAudio:
             if stream_callback:
                 arguments['stream_callback'] = stream_callback
 
+            if reuse_input_buffer:
+                arguments['reuse_input_buffer'] = reuse_input_buffer
+
+            if output_in_place:
+                arguments['output_in_place'] = output_in_place
+
+            if decoupled_callback_periods:
+                arguments[
+                    'decoupled_callback_periods'
+                ] = decoupled_callback_periods
+
+            if callback_batch_periods != 1:
+                arguments['callback_batch_periods'] = callback_batch_periods
+
+            if callback_in_subinterpreter:
+                arguments[
+                    'callback_in_subinterpreter'
+                ] = callback_in_subinterpreter
+
+            if capture_buffer_seconds:
+                arguments['capture_buffer_seconds'] = capture_buffer_seconds
+
+            if playback_queue_seconds:
+                arguments['playback_queue_seconds'] = playback_queue_seconds
+
+            if self._device_format != format:
+                arguments['device_format'] = self._device_format
+
+            if non_interleaved:
+                arguments['non_interleaved'] = True
+
+            if app_rate is not None and app_rate != rate:
+                if resample_quality not in _RESAMPLE_QUALITIES:
+                    raise ValueError(
+                        f"Invalid resample quality: {resample_quality!r}")
+                arguments['app_rate'] = app_rate
+                arguments['resample_quality'] = _RESAMPLE_QUALITIES[
+                    resample_quality]
+
+            if channel_gains is not None:
+                arguments['device_channels'] = self._device_channels
+                arguments['channel_matrix'] = channel_gains
+
             # calling pa.open returns a stream object
             self._stream = pa.open(**arguments)
 
+            self._callback_thread = None
+            # The (loop, future) of a pending aread() or awrite(), if any.
+            self._ready_waiter = None
+            if decoupled_callback_periods:
+                self._start_callback_thread()
+
+            # The stream's subinterpreter must end before the main
+            # interpreter does.
+            if callback_in_subinterpreter:
+                atexit.register(self.close)
+
             self._input_latency = self._stream.inputLatency
             self._output_latency = self._stream.outputLatency
 
@@ -449,11 +854,72 @@ class PyAudio:
         def close(self):
             """Closes the stream."""
             pa.close(self._stream)
+            atexit.unregister(self.close)
             self._is_running = False
+            self._wake_ready_waiter()
+            if (self._callback_thread is not None and
+                    self._callback_thread is not threading.current_thread()):
+                self._callback_thread.join()
             self._parent._remove_stream(self)
 
+        def _start_callback_thread(self):
+            # Runs the callback of a decoupled stream until the callback
+            # completes or the stream closes.
+            self._callback_thread = threading.Thread(
+                target=pa.run_decoupled_callback,
+                args=(self._stream,),
+                name='PyAudio stream callback',
+                daemon=True)
+            self._callback_thread.start()
+
+        def _negotiate_device_format(self, input_device_index,
+                                     output_device_index):
+            """Return the first sample format, by preference, that the
+            stream's devices support (see the `device_format` parameter of
+            :py:func:`__init__`)."""
+            candidates = [self._format]
+            if self._format in _CONVERTIBLE_FORMATS:
+                candidates += [f for f in _CONVERTIBLE_FORMATS
+                               if f != self._format]
+
+            kwargs = {}
+            if self._is_input:
+                kwargs['input_device'] = (
+                    pa.get_default_input_device()
+                    if input_device_index is None else input_device_index)
+                kwargs['input_channels'] = self._device_channels
+            if self._is_output:
+                kwargs['output_device'] = (
+                    pa.get_default_output_device()
+                    if output_device_index is None else output_device_index)
+                kwargs['output_channels'] = self._device_channels
+
+            for candidate in candidates:
+                if self._is_input:
+                    kwargs['input_format'] = candidate
+                if self._is_output:
+                    kwargs['output_format'] = candidate
+                try:
+                    self._parent.is_format_supported(self._rate, **kwargs)
+                except ValueError:
+                    continue
+                return candidate
+
+            raise ValueError("No sample format supported by the device",
+                             paSampleFormatNotSupported)
+
         # Stream Info
 
+        def get_device_format(self):
+            """Returns the sample format that the device was opened with.
+
+            Differs from the stream's format when the stream converts (see
+            the `device_format` parameter of :py:func:`__init__`).
+
+            :rtype: A |PaSampleFormat| constant
+            """
+            return self._device_format
+
         def get_input_latency(self):
             """Returns the input latency.
 
@@ -492,13 +958,22 @@ class PyAudio:
             pa.start_stream(self._stream)
             self._is_running = True
 
+            # The callback thread exits once the callback completes, so
+            # restarting the stream needs a new one.
+            if (self._callback_thread is not None and
+                    not self._callback_thread.is_alive()):
+                self._start_callback_thread()
+
         def stop_stream(self):
             """Stops the stream."""
             if not self._is_running:
                 return
 
-            pa.stop_stream(self._stream)
-            self._is_running = False
+            try:
+                pa.stop_stream(self._stream)
+            finally:
+                self._is_running = False
+                self._wake_ready_waiter()
 
         def is_active(self):
             """Returns whether the stream is active.
@@ -514,6 +989,16 @@ class PyAudio:
             """
             return pa.is_stream_stopped(self._stream)
 
+        def get_error(self):
+            """Returns the exception that `stream_callback` raised, if any.
+
+            Returns the exception only once: afterwards, neither this method
+            nor other stream methods return or raise it again.
+
+            :rtype: Exception or None
+            """
+            return pa.get_stream_error(self._stream)
+
         # Stream blocking I/O
 
         def write(self, frames, num_frames=None, exception_on_underflow=False):
@@ -522,11 +1007,15 @@ class PyAudio:
             Do not call when using non-blocking mode.
 
             :param frames:
-               The frames of data.
+               The frames of data: ``bytes``, or any C-contiguous
+               buffer-protocol object (e.g., ``bytearray``, a ``memoryview``
+               slice, ``array.array``, or a NumPy array) whose items are
+               either bytes or samples of the stream's format. The samples
+               are written without being copied.
             :param num_frames:
                The number of frames to write.
-               Defaults to None, in which this value will be
-               automatically computed.
+               Defaults to None, in which case all whole frames in `frames`
+               are written.
             :param exception_on_underflow:
                Specifies whether an IOError exception should be thrown
                (or silently ignored) on buffer underflow. Defaults
@@ -535,6 +1024,8 @@ class PyAudio:
 
             :raises IOError: if the stream is not an output stream
                or if the write operation was unsuccessful.
+            :raises ValueError: if `frames` holds fewer than `num_frames`
+               frames, or is not C-contiguous.
 
             :rtype: `None`
             """
@@ -542,15 +1033,11 @@ class PyAudio:
                 raise IOError("Not output stream",
                               paCanNotWriteToAnInputOnlyStream)
 
-            if num_frames is None:
-                # Determine how many frames to read:
-                width = get_sample_size(self._format)
-                num_frames = int(len(frames) / (self._channels * width))
-
             pa.write_stream(self._stream, frames, num_frames,
                             exception_on_underflow)
 
-        def read(self, num_frames, exception_on_overflow=True):
+        def read(self, num_frames, exception_on_overflow=True,
+                 with_timestamp=False):
             """Read samples from the stream.
 
             Do not call when using non-blocking mode.
@@ -560,15 +1047,294 @@ class PyAudio:
                Specifies whether an IOError exception should be thrown
                (or silently ignored) on input buffer overflow. Defaults
                to True.
+            :param with_timestamp:
+               Whether to also return when and where in the input the
+               samples were captured. Defaults to False.
             :raises IOError: if stream is not an input stream
               or if the read operation was unsuccessful.
-            :rtype: bytes
+            :rtype: bytes, or a tuple if `with_timestamp` is set
+            :returns: The samples. If `with_timestamp` is set, a tuple
+               ``(data, adc_time, frame_position)`` instead, where
+               `adc_time` is the time, on the :py:func:`get_time` clock,
+               at which the first frame of `data` was captured, and
+               `frame_position` is the number of frames that reads from
+               this stream returned before `data`.
             """
             if not self._is_input:
                 raise IOError("Not input stream",
                               paCanNotReadFromAnOutputOnlyStream)
             return pa.read_stream(self._stream, num_frames,
-                                  exception_on_overflow)
+                                  exception_on_overflow, with_timestamp)
+
+        def read_into(self, buffer, num_frames=None,
+                      exception_on_overflow=True):
+            """Read samples from the stream into `buffer`.
+
+            Unlike :py:func:`read`, allocates no new buffer for the samples,
+            so that capture loops can reuse one buffer. Do not call when
+            using non-blocking mode.
+
+            :param buffer: A writable, C-contiguous buffer-protocol object
+               (e.g., ``bytearray``, a ``memoryview`` slice, or a NumPy
+               array) to read the samples into, starting at its first byte.
+            :param num_frames: The number of frames to read. Defaults to as
+               many frames as `buffer` holds.
+            :param exception_on_overflow:
+               Specifies whether an IOError exception should be thrown
+               (or silently ignored) on input buffer overflow. Defaults
+               to True.
+            :raises IOError: if stream is not an input stream
+              or if the read operation was unsuccessful.
+            :raises ValueError: if `buffer` cannot hold `num_frames` frames.
+            :rtype: integer
+            :returns: The number of frames read.
+            """
+            if not self._is_input:
+                raise IOError("Not input stream",
+                              paCanNotReadFromAnOutputOnlyStream)
+            return pa.read_stream_into(self._stream, buffer, num_frames,
+                                       exception_on_overflow)
+
+        def read_nowait(self, max_frames, exception_on_overflow=True):
+            """Read the samples that are available, without waiting.
+
+            Reads up to `max_frames` frames, but only as many as the stream
+            can provide immediately (see :py:func:`get_read_available`), in
+            one call.
+
+            :param max_frames: The most frames to read.
+            :param exception_on_overflow:
+               Specifies whether an IOError exception should be thrown
+               (or silently ignored) on input buffer overflow. Defaults
+               to True.
+            :raises IOError: if stream is not an input stream
+              or if the read operation was unsuccessful.
+            :rtype: bytes
+            :returns: The frames read, possibly none.
+            """
+            if not self._is_input:
+                raise IOError("Not input stream",
+                              paCanNotReadFromAnOutputOnlyStream)
+            return pa.read_stream_nowait(self._stream, max_frames,
+                                         exception_on_overflow)
+
+        def write_nowait(self, frames, exception_on_underflow=False):
+            """Write as many samples as fit, without waiting.
+
+            Writes as many whole frames of `frames` as the stream can take
+            immediately (see :py:func:`get_write_available`), in one call.
+
+            :param frames: The frames of data, as for :py:func:`write`.
+            :param exception_on_underflow:
+               Specifies whether an IOError exception should be thrown
+               (or silently ignored) on buffer underflow. Defaults
+               to False.
+            :raises IOError: if the stream is not an output stream
+               or if the write operation was unsuccessful.
+            :rtype: integer
+            :returns: The number of frames written, possibly 0.
+            """
+            if not self._is_output:
+                raise IOError("Not output stream",
+                              paCanNotWriteToAnInputOnlyStream)
+            return pa.write_stream_nowait(self._stream, frames,
+                                          exception_on_underflow)
+
+        def writev(self, buffers, exception_on_underflow=False):
+            """Write the samples of several buffers to the stream, in order.
+
+            Plays each buffer of `buffers` back to back, as a series of
+            :py:func:`write` calls would, but in a single call that releases
+            the GIL once, which saves per-buffer overhead when the samples
+            come in many small chunks (e.g., decoded packets). Do not call
+            when using non-blocking mode.
+
+            :param buffers: An iterable of frames of data, each as for
+               :py:func:`write` and holding a whole number of frames.
+            :param exception_on_underflow:
+               Specifies whether an IOError exception should be thrown
+               (or silently ignored) on buffer underflow. Defaults
+               to False.
+            :raises IOError: if the stream is not an output stream
+               or if a write was unsuccessful. The exception's
+               ``frames_written`` attribute holds the number of frames
+               written before the error. An underflow leaves the stream
+               open, so that the rest of `buffers` may still be written.
+            :raises ValueError: if a buffer does not hold a whole number of
+               frames, or is not C-contiguous. Nothing is written then.
+            :rtype: integer
+            :returns: The number of frames written.
+            """
+            if not self._is_output:
+                raise IOError("Not output stream",
+                              paCanNotWriteToAnInputOnlyStream)
+            return pa.write_stream_v(self._stream, buffers,
+                                     exception_on_underflow)
+
+        def process(self, out_frames, in_buffer, num_frames=None,
+                    read_first=False, exception_on_overflow=True,
+                    exception_on_underflow=False):
+            """Write samples to, and read samples from, a full-duplex stream.
+
+            Does the work of :py:func:`write` followed by
+            :py:func:`read_into` (or the reverse) in a single call, which
+            saves per-block overhead in processing loops. Do not call when
+            using non-blocking mode.
+
+            :param out_frames: The frames to write, as for :py:func:`write`.
+            :param in_buffer: A writable, C-contiguous buffer-protocol object
+               to read the samples into, as for :py:func:`read_into`. May be
+               the same object as `out_frames`, unless `read_first` is set.
+            :param num_frames: The number of frames to write and read.
+               Defaults to all whole frames in `out_frames`.
+            :param read_first: Whether to read before writing. Defaults to
+               False (write first).
+            :param exception_on_overflow:
+               Specifies whether an IOError exception should be thrown
+               (or silently ignored) on input buffer overflow. Defaults
+               to True.
+            :param exception_on_underflow:
+               Specifies whether an IOError exception should be thrown
+               (or silently ignored) on output buffer underflow. Defaults
+               to False.
+            :raises IOError: if the stream is not a full-duplex stream,
+               or if either operation was unsuccessful.
+            :raises ValueError: if `out_frames` or `in_buffer` holds fewer
+               than `num_frames` frames.
+            :rtype: integer
+            :returns: The number of frames written and read.
+            """
+            if not (self._is_input and self._is_output):
+                raise IOError("Not full-duplex stream",
+                              paBadIODeviceCombination)
+            return pa.process_stream(self._stream, out_frames, in_buffer,
+                                     num_frames, read_first,
+                                     exception_on_overflow,
+                                     exception_on_underflow)
+
+        # Stream asyncio I/O
+
+        async def aread(self, num_frames, exception_on_overflow=True):
+            """Read samples from the stream, in a coroutine.
+
+            Waits for the samples without blocking the event loop, or
+            involving any other thread: the stream wakes the loop up through
+            a file descriptor (see :py:meth:`asyncio.loop.add_reader`) once
+            the samples are available. Requires a stream opened with
+            `capture_buffer_seconds`, and an event loop that supports
+            ``add_reader`` (i.e., not the default event loop on Windows).
+
+            :param num_frames: The number of frames to read.
+            :param exception_on_overflow:
+               Specifies whether an IOError exception should be thrown
+               (or silently ignored) on input buffer overflow. Defaults
+               to True.
+            :raises IOError: if stream is not an input stream, if the stream
+              stops or closes first, or if the read operation was
+              unsuccessful.
+            :raises ValueError: if the stream has no capture buffer.
+            :rtype: bytes
+            """
+            if not self._is_input:
+                raise IOError("Not input stream",
+                              paCanNotReadFromAnOutputOnlyStream)
+
+            available = await self._wait_ready(num_frames)
+            if available >= num_frames:
+                return pa.read_stream(self._stream, num_frames,
+                                      exception_on_overflow)
+
+            # More frames than the capture buffer holds: read them as they
+            # arrive, each batch after the frames before it (in each plane,
+            # for planar streams).
+            frame_size = self._channels * get_sample_size(self._format)
+            samples = bytearray(num_frames * frame_size)
+            num_read = 0
+            while True:
+                num_read += pa.read_stream_into(
+                    self._stream, samples,
+                    min(available, num_frames - num_read),
+                    exception_on_overflow, num_read)
+                if num_read == num_frames:
+                    return bytes(samples)
+                available = await self._wait_ready(num_frames - num_read)
+
+        async def awrite(self, frames, exception_on_underflow=False):
+            """Write samples to the stream, in a coroutine.
+
+            Queues the samples for playback as soon as they fit, without
+            blocking the event loop, or involving any other thread: the
+            stream wakes the loop up through a file descriptor (see
+            :py:meth:`asyncio.loop.add_reader`) once the queue has room.
+            Requires a stream opened with `playback_queue_seconds`, and an
+            event loop that supports ``add_reader`` (i.e., not the default
+            event loop on Windows).
+
+            :param frames: The frames of data: ``bytes``, or any
+               C-contiguous buffer-protocol object.
+            :param exception_on_underflow:
+               Specifies whether an IOError exception should be thrown
+               (or silently ignored) on buffer underflow. Defaults
+               to False.
+            :raises IOError: if the stream is not an output stream, if the
+               stream stops or closes first, or if the write operation was
+               unsuccessful.
+            :raises ValueError: if the stream has no playback queue.
+            """
+            if not self._is_output:
+                raise IOError("Not output stream",
+                              paCanNotWriteToAnInputOnlyStream)
+
+            frame_size = self._channels * get_sample_size(self._format)
+            num_frames = memoryview(frames).nbytes // frame_size
+            num_written = 0
+            while True:
+                num_written += pa.write_stream_nowait(self._stream, frames,
+                                                      exception_on_underflow,
+                                                      num_written)
+                if num_written == num_frames:
+                    return
+                await self._wait_ready(num_frames - num_written)
+
+        async def _wait_ready(self, num_frames):
+            # Waits until the stream can read (or, for output streams,
+            # write) num_frames frames without waiting, or as many as its
+            # buffer holds, and returns how many it can.
+            import asyncio  # Only needed, and already imported, in a loop.
+
+            available = pa.arm_stream_ready(self._stream, num_frames)
+            if available:
+                return available
+
+            if self._ready_waiter is not None:
+                raise RuntimeError("Another coroutine is already waiting "
+                                   "for this stream")
+
+            loop = asyncio.get_running_loop()
+            fd = pa.get_stream_ready_fd(self._stream)
+            while not available:
+                if not self._is_running:
+                    raise IOError("Stream not running", paStreamIsStopped)
+
+                waiter = loop.create_future()
+                self._ready_waiter = (loop, waiter)
+                loop.add_reader(fd, _set_result_unless_done, waiter)
+                try:
+                    await waiter
+                finally:
+                    loop.remove_reader(fd)
+                    self._ready_waiter = None
+                available = pa.arm_stream_ready(self._stream, num_frames)
+            return available
+
+        def _wake_ready_waiter(self):
+            # Wakes up a pending aread() or awrite(), so that it notices that
+            # the stream stopped or closed.
+            if self._ready_waiter is not None:
+                loop, waiter = self._ready_waiter
+                if not loop.is_closed():
+                    loop.call_soon_threadsafe(_set_result_unless_done,
+                                              waiter)
 
         def get_read_available(self):
             """Return the number of frames that can be read without waiting.
@@ -577,6 +1343,59 @@ class PyAudio:
             """
             return pa.get_stream_read_available(self._stream)
 
+        def get_capture_lost_frames(self):
+            """Return the number of input frames that were dropped because
+            the capture buffer was full.
+
+            Requires a stream opened with `capture_buffer_seconds`.
+
+            :rtype: integer
+            """
+            return pa.get_stream_capture_lost_frames(self._stream)
+
+        def get_xrun_counts(self, reset=False):
+            """Return how often the stream glitched so far.
+
+            Counts the xruns that PortAudio reports to the stream, whether
+            to a callback (as `status_flags`) or to blocking reads and
+            writes (as errors, even the ones that are ignored), along with
+            the input that capture buffers drop and the silence that
+            playback queues play when they run out. Cheap enough to poll
+            from monitoring code while the stream runs.
+
+            :param reset: Whether to reset the counters to zero, in the same
+               call. Defaults to False.
+            :rtype: dict
+            :returns: The number of xruns of each kind, under the keys
+               ``input_overflows``, ``input_underflows``,
+               ``output_underflows`` and ``output_overflows``, and the
+               number of frames that they affected (those of the periods
+               or blocking calls that reported them, or the frames dropped
+               or filled with silence) under the same keys with
+               ``_frames`` in place of ``s`` (e.g.,
+               ``input_overflow_frames``).
+            """
+            return pa.get_stream_xrun_counts(self._stream, reset)
+
+        def get_queued_frames(self):
+            """Return the number of frames queued for playback.
+
+            Requires a stream opened with `playback_queue_seconds`.
+
+            :rtype: integer
+            """
+            return pa.get_stream_queued_frames(self._stream)
+
+        def drain(self):
+            """Wait until the device has taken every frame queued for
+            playback.
+
+            Requires a stream opened with `playback_queue_seconds`.
+
+            :raises IOError: if the stream stops before the queue drains.
+            """
+            pa.drain_stream(self._stream)
+
         def get_write_available(self):
             """Return the number of frames that can be written without waiting.
 
@@ -590,6 +1409,9 @@ class PyAudio:
         """Initialize PortAudio."""
         pa.initialize()
         self._streams = set()
+        # Guards _streams, since streams may be opened and closed from
+        # several threads (without a GIL, on free-threaded Python).
+        self._streams_lock = threading.Lock()
 
     def terminate(self):
         """Terminates PortAudio.
@@ -597,10 +1419,13 @@ class PyAudio:
         :attention: Be sure to call this method for every instance of this
           object to release PortAudio resources.
         """
-        for stream in self._streams.copy():
+        with self._streams_lock:
+            streams = self._streams.copy()
+        for stream in streams:
             stream.close()
 
-        self._streams = set()
+        with self._streams_lock:
+            self._streams = set()
         pa.terminate()
 
     # Utilities
@@ -637,7 +1462,8 @@ class PyAudio:
         :returns: A new :py:class:`PyAudio.Stream`
         """
         stream = PyAudio.Stream(self, *args, **kwargs)
-        self._streams.add(stream)
+        with self._streams_lock:
+            self._streams.add(stream)
         return stream
 
     def close(self, stream):
@@ -646,8 +1472,9 @@ class PyAudio:
         :param stream: An instance of the :py:class:`PyAudio.Stream` object.
         :raises ValueError: if stream does not exist.
         """
-        if stream not in self._streams:
-            raise ValueError(f"Stream {stream} not found")
+        with self._streams_lock:
+            if stream not in self._streams:
+                raise ValueError(f"Stream {stream} not found")
 
         stream.close()
 
@@ -656,8 +1483,8 @@ class PyAudio:
 
         :param stream: An instance of the :py:class:`PyAudio.Stream` object.
         """
-        if stream in self._streams:
-            self._streams.remove(stream)
+        with self._streams_lock:
+            self._streams.discard(stream)
 
     # Host API Inspection
 
@@ -0,0 +1,700 @@
+#include "convert.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifndef PY_SSIZE_T_CLEAN
+#define PY_SSIZE_T_CLEAN
+#endif
+#include "Python.h"
+#include "portaudio.h"
+
+#include "sync.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || \
+    defined(_M_IX86)
+#define CONVERT_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// GCC and Clang compile SIMD code only in functions that target the
+// instruction set; MSVC compiles it anywhere.
+#if defined(CONVERT_X86) && (defined(__GNUC__) || defined(__clang__))
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_SSE2
+#define TARGET_AVX2
+#endif
+
+// Samples that conversions between two integer formats convert at a time,
+// through float32 on the stack.
+#define FLOAT_CHUNK_SAMPLES 256
+
+// The most negative and most positive integers of a format, as floats. The
+// largest int32 is not a float, so int32 clips at the largest float below
+// 2^31.
+#define S8_MIN -128.0f
+#define S8_MAX 127.0f
+#define S16_MIN -32768.0f
+#define S16_MAX 32767.0f
+#define S24_MIN -8388608.0f
+#define S24_MAX 8388607.0f
+#define S32_MIN -2147483648.0f
+#define S32_MAX 2147483520.0f
+
+// Scales x to full scale, clips it to [lo, hi], and rounds it to the nearest
+// integer (ties to even, like the SIMD kernels). NaN clips to lo, also like
+// the SIMD kernels.
+static inline long clip_round(float x, float scale, float lo, float hi) {
+  float v = x * scale;
+  if (!(v >= lo)) {
+    v = lo;
+  } else if (v > hi) {
+    v = hi;
+  }
+  return lrintf(v);
+}
+
+/*************************************************************
+ * Scalar kernels
+ *************************************************************/
+
+static void s8_to_float(void *dst, const void *src, size_t n) {
+  const int8_t *s = (const int8_t *)src;
+  float *d = (float *)dst;
+  for (size_t i = 0; i < n; i++) {
+    d[i] = s[i] * (1.0f / 128.0f);
+  }
+}
+
+static void float_to_s8(void *dst, const void *src, size_t n) {
+  const float *s = (const float *)src;
+  int8_t *d = (int8_t *)dst;
+  for (size_t i = 0; i < n; i++) {
+    d[i] = (int8_t)clip_round(s[i], 128.0f, S8_MIN, S8_MAX);
+  }
+}
+
+static void u8_to_float(void *dst, const void *src, size_t n) {
+  const uint8_t *s = (const uint8_t *)src;
+  float *d = (float *)dst;
+  for (size_t i = 0; i < n; i++) {
+    d[i] = ((int)s[i] - 128) * (1.0f / 128.0f);
+  }
+}
+
+static void float_to_u8(void *dst, const void *src, size_t n) {
+  const float *s = (const float *)src;
+  uint8_t *d = (uint8_t *)dst;
+  for (size_t i = 0; i < n; i++) {
+    d[i] = (uint8_t)(clip_round(s[i], 128.0f, S8_MIN, S8_MAX) + 128);
+  }
+}
+
+static void s16_to_float(void *dst, const void *src, size_t n) {
+  const int16_t *s = (const int16_t *)src;
+  float *d = (float *)dst;
+  for (size_t i = 0; i < n; i++) {
+    d[i] = s[i] * (1.0f / 32768.0f);
+  }
+}
+
+static void float_to_s16(void *dst, const void *src, size_t n) {
+  const float *s = (const float *)src;
+  int16_t *d = (int16_t *)dst;
+  for (size_t i = 0; i < n; i++) {
+    d[i] = (int16_t)clip_round(s[i], 32768.0f, S16_MIN, S16_MAX);
+  }
+}
+
+// Packed 24-bit samples are in native byte order, as PortAudio's are.
+static void s24_to_float(void *dst, const void *src, size_t n) {
+  const uint8_t *s = (const uint8_t *)src;
+  float *d = (float *)dst;
+  for (size_t i = 0; i < n; i++, s += 3) {
+#if PY_BIG_ENDIAN
+    uint32_t u = ((uint32_t)s[0] << 24) | ((uint32_t)s[1] << 16) |
+                 ((uint32_t)s[2] << 8);
+#else
+    uint32_t u = ((uint32_t)s[2] << 24) | ((uint32_t)s[1] << 16) |
+                 ((uint32_t)s[0] << 8);
+#endif
+    // The sample sits in the top 24 bits, so it scales like an int32.
+    d[i] = (float)(int32_t)u * (1.0f / 2147483648.0f);
+  }
+}
+
+static void float_to_s24(void *dst, const void *src, size_t n) {
+  const float *s = (const float *)src;
+  uint8_t *d = (uint8_t *)dst;
+  for (size_t i = 0; i < n; i++, d += 3) {
+    uint32_t u = (uint32_t)clip_round(s[i], 8388608.0f, S24_MIN, S24_MAX);
+#if PY_BIG_ENDIAN
+    d[0] = (uint8_t)(u >> 16);
+    d[1] = (uint8_t)(u >> 8);
+    d[2] = (uint8_t)u;
+#else
+    d[0] = (uint8_t)u;
+    d[1] = (uint8_t)(u >> 8);
+    d[2] = (uint8_t)(u >> 16);
+#endif
+  }
+}
+
+static void s32_to_float(void *dst, const void *src, size_t n) {
+  const int32_t *s = (const int32_t *)src;
+  float *d = (float *)dst;
+  for (size_t i = 0; i < n; i++) {
+    d[i] = (float)s[i] * (1.0f / 2147483648.0f);
+  }
+}
+
+static void float_to_s32(void *dst, const void *src, size_t n) {
+  const float *s = (const float *)src;
+  int32_t *d = (int32_t *)dst;
+  for (size_t i = 0; i < n; i++) {
+    d[i] = (int32_t)clip_round(s[i], 2147483648.0f, S32_MIN, S32_MAX);
+  }
+}
+
+/*************************************************************
+ * Interleaving kernels
+ *************************************************************/
+
+// Copies n samples of `size` bytes from s to d, s_stride and d_stride bytes
+// apart. Fixed-size copies compile to single loads and stores, without
+// assuming that the samples are aligned.
+static void copy_strided(char *d, size_t d_stride, const char *s,
+                         size_t s_stride, size_t n, unsigned int size) {
+  switch (size) {
+    case 1:
+      for (size_t i = 0; i < n; i++) {
+        d[i * d_stride] = s[i * s_stride];
+      }
+      break;
+    case 2:
+      for (size_t i = 0; i < n; i++) {
+        memcpy(d + i * d_stride, s + i * s_stride, 2);
+      }
+      break;
+    case 3:
+      for (size_t i = 0; i < n; i++) {
+        memcpy(d + i * d_stride, s + i * s_stride, 3);
+      }
+      break;
+    case 4:
+      for (size_t i = 0; i < n; i++) {
+        memcpy(d + i * d_stride, s + i * s_stride, 4);
+      }
+      break;
+    default:
+      for (size_t i = 0; i < n; i++) {
+        memcpy(d + i * d_stride, s + i * s_stride, size);
+      }
+      break;
+  }
+}
+
+static void interleave_scalar(void *dst, const void *src, size_t frames,
+                              unsigned int channels, unsigned int size,
+                              size_t plane_frames) {
+  for (unsigned int c = 0; c < channels; c++) {
+    copy_strided((char *)dst + (size_t)c * size, (size_t)channels * size,
+                 (const char *)src + (size_t)c * plane_frames * size, size,
+                 frames, size);
+  }
+}
+
+static void deinterleave_scalar(void *dst, const void *src, size_t frames,
+                                unsigned int channels, unsigned int size,
+                                size_t plane_frames) {
+  for (unsigned int c = 0; c < channels; c++) {
+    copy_strided((char *)dst + (size_t)c * plane_frames * size, size,
+                 (const char *)src + (size_t)c * size, (size_t)channels * size,
+                 frames, size);
+  }
+}
+
+/*************************************************************
+ * SIMD kernels
+ *************************************************************/
+
+// Each kernel converts whole vectors, and leaves the rest to the scalar
+// kernel. _mm_cvtps_epi32 rounds to nearest even, as lrintf does.
+
+#ifdef CONVERT_X86
+
+TARGET_SSE2 static void s16_to_float_sse2(void *dst, const void *src,
+                                          size_t n) {
+  const int16_t *s = (const int16_t *)src;
+  float *d = (float *)dst;
+  const __m128 scale = _mm_set1_ps(1.0f / 32768.0f);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m128i x = _mm_loadu_si128((const __m128i *)(s + i));
+    // Sign-extend, by moving each sample to the top half of a 32-bit lane.
+    __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+    __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+    _mm_storeu_ps(d + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+    _mm_storeu_ps(d + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+  }
+  s16_to_float(d + i, s + i, n - i);
+}
+
+TARGET_SSE2 static void float_to_s16_sse2(void *dst, const void *src,
+                                          size_t n) {
+  const float *s = (const float *)src;
+  int16_t *d = (int16_t *)dst;
+  const __m128 scale = _mm_set1_ps(32768.0f);
+  const __m128 lo = _mm_set1_ps(S16_MIN);
+  const __m128 hi = _mm_set1_ps(S16_MAX);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m128 a = _mm_mul_ps(_mm_loadu_ps(s + i), scale);
+    __m128 b = _mm_mul_ps(_mm_loadu_ps(s + i + 4), scale);
+    a = _mm_min_ps(_mm_max_ps(a, lo), hi);
+    b = _mm_min_ps(_mm_max_ps(b, lo), hi);
+    __m128i packed = _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b));
+    _mm_storeu_si128((__m128i *)(d + i), packed);
+  }
+  float_to_s16(d + i, s + i, n - i);
+}
+
+TARGET_SSE2 static void s32_to_float_sse2(void *dst, const void *src,
+                                          size_t n) {
+  const int32_t *s = (const int32_t *)src;
+  float *d = (float *)dst;
+  const __m128 scale = _mm_set1_ps(1.0f / 2147483648.0f);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128i x = _mm_loadu_si128((const __m128i *)(s + i));
+    _mm_storeu_ps(d + i, _mm_mul_ps(_mm_cvtepi32_ps(x), scale));
+  }
+  s32_to_float(d + i, s + i, n - i);
+}
+
+TARGET_SSE2 static void float_to_s32_sse2(void *dst, const void *src,
+                                          size_t n) {
+  const float *s = (const float *)src;
+  int32_t *d = (int32_t *)dst;
+  const __m128 scale = _mm_set1_ps(2147483648.0f);
+  const __m128 lo = _mm_set1_ps(S32_MIN);
+  const __m128 hi = _mm_set1_ps(S32_MAX);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128 x = _mm_mul_ps(_mm_loadu_ps(s + i), scale);
+    x = _mm_min_ps(_mm_max_ps(x, lo), hi);
+    _mm_storeu_si128((__m128i *)(d + i), _mm_cvtps_epi32(x));
+  }
+  float_to_s32(d + i, s + i, n - i);
+}
+
+TARGET_AVX2 static void s16_to_float_avx2(void *dst, const void *src,
+                                          size_t n) {
+  const int16_t *s = (const int16_t *)src;
+  float *d = (float *)dst;
+  const __m256 scale = _mm256_set1_ps(1.0f / 32768.0f);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256i x =
+        _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(s + i)));
+    _mm256_storeu_ps(d + i, _mm256_mul_ps(_mm256_cvtepi32_ps(x), scale));
+  }
+  s16_to_float(d + i, s + i, n - i);
+}
+
+TARGET_AVX2 static void float_to_s16_avx2(void *dst, const void *src,
+                                          size_t n) {
+  const float *s = (const float *)src;
+  int16_t *d = (int16_t *)dst;
+  const __m256 scale = _mm256_set1_ps(32768.0f);
+  const __m256 lo = _mm256_set1_ps(S16_MIN);
+  const __m256 hi = _mm256_set1_ps(S16_MAX);
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m256 a = _mm256_mul_ps(_mm256_loadu_ps(s + i), scale);
+    __m256 b = _mm256_mul_ps(_mm256_loadu_ps(s + i + 8), scale);
+    a = _mm256_min_ps(_mm256_max_ps(a, lo), hi);
+    b = _mm256_min_ps(_mm256_max_ps(b, lo), hi);
+    // Packing works within 128-bit lanes, so put the lanes back in order.
+    __m256i packed =
+        _mm256_packs_epi32(_mm256_cvtps_epi32(a), _mm256_cvtps_epi32(b));
+    packed = _mm256_permute4x64_epi64(packed, 0xD8);
+    _mm256_storeu_si256((__m256i *)(d + i), packed);
+  }
+  float_to_s16(d + i, s + i, n - i);
+}
+
+TARGET_AVX2 static void s32_to_float_avx2(void *dst, const void *src,
+                                          size_t n) {
+  const int32_t *s = (const int32_t *)src;
+  float *d = (float *)dst;
+  const __m256 scale = _mm256_set1_ps(1.0f / 2147483648.0f);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256i x = _mm256_loadu_si256((const __m256i *)(s + i));
+    _mm256_storeu_ps(d + i, _mm256_mul_ps(_mm256_cvtepi32_ps(x), scale));
+  }
+  s32_to_float(d + i, s + i, n - i);
+}
+
+TARGET_AVX2 static void float_to_s32_avx2(void *dst, const void *src,
+                                          size_t n) {
+  const float *s = (const float *)src;
+  int32_t *d = (int32_t *)dst;
+  const __m256 scale = _mm256_set1_ps(2147483648.0f);
+  const __m256 lo = _mm256_set1_ps(S32_MIN);
+  const __m256 hi = _mm256_set1_ps(S32_MAX);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256 x = _mm256_mul_ps(_mm256_loadu_ps(s + i), scale);
+    x = _mm256_min_ps(_mm256_max_ps(x, lo), hi);
+    _mm256_storeu_si256((__m256i *)(d + i), _mm256_cvtps_epi32(x));
+  }
+  float_to_s32(d + i, s + i, n - i);
+}
+
+// Stereo interleaving, the most common case, of 16-bit and 32-bit samples.
+// The 32-bit kernels only move bits, so they serve integers and floats alike.
+
+TARGET_SSE2 static void interleave2_16_sse2(void *dst, const void *left,
+                                            const void *right, size_t n) {
+  const int16_t *l = (const int16_t *)left;
+  const int16_t *r = (const int16_t *)right;
+  int16_t *d = (int16_t *)dst;
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m128i a = _mm_loadu_si128((const __m128i *)(l + i));
+    __m128i b = _mm_loadu_si128((const __m128i *)(r + i));
+    _mm_storeu_si128((__m128i *)(d + 2 * i), _mm_unpacklo_epi16(a, b));
+    _mm_storeu_si128((__m128i *)(d + 2 * i + 8), _mm_unpackhi_epi16(a, b));
+  }
+  copy_strided((char *)(d + 2 * i), 4, (const char *)(l + i), 2, n - i, 2);
+  copy_strided((char *)(d + 2 * i + 1), 4, (const char *)(r + i), 2, n - i,
+               2);
+}
+
+TARGET_SSE2 static void deinterleave2_16_sse2(void *left, void *right,
+                                              const void *src, size_t n) {
+  const int16_t *s = (const int16_t *)src;
+  int16_t *l = (int16_t *)left;
+  int16_t *r = (int16_t *)right;
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m128i a = _mm_loadu_si128((const __m128i *)(s + 2 * i));
+    __m128i b = _mm_loadu_si128((const __m128i *)(s + 2 * i + 8));
+    // Sign-extend each channel into 32-bit lanes, which then pack back into
+    // 16 bits exactly.
+    __m128i la = _mm_srai_epi32(_mm_slli_epi32(a, 16), 16);
+    __m128i lb = _mm_srai_epi32(_mm_slli_epi32(b, 16), 16);
+    __m128i ra = _mm_srai_epi32(a, 16);
+    __m128i rb = _mm_srai_epi32(b, 16);
+    _mm_storeu_si128((__m128i *)(l + i), _mm_packs_epi32(la, lb));
+    _mm_storeu_si128((__m128i *)(r + i), _mm_packs_epi32(ra, rb));
+  }
+  copy_strided((char *)(l + i), 2, (const char *)(s + 2 * i), 4, n - i, 2);
+  copy_strided((char *)(r + i), 2, (const char *)(s + 2 * i + 1), 4, n - i,
+               2);
+}
+
+TARGET_SSE2 static void interleave2_32_sse2(void *dst, const void *left,
+                                            const void *right, size_t n) {
+  const float *l = (const float *)left;
+  const float *r = (const float *)right;
+  float *d = (float *)dst;
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128 a = _mm_loadu_ps(l + i);
+    __m128 b = _mm_loadu_ps(r + i);
+    _mm_storeu_ps(d + 2 * i, _mm_unpacklo_ps(a, b));
+    _mm_storeu_ps(d + 2 * i + 4, _mm_unpackhi_ps(a, b));
+  }
+  copy_strided((char *)(d + 2 * i), 8, (const char *)(l + i), 4, n - i, 4);
+  copy_strided((char *)(d + 2 * i + 1), 8, (const char *)(r + i), 4, n - i,
+               4);
+}
+
+TARGET_SSE2 static void deinterleave2_32_sse2(void *left, void *right,
+                                              const void *src, size_t n) {
+  const float *s = (const float *)src;
+  float *l = (float *)left;
+  float *r = (float *)right;
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128 a = _mm_loadu_ps(s + 2 * i);
+    __m128 b = _mm_loadu_ps(s + 2 * i + 4);
+    _mm_storeu_ps(l + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+    _mm_storeu_ps(r + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+  }
+  copy_strided((char *)(l + i), 4, (const char *)(s + 2 * i), 8, n - i, 4);
+  copy_strided((char *)(r + i), 4, (const char *)(s + 2 * i + 1), 8, n - i,
+               4);
+}
+
+// Returns 2 if the CPU (and OS) support AVX2, 1 if they support SSE2, or 0.
+static int detect_simd_level(void) {
+#if defined(_MSC_VER)
+  int info[4];
+  __cpuid(info, 0);
+  int max_leaf = info[0];
+  __cpuid(info, 1);
+  int level = (info[3] & (1 << 26)) ? 1 : 0;
+  // AVX2 also needs the OS to save the YMM registers.
+  if (level && max_leaf >= 7 && (info[2] & (1 << 27)) &&
+      (_xgetbv(0) & 6) == 6) {
+    __cpuidex(info, 7, 0);
+    if (info[1] & (1 << 5)) {
+      level = 2;
+    }
+  }
+  return level;
+#else
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return 2;
+  }
+  return __builtin_cpu_supports("sse2") ? 1 : 0;
+#endif
+}
+
+#endif  // CONVERT_X86
+
+/*************************************************************
+ * Kernel selection
+ *************************************************************/
+
+#ifdef CONVERT_X86
+// The SIMD level to use (see detect_simd_level), or -1 until detected.
+// Interpreters with their own GIL (and free-threaded builds) may convert
+// concurrently, so access it atomically; detecting twice is harmless.
+static PyAudioAtomic simd_level = -1;
+#endif
+
+static int get_simd_level(void) {
+#ifdef CONVERT_X86
+  int64_t level = PyAudioAtomic_Load(&simd_level);
+  if (level < 0) {
+    level = detect_simd_level();
+    PyAudioAtomic_Store(&simd_level, level);
+  }
+  return (int)level;
+#else
+  return 0;
+#endif
+}
+
+static PyAudioConvertKernel get_to_float(PaSampleFormat format) {
+  int level = get_simd_level();
+  switch (format) {
+    case paUInt8:
+      return u8_to_float;
+    case paInt8:
+      return s8_to_float;
+    case paInt16:
+#ifdef CONVERT_X86
+      if (level >= 2) {
+        return s16_to_float_avx2;
+      }
+      if (level >= 1) {
+        return s16_to_float_sse2;
+      }
+#endif
+      return s16_to_float;
+    case paInt24:
+      return s24_to_float;
+    case paInt32:
+#ifdef CONVERT_X86
+      if (level >= 2) {
+        return s32_to_float_avx2;
+      }
+      if (level >= 1) {
+        return s32_to_float_sse2;
+      }
+#endif
+      return s32_to_float;
+    default:
+      (void)level;
+      return NULL;
+  }
+}
+
+static PyAudioConvertKernel get_from_float(PaSampleFormat format) {
+  int level = get_simd_level();
+  switch (format) {
+    case paUInt8:
+      return float_to_u8;
+    case paInt8:
+      return float_to_s8;
+    case paInt16:
+#ifdef CONVERT_X86
+      if (level >= 2) {
+        return float_to_s16_avx2;
+      }
+      if (level >= 1) {
+        return float_to_s16_sse2;
+      }
+#endif
+      return float_to_s16;
+    case paInt24:
+      return float_to_s24;
+    case paInt32:
+#ifdef CONVERT_X86
+      if (level >= 2) {
+        return float_to_s32_avx2;
+      }
+      if (level >= 1) {
+        return float_to_s32_sse2;
+      }
+#endif
+      return float_to_s32;
+    default:
+      (void)level;
+      return NULL;
+  }
+}
+
+int PyAudioConverter_IsSupported(PaSampleFormat format) {
+  switch (format) {
+    case paFloat32:
+    case paInt32:
+    case paInt24:
+    case paInt16:
+    case paInt8:
+    case paUInt8:
+      return 1;
+    default:
+      return 0;
+  }
+}
+
+void PyAudioConverter_Init(PyAudioConverter *converter, PaSampleFormat from,
+                           PaSampleFormat to) {
+  converter->from_size = (unsigned int)Pa_GetSampleSize(from);
+  converter->to_size = (unsigned int)Pa_GetSampleSize(to);
+  if (from == to) {
+    converter->to_float = NULL;
+    converter->from_float = NULL;
+    return;
+  }
+  converter->to_float = get_to_float(from);
+  converter->from_float = get_from_float(to);
+}
+
+void PyAudioConverter_Run(const PyAudioConverter *converter, void *dst,
+                          const void *src, size_t num_samples) {
+  if (converter->from_float == NULL) {
+    if (converter->to_float == NULL) {
+      // Same format, or float32 to float32.
+      memcpy(dst, src, num_samples * converter->from_size);
+    } else {
+      converter->to_float(dst, src, num_samples);
+    }
+    return;
+  }
+  if (converter->to_float == NULL) {
+    converter->from_float(dst, src, num_samples);
+    return;
+  }
+
+  // Between two integer formats, a chunk at a time through float32.
+  float chunk[FLOAT_CHUNK_SAMPLES];
+  const char *s = (const char *)src;
+  char *d = (char *)dst;
+  while (num_samples > 0) {
+    size_t n =
+        num_samples < FLOAT_CHUNK_SAMPLES ? num_samples : FLOAT_CHUNK_SAMPLES;
+    converter->to_float(chunk, s, n);
+    converter->from_float(d, chunk, n);
+    s += n * converter->from_size;
+    d += n * converter->to_size;
+    num_samples -= n;
+  }
+}
+
+void PyAudioInterleave(void *dst, const void *src, size_t frames,
+                       unsigned int channels, unsigned int sample_size,
+                       size_t plane_frames) {
+#ifdef CONVERT_X86
+  if (channels == 2 && get_simd_level() >= 1) {
+    const char *right = (const char *)src + plane_frames * sample_size;
+    if (sample_size == 2) {
+      interleave2_16_sse2(dst, src, right, frames);
+      return;
+    }
+    if (sample_size == 4) {
+      interleave2_32_sse2(dst, src, right, frames);
+      return;
+    }
+  }
+#endif
+  interleave_scalar(dst, src, frames, channels, sample_size, plane_frames);
+}
+
+void PyAudioDeinterleave(void *dst, const void *src, size_t frames,
+                         unsigned int channels, unsigned int sample_size,
+                         size_t plane_frames) {
+#ifdef CONVERT_X86
+  if (channels == 2 && get_simd_level() >= 1) {
+    char *right = (char *)dst + plane_frames * sample_size;
+    if (sample_size == 2) {
+      deinterleave2_16_sse2(dst, right, src, frames);
+      return;
+    }
+    if (sample_size == 4) {
+      deinterleave2_32_sse2(dst, right, src, frames);
+      return;
+    }
+  }
+#endif
+  deinterleave_scalar(dst, src, frames, channels, sample_size, plane_frames);
+}
+
+PyObject *PyAudio_ConvertFormat(PyObject *self, PyObject *args) {
+  Py_buffer data;
+  PaSampleFormat from, to;
+  if (!PyArg_ParseTuple(args, "y*kk", &data, &from, &to)) {
+    return NULL;
+  }
+
+  if (!PyAudioConverter_IsSupported(from) ||
+      !PyAudioConverter_IsSupported(to)) {
+    PyBuffer_Release(&data);
+    PyErr_SetString(PyExc_ValueError,
+                    "Conversions support paFloat32, paInt32, paInt24, "
+                    "paInt16, paInt8 and paUInt8");
+    return NULL;
+  }
+
+  PyAudioConverter converter;
+  PyAudioConverter_Init(&converter, from, to);
+  if (data.len % converter.from_size != 0) {
+    PyBuffer_Release(&data);
+    PyErr_Format(PyExc_ValueError,
+                 "Data holds %zd bytes, which is not a whole number of "
+                 "samples (of %u bytes each)",
+                 data.len, converter.from_size);
+    return NULL;
+  }
+
+  Py_ssize_t num_samples = data.len / converter.from_size;
+  PyObject *rv =
+      PyBytes_FromStringAndSize(NULL, num_samples * converter.to_size);
+  if (rv == NULL) {
+    PyBuffer_Release(&data);
+    return NULL;
+  }
+
+  // clang-format off
+  Py_BEGIN_ALLOW_THREADS
+  PyAudioConverter_Run(&converter, PyBytes_AS_STRING(rv), data.buf,
+                       (size_t)num_samples);
+  Py_END_ALLOW_THREADS
+  // clang-format on
+  PyBuffer_Release(&data);
+  return rv;
+}
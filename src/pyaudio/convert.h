@@ -0,0 +1,67 @@
+// Sample format conversion between PortAudio's interleaved sample formats
+// (paFloat32, paInt32, packed paInt24, paInt16, paInt8 and paUInt8). Integer
+// samples map to floats by scaling by 2^(bits - 1), so that conversions to
+// float32 and back are exact. Conversions from float32 round to the nearest
+// integer, and clip to the range of the format. The hottest kernels use SSE2 or
+// AVX2 when the CPU supports them. Also interleaves and deinterleaves samples.
+
+#ifndef CONVERT_H_
+#define CONVERT_H_
+
+#include <stddef.h>
+
+#ifndef PY_SSIZE_T_CLEAN
+#define PY_SSIZE_T_CLEAN
+#endif
+#include "Python.h"
+#include "portaudio.h"
+
+// Converts num_samples samples from src into dst, which must not overlap.
+typedef void (*PyAudioConvertKernel)(void *dst, const void *src,
+                                     size_t num_samples);
+
+// A conversion from one sample format to another, through float32 when
+// neither of them is float32. Both kernels are NULL when the formats are the
+// same.
+typedef struct {
+  // Converts to float32, or NULL if the source format is float32.
+  PyAudioConvertKernel to_float;
+  // Converts from float32, or NULL if the target format is float32.
+  PyAudioConvertKernel from_float;
+  // Sample sizes of the source and target formats, in bytes.
+  unsigned int from_size;
+  unsigned int to_size;
+} PyAudioConverter;
+
+// Returns whether conversions support the given sample format.
+int PyAudioConverter_IsSupported(PaSampleFormat format);
+
+// Sets up a conversion between two supported sample formats.
+void PyAudioConverter_Init(PyAudioConverter *converter, PaSampleFormat from,
+                           PaSampleFormat to);
+
+// Converts num_samples samples from src into dst, which must not overlap.
+// Never blocks, and does not require the GIL.
+void PyAudioConverter_Run(const PyAudioConverter *converter, void *dst,
+                          const void *src, size_t num_samples);
+
+// Interleaving between frames, in which each channel's sample follows the
+// previous channel's, and planes, in which each channel's samples follow the
+// previous channel's (channel-major), for non-interleaved streams. Each
+// converts `frames` frames of `channels` channels, with samples of
+// sample_size bytes. In the planar buffer, plane c starts plane_frames
+// samples after plane c - 1. The buffers must not overlap. Never block, and do
+// not require the GIL.
+void PyAudioInterleave(void *dst, const void *src, size_t frames,
+                       unsigned int channels, unsigned int sample_size,
+                       size_t plane_frames);
+void PyAudioDeinterleave(void *dst, const void *src, size_t frames,
+                         unsigned int channels, unsigned int sample_size,
+                         size_t plane_frames);
+
+// Exported functions.
+
+// Converts a buffer of samples from one sample format to another.
+PyObject *PyAudio_ConvertFormat(PyObject *self, PyObject *args);
+
+#endif  // CONVERT_H_
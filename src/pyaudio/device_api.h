@@ -6,10 +6,11 @@
 #endif
 #include "Python.h"
 
-// Python object wrapper for PortAudio's PaDeviceInfo struct.
-extern PyTypeObject PyAudioDeviceInfoType;
+// Python object wrapper for PortAudio's PaDeviceInfo struct. See
+// module_state.h for the type object.
+extern PyType_Spec PyAudioDeviceInfoTypeSpec;
 
-// Returns a PyAudioDeviceInfoType object
+// Returns a PyAudioDeviceInfo object
 PyObject *PyAudio_GetDeviceInfo(PyObject *self, PyObject *args);
 PyObject *PyAudio_GetDeviceCount(PyObject *self, PyObject *args);
 PyObject *PyAudio_GetDefaultInputDevice(PyObject *self, PyObject *args);
@@ -8,6 +8,8 @@
 #include "Python.h"
 #include "portaudio.h"
 
+#include "module_state.h"
+
 // Wrapper object for the PaHostApiInfo struct.
 
 typedef struct {
@@ -77,8 +79,10 @@ static int antiset(PyAudioHostApiInfo *self, PyObject *value, void *closure) {
 }
 
 static void dealloc(PyAudioHostApiInfo *self) {
+  PyTypeObject *type = Py_TYPE(self);
   self->api_info = NULL;
-  Py_TYPE(self)->tp_free((PyObject *)self);
+  type->tp_free((PyObject *)self);
+  PYAUDIO_DECREF_HEAP_TYPE(type);
 }
 
 static PyGetSetDef get_setters[] = {
@@ -100,23 +104,24 @@ static PyGetSetDef get_setters[] = {
 
     {NULL}};
 
-PyTypeObject PyAudioHostApiInfoType = {
-    // clang-format off
-    PyVarObject_HEAD_INIT(NULL, 0)
-    // clang-format on
-    .tp_name = "_portaudio.paHostApiInfo",
-    .tp_basicsize = sizeof(PyAudioHostApiInfo),
-    .tp_itemsize = 0,
-    .tp_dealloc = (destructor)dealloc,
-    .tp_flags = Py_TPFLAGS_DEFAULT,
-    .tp_doc = PyDoc_STR("PortAudio PaHostApiInfo"),
-    .tp_getset = get_setters,
-    .tp_new = PyType_GenericNew,
+static PyType_Slot slots[] = {
+    {Py_tp_dealloc, dealloc},
+    {Py_tp_doc, (void *)PyDoc_STR("PortAudio PaHostApiInfo")},
+    {Py_tp_getset, get_setters},
+    {Py_tp_new, PyType_GenericNew},
+    {0, NULL}};
+
+PyType_Spec PyAudioHostApiInfoTypeSpec = {
+    .name = "_portaudio.paHostApiInfo",
+    .basicsize = sizeof(PyAudioHostApiInfo),
+    .itemsize = 0,
+    .flags = PYAUDIO_TPFLAGS_DEFAULT,
+    .slots = slots,
 };
 
 // Public Functions
 
-// Creates and returns a PyAudioHostApiInfo (PyAudioHostApiInfoType).
+// Creates and returns a PyAudioHostApiInfo.
 PyObject *PyAudio_GetHostApiInfo(PyObject *self, PyObject *args) {
   PaHostApiIndex index;
   if (!PyArg_ParseTuple(args, "i", &index)) {
@@ -131,7 +136,10 @@ PyObject *PyAudio_GetHostApiInfo(PyObject *self, PyObject *args) {
   }
 
   PyAudioHostApiInfo *py_hostapi_info = (PyAudioHostApiInfo *)PyObject_New(
-      PyAudioHostApiInfo, &PyAudioHostApiInfoType);
+      PyAudioHostApiInfo, PyAudioModule_GetState(self)->host_api_info_type);
+  if (!py_hostapi_info) {
+    return NULL;
+  }
   py_hostapi_info->api_info = pa_hostapi_info;
   return (PyObject *)py_hostapi_info;
 }
@@ -8,10 +8,11 @@
 #endif
 #include "Python.h"
 
-// Python object wrapper for PortAudio's PaHostApi struct.
-extern PyTypeObject PyAudioHostApiInfoType;
+// Python object wrapper for PortAudio's PaHostApi struct. See
+// module_state.h for the type object.
+extern PyType_Spec PyAudioHostApiInfoTypeSpec;
 
-// Returns a PyAudioHostApiInfoType object
+// Returns a PyAudioHostApiInfo object
 PyObject *PyAudio_GetHostApiInfo(PyObject *self, PyObject *args);
 PyObject *PyAudio_GetHostApiCount(PyObject *self, PyObject *args);
 PyObject *PyAudio_GetDefaultHostApi(PyObject *self, PyObject *args);
@@ -9,6 +9,8 @@
 #include "portaudio.h"
 #include "pa_mac_core.h"
 
+#include "module_state.h"
+
 static void cleanup(PyAudioMacCoreStreamInfo *self) {
   if (self->channel_map != NULL) {
     free(self->channel_map);
@@ -19,8 +21,10 @@ static void cleanup(PyAudioMacCoreStreamInfo *self) {
 }
 
 static void dealloc(PyAudioMacCoreStreamInfo *self) {
+  PyTypeObject *type = Py_TYPE(self);
   cleanup(self);
-  Py_TYPE(self)->tp_free((PyObject *)self);
+  type->tp_free((PyObject *)self);
+  PYAUDIO_DECREF_HEAP_TYPE(type);
 }
 
 static int init(PyObject *_self, PyObject *args, PyObject *kwargs) {
@@ -126,19 +130,20 @@ static PyGetSetDef get_setters[] = {
      NULL},
     {NULL}};
 
-PyTypeObject PyAudioMacCoreStreamInfoType = {
-    // clang-format off
-    PyVarObject_HEAD_INIT(NULL, 0)
-    // clang-format on
-    .tp_name = "_portaudio.PaMacCoreStreamInfo",
-    .tp_basicsize = sizeof(PyAudioMacCoreStreamInfo),
-    .tp_itemsize = 0,
-    .tp_dealloc = (destructor)dealloc,
-    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,
-    .tp_doc = PyDoc_STR("macOS Specific HostAPI configuration"),
-    .tp_getset = get_setters,
-    .tp_init = (initproc)init,
-    .tp_new = PyType_GenericNew,
+static PyType_Slot slots[] = {
+    {Py_tp_dealloc, dealloc},
+    {Py_tp_doc, (void *)PyDoc_STR("macOS Specific HostAPI configuration")},
+    {Py_tp_getset, get_setters},
+    {Py_tp_init, init},
+    {Py_tp_new, PyType_GenericNew},
+    {0, NULL}};
+
+PyType_Spec PyAudioMacCoreStreamInfoTypeSpec = {
+    .name = "_portaudio.PaMacCoreStreamInfo",
+    .basicsize = sizeof(PyAudioMacCoreStreamInfo),
+    .itemsize = 0,
+    .flags = PYAUDIO_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,
+    .slots = slots,
 };
 
 #endif  // MACOS
@@ -22,7 +22,8 @@ typedef struct {
   int channel_map_size;
 } PyAudioMacCoreStreamInfo;
 
-extern PyTypeObject PyAudioMacCoreStreamInfoType;
+// See module_state.h for the type object.
+extern PyType_Spec PyAudioMacCoreStreamInfoTypeSpec;
 
 #endif  // MACOS
 #endif  // MAC_CORE_STREAM_INFO_H_
@@ -30,14 +30,25 @@
 #include "Python.h"
 #include "portaudio.h"
 
+#include "convert.h"
 #include "device_api.h"
 #include "host_api.h"
 #include "init.h"
 #include "mac_core_stream_info.h"
 #include "misc.h"
+#include "mix.h"
+#include "module_state.h"
+#include "ops.h"
+#include "resample.h"
 #include "stream.h"
+#include "stream_async.h"
+#include "stream_capture.h"
+#include "stream_decoupled.h"
 #include "stream_io.h"
 #include "stream_lifecycle.h"
+#include "stream_playback.h"
+#include "thread_state.h"
+#include "time_info.h"
 
 static PyMethodDef exported_functions[] = {
     // init.h
@@ -45,6 +56,18 @@ static PyMethodDef exported_functions[] = {
 
     {"terminate", PyAudio_Terminate, METH_VARARGS, "Terminates PortAudio"},
 
+    // convert.h
+    {"convert_format", PyAudio_ConvertFormat, METH_VARARGS,
+     "Converts samples from one sample format to another"},
+
+    // mix.h
+    {"mix_channels", PyAudio_MixChannels, METH_VARARGS,
+     "Mixes frames through a channel gain matrix"},
+
+    // resample.h
+    {"resample", PyAudio_Resample, METH_VARARGS,
+     "Converts samples from one sample rate to another"},
+
     // misc.h
     {"get_sample_size", PyAudio_GetSampleSize, METH_VARARGS,
      "Returns sample size of a format in bytes"},
@@ -97,6 +120,13 @@ static PyMethodDef exported_functions[] = {
     {"get_stream_cpu_load", PyAudio_GetStreamCpuLoad, METH_VARARGS,
      "Returns the stream's CPU load (always 0 for blocking mode)"},
 
+    {"get_stream_error", PyAudio_GetStreamError, METH_VARARGS,
+     "Returns (and clears) the exception that the stream's callback raised, "
+     "if any"},
+
+    {"get_stream_xrun_counts", PyAudio_GetStreamXrunCounts, METH_VARARGS,
+     "Returns (and optionally resets) the stream's xrun counters"},
+
     // stream_lifecycle.h (and stream.h)
     {"open", (PyCFunction)PyAudio_OpenStream, METH_VARARGS | METH_KEYWORDS,
      "Opens a PortAudio stream"},
@@ -123,6 +153,22 @@ static PyMethodDef exported_functions[] = {
     {"read_stream", PyAudio_ReadStream, METH_VARARGS,
      "Read samples from stream"},
 
+    {"read_stream_into", PyAudio_ReadStreamInto, METH_VARARGS,
+     "Read samples from stream into a writable buffer"},
+
+    {"read_stream_nowait", PyAudio_ReadStreamNowait, METH_VARARGS,
+     "Read the samples that are available from stream, without waiting"},
+
+    {"write_stream_nowait", PyAudio_WriteStreamNowait, METH_VARARGS,
+     "Write as many samples as fit to stream, without waiting"},
+
+    {"write_stream_v", PyAudio_WriteStreamV, METH_VARARGS,
+     "Write the samples of a sequence of buffers to stream, in order"},
+
+    {"process_stream", PyAudio_ProcessStream, METH_VARARGS,
+     "Write samples to, and read samples from, a full-duplex stream in one "
+     "call"},
+
     {"get_stream_write_available", PyAudio_GetStreamWriteAvailable,
      METH_VARARGS,
      "Returns the number of frames that can be written without waiting"},
@@ -130,74 +176,100 @@ static PyMethodDef exported_functions[] = {
     {"get_stream_read_available", PyAudio_GetStreamReadAvailable, METH_VARARGS,
      "Returns the number of frames that can be read without waiting"},
 
-    {NULL, NULL, 0, NULL}};
+    // stream_decoupled.h (and stream.h)
+    {"run_decoupled_callback", PyAudio_RunDecoupledCallback, METH_VARARGS,
+     "Runs the callback for a decoupled stream until it completes or closes"},
 
-#if PY_MAJOR_VERSION >= 3
-#define ERROR_INIT NULL
-#else
-#define ERROR_INIT /**/
-#endif
+    // stream_capture.h (and stream.h)
+    {"get_stream_capture_lost_frames", PyAudio_GetStreamCaptureLostFrames,
+     METH_VARARGS,
+     "Returns the number of frames that the stream's capture buffer dropped "
+     "because it was full"},
 
-#if PY_MAJOR_VERSION >= 3
-static struct PyModuleDef moduledef = {  //
-    PyModuleDef_HEAD_INIT,
-    "_portaudio",
-    NULL,
-    -1,
-    exported_functions,
-    NULL,
-    NULL,
-    NULL,
-    NULL};
-#endif
+    // stream_playback.h (and stream.h)
+    {"drain_stream", PyAudio_DrainStream, METH_VARARGS,
+     "Waits until the device has taken every frame queued for playback"},
 
-PyMODINIT_FUNC
-#if PY_MAJOR_VERSION >= 3
-PyInit__portaudio(void)
-#else
-init_portaudio(void)
-#endif
-{
-  PyObject *m;
+    {"get_stream_queued_frames", PyAudio_GetStreamQueuedFrames, METH_VARARGS,
+     "Returns the number of frames queued for playback"},
 
-#if PY_MAJOR_VERSION >= 3 && PY_MINOR_VERSION <= 6
-  // Deprecated since Python 3.7; now called by Py_Initialize().
-  PyEval_InitThreads();
-#endif
+    // stream_async.h (and stream.h)
+    {"get_stream_ready_fd", PyAudio_GetStreamReadyFd, METH_VARARGS,
+     "Returns the file descriptor that signals when the stream is ready"},
 
-  if (PyType_Ready(&PyAudioStreamType) < 0) {
-    return ERROR_INIT;
-  }
+    {"arm_stream_ready", PyAudio_ArmStreamReady, METH_VARARGS,
+     "Asks for a signal once the stream can read or write a number of frames "
+     "without waiting"},
 
-  if (PyType_Ready(&PyAudioDeviceInfoType) < 0) {
-    return ERROR_INIT;
-  }
+    {NULL, NULL, 0, NULL}};
 
-  if (PyType_Ready(&PyAudioHostApiInfoType) < 0) {
-    return ERROR_INIT;
+// Before Python 3.9, the garbage collector may traverse and clear the module
+// before its state is allocated (i.e., before exec_module).
+static int traverse_module(PyObject *m, visitproc visit, void *arg) {
+  PyAudioModuleState *state = PyAudioModule_GetState(m);
+  if (state == NULL) {
+    return 0;
   }
-
+  Py_VISIT(state->stream_type);
+  Py_VISIT(state->device_info_type);
+  Py_VISIT(state->host_api_info_type);
+  Py_VISIT(state->time_info_type);
 #ifdef MACOS
-  if (PyType_Ready(&PyAudioMacCoreStreamInfoType) < 0) {
-    return ERROR_INIT;
-  }
+  Py_VISIT(state->mac_core_stream_info_type);
 #endif
+  return 0;
+}
 
-#if PY_MAJOR_VERSION >= 3
-  m = PyModule_Create(&moduledef);
-#else
-  m = Py_InitModule("_portaudio", exported_functions);
+static int clear_module(PyObject *m) {
+  PyAudioModuleState *state = PyAudioModule_GetState(m);
+  if (state == NULL) {
+    return 0;
+  }
+  Py_CLEAR(state->stream_type);
+  Py_CLEAR(state->device_info_type);
+  Py_CLEAR(state->host_api_info_type);
+  Py_CLEAR(state->time_info_type);
+#ifdef MACOS
+  Py_CLEAR(state->mac_core_stream_info_type);
 #endif
+  return 0;
+}
+
+static void free_module(void *m) { clear_module((PyObject *)m); }
+
+// Creates the module's types (in the module state) and adds the module's
+// constants to m. Returns 0 on success, or -1 with an exception set.
+static int exec_module(PyObject *m) {
+  PyAudioModuleState *state = PyAudioModule_GetState(m);
+  if (!(state->stream_type =
+            (PyTypeObject *)PyType_FromSpec(&PyAudioStreamTypeSpec)) ||
+      !(state->device_info_type =
+            (PyTypeObject *)PyType_FromSpec(&PyAudioDeviceInfoTypeSpec)) ||
+      !(state->host_api_info_type =
+            (PyTypeObject *)PyType_FromSpec(&PyAudioHostApiInfoTypeSpec)) ||
+      !(state->time_info_type =
+            (PyTypeObject *)PyType_FromSpec(&PyAudioTimeInfoTypeSpec))) {
+    return -1;
+  }
 
-  Py_INCREF(&PyAudioStreamType);
-  Py_INCREF(&PyAudioDeviceInfoType);
-  Py_INCREF(&PyAudioHostApiInfoType);
 #ifdef MACOS
-  Py_INCREF(&PyAudioMacCoreStreamInfoType);
-  PyModule_AddObject(m, "paMacCoreStreamInfo",
-                     (PyObject *)&PyAudioMacCoreStreamInfoType);
+  state->mac_core_stream_info_type =
+      (PyTypeObject *)PyType_FromSpec(&PyAudioMacCoreStreamInfoTypeSpec);
+  if (!state->mac_core_stream_info_type) {
+    return -1;
+  }
+  Py_INCREF(state->mac_core_stream_info_type);
+  if (PyModule_AddObject(m, "paMacCoreStreamInfo",
+                         (PyObject *)state->mac_core_stream_info_type) < 0) {
+    Py_DECREF(state->mac_core_stream_info_type);
+    return -1;
+  }
 #endif
 
+  if (PyAudioOps_AddModule(m) < 0) {
+    return -1;
+  }
+
   // Add PortAudio constants
 
   // Host APIs
@@ -224,6 +296,12 @@ init_portaudio(void)
   PyModule_AddIntConstant(m, "paInt8", paInt8);
   PyModule_AddIntConstant(m, "paUInt8", paUInt8);
   PyModule_AddIntConstant(m, "paCustomFormat", paCustomFormat);
+  // The top bit, which overflows a C long where longs have 32 bits.
+  PyObject *non_interleaved = PyLong_FromUnsignedLong(paNonInterleaved);
+  if (non_interleaved != NULL &&
+      PyModule_AddObject(m, "paNonInterleaved", non_interleaved) < 0) {
+    Py_DECREF(non_interleaved);
+  }
 
   // Error codes
   PyModule_AddIntConstant(m, "paNoError", paNoError);
@@ -303,7 +381,42 @@ init_portaudio(void)
   PyModule_AddIntConstant(m, "paMacCoreMinimizeCPU", paMacCoreMinimizeCPU);
 #endif
 
-#if PY_MAJOR_VERSION >= 3
-  return m;
+  return 0;
+}
+
+static PyModuleDef_Slot module_slots[] = {
+    {Py_mod_exec, exec_module},
+#ifdef Py_mod_multiple_interpreters
+    // The module keeps its Python objects in its module state, so each
+    // interpreter, including the ones that run stream callbacks (see
+    // stream_subinterpreter.h), gets its own.
+    {Py_mod_multiple_interpreters, Py_MOD_PER_INTERPRETER_GIL_SUPPORTED},
+#endif
+#ifdef Py_mod_gil
+    // Streams synchronize their own state (see PyAudioStream_BeginUse), so
+    // free-threaded Python need not enable the GIL for this module.
+    {Py_mod_gil, Py_MOD_GIL_NOT_USED},
+#endif
+    {0, NULL}};
+
+static struct PyModuleDef moduledef = {  //
+    PyModuleDef_HEAD_INIT,
+    "_portaudio",
+    NULL,
+    sizeof(PyAudioModuleState),
+    exported_functions,
+    module_slots,
+    traverse_module,
+    clear_module,
+    free_module};
+
+PyMODINIT_FUNC PyInit__portaudio(void) {
+#if PY_VERSION_HEX < 0x03070000
+  // Deprecated since Python 3.7; now called by Py_Initialize().
+  PyEval_InitThreads();
 #endif
+
+  PyAudioThreadState_Init();
+
+  return PyModuleDef_Init(&moduledef);
 }
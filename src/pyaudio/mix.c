@@ -0,0 +1,335 @@
+#include "mix.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef PY_SSIZE_T_CLEAN
+#define PY_SSIZE_T_CLEAN
+#endif
+#include "Python.h"
+#include "portaudio.h"
+
+#include "convert.h"
+
+// x86-64 always has SSE2, so use it whenever the compiler targets it.
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MIX_SSE2 1
+#include <emmintrin.h>
+#endif
+
+// Frames that PyAudioMixer_Run mixes at a time, so that the planes stay in
+// the L1 cache.
+#define BLOCK_FRAMES 256
+
+// Frames that PyAudio_MixChannels converts at a time.
+#define CHUNK_FRAMES 4096
+
+struct PyAudioMixer {
+  unsigned int in_channels;
+  unsigned int out_channels;
+  // The matrix's nonzero gains, row by row: output channel i sums the
+  // num_terms[i] terms from first_term[i], each an input channel and its
+  // gain.
+  unsigned int *num_terms;
+  unsigned int *first_term;
+  unsigned int *term_channels;
+  float *term_gains;
+  int is_selection;
+  // Planes for one block of input and output channels.
+  float *planes;
+};
+
+PyAudioMixer *PyAudioMixer_New(const float *gains, unsigned int in_channels,
+                               unsigned int out_channels) {
+  PyAudioMixer *mixer = (PyAudioMixer *)calloc(1, sizeof(PyAudioMixer));
+  if (!mixer) {
+    return NULL;
+  }
+
+  size_t size = (size_t)in_channels * out_channels;
+  mixer->in_channels = in_channels;
+  mixer->out_channels = out_channels;
+  mixer->num_terms = (unsigned int *)calloc(out_channels, sizeof(unsigned int));
+  mixer->first_term =
+      (unsigned int *)calloc(out_channels, sizeof(unsigned int));
+  mixer->term_channels = (unsigned int *)malloc(size * sizeof(unsigned int));
+  mixer->term_gains = (float *)malloc(size * sizeof(float));
+  mixer->planes = (float *)malloc((size_t)(in_channels + out_channels) *
+                                  BLOCK_FRAMES * sizeof(float));
+  if (!mixer->num_terms || !mixer->first_term || !mixer->term_channels ||
+      !mixer->term_gains || !mixer->planes) {
+    PyAudioMixer_Free(mixer);
+    return NULL;
+  }
+
+  unsigned int num_terms = 0;
+  mixer->is_selection = 1;
+  for (unsigned int i = 0; i < out_channels; i++) {
+    mixer->first_term[i] = num_terms;
+    for (unsigned int j = 0; j < in_channels; j++) {
+      float gain = gains[(size_t)i * in_channels + j];
+      if (gain != 0) {
+        mixer->term_channels[num_terms] = j;
+        mixer->term_gains[num_terms] = gain;
+        num_terms++;
+      }
+    }
+    mixer->num_terms[i] = num_terms - mixer->first_term[i];
+    if (mixer->num_terms[i] > 1 ||
+        (mixer->num_terms[i] == 1 &&
+         mixer->term_gains[mixer->first_term[i]] != 1.0f)) {
+      mixer->is_selection = 0;
+    }
+  }
+  return mixer;
+}
+
+void PyAudioMixer_Free(PyAudioMixer *mixer) {
+  if (!mixer) {
+    return;
+  }
+  free(mixer->num_terms);
+  free(mixer->first_term);
+  free(mixer->term_channels);
+  free(mixer->term_gains);
+  free(mixer->planes);
+  free(mixer);
+}
+
+int PyAudioMixer_IsSelection(const PyAudioMixer *mixer) {
+  return mixer->is_selection;
+}
+
+// Copies the samples of a selection, with one loop per sample size, so that
+// the common sizes copy whole words.
+#define SELECT_LOOP(type)                                                   \
+  do {                                                                      \
+    const type *s = (const type *)src;                                      \
+    type *d = (type *)dst;                                                  \
+    type zero;                                                              \
+    memcpy(&zero, silence, sizeof(type));                                   \
+    for (size_t f = 0; f < frames; f++) {                                   \
+      for (unsigned int i = 0; i < out_channels; i++) {                     \
+        d[i] = mixer->num_terms[i]                                          \
+                   ? s[mixer->term_channels[mixer->first_term[i]]]          \
+                   : zero;                                                  \
+      }                                                                     \
+      s += in_channels;                                                     \
+      d += out_channels;                                                    \
+    }                                                                       \
+  } while (0)
+
+void PyAudioMixer_Select(const PyAudioMixer *mixer, void *dst, const void *src,
+                         size_t frames, unsigned int sample_size,
+                         const void *silence) {
+  unsigned int in_channels = mixer->in_channels;
+  unsigned int out_channels = mixer->out_channels;
+  switch (sample_size) {
+    case 1:
+      SELECT_LOOP(uint8_t);
+      return;
+    case 2:
+      SELECT_LOOP(uint16_t);
+      return;
+    case 4:
+      SELECT_LOOP(uint32_t);
+      return;
+  }
+
+  const char *s = (const char *)src;
+  char *d = (char *)dst;
+  for (size_t f = 0; f < frames; f++) {
+    for (unsigned int i = 0; i < out_channels; i++) {
+      memcpy(d,
+             mixer->num_terms[i]
+                 ? s + (size_t)mixer->term_channels[mixer->first_term[i]] *
+                           sample_size
+                 : (const char *)silence,
+             sample_size);
+      d += sample_size;
+    }
+    s += (size_t)in_channels * sample_size;
+  }
+}
+
+#undef SELECT_LOOP
+
+// dst = gain * src, and dst += gain * src, over n samples.
+static void scale(float *dst, const float *src, float gain, size_t n) {
+  size_t i = 0;
+#ifdef MIX_SSE2
+  __m128 g = _mm_set1_ps(gain);
+  for (; i + 4 <= n; i += 4) {
+    _mm_storeu_ps(dst + i, _mm_mul_ps(g, _mm_loadu_ps(src + i)));
+  }
+#endif
+  for (; i < n; i++) {
+    dst[i] = gain * src[i];
+  }
+}
+
+static void scale_add(float *dst, const float *src, float gain, size_t n) {
+  size_t i = 0;
+#ifdef MIX_SSE2
+  __m128 g = _mm_set1_ps(gain);
+  for (; i + 4 <= n; i += 4) {
+    _mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i),
+                                      _mm_mul_ps(g, _mm_loadu_ps(src + i))));
+  }
+#endif
+  for (; i < n; i++) {
+    dst[i] += gain * src[i];
+  }
+}
+
+void PyAudioMixer_Run(PyAudioMixer *mixer, float *dst, const float *src,
+                      size_t frames) {
+  unsigned int in_channels = mixer->in_channels;
+  unsigned int out_channels = mixer->out_channels;
+  float *in_planes = mixer->planes;
+  float *out_planes = mixer->planes + (size_t)in_channels * BLOCK_FRAMES;
+
+  while (frames > 0) {
+    size_t n = frames < BLOCK_FRAMES ? frames : BLOCK_FRAMES;
+    PyAudioDeinterleave(in_planes, src, n, in_channels, sizeof(float),
+                        BLOCK_FRAMES);
+    for (unsigned int i = 0; i < out_channels; i++) {
+      float *out = out_planes + (size_t)i * BLOCK_FRAMES;
+      unsigned int first = mixer->first_term[i];
+      unsigned int num_terms = mixer->num_terms[i];
+      if (num_terms == 0) {
+        memset(out, 0, n * sizeof(float));
+        continue;
+      }
+      scale(out, in_planes + (size_t)mixer->term_channels[first] * BLOCK_FRAMES,
+            mixer->term_gains[first], n);
+      for (unsigned int t = first + 1; t < first + num_terms; t++) {
+        scale_add(out,
+                  in_planes + (size_t)mixer->term_channels[t] * BLOCK_FRAMES,
+                  mixer->term_gains[t], n);
+      }
+    }
+    PyAudioInterleave(dst, out_planes, n, out_channels, sizeof(float),
+                      BLOCK_FRAMES);
+
+    src += n * in_channels;
+    dst += n * out_channels;
+    frames -= n;
+  }
+}
+
+int PyAudioMixer_ParseGains(PyObject *matrix, size_t count, float *gains) {
+  PyObject *seq = PySequence_Fast(matrix, "channel_matrix must be a sequence");
+  if (!seq) {
+    return -1;
+  }
+  if ((size_t)PySequence_Fast_GET_SIZE(seq) != count) {
+    Py_DECREF(seq);
+    PyErr_SetString(PyExc_ValueError,
+                    "channel_matrix does not match the channel counts");
+    return -1;
+  }
+
+  PyObject **items = PySequence_Fast_ITEMS(seq);
+  for (size_t k = 0; k < count; k++) {
+    double gain = PyFloat_AsDouble(items[k]);
+    if (gain == -1.0 && PyErr_Occurred()) {
+      Py_DECREF(seq);
+      return -1;
+    }
+    gains[k] = (float)gain;
+  }
+  Py_DECREF(seq);
+  return 0;
+}
+
+PyObject *PyAudio_MixChannels(PyObject *self, PyObject *args) {
+  Py_buffer data;
+  PaSampleFormat format;
+  int in_channels, out_channels;
+  PyObject *matrix;
+  if (!PyArg_ParseTuple(args, "y*kiiO", &data, &format, &in_channels,
+                        &out_channels, &matrix)) {
+    return NULL;
+  }
+
+  if (!PyAudioConverter_IsSupported(format) || in_channels < 1 ||
+      out_channels < 1) {
+    PyBuffer_Release(&data);
+    PyErr_SetString(PyExc_ValueError, "Invalid format or channels");
+    return NULL;
+  }
+
+  PyAudioConverter to_float, from_float;
+  PyAudioConverter_Init(&to_float, format, paFloat32);
+  PyAudioConverter_Init(&from_float, paFloat32, format);
+  size_t sample_size = to_float.from_size;
+  if (data.len % (sample_size * in_channels) != 0) {
+    PyBuffer_Release(&data);
+    PyErr_Format(PyExc_ValueError,
+                 "Data holds %zd bytes, which is not a whole number of "
+                 "frames (of %zu bytes each)",
+                 data.len, sample_size * in_channels);
+    return NULL;
+  }
+
+  size_t count = (size_t)in_channels * out_channels;
+  float *gains = (float *)PyMem_Malloc(count * sizeof(float));
+  if (!gains) {
+    PyBuffer_Release(&data);
+    return PyErr_NoMemory();
+  }
+  if (PyAudioMixer_ParseGains(matrix, count, gains) < 0) {
+    PyBuffer_Release(&data);
+    PyMem_Free(gains);
+    return NULL;
+  }
+
+  size_t frames = (size_t)data.len / (sample_size * in_channels);
+  PyObject *rv =
+      PyBytes_FromStringAndSize(NULL, frames * sample_size * out_channels);
+  PyAudioMixer *mixer = PyAudioMixer_New(gains, (unsigned int)in_channels,
+                                         (unsigned int)out_channels);
+  float *scratch = (float *)PyMem_RawMalloc(
+      (size_t)CHUNK_FRAMES * (in_channels + out_channels) * sizeof(float));
+  PyMem_Free(gains);
+  if (!rv || !mixer || !scratch) {
+    PyBuffer_Release(&data);
+    Py_XDECREF(rv);
+    PyAudioMixer_Free(mixer);
+    PyMem_RawFree(scratch);
+    return rv ? PyErr_NoMemory() : NULL;
+  }
+
+  // clang-format off
+  Py_BEGIN_ALLOW_THREADS
+  const char *src = (const char *)data.buf;
+  char *dst = PyBytes_AS_STRING(rv);
+  if (PyAudioMixer_IsSelection(mixer)) {
+    char silence[4];
+    float zero = 0;
+    PyAudioConverter_Run(&from_float, silence, &zero, 1);
+    PyAudioMixer_Select(mixer, dst, src, frames, (unsigned int)sample_size,
+                        silence);
+  } else {
+    float *mixed = scratch + (size_t)CHUNK_FRAMES * in_channels;
+    while (frames > 0) {
+      size_t n = frames < CHUNK_FRAMES ? frames : CHUNK_FRAMES;
+      PyAudioConverter_Run(&to_float, scratch, src, n * in_channels);
+      PyAudioMixer_Run(mixer, mixed, scratch, n);
+      PyAudioConverter_Run(&from_float, dst, mixed, n * out_channels);
+      src += n * sample_size * in_channels;
+      dst += n * sample_size * out_channels;
+      frames -= n;
+    }
+  }
+  Py_END_ALLOW_THREADS
+  // clang-format on
+
+  PyBuffer_Release(&data);
+  PyAudioMixer_Free(mixer);
+  PyMem_RawFree(scratch);
+  return rv;
+}
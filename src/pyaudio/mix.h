@@ -0,0 +1,59 @@
+// Channel routing: mixes interleaved frames of one channel count into frames
+// of another through a gain matrix, with one row per output channel and one
+// column per input channel. Matrices that only select channels (each output
+// channel copies one input channel at unity gain, or is silent) copy samples
+// in any format. Other matrices mix float32 samples, a block at a time:
+// each output channel's plane is a sum of scaled input planes, which SSE2
+// computes four samples at a time when the compiler targets it.
+
+#ifndef MIX_H_
+#define MIX_H_
+
+#include <stddef.h>
+
+#ifndef PY_SSIZE_T_CLEAN
+#define PY_SSIZE_T_CLEAN
+#endif
+#include "Python.h"
+#include "portaudio.h"
+
+typedef struct PyAudioMixer PyAudioMixer;
+
+// Creates a mixer from in_channels to out_channels channels, with the given
+// row-major gain matrix of out_channels x in_channels gains, which it copies.
+// Returns NULL if out of memory, without setting an exception.
+PyAudioMixer *PyAudioMixer_New(const float *gains, unsigned int in_channels,
+                               unsigned int out_channels);
+
+void PyAudioMixer_Free(PyAudioMixer *mixer);
+
+// Returns whether the matrix only selects channels, so that
+// PyAudioMixer_Select applies it.
+int PyAudioMixer_IsSelection(const PyAudioMixer *mixer);
+
+// Applies a selection matrix to `frames` frames of samples of sample_size
+// bytes, writing the sample at `silence` to output channels that select no
+// input channel.
+void PyAudioMixer_Select(const PyAudioMixer *mixer, void *dst, const void *src,
+                         size_t frames, unsigned int sample_size,
+                         const void *silence);
+
+// Applies any matrix to `frames` frames of float32 samples.
+void PyAudioMixer_Run(PyAudioMixer *mixer, float *dst, const float *src,
+                      size_t frames);
+
+// None of the functions above block or require the GIL, except for
+// PyAudioMixer_New and PyAudioMixer_Free, which allocate. A mixer runs on
+// one thread at a time. The buffers must not overlap.
+
+// Fills `gains` with the `count` numbers in `matrix`, a flat sequence, as
+// the Python side passes gain matrices. Returns 0 on success, or -1 with an
+// exception set.
+int PyAudioMixer_ParseGains(PyObject *matrix, size_t count, float *gains);
+
+// Exported functions.
+
+// Mixes a buffer of frames through a gain matrix.
+PyObject *PyAudio_MixChannels(PyObject *self, PyObject *args);
+
+#endif  // MIX_H_
@@ -0,0 +1,46 @@
+// Per-module state of the _portaudio extension module.
+//
+// Each interpreter that imports the module gets its own copy of the module,
+// and with it, its own type objects, so that no Python objects are shared
+// across interpreters. Module-level functions receive the module as self, and
+// can find the types through PyAudioModule_GetState(self).
+
+#ifndef MODULE_STATE_H_
+#define MODULE_STATE_H_
+
+#ifndef PY_SSIZE_T_CLEAN
+#define PY_SSIZE_T_CLEAN
+#endif
+#include "Python.h"
+
+typedef struct {
+  PyTypeObject *stream_type;
+  PyTypeObject *device_info_type;
+  PyTypeObject *host_api_info_type;
+  PyTypeObject *time_info_type;
+#ifdef MACOS
+  PyTypeObject *mac_core_stream_info_type;
+#endif
+} PyAudioModuleState;
+
+static inline PyAudioModuleState *PyAudioModule_GetState(PyObject *module) {
+  return (PyAudioModuleState *)PyModule_GetState(module);
+}
+
+// Type flags for the module's types, which were static (and so immutable)
+// types before they moved into the module state.
+#ifdef Py_TPFLAGS_IMMUTABLETYPE
+#define PYAUDIO_TPFLAGS_DEFAULT (Py_TPFLAGS_DEFAULT | Py_TPFLAGS_IMMUTABLETYPE)
+#else
+#define PYAUDIO_TPFLAGS_DEFAULT Py_TPFLAGS_DEFAULT
+#endif
+
+// Instances of heap types hold a reference to their type since Python 3.8,
+// which the type's tp_dealloc must release.
+#if PY_VERSION_HEX >= 0x03080000
+#define PYAUDIO_DECREF_HEAP_TYPE(type) Py_DECREF(type)
+#else
+#define PYAUDIO_DECREF_HEAP_TYPE(type)
+#endif
+
+#endif  // MODULE_STATE_H_
@@ -0,0 +1,1042 @@
+#include "ops.h"
+
+#include <limits.h>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifndef PY_SSIZE_T_CLEAN
+#define PY_SSIZE_T_CLEAN
+#endif
+#include "Python.h"
+#include "portaudio.h"
+
+// x86-64 always has SSE2, so use it whenever the compiler targets it.
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define OPS_SSE2 1
+#include <emmintrin.h>
+#endif
+
+// Inputs smaller than this many bytes run with the GIL held: releasing and
+// retaking it would cost more than the work.
+#define MIN_UNLOCKED_BYTES 16384
+
+// The range of samples of each width, indexed by width.
+static const int32_t min_values[] = {0, -0x80, -0x8000, -0x800000,
+                                     INT32_MIN};
+static const int32_t max_values[] = {0, 0x7F, 0x7FFF, 0x7FFFFF, INT32_MAX};
+
+// Returns the sample of `width` bytes at p.
+static inline int32_t load_sample(const unsigned char *p, int width) {
+  switch (width) {
+    case 1:
+      return (int8_t)p[0];
+    case 2: {
+      int16_t v;
+      memcpy(&v, p, sizeof(v));
+      return v;
+    }
+    case 3: {
+      // Packed 24-bit samples are in native byte order, as PortAudio's are.
+#if PY_BIG_ENDIAN
+      uint32_t u = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+                   ((uint32_t)p[2] << 8);
+#else
+      uint32_t u = ((uint32_t)p[2] << 24) | ((uint32_t)p[1] << 16) |
+                   ((uint32_t)p[0] << 8);
+#endif
+      return (int32_t)u >> 8;
+    }
+    default: {
+      int32_t v;
+      memcpy(&v, p, sizeof(v));
+      return v;
+    }
+  }
+}
+
+// Stores the low `width` bytes of v at p.
+static inline void store_sample(unsigned char *p, int width, int32_t v) {
+  switch (width) {
+    case 1:
+      p[0] = (unsigned char)v;
+      return;
+    case 2: {
+      int16_t s = (int16_t)v;
+      memcpy(p, &s, sizeof(s));
+      return;
+    }
+    case 3:
+#if PY_BIG_ENDIAN
+      p[0] = (unsigned char)(v >> 16);
+      p[1] = (unsigned char)(v >> 8);
+      p[2] = (unsigned char)v;
+#else
+      p[0] = (unsigned char)v;
+      p[1] = (unsigned char)(v >> 8);
+      p[2] = (unsigned char)(v >> 16);
+#endif
+      return;
+    default:
+      memcpy(p, &v, sizeof(v));
+      return;
+  }
+}
+
+// Returns the sample of `width` bytes at p, scaled to the full range of an
+// int32, as audioop does before changing widths.
+static inline int32_t load_sample32(const unsigned char *p, int width) {
+  return (int32_t)((uint32_t)load_sample(p, width) << (32 - 8 * width));
+}
+
+// Runs the statements that follow `width` once for each width, with W, a
+// constant, set to it, so that the compiler specializes the loads and stores
+// in them.
+#define SWITCH_WIDTH(width, ...) \
+  switch (width) {               \
+    case 1: {                    \
+      const int W = 1;           \
+      __VA_ARGS__                \
+    } break;                     \
+    case 2: {                    \
+      const int W = 2;           \
+      __VA_ARGS__                \
+    } break;                     \
+    case 3: {                    \
+      const int W = 3;           \
+      __VA_ARGS__                \
+    } break;                     \
+    default: {                   \
+      const int W = 4;           \
+      __VA_ARGS__                \
+    } break;                     \
+  }
+
+// Rounds a scaled sample as audioop does: clips it to [lo, hi], then rounds
+// down.
+static inline int32_t clip_floor(double x, double lo, double hi) {
+  if (x > hi) {
+    x = hi;
+  } else if (x < lo + 1.0) {
+    x = lo;
+  }
+  // x is now within the range of an int32, so truncating and correcting
+  // negative fractions rounds down, without calling floor().
+  int32_t t = (int32_t)x;
+  return t - (x < t);
+}
+
+#ifdef OPS_SSE2
+// Rounds down doubles that are within the range of an int32.
+static inline __m128d floor_pd(__m128d x) {
+  __m128d t = _mm_cvtepi32_pd(_mm_cvttpd_epi32(x));
+  return _mm_sub_pd(t, _mm_and_pd(_mm_cmplt_pd(x, t), _mm_set1_pd(1.0)));
+}
+
+// Converts four int32 to two pairs of doubles.
+static inline void epi32_to_pd(__m128i v, __m128d *a, __m128d *b) {
+  *a = _mm_cvtepi32_pd(v);
+  *b = _mm_cvtepi32_pd(_mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+}
+
+// Rounds two pairs of doubles as clip_floor does, to four int32.
+static inline __m128i clip_floor_pd(__m128d a, __m128d b, __m128d lo,
+                                    __m128d hi) {
+  a = floor_pd(_mm_min_pd(_mm_max_pd(a, lo), hi));
+  b = floor_pd(_mm_min_pd(_mm_max_pd(b, lo), hi));
+  return _mm_unpacklo_epi64(_mm_cvttpd_epi32(a), _mm_cvttpd_epi32(b));
+}
+
+// Scales four int32 by a factor, rounding as clip_floor does.
+static inline __m128i scale_epi32(__m128i v, __m128d factor, __m128d lo,
+                                  __m128d hi) {
+  __m128d a, b;
+  epi32_to_pd(v, &a, &b);
+  return clip_floor_pd(_mm_mul_pd(a, factor), _mm_mul_pd(b, factor), lo, hi);
+}
+
+// Sign-extends the low and high four of eight int16.
+static inline __m128i low_epi16_to_epi32(__m128i v) {
+  return _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+}
+
+static inline __m128i high_epi16_to_epi32(__m128i v) {
+  return _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+}
+#endif
+
+// The kernels below work on n samples (or frames, where noted), and neither
+// block nor require the GIL. dst may be the same buffer as the input for
+// add_samples, scale_samples, and convert_width between equal widths;
+// otherwise the buffers must not overlap.
+
+static void add_samples(unsigned char *dst, const unsigned char *a,
+                        const unsigned char *b, size_t n, int width) {
+  size_t i = 0;
+#ifdef OPS_SSE2
+  // Saturating adds clip exactly as the scalar loop does.
+  if (width == 1) {
+    for (; i + 16 <= n; i += 16) {
+      __m128i sum = _mm_adds_epi8(_mm_loadu_si128((const __m128i *)(a + i)),
+                                  _mm_loadu_si128((const __m128i *)(b + i)));
+      _mm_storeu_si128((__m128i *)(dst + i), sum);
+    }
+  } else if (width == 2) {
+    for (; i + 8 <= n; i += 8) {
+      __m128i sum =
+          _mm_adds_epi16(_mm_loadu_si128((const __m128i *)(a + 2 * i)),
+                         _mm_loadu_si128((const __m128i *)(b + 2 * i)));
+      _mm_storeu_si128((__m128i *)(dst + 2 * i), sum);
+    }
+  }
+#endif
+  int64_t lo = min_values[width];
+  int64_t hi = max_values[width];
+  SWITCH_WIDTH(width, for (; i < n; i++) {
+    int64_t sum =
+        (int64_t)load_sample(a + i * W, W) + load_sample(b + i * W, W);
+    store_sample(dst + i * W, W,
+                 (int32_t)(sum > hi ? hi : sum < lo ? lo : sum));
+  })
+}
+
+static void scale_samples(unsigned char *dst, const unsigned char *src,
+                          size_t n, int width, double factor) {
+  size_t i = 0;
+  double lo = min_values[width];
+  double hi = max_values[width];
+#ifdef OPS_SSE2
+  if (width == 2) {
+    __m128d f = _mm_set1_pd(factor);
+    __m128d lo2 = _mm_set1_pd(lo);
+    __m128d hi2 = _mm_set1_pd(hi);
+    for (; i + 8 <= n; i += 8) {
+      __m128i v = _mm_loadu_si128((const __m128i *)(src + 2 * i));
+      __m128i low = scale_epi32(low_epi16_to_epi32(v), f, lo2, hi2);
+      __m128i high = scale_epi32(high_epi16_to_epi32(v), f, lo2, hi2);
+      _mm_storeu_si128((__m128i *)(dst + 2 * i), _mm_packs_epi32(low, high));
+    }
+  }
+#endif
+  SWITCH_WIDTH(width, for (; i < n; i++) {
+    double v = load_sample(src + i * W, W);
+    store_sample(dst + i * W, W, clip_floor(v * factor, lo, hi));
+  })
+}
+
+static double sum_squares(const unsigned char *src, size_t n, int width) {
+  size_t i = 0;
+  double sum = 0;
+#ifdef OPS_SSE2
+  if (width == 2) {
+    // Each pair of squares fits in a uint32, and their sum in a uint64
+    // (exactly, unlike the double sums of the scalar loop, which round once
+    // they pass 2^53).
+    __m128i zero = _mm_setzero_si128();
+    __m128i acc = zero;
+    for (; i + 8 <= n; i += 8) {
+      __m128i v = _mm_loadu_si128((const __m128i *)(src + 2 * i));
+      __m128i squares = _mm_madd_epi16(v, v);
+      acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(squares, zero));
+      acc = _mm_add_epi64(acc, _mm_unpackhi_epi32(squares, zero));
+    }
+    uint64_t lanes[2];
+    _mm_storeu_si128((__m128i *)lanes, acc);
+    sum = (double)(lanes[0] + lanes[1]);
+  }
+#endif
+  if (width == 1) {
+    // 8-bit squares sum exactly in an int64, in a loop that the compiler
+    // vectorizes.
+    int64_t total = 0;
+    for (; i < n; i++) {
+      int32_t v = (int8_t)src[i];
+      total += v * v;
+    }
+    sum = (double)total;
+  }
+  SWITCH_WIDTH(width, for (; i < n; i++) {
+    double v = load_sample(src + i * W, W);
+    sum += v * v;
+  })
+  return sum;
+}
+
+static uint32_t max_magnitude(const unsigned char *src, size_t n, int width) {
+  size_t i = 0;
+  uint32_t max = 0;
+#ifdef OPS_SSE2
+  if (width == 2 && n >= 8) {
+    __m128i high = _mm_setzero_si128();
+    __m128i low = high;
+    for (; i + 8 <= n; i += 8) {
+      __m128i v = _mm_loadu_si128((const __m128i *)(src + 2 * i));
+      high = _mm_max_epi16(high, v);
+      low = _mm_min_epi16(low, v);
+    }
+    int16_t highs[8], lows[8];
+    _mm_storeu_si128((__m128i *)highs, high);
+    _mm_storeu_si128((__m128i *)lows, low);
+    for (int k = 0; k < 8; k++) {
+      if ((uint32_t)highs[k] > max) {
+        max = (uint32_t)highs[k];
+      }
+      if ((uint32_t)-lows[k] > max) {
+        max = (uint32_t)-lows[k];
+      }
+    }
+  }
+#endif
+  SWITCH_WIDTH(width, for (; i < n; i++) {
+    int32_t v = load_sample(src + i * W, W);
+    uint32_t magnitude = v < 0 ? 0u - (uint32_t)v : (uint32_t)v;
+    if (magnitude > max) {
+      max = magnitude;
+    }
+  })
+  return max;
+}
+
+// Changes the width of samples, keeping their top bits, as audioop does:
+// narrowing truncates, and widening pads with zeros.
+static void convert_width(unsigned char *dst, const unsigned char *src,
+                          size_t n, int width, int new_width) {
+  size_t i = 0;
+#ifdef OPS_SSE2
+  if (width == 2 && new_width == 4) {
+    __m128i zero = _mm_setzero_si128();
+    for (; i + 8 <= n; i += 8) {
+      __m128i v = _mm_loadu_si128((const __m128i *)(src + 2 * i));
+      _mm_storeu_si128((__m128i *)(dst + 4 * i), _mm_unpacklo_epi16(zero, v));
+      _mm_storeu_si128((__m128i *)(dst + 4 * i + 16),
+                       _mm_unpackhi_epi16(zero, v));
+    }
+  } else if (width == 4 && new_width == 2) {
+    for (; i + 8 <= n; i += 8) {
+      __m128i a = _mm_srai_epi32(
+          _mm_loadu_si128((const __m128i *)(src + 4 * i)), 16);
+      __m128i b = _mm_srai_epi32(
+          _mm_loadu_si128((const __m128i *)(src + 4 * i + 16)), 16);
+      _mm_storeu_si128((__m128i *)(dst + 2 * i), _mm_packs_epi32(a, b));
+    }
+  }
+#endif
+  int shift = 32 - 8 * new_width;
+  SWITCH_WIDTH(width, for (; i < n; i++) {
+    store_sample(dst + i * new_width, new_width,
+                 load_sample32(src + i * W, W) >> shift);
+  })
+}
+
+#ifdef OPS_SSE2
+// Mixes four frames of 16-bit stereo samples, one per 32-bit lane, to mono.
+static inline __m128i mix_frames(__m128i v, __m128d left_factor,
+                                 __m128d right_factor, __m128d lo,
+                                 __m128d hi) {
+  __m128d l0, l1, r0, r1;
+  epi32_to_pd(_mm_srai_epi32(_mm_slli_epi32(v, 16), 16), &l0, &l1);
+  epi32_to_pd(_mm_srai_epi32(v, 16), &r0, &r1);
+  return clip_floor_pd(
+      _mm_add_pd(_mm_mul_pd(l0, left_factor), _mm_mul_pd(r0, right_factor)),
+      _mm_add_pd(_mm_mul_pd(l1, left_factor), _mm_mul_pd(r1, right_factor)),
+      lo, hi);
+}
+#endif
+
+// Mixes n stereo frames to mono.
+static void to_mono(unsigned char *dst, const unsigned char *src, size_t n,
+                    int width, double left_factor, double right_factor) {
+  size_t i = 0;
+  double lo = min_values[width];
+  double hi = max_values[width];
+#ifdef OPS_SSE2
+  if (width == 2) {
+    __m128d lf = _mm_set1_pd(left_factor);
+    __m128d rf = _mm_set1_pd(right_factor);
+    __m128d lo2 = _mm_set1_pd(lo);
+    __m128d hi2 = _mm_set1_pd(hi);
+    for (; i + 8 <= n; i += 8) {
+      __m128i a = mix_frames(_mm_loadu_si128((const __m128i *)(src + 4 * i)),
+                             lf, rf, lo2, hi2);
+      __m128i b =
+          mix_frames(_mm_loadu_si128((const __m128i *)(src + 4 * i + 16)), lf,
+                     rf, lo2, hi2);
+      _mm_storeu_si128((__m128i *)(dst + 2 * i), _mm_packs_epi32(a, b));
+    }
+  }
+#endif
+  SWITCH_WIDTH(width, for (; i < n; i++) {
+    double left = load_sample(src + 2 * i * W, W);
+    double right = load_sample(src + (2 * i + 1) * W, W);
+    store_sample(dst + i * W, W,
+                 clip_floor(left * left_factor + right * right_factor, lo, hi));
+  })
+}
+
+// Spreads n mono samples to stereo frames.
+static void to_stereo(unsigned char *dst, const unsigned char *src, size_t n,
+                      int width, double left_factor, double right_factor) {
+  size_t i = 0;
+  double lo = min_values[width];
+  double hi = max_values[width];
+#ifdef OPS_SSE2
+  if (width == 2) {
+    __m128d lf = _mm_set1_pd(left_factor);
+    __m128d rf = _mm_set1_pd(right_factor);
+    __m128d lo2 = _mm_set1_pd(lo);
+    __m128d hi2 = _mm_set1_pd(hi);
+    for (; i + 8 <= n; i += 8) {
+      __m128i v = _mm_loadu_si128((const __m128i *)(src + 2 * i));
+      __m128i low = low_epi16_to_epi32(v);
+      __m128i high = high_epi16_to_epi32(v);
+      __m128i left = _mm_packs_epi32(scale_epi32(low, lf, lo2, hi2),
+                                     scale_epi32(high, lf, lo2, hi2));
+      __m128i right = _mm_packs_epi32(scale_epi32(low, rf, lo2, hi2),
+                                      scale_epi32(high, rf, lo2, hi2));
+      _mm_storeu_si128((__m128i *)(dst + 4 * i),
+                       _mm_unpacklo_epi16(left, right));
+      _mm_storeu_si128((__m128i *)(dst + 4 * i + 16),
+                       _mm_unpackhi_epi16(left, right));
+    }
+  }
+#endif
+  SWITCH_WIDTH(width, for (; i < n; i++) {
+    double v = load_sample(src + i * W, W);
+    store_sample(dst + 2 * i * W, W, clip_floor(v * left_factor, lo, hi));
+    store_sample(dst + (2 * i + 1) * W, W,
+                 clip_floor(v * right_factor, lo, hi));
+  })
+}
+
+// The u-law segment of each biased magnitude, indexed by its bits above bit
+// 5: the number of those bits, up to the top one.
+static const unsigned char ulaw_segments[128] = {
+    0, 1, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4, 4, 4, 5, 5, 5, 5, 5, 5,
+    5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
+    6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 7, 7,
+    7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7};
+
+// Encodes a sample, scaled to the range of an int32, as u-law (G.711), from
+// its top 14 bits, as audioop does, without branches.
+static inline unsigned char encode_ulaw(int32_t sample) {
+  int v = sample >> 18;
+  int sign = v >> 31;
+  int magnitude = ((v ^ sign) - sign) + (0x84 >> 2);
+  // Magnitudes past the last segment encode as its largest code.
+  magnitude = magnitude < 0x1FFF ? magnitude : 0x1FFF;
+  int segment = ulaw_segments[magnitude >> 6];
+  int code = (segment << 4) | ((magnitude >> (segment + 1)) & 0xF);
+  // u-law inverts all bits, except the sign bit of negative samples.
+  return (unsigned char)(code ^ (0xFF ^ (sign & 0x80)));
+}
+
+static void to_ulaw(unsigned char *dst, const unsigned char *src, size_t n,
+                    int width) {
+  SWITCH_WIDTH(width, for (size_t i = 0; i < n; i++) {
+    dst[i] = encode_ulaw(load_sample32(src + i * W, W));
+  })
+}
+
+// audioop's sample-rate conversion: linear interpolation between consecutive
+// input frames, optionally smoothed by a one-pole filter with weights
+// weight_a (current frame) and weight_b (previous frame). *d is the position
+// of the next output frame relative to the latest input frame, in units of
+// 1 / (in_rate * out_rate) of the (reduced) rates' common period; prev and
+// cur hold each channel's last two input samples, scaled to int32. All three
+// carry over between calls. Returns the number of bytes written to dst.
+static size_t convert_rate(unsigned char *dst, const unsigned char *src,
+                           size_t frames, int width, int channels, int in_rate,
+                           int out_rate, int weight_a, int weight_b, int *d,
+                           int *prev, int *cur) {
+  unsigned char *out = dst;
+  int shift = 32 - 8 * width;
+  int position = *d;
+  for (;;) {
+    while (position < 0) {
+      if (frames == 0) {
+        *d = position;
+        return (size_t)(out - dst);
+      }
+      for (int c = 0; c < channels; c++) {
+        prev[c] = cur[c];
+        cur[c] = load_sample32(src, width);
+        src += width;
+        if (weight_b) {
+          cur[c] = (int)(((double)weight_a * (double)cur[c] +
+                          (double)weight_b * (double)prev[c]) /
+                         ((double)weight_a + (double)weight_b));
+        }
+      }
+      frames--;
+      position += out_rate;
+    }
+    while (position >= 0) {
+      for (int c = 0; c < channels; c++) {
+        int v = (int)(((double)prev[c] * (double)position +
+                       (double)cur[c] * (double)(out_rate - position)) /
+                      (double)out_rate);
+        store_sample(out, width, v >> shift);
+        out += width;
+      }
+      position -= in_rate;
+    }
+  }
+}
+
+static int gcd(int a, int b) {
+  while (b > 0) {
+    int t = a % b;
+    a = b;
+    b = t;
+  }
+  return a;
+}
+
+// Releases the GIL for inputs of at least MIN_UNLOCKED_BYTES bytes. Returns
+// the state to pass to end_kernel.
+static PyThreadState *begin_kernel(Py_ssize_t size) {
+  return size >= MIN_UNLOCKED_BYTES ? PyEval_SaveThread() : NULL;
+}
+
+static void end_kernel(PyThreadState *save) {
+  if (save) {
+    PyEval_RestoreThread(save);
+  }
+}
+
+// Checks that `width` is a sample width and that `fragment` holds whole
+// frames of `channels` samples. Returns 0 if so, or -1 with an exception set.
+static int check_fragment(const Py_buffer *fragment, int width, int channels) {
+  if (width < 1 || width > 4) {
+    PyErr_SetString(PyExc_ValueError, "Width must be 1, 2, 3 or 4 (bytes)");
+    return -1;
+  }
+  if (fragment->len % ((Py_ssize_t)width * channels) != 0) {
+    PyErr_Format(PyExc_ValueError,
+                 "Data holds %zd bytes, which is not a whole number of "
+                 "frames (of %d bytes each)",
+                 fragment->len, width * channels);
+    return -1;
+  }
+  return 0;
+}
+
+// Where a function writes its samples: a new bytes object, or the caller's
+// `out` buffer.
+typedef struct {
+  PyObject *object;
+  Py_buffer view;
+  unsigned char *buf;
+} Output;
+
+// Sets up `output` for a result of `size` bytes, in `out` unless it is NULL
+// or None. Returns 0 on success, or -1 with an exception set.
+static int init_output(Output *output, PyObject *out, Py_ssize_t size) {
+  output->view.obj = NULL;
+  if (out == NULL || out == Py_None) {
+    output->object = PyBytes_FromStringAndSize(NULL, size);
+    if (!output->object) {
+      return -1;
+    }
+    output->buf = (unsigned char *)PyBytes_AS_STRING(output->object);
+    return 0;
+  }
+
+  if (PyObject_GetBuffer(out, &output->view, PyBUF_WRITABLE) < 0) {
+    return -1;
+  }
+  if (output->view.len != size) {
+    PyErr_Format(PyExc_ValueError,
+                 "out holds %zd bytes, but the result takes %zd",
+                 output->view.len, size);
+    PyBuffer_Release(&output->view);
+    return -1;
+  }
+  Py_INCREF(out);
+  output->object = out;
+  output->buf = (unsigned char *)output->view.buf;
+  return 0;
+}
+
+// Returns the result: the new bytes object, or `out`.
+static PyObject *finish_output(Output *output) {
+  if (output->view.obj) {
+    PyBuffer_Release(&output->view);
+  }
+  return output->object;
+}
+
+PyDoc_STRVAR(
+    ops_add_doc,
+    "add($module, fragment1, fragment2, width, /, *, out=None)\n"
+    "--\n"
+    "\n"
+    "Returns the sums of the samples of two fragments of the same length,\n"
+    "clipped to the range of `width`-byte samples. `out` may be one of the\n"
+    "fragments.");
+
+static PyObject *ops_add(PyObject *self, PyObject *args, PyObject *kwargs) {
+  static char *kwlist[] = {"", "", "", "out", NULL};
+  Py_buffer a, b;
+  int width;
+  PyObject *out = NULL;
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "y*y*i|$O:add", kwlist, &a,
+                                   &b, &width, &out)) {
+    return NULL;
+  }
+
+  Output output;
+  if (check_fragment(&a, width, 1) < 0) {
+    PyBuffer_Release(&a);
+    PyBuffer_Release(&b);
+    return NULL;
+  }
+  if (a.len != b.len) {
+    PyBuffer_Release(&a);
+    PyBuffer_Release(&b);
+    PyErr_SetString(PyExc_ValueError, "Fragments must be the same length");
+    return NULL;
+  }
+  if (init_output(&output, out, a.len) < 0) {
+    PyBuffer_Release(&a);
+    PyBuffer_Release(&b);
+    return NULL;
+  }
+
+  PyThreadState *save = begin_kernel(a.len);
+  add_samples(output.buf, (const unsigned char *)a.buf,
+              (const unsigned char *)b.buf, (size_t)(a.len / width), width);
+  end_kernel(save);
+  PyBuffer_Release(&a);
+  PyBuffer_Release(&b);
+  return finish_output(&output);
+}
+
+PyDoc_STRVAR(
+    ops_mul_doc,
+    "mul($module, fragment, width, factor, /, *, out=None)\n"
+    "--\n"
+    "\n"
+    "Returns the samples multiplied by `factor`, clipped and rounded down.\n"
+    "`out` may be the fragment.");
+
+static PyObject *ops_mul(PyObject *self, PyObject *args, PyObject *kwargs) {
+  static char *kwlist[] = {"", "", "", "out", NULL};
+  Py_buffer fragment;
+  int width;
+  double factor;
+  PyObject *out = NULL;
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "y*id|$O:mul", kwlist,
+                                   &fragment, &width, &factor, &out)) {
+    return NULL;
+  }
+
+  Output output;
+  if (check_fragment(&fragment, width, 1) < 0 ||
+      init_output(&output, out, fragment.len) < 0) {
+    PyBuffer_Release(&fragment);
+    return NULL;
+  }
+
+  PyThreadState *save = begin_kernel(fragment.len);
+  scale_samples(output.buf, (const unsigned char *)fragment.buf,
+                (size_t)(fragment.len / width), width, factor);
+  end_kernel(save);
+  PyBuffer_Release(&fragment);
+  return finish_output(&output);
+}
+
+PyDoc_STRVAR(ops_rms_doc,
+             "rms($module, fragment, width, /)\n"
+             "--\n"
+             "\n"
+             "Returns the root-mean-square of the samples, rounded down.");
+
+static PyObject *ops_rms(PyObject *self, PyObject *args) {
+  Py_buffer fragment;
+  int width;
+  if (!PyArg_ParseTuple(args, "y*i:rms", &fragment, &width)) {
+    return NULL;
+  }
+  if (check_fragment(&fragment, width, 1) < 0) {
+    PyBuffer_Release(&fragment);
+    return NULL;
+  }
+
+  size_t n = (size_t)(fragment.len / width);
+  PyThreadState *save = begin_kernel(fragment.len);
+  double sum = sum_squares((const unsigned char *)fragment.buf, n, width);
+  end_kernel(save);
+  PyBuffer_Release(&fragment);
+  return PyLong_FromUnsignedLong(
+      n ? (unsigned long)(unsigned int)sqrt(sum / (double)n) : 0);
+}
+
+PyDoc_STRVAR(ops_max_doc,
+             "max($module, fragment, width, /)\n"
+             "--\n"
+             "\n"
+             "Returns the largest magnitude of the samples.");
+
+static PyObject *ops_max(PyObject *self, PyObject *args) {
+  Py_buffer fragment;
+  int width;
+  if (!PyArg_ParseTuple(args, "y*i:max", &fragment, &width)) {
+    return NULL;
+  }
+  if (check_fragment(&fragment, width, 1) < 0) {
+    PyBuffer_Release(&fragment);
+    return NULL;
+  }
+
+  PyThreadState *save = begin_kernel(fragment.len);
+  uint32_t max = max_magnitude((const unsigned char *)fragment.buf,
+                               (size_t)(fragment.len / width), width);
+  end_kernel(save);
+  PyBuffer_Release(&fragment);
+  return PyLong_FromUnsignedLong(max);
+}
+
+PyDoc_STRVAR(
+    ops_lin2lin_doc,
+    "lin2lin($module, fragment, width, newwidth, /, *, out=None)\n"
+    "--\n"
+    "\n"
+    "Returns the samples converted to `newwidth` bytes each, keeping their\n"
+    "most significant bits. `out` may be the fragment if the widths are\n"
+    "equal.");
+
+static PyObject *ops_lin2lin(PyObject *self, PyObject *args,
+                             PyObject *kwargs) {
+  static char *kwlist[] = {"", "", "", "out", NULL};
+  Py_buffer fragment;
+  int width, new_width;
+  PyObject *out = NULL;
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "y*ii|$O:lin2lin", kwlist,
+                                   &fragment, &width, &new_width, &out)) {
+    return NULL;
+  }
+
+  Output output;
+  if (check_fragment(&fragment, width, 1) < 0) {
+    PyBuffer_Release(&fragment);
+    return NULL;
+  }
+  if (new_width < 1 || new_width > 4) {
+    PyBuffer_Release(&fragment);
+    PyErr_SetString(PyExc_ValueError, "Width must be 1, 2, 3 or 4 (bytes)");
+    return NULL;
+  }
+  Py_ssize_t n = fragment.len / width;
+  if (n > PY_SSIZE_T_MAX / new_width) {
+    PyBuffer_Release(&fragment);
+    return PyErr_NoMemory();
+  }
+  if (init_output(&output, out, n * new_width) < 0) {
+    PyBuffer_Release(&fragment);
+    return NULL;
+  }
+
+  PyThreadState *save = begin_kernel(fragment.len);
+  convert_width(output.buf, (const unsigned char *)fragment.buf, (size_t)n,
+                width, new_width);
+  end_kernel(save);
+  PyBuffer_Release(&fragment);
+  return finish_output(&output);
+}
+
+PyDoc_STRVAR(
+    ops_tomono_doc,
+    "tomono($module, fragment, width, lfactor, rfactor, /, *, out=None)\n"
+    "--\n"
+    "\n"
+    "Returns the mono samples lfactor * left + rfactor * right of stereo\n"
+    "frames, clipped and rounded down.");
+
+static PyObject *ops_tomono(PyObject *self, PyObject *args,
+                            PyObject *kwargs) {
+  static char *kwlist[] = {"", "", "", "", "out", NULL};
+  Py_buffer fragment;
+  int width;
+  double left_factor, right_factor;
+  PyObject *out = NULL;
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "y*idd|$O:tomono", kwlist,
+                                   &fragment, &width, &left_factor,
+                                   &right_factor, &out)) {
+    return NULL;
+  }
+
+  Output output;
+  if (check_fragment(&fragment, width, 2) < 0 ||
+      init_output(&output, out, fragment.len / 2) < 0) {
+    PyBuffer_Release(&fragment);
+    return NULL;
+  }
+
+  PyThreadState *save = begin_kernel(fragment.len);
+  to_mono(output.buf, (const unsigned char *)fragment.buf,
+          (size_t)(fragment.len / (2 * width)), width, left_factor,
+          right_factor);
+  end_kernel(save);
+  PyBuffer_Release(&fragment);
+  return finish_output(&output);
+}
+
+PyDoc_STRVAR(
+    ops_tostereo_doc,
+    "tostereo($module, fragment, width, lfactor, rfactor, /, *, out=None)\n"
+    "--\n"
+    "\n"
+    "Returns stereo frames of each mono sample times `lfactor` and times\n"
+    "`rfactor`, clipped and rounded down.");
+
+static PyObject *ops_tostereo(PyObject *self, PyObject *args,
+                              PyObject *kwargs) {
+  static char *kwlist[] = {"", "", "", "", "out", NULL};
+  Py_buffer fragment;
+  int width;
+  double left_factor, right_factor;
+  PyObject *out = NULL;
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "y*idd|$O:tostereo", kwlist,
+                                   &fragment, &width, &left_factor,
+                                   &right_factor, &out)) {
+    return NULL;
+  }
+
+  Output output;
+  if (check_fragment(&fragment, width, 1) < 0) {
+    PyBuffer_Release(&fragment);
+    return NULL;
+  }
+  if (fragment.len > PY_SSIZE_T_MAX / 2) {
+    PyBuffer_Release(&fragment);
+    return PyErr_NoMemory();
+  }
+  if (init_output(&output, out, fragment.len * 2) < 0) {
+    PyBuffer_Release(&fragment);
+    return NULL;
+  }
+
+  PyThreadState *save = begin_kernel(fragment.len);
+  to_stereo(output.buf, (const unsigned char *)fragment.buf,
+            (size_t)(fragment.len / width), width, left_factor,
+            right_factor);
+  end_kernel(save);
+  PyBuffer_Release(&fragment);
+  return finish_output(&output);
+}
+
+PyDoc_STRVAR(ops_lin2ulaw_doc,
+             "lin2ulaw($module, fragment, width, /, *, out=None)\n"
+             "--\n"
+             "\n"
+             "Returns the samples encoded as u-law (G.711), one byte each.");
+
+static PyObject *ops_lin2ulaw(PyObject *self, PyObject *args,
+                              PyObject *kwargs) {
+  static char *kwlist[] = {"", "", "out", NULL};
+  Py_buffer fragment;
+  int width;
+  PyObject *out = NULL;
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "y*i|$O:lin2ulaw", kwlist,
+                                   &fragment, &width, &out)) {
+    return NULL;
+  }
+
+  Output output;
+  if (check_fragment(&fragment, width, 1) < 0 ||
+      init_output(&output, out, fragment.len / width) < 0) {
+    PyBuffer_Release(&fragment);
+    return NULL;
+  }
+
+  PyThreadState *save = begin_kernel(fragment.len);
+  to_ulaw(output.buf, (const unsigned char *)fragment.buf,
+          (size_t)(fragment.len / width), width);
+  end_kernel(save);
+  PyBuffer_Release(&fragment);
+  return finish_output(&output);
+}
+
+PyDoc_STRVAR(
+    ops_ratecv_doc,
+    "ratecv($module, fragment, width, nchannels, inrate, outrate, state,\n"
+    "       weightA=1, weightB=0, /)\n"
+    "--\n"
+    "\n"
+    "Converts the frames from `inrate` to `outrate` by linear\n"
+    "interpolation. Returns (samples, new_state); pass None as the state of\n"
+    "the first fragment, and new_state as the state of the next.");
+
+static PyObject *ops_ratecv(PyObject *self, PyObject *args) {
+  Py_buffer fragment;
+  int width, channels, in_rate, out_rate, weight_a = 1, weight_b = 0;
+  PyObject *state;
+  if (!PyArg_ParseTuple(args, "y*iiiiO|ii:ratecv", &fragment, &width,
+                        &channels, &in_rate, &out_rate, &state, &weight_a,
+                        &weight_b)) {
+    return NULL;
+  }
+
+  PyObject *rv = NULL;
+  PyObject *samples = NULL;
+  int *history = NULL;
+  if (width < 1 || width > 4) {
+    PyErr_SetString(PyExc_ValueError, "Width must be 1, 2, 3 or 4 (bytes)");
+    goto done;
+  }
+  if (channels < 1) {
+    PyErr_SetString(PyExc_ValueError, "Channels must be at least 1");
+    goto done;
+  }
+  if (width > INT_MAX / channels) {
+    PyErr_SetString(PyExc_OverflowError,
+                    "width * nchannels too big for a C int");
+    goto done;
+  }
+  if (check_fragment(&fragment, width, channels) < 0) {
+    goto done;
+  }
+  if (weight_a < 1 || weight_b < 0) {
+    PyErr_SetString(PyExc_ValueError,
+                    "weightA must be at least 1, and weightB at least 0");
+    goto done;
+  }
+  if (in_rate <= 0 || out_rate <= 0) {
+    PyErr_SetString(PyExc_ValueError, "Sample rates must be positive");
+    goto done;
+  }
+
+  int common = gcd(in_rate, out_rate);
+  in_rate /= common;
+  out_rate /= common;
+  common = gcd(weight_a, weight_b);
+  weight_a /= common;
+  weight_b /= common;
+
+  history = (int *)PyMem_Calloc((size_t)channels * 2, sizeof(int));
+  if (!history) {
+    PyErr_NoMemory();
+    goto done;
+  }
+  int *prev = history;
+  int *cur = history + channels;
+  int d = -out_rate;
+  if (state != Py_None) {
+    PyObject *channel_states;
+    if (!PyTuple_Check(state)) {
+      PyErr_SetString(PyExc_TypeError, "state must be a tuple or None");
+      goto done;
+    }
+    if (!PyArg_ParseTuple(state, "iO!;ratecv(): illegal state argument", &d,
+                          &PyTuple_Type, &channel_states)) {
+      goto done;
+    }
+    // The position is negative between calls. Larger positions would
+    // produce more frames than the output holds.
+    if (d >= 0 || PyTuple_GET_SIZE(channel_states) != channels) {
+      PyErr_SetString(PyExc_ValueError, "ratecv(): illegal state argument");
+      goto done;
+    }
+    for (int c = 0; c < channels; c++) {
+      if (!PyArg_ParseTuple(PyTuple_GET_ITEM(channel_states, c),
+                            "ii;ratecv(): illegal state argument", &prev[c],
+                            &cur[c])) {
+        goto done;
+      }
+    }
+  }
+
+  // Each input frame advances the position by out_rate, and each output
+  // frame moves it back by in_rate, so n input frames produce at most
+  // ceil(n * out_rate / in_rate) output frames.
+  Py_ssize_t frame_size = (Py_ssize_t)width * channels;
+  Py_ssize_t frames = fragment.len / frame_size;
+  Py_ssize_t size = 0;
+  if (frames > 0) {
+    Py_ssize_t q = 1 + (frames - 1) / in_rate;
+    if (out_rate > PY_SSIZE_T_MAX / q / frame_size) {
+      PyErr_NoMemory();
+      goto done;
+    }
+    size = q * out_rate * frame_size;
+  }
+  rv = PyBytes_FromStringAndSize(NULL, size);
+  if (!rv) {
+    goto done;
+  }
+
+  PyThreadState *save = begin_kernel(fragment.len);
+  size = (Py_ssize_t)convert_rate(
+      (unsigned char *)PyBytes_AS_STRING(rv),
+      (const unsigned char *)fragment.buf, (size_t)frames, width, channels,
+      in_rate, out_rate, weight_a, weight_b, &d, prev, cur);
+  end_kernel(save);
+  if (_PyBytes_Resize(&rv, size) < 0) {
+    goto done;
+  }
+
+  samples = PyTuple_New(channels);
+  if (!samples) {
+    Py_CLEAR(rv);
+    goto done;
+  }
+  for (int c = 0; c < channels; c++) {
+    PyObject *sample = Py_BuildValue("(ii)", prev[c], cur[c]);
+    if (!sample) {
+      Py_CLEAR(rv);
+      goto done;
+    }
+    PyTuple_SET_ITEM(samples, c, sample);
+  }
+  Py_SETREF(rv, Py_BuildValue("(O(iO))", rv, d, samples));
+
+done:
+  Py_XDECREF(samples);
+  PyMem_Free(history);
+  PyBuffer_Release(&fragment);
+  return rv;
+}
+
+static PyMethodDef ops_functions[] = {
+    {"add", (PyCFunction)ops_add, METH_VARARGS | METH_KEYWORDS, ops_add_doc},
+
+    {"mul", (PyCFunction)ops_mul, METH_VARARGS | METH_KEYWORDS, ops_mul_doc},
+
+    {"rms", ops_rms, METH_VARARGS, ops_rms_doc},
+
+    {"max", ops_max, METH_VARARGS, ops_max_doc},
+
+    {"lin2lin", (PyCFunction)ops_lin2lin, METH_VARARGS | METH_KEYWORDS,
+     ops_lin2lin_doc},
+
+    {"ratecv", ops_ratecv, METH_VARARGS, ops_ratecv_doc},
+
+    {"tomono", (PyCFunction)ops_tomono, METH_VARARGS | METH_KEYWORDS,
+     ops_tomono_doc},
+
+    {"tostereo", (PyCFunction)ops_tostereo, METH_VARARGS | METH_KEYWORDS,
+     ops_tostereo_doc},
+
+    {"lin2ulaw", (PyCFunction)ops_lin2ulaw, METH_VARARGS | METH_KEYWORDS,
+     ops_lin2ulaw_doc},
+
+    {NULL, NULL, 0, NULL}};
+
+int PyAudioOps_AddModule(PyObject *m) {
+  PyObject *ops = PyModule_New("pyaudio._portaudio.ops");
+  if (!ops) {
+    return -1;
+  }
+  if (PyModule_AddFunctions(ops, ops_functions) < 0 ||
+      PyModule_SetDocString(ops, "Sample operations, in place of audioop") <
+          0 ||
+      PyModule_AddObject(m, "ops", ops) < 0) {
+    Py_DECREF(ops);
+    return -1;
+  }
+  return 0;
+}
@@ -0,0 +1,23 @@
+// Sample operations on raw buffers of signed, native-endian integer samples,
+// 1, 2, 3 or 4 bytes wide, with the semantics of the standard library's
+// audioop module (which Python 3.13 removed), so that code can switch from
+// one to the other. The functions accept any C-contiguous buffer-protocol
+// object, those that produce samples can write them into a caller's buffer
+// instead of allocating one, and the common 16-bit cases run SSE2 loops when
+// the compiler targets it. They live in a submodule, pyaudio._portaudio.ops,
+// which pyaudio/ops.py exports.
+
+#ifndef OPS_H_
+#define OPS_H_
+
+#ifndef PY_SSIZE_T_CLEAN
+#define PY_SSIZE_T_CLEAN
+#endif
+#include "Python.h"
+#include "portaudio.h"
+
+// Creates the ops submodule and adds it to m, as m.ops. Returns 0 on success,
+// or -1 with an exception set.
+int PyAudioOps_AddModule(PyObject *m);
+
+#endif  // OPS_H_
@@ -0,0 +1,79 @@
+# PyAudio : Python Bindings for PortAudio.
+#
+# Copyright (c) 2006 Hubert Pham
+#
+# Permission is hereby granted, free of charge, to any person obtaining
+# a copy of this software and associated documentation files (the
+# "Software"), to deal in the Software without restriction, including
+# without limitation the rights to use, copy, modify, merge, publish,
+# distribute, sublicense, and/or sell copies of the Software, and to
+# permit persons to whom the Software is furnished to do so, subject to
+# the following conditions:
+#
+# The above copyright notice and this permission notice shall be
+# included in all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+# EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+# MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+# NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+# LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+# OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+# WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+"""
+Native sample operations on raw audio fragments, in place of the standard
+library's ``audioop`` module, which Python 3.13 removed.
+
+The functions take the same arguments as their ``audioop`` namesakes and
+return the same results: fragments of signed, native-endian integer
+samples, `width` bytes each (1, 2, 3 or 4; note that 1-byte samples are
+signed, unlike :py:data:`pyaudio.paUInt8`), with interleaved channels.
+Code that used ``audioop`` can switch with::
+
+    from pyaudio import ops as audioop
+
+Beyond ``audioop``:
+
+- Fragments may be any C-contiguous buffer-protocol object (``bytes``,
+  ``bytearray``, ``memoryview``, ``array.array``, NumPy arrays, ...).
+- The functions that return samples take a keyword-only `out` argument: a
+  writable buffer of exactly the size of the result, which they fill and
+  return instead of allocating a new ``bytes`` object. :py:func:`add`,
+  :py:func:`mul`, and :py:func:`lin2lin` between equal widths can work in
+  place (`out` may be an input); otherwise `out` must not overlap the input.
+- 16-bit samples, the common case, run vectorized (SSE2) loops, and large
+  fragments run without the GIL.
+- :py:func:`rms` sums 16-bit squares exactly, where ``audioop`` rounded sums
+  past 2^53 (fragments of millions of samples).
+
+Overview
+--------
+
+:py:func:`add`, :py:func:`mul`, :py:func:`rms`, :py:func:`max`,
+:py:func:`lin2lin`, :py:func:`ratecv`, :py:func:`tomono`,
+:py:func:`tostereo`, :py:func:`lin2ulaw`, :py:data:`error`
+"""
+
+try:
+    from pyaudio._portaudio import ops as _ops
+except ImportError:
+    print("Could not import the PyAudio C module 'pyaudio._portaudio'.")
+    raise
+
+__all__ = ['error', 'add', 'mul', 'rms', 'max', 'lin2lin', 'ratecv',
+           'tomono', 'tostereo', 'lin2ulaw']
+
+#: The exception that the functions raise for invalid widths, lengths and
+#: states, as ``audioop.error`` was, so that ``except audioop.error`` clauses
+#: keep working.
+error = ValueError
+
+add = _ops.add
+mul = _ops.mul
+rms = _ops.rms
+max = _ops.max
+lin2lin = _ops.lin2lin
+ratecv = _ops.ratecv
+tomono = _ops.tomono
+tostereo = _ops.tostereo
+lin2ulaw = _ops.lin2ulaw
@@ -0,0 +1,431 @@
+#include "resample.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef PY_SSIZE_T_CLEAN
+#define PY_SSIZE_T_CLEAN
+#endif
+#include "Python.h"
+#include "portaudio.h"
+
+#include "convert.h"
+
+// x86-64 always has SSE2, so use it whenever the compiler targets it.
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RESAMPLE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// The most filter phases to compute. Ratios with larger numerators (e.g.,
+// 44100 Hz to 44099 Hz) interpolate between this many phases instead.
+#define MAX_PHASES 1024
+
+// Frames that PyAudio_Resample converts at a time.
+#define CHUNK_FRAMES 4096
+
+// Filter parameters per quality tier: the zero crossings of the sinc on each
+// side, the cutoff as a fraction of the lower Nyquist frequency, and the beta
+// of the Kaiser window (about 50, 80 and 100 dB of stopband attenuation).
+static const struct {
+  unsigned int zero_crossings;
+  double rolloff;
+  double beta;
+} qualities[] = {
+    {8, 0.85, 5.0},
+    {16, 0.92, 8.0},
+    {32, 0.96, 10.0},
+};
+
+struct PyAudioResampler {
+  unsigned int channels;
+  // The ratio of the rates, to_rate / from_rate, in lowest terms: each output
+  // frame advances the input by down / up frames.
+  unsigned long up;
+  unsigned long down;
+  // Filter taps on each side of an output frame, and in all.
+  unsigned int half_taps;
+  unsigned int num_taps;
+  // num_phases + 1 rows of num_taps coefficients: row p for output frames p
+  // / num_phases of the way from one input frame to the next. The last row
+  // is only for interpolating.
+  unsigned int num_phases;
+  float *filters;
+  // Buffered input, one plane of `capacity` frames per channel, of which the
+  // first `length` frames hold samples.
+  size_t capacity;
+  size_t length;
+  float *input;
+  // Where the next output frame lines up with the input: at input frame
+  // `position`, and `phase` / up of the way to the next.
+  size_t position;
+  unsigned long phase;
+};
+
+static unsigned long gcd(unsigned long a, unsigned long b) {
+  while (b != 0) {
+    unsigned long t = a % b;
+    a = b;
+    b = t;
+  }
+  return a;
+}
+
+// The modified Bessel function of the first kind, of order 0.
+static double bessel_i0(double x) {
+  double sum = 1.0;
+  double term = 1.0;
+  for (int k = 1; k < 50; k++) {
+    term *= (x / (2.0 * k)) * (x / (2.0 * k));
+    sum += term;
+    if (term < sum * 1e-12) {
+      break;
+    }
+  }
+  return sum;
+}
+
+// Fills in the filter rows: a windowed sinc whose cutoff is `scale` times the
+// input's Nyquist frequency, normalized so that each row passes DC at unity
+// gain.
+static void design_filters(PyAudioResampler *resampler, double scale,
+                           double half_width, double beta) {
+  unsigned int num_taps = resampler->num_taps;
+  double i0_beta = bessel_i0(beta);
+  for (unsigned int p = 0; p <= resampler->num_phases; p++) {
+    float *row = resampler->filters + (size_t)p * num_taps;
+    double offset = (double)p / resampler->num_phases;
+    double sum = 0;
+    for (unsigned int k = 0; k < num_taps; k++) {
+      // The distance, in input frames, from the output frame to this tap.
+      double u = offset + resampler->half_taps - 1 - k;
+      double c = 0;
+      if (fabs(u) < half_width) {
+        double x = scale * u;
+        double sinc = x == 0 ? 1.0 : sin(M_PI * x) / (M_PI * x);
+        double r = u / half_width;
+        c = scale * sinc * bessel_i0(beta * sqrt(1.0 - r * r)) / i0_beta;
+      }
+      row[k] = (float)c;
+      sum += c;
+    }
+    if (sum != 0) {
+      for (unsigned int k = 0; k < num_taps; k++) {
+        row[k] = (float)(row[k] / sum);
+      }
+    }
+  }
+}
+
+PyAudioResampler *PyAudioResampler_New(unsigned long from_rate,
+                                       unsigned long to_rate,
+                                       unsigned int channels, int quality,
+                                       size_t max_write_frames) {
+  PyAudioResampler *resampler =
+      (PyAudioResampler *)calloc(1, sizeof(PyAudioResampler));
+  if (!resampler) {
+    return NULL;
+  }
+
+  unsigned long divisor = gcd(from_rate, to_rate);
+  resampler->channels = channels;
+  resampler->up = to_rate / divisor;
+  resampler->down = from_rate / divisor;
+  resampler->num_phases =
+      resampler->up <= MAX_PHASES ? (unsigned int)resampler->up : MAX_PHASES;
+
+  // Downsampling lowers the cutoff to the output's Nyquist frequency, which
+  // stretches the filter over more input frames.
+  double scale = (to_rate < from_rate ? (double)to_rate / from_rate : 1.0) *
+                 qualities[quality].rolloff;
+  double half_width = qualities[quality].zero_crossings / scale;
+  resampler->half_taps = (unsigned int)ceil(half_width);
+  resampler->num_taps = 2 * resampler->half_taps;
+
+  // Room for the input that a write can add to what the previous read left.
+  resampler->capacity = max_write_frames + 2 * (size_t)resampler->num_taps;
+  resampler->filters = (float *)malloc((size_t)(resampler->num_phases + 1) *
+                                       resampler->num_taps * sizeof(float));
+  resampler->input =
+      (float *)malloc(resampler->capacity * channels * sizeof(float));
+  if (!resampler->filters || !resampler->input) {
+    PyAudioResampler_Free(resampler);
+    return NULL;
+  }
+
+  design_filters(resampler, scale, half_width, qualities[quality].beta);
+  PyAudioResampler_Reset(resampler);
+  return resampler;
+}
+
+void PyAudioResampler_Free(PyAudioResampler *resampler) {
+  if (!resampler) {
+    return;
+  }
+  free(resampler->filters);
+  free(resampler->input);
+  free(resampler);
+}
+
+void PyAudioResampler_Reset(PyAudioResampler *resampler) {
+  // Start with silence before the first frame, so that the first output frame
+  // lines up with the first input frame.
+  size_t silence = resampler->half_taps - 1;
+  for (unsigned int c = 0; c < resampler->channels; c++) {
+    memset(resampler->input + c * resampler->capacity, 0,
+           silence * sizeof(float));
+  }
+  resampler->length = silence;
+  resampler->position = silence;
+  resampler->phase = 0;
+}
+
+// Drops the input that no output frame needs anymore.
+static void compact(PyAudioResampler *resampler) {
+  size_t start = resampler->position - (resampler->half_taps - 1);
+  size_t drop = start < resampler->length ? start : resampler->length;
+  if (drop == 0) {
+    return;
+  }
+  size_t keep = resampler->length - drop;
+  for (unsigned int c = 0; c < resampler->channels; c++) {
+    float *plane = resampler->input + c * resampler->capacity;
+    memmove(plane, plane + drop, keep * sizeof(float));
+  }
+  resampler->length = keep;
+  resampler->position -= drop;
+}
+
+size_t PyAudioResampler_Write(PyAudioResampler *resampler, const float *input,
+                              size_t frames) {
+  compact(resampler);
+  size_t room = resampler->capacity - resampler->length;
+  if (frames > room) {
+    frames = room;
+  }
+  // Deinterleave, so that each output sample is one contiguous dot product.
+  unsigned int channels = resampler->channels;
+  for (unsigned int c = 0; c < channels; c++) {
+    float *plane = resampler->input + c * resampler->capacity +
+                   resampler->length;
+    for (size_t i = 0; i < frames; i++) {
+      plane[i] = input[i * channels + c];
+    }
+  }
+  resampler->length += frames;
+  return frames;
+}
+
+static float dot(const float *a, const float *b, unsigned int n) {
+  unsigned int i = 0;
+#ifdef RESAMPLE_SSE2
+  __m128 acc0 = _mm_setzero_ps();
+  __m128 acc1 = _mm_setzero_ps();
+  for (; i + 8 <= n; i += 8) {
+    acc0 = _mm_add_ps(acc0,
+                      _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    acc1 = _mm_add_ps(
+        acc1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+  }
+  float lanes[4];
+  _mm_storeu_ps(lanes, _mm_add_ps(acc0, acc1));
+  float sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#else
+  // Independent sums, so that the multiplies can overlap.
+  float s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+  for (; i + 4 <= n; i += 4) {
+    s0 += a[i] * b[i];
+    s1 += a[i + 1] * b[i + 1];
+    s2 += a[i + 2] * b[i + 2];
+    s3 += a[i + 3] * b[i + 3];
+  }
+  float sum = (s0 + s1) + (s2 + s3);
+#endif
+  for (; i < n; i++) {
+    sum += a[i] * b[i];
+  }
+  return sum;
+}
+
+size_t PyAudioResampler_Read(PyAudioResampler *resampler, float *output,
+                             size_t frames) {
+  size_t available = PyAudioResampler_GetAvailable(resampler, 0);
+  if (frames > available) {
+    frames = available;
+  }
+
+  unsigned int channels = resampler->channels;
+  unsigned int num_taps = resampler->num_taps;
+  int exact = resampler->num_phases == resampler->up;
+  for (size_t j = 0; j < frames; j++) {
+    const float *x = resampler->input + resampler->position -
+                     (resampler->half_taps - 1);
+    if (exact) {
+      const float *row = resampler->filters + resampler->phase * num_taps;
+      for (unsigned int c = 0; c < channels; c++) {
+        output[j * channels + c] =
+            dot(row, x + c * resampler->capacity, num_taps);
+      }
+    } else {
+      double where = (double)resampler->phase * resampler->num_phases /
+                     resampler->up;
+      unsigned int p = (unsigned int)where;
+      float weight = (float)(where - p);
+      const float *row = resampler->filters + (size_t)p * num_taps;
+      for (unsigned int c = 0; c < channels; c++) {
+        const float *plane = x + c * resampler->capacity;
+        float a = dot(row, plane, num_taps);
+        float b = dot(row + num_taps, plane, num_taps);
+        output[j * channels + c] = a + weight * (b - a);
+      }
+    }
+
+    resampler->phase += resampler->down;
+    resampler->position += resampler->phase / resampler->up;
+    resampler->phase %= resampler->up;
+  }
+  return frames;
+}
+
+size_t PyAudioResampler_GetAvailable(const PyAudioResampler *resampler,
+                                     size_t extra_frames) {
+  // Output frame k needs input up to frame position + half_taps +
+  // floor((phase + k * down) / up).
+  size_t length = resampler->length + extra_frames;
+  if (length <= resampler->position + resampler->half_taps) {
+    return 0;
+  }
+  uint64_t room = (uint64_t)(length - resampler->position -
+                             resampler->half_taps) *
+                  resampler->up;
+  if (room <= resampler->phase) {
+    return 0;
+  }
+  return (size_t)((room - resampler->phase + resampler->down - 1) /
+                  resampler->down);
+}
+
+size_t PyAudioResampler_GetInputNeeded(const PyAudioResampler *resampler,
+                                       size_t frames) {
+  if (frames == 0) {
+    return 0;
+  }
+  size_t last = resampler->position +
+                (size_t)((resampler->phase + (uint64_t)(frames - 1) *
+                                                  resampler->down) /
+                         resampler->up);
+  size_t needed = last + resampler->half_taps + 1;
+  return needed > resampler->length ? needed - resampler->length : 0;
+}
+
+unsigned int PyAudioResampler_GetDelay(const PyAudioResampler *resampler) {
+  return resampler->half_taps;
+}
+
+PyObject *PyAudio_Resample(PyObject *self, PyObject *args) {
+  Py_buffer data;
+  PaSampleFormat format;
+  int channels, quality = PYAUDIO_RESAMPLE_MEDIUM;
+  unsigned long from_rate, to_rate;
+  if (!PyArg_ParseTuple(args, "y*kikk|i", &data, &format, &channels,
+                        &from_rate, &to_rate, &quality)) {
+    return NULL;
+  }
+
+  if (!PyAudioConverter_IsSupported(format) || channels < 1 ||
+      from_rate == 0 || to_rate == 0 || quality < PYAUDIO_RESAMPLE_LOW ||
+      quality > PYAUDIO_RESAMPLE_HIGH) {
+    PyBuffer_Release(&data);
+    PyErr_SetString(PyExc_ValueError,
+                    "Invalid format, channels, rate or quality");
+    return NULL;
+  }
+
+  PyAudioConverter to_float, from_float;
+  PyAudioConverter_Init(&to_float, format, paFloat32);
+  PyAudioConverter_Init(&from_float, paFloat32, format);
+  size_t frame_size = (size_t)to_float.from_size * channels;
+  if (data.len % frame_size != 0) {
+    PyBuffer_Release(&data);
+    PyErr_Format(PyExc_ValueError,
+                 "Data holds %zd bytes, which is not a whole number of "
+                 "frames (of %zu bytes each)",
+                 data.len, frame_size);
+    return NULL;
+  }
+
+  // Equal rates need no filter, which would only band-limit the signal.
+  if (from_rate == to_rate) {
+    PyObject *rv = PyBytes_FromStringAndSize((const char *)data.buf, data.len);
+    PyBuffer_Release(&data);
+    return rv;
+  }
+
+  // The output spans the same time as the input.
+  size_t in_frames = (size_t)data.len / frame_size;
+  size_t out_frames =
+      (size_t)(((uint64_t)in_frames * to_rate + from_rate - 1) / from_rate);
+  PyObject *rv = PyBytes_FromStringAndSize(NULL, out_frames * frame_size);
+  float *scratch =
+      (float *)PyMem_RawMalloc(CHUNK_FRAMES * channels * sizeof(float));
+  PyAudioResampler *resampler = PyAudioResampler_New(
+      from_rate, to_rate, (unsigned int)channels, quality, CHUNK_FRAMES);
+  if (!rv || !scratch || !resampler) {
+    PyBuffer_Release(&data);
+    Py_XDECREF(rv);
+    PyMem_RawFree(scratch);
+    PyAudioResampler_Free(resampler);
+    return rv ? PyErr_NoMemory() : NULL;
+  }
+
+  // clang-format off
+  Py_BEGIN_ALLOW_THREADS
+  const char *src = (const char *)data.buf;
+  char *dst = PyBytes_AS_STRING(rv);
+  size_t written = 0;
+  size_t read = 0;
+  while (read < out_frames) {
+    // Feed the input, and then the silence after it that the last output
+    // frames need.
+    size_t n = in_frames - written;
+    if (n == 0) {
+      n = PyAudioResampler_GetInputNeeded(resampler, out_frames - read);
+    }
+    if (n > CHUNK_FRAMES) {
+      n = CHUNK_FRAMES;
+    }
+    if (written < in_frames) {
+      PyAudioConverter_Run(&to_float, scratch, src + written * frame_size,
+                           n * channels);
+      written += n;
+    } else {
+      memset(scratch, 0, n * channels * sizeof(float));
+    }
+    PyAudioResampler_Write(resampler, scratch, n);
+
+    size_t got;
+    while (read < out_frames &&
+           (got = PyAudioResampler_Read(
+                resampler, scratch,
+                out_frames - read < CHUNK_FRAMES ? out_frames - read
+                                                 : CHUNK_FRAMES)) > 0) {
+      PyAudioConverter_Run(&from_float, dst + read * frame_size, scratch,
+                           got * channels);
+      read += got;
+    }
+  }
+  Py_END_ALLOW_THREADS
+  // clang-format on
+
+  PyBuffer_Release(&data);
+  PyMem_RawFree(scratch);
+  PyAudioResampler_Free(resampler);
+  return rv;
+}
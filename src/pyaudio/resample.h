@@ -0,0 +1,76 @@
+// Sample-rate conversion with a polyphase windowed-sinc filter, on
+// interleaved float32 frames. The filter has one phase per output position
+// between two input frames when the ratio of the rates, in lowest terms, has a
+// small enough numerator, and otherwise interpolates linearly between a fixed
+// number of phases. Output frames line up with input frames: output frame k
+// is the input signal at input frame k * from_rate / to_rate, which takes
+// half of the filter's taps of input after it to compute (see
+// PyAudioResampler_GetDelay).
+
+#ifndef RESAMPLE_H_
+#define RESAMPLE_H_
+
+#include <stddef.h>
+
+#ifndef PY_SSIZE_T_CLEAN
+#define PY_SSIZE_T_CLEAN
+#endif
+#include "Python.h"
+#include "portaudio.h"
+
+// Quality tiers, from the shortest filter with the widest transition band to
+// the longest with the narrowest.
+#define PYAUDIO_RESAMPLE_LOW 0
+#define PYAUDIO_RESAMPLE_MEDIUM 1
+#define PYAUDIO_RESAMPLE_HIGH 2
+
+typedef struct PyAudioResampler PyAudioResampler;
+
+// Creates a resampler for `channels` channels from from_rate to to_rate, at
+// the given quality, whose input buffer takes up to max_write_frames frames
+// at a time. Returns NULL if out of memory, without setting an exception.
+PyAudioResampler *PyAudioResampler_New(unsigned long from_rate,
+                                       unsigned long to_rate,
+                                       unsigned int channels, int quality,
+                                       size_t max_write_frames);
+
+void PyAudioResampler_Free(PyAudioResampler *resampler);
+
+// Discards all buffered input, as if newly created.
+void PyAudioResampler_Reset(PyAudioResampler *resampler);
+
+// Buffers up to `frames` frames of input, and returns how many it took: all
+// of them, as long as the output that they allow is read before writing more
+// than max_write_frames frames.
+size_t PyAudioResampler_Write(PyAudioResampler *resampler, const float *input,
+                              size_t frames);
+
+// Computes up to `frames` frames of output from the buffered input, and
+// returns how many it computed.
+size_t PyAudioResampler_Read(PyAudioResampler *resampler, float *output,
+                             size_t frames);
+
+// Returns how many frames of output PyAudioResampler_Read could compute if
+// the resampler had `extra_frames` more frames of input.
+size_t PyAudioResampler_GetAvailable(const PyAudioResampler *resampler,
+                                     size_t extra_frames);
+
+// Returns how many more frames of input the resampler needs to compute
+// `frames` frames of output.
+size_t PyAudioResampler_GetInputNeeded(const PyAudioResampler *resampler,
+                                       size_t frames);
+
+// Returns the latency of the filter, in frames of input: how far the input
+// has to run ahead of the frame that an output frame lines up with.
+unsigned int PyAudioResampler_GetDelay(const PyAudioResampler *resampler);
+
+// None of the functions above block or require the GIL, and they may run on
+// PortAudio's real-time thread, except for PyAudioResampler_New and
+// PyAudioResampler_Free, which allocate.
+
+// Exported functions.
+
+// Resamples a buffer of samples, with the flush that ends the stream.
+PyObject *PyAudio_Resample(PyObject *self, PyObject *args);
+
+#endif  // RESAMPLE_H_
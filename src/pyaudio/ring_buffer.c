@@ -0,0 +1,85 @@
+#include "ring_buffer.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "sync.h"
+
+int PyAudioRingBuffer_Init(PyAudioRingBuffer *ring, size_t capacity) {
+  ring->data = capacity ? (char *)calloc(capacity, 1) : NULL;
+  if (!ring->data) {
+    return -1;
+  }
+  ring->capacity = capacity;
+  PyAudioAtomic_Store(&ring->write_count, 0);
+  PyAudioAtomic_Store(&ring->read_count, 0);
+  return 0;
+}
+
+void PyAudioRingBuffer_Free(PyAudioRingBuffer *ring) {
+  free(ring->data);
+  ring->data = NULL;
+  ring->capacity = 0;
+}
+
+size_t PyAudioRingBuffer_ReadAvailable(PyAudioRingBuffer *ring) {
+  return (size_t)(PyAudioAtomic_Load(&ring->write_count) -
+                  PyAudioAtomic_Load(&ring->read_count));
+}
+
+size_t PyAudioRingBuffer_WriteAvailable(PyAudioRingBuffer *ring) {
+  return ring->capacity - PyAudioRingBuffer_ReadAvailable(ring);
+}
+
+size_t PyAudioRingBuffer_Write(PyAudioRingBuffer *ring, const void *src,
+                               size_t num_bytes) {
+  int64_t write_count = PyAudioAtomic_Load(&ring->write_count);
+  size_t available =
+      ring->capacity -
+      (size_t)(write_count - PyAudioAtomic_Load(&ring->read_count));
+  if (num_bytes > available) {
+    num_bytes = available;
+  }
+
+  // Copy in (at most) two parts, in case the region wraps around.
+  size_t offset = (size_t)(write_count % (int64_t)ring->capacity);
+  size_t first = ring->capacity - offset;
+  if (first > num_bytes) {
+    first = num_bytes;
+  }
+  if (src) {
+    memcpy(ring->data + offset, src, first);
+    memcpy(ring->data, (const char *)src + first, num_bytes - first);
+  } else {
+    memset(ring->data + offset, 0, first);
+    memset(ring->data, 0, num_bytes - first);
+  }
+
+  // Publish the data only after it is in place.
+  PyAudioAtomic_Store(&ring->write_count, write_count + (int64_t)num_bytes);
+  return num_bytes;
+}
+
+size_t PyAudioRingBuffer_Read(PyAudioRingBuffer *ring, void *dst,
+                              size_t num_bytes) {
+  int64_t read_count = PyAudioAtomic_Load(&ring->read_count);
+  size_t available =
+      (size_t)(PyAudioAtomic_Load(&ring->write_count) - read_count);
+  if (num_bytes > available) {
+    num_bytes = available;
+  }
+
+  size_t offset = (size_t)(read_count % (int64_t)ring->capacity);
+  size_t first = ring->capacity - offset;
+  if (first > num_bytes) {
+    first = num_bytes;
+  }
+  if (dst) {
+    memcpy(dst, ring->data + offset, first);
+    memcpy((char *)dst + first, ring->data, num_bytes - first);
+  }
+
+  // Hand the space back to the producer only after copying out of it.
+  PyAudioAtomic_Store(&ring->read_count, read_count + (int64_t)num_bytes);
+  return num_bytes;
+}
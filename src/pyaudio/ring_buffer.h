@@ -0,0 +1,41 @@
+// Lock-free single-producer/single-consumer ring buffer, used to move audio
+// between PortAudio's real-time thread and other threads without blocking.
+
+#ifndef RING_BUFFER_H_
+#define RING_BUFFER_H_
+
+#include <stddef.h>
+
+#include "sync.h"
+
+typedef struct {
+  char *data;
+  // Size of data, in bytes.
+  size_t capacity;
+  // Total number of bytes ever written and read. Only the producer advances
+  // write_count, and only the consumer advances read_count.
+  PyAudioAtomic write_count;
+  PyAudioAtomic read_count;
+} PyAudioRingBuffer;
+
+// Allocates the ring's storage, which must be non-empty. Returns 0 on success,
+// -1 on failure.
+int PyAudioRingBuffer_Init(PyAudioRingBuffer *ring, size_t capacity);
+// Frees the ring's storage. Neither side may use the ring afterwards.
+void PyAudioRingBuffer_Free(PyAudioRingBuffer *ring);
+
+// Number of bytes that the consumer can read.
+size_t PyAudioRingBuffer_ReadAvailable(PyAudioRingBuffer *ring);
+// Number of bytes that the producer can write.
+size_t PyAudioRingBuffer_WriteAvailable(PyAudioRingBuffer *ring);
+
+// Producer: copies up to num_bytes from src into the ring (zeros, if src is
+// NULL). Returns the number of bytes written.
+size_t PyAudioRingBuffer_Write(PyAudioRingBuffer *ring, const void *src,
+                               size_t num_bytes);
+// Consumer: copies up to num_bytes from the ring into dst (or discards them,
+// if dst is NULL). Returns the number of bytes read.
+size_t PyAudioRingBuffer_Read(PyAudioRingBuffer *ring, void *dst,
+                              size_t num_bytes);
+
+#endif  // RING_BUFFER_H_
@@ -1,5 +1,6 @@
 #include "stream.h"
 
+#include <stdint.h>
 #include <string.h>
 
 #ifndef PY_SSIZE_T_CLEAN
@@ -8,13 +9,30 @@
 #include "Python.h"
 #include "portaudio.h"
 
+#include "module_state.h"
+#include "stream_async.h"
+#include "stream_batch.h"
+#include "stream_capture.h"
+#include "stream_convert.h"
+#include "stream_decoupled.h"
+#include "stream_io.h"
+#include "stream_mix.h"
+#include "stream_planar.h"
+#include "stream_playback.h"
+#include "stream_resample.h"
+#include "stream_subinterpreter.h"
+
 static void dealloc(PyAudioStream *self) {
+  PyTypeObject *type = Py_TYPE(self);
   PyAudioStream_Cleanup(self);
-  Py_TYPE(self)->tp_free((PyObject *)self);
+  type->tp_free((PyObject *)self);
+  PYAUDIO_DECREF_HEAP_TYPE(type);
 }
 
-static PyObject *get_structVersion(PyAudioStream *self, void *closure) {
-  if (!PyAudioStream_IsOpen(self)) {
+// Returns the stream's PaStreamInfo, or NULL with an exception set. On success,
+// the caller must call PyAudioStream_EndUse when done with it.
+static const PaStreamInfo *begin_use_stream_info(PyAudioStream *self) {
+  if (!PyAudioStream_BeginUse(self)) {
     PyErr_SetObject(PyExc_IOError,
                     Py_BuildValue("(i,s)", paBadStreamPtr, "Stream closed"));
     return NULL;
@@ -22,67 +40,64 @@ static PyObject *get_structVersion(PyAudioStream *self, void *closure) {
 
   const PaStreamInfo *stream_info = Pa_GetStreamInfo(self->context.stream);
   if (!stream_info) {
+    PyAudioStream_EndUse(self);
     PyErr_SetObject(PyExc_IOError,
                     Py_BuildValue("(i,s)", paInternalError,
                                   "Could not get stream information"));
     return NULL;
   }
 
-  return PyLong_FromLong(stream_info->structVersion);
+  return stream_info;
 }
 
-static PyObject *get_inputLatency(PyAudioStream *self, void *closure) {
-  if (!PyAudioStream_IsOpen(self)) {
-    PyErr_SetObject(PyExc_IOError,
-                    Py_BuildValue("(i,s)", paBadStreamPtr, "Stream closed"));
+static PyObject *get_structVersion(PyAudioStream *self, void *closure) {
+  const PaStreamInfo *stream_info = begin_use_stream_info(self);
+  if (!stream_info) {
     return NULL;
   }
 
-  const PaStreamInfo *stream_info = Pa_GetStreamInfo(self->context.stream);
+  int struct_version = stream_info->structVersion;
+  PyAudioStream_EndUse(self);
+  return PyLong_FromLong(struct_version);
+}
+
+static PyObject *get_inputLatency(PyAudioStream *self, void *closure) {
+  const PaStreamInfo *stream_info = begin_use_stream_info(self);
   if (!stream_info) {
-    PyErr_SetObject(PyExc_IOError,
-                    Py_BuildValue("(i,s)", paInternalError,
-                                  "Could not get stream information"));
     return NULL;
   }
 
-  return PyFloat_FromDouble(stream_info->inputLatency);
+  double latency = stream_info->inputLatency +
+                   PyAudioBatch_GetInputLatency(self, stream_info->sampleRate) +
+                   PyAudioResample_GetInputLatency(self);
+  PyAudioStream_EndUse(self);
+  return PyFloat_FromDouble(latency);
 }
 
 static PyObject *get_outputLatency(PyAudioStream *self, void *closure) {
-  if (!PyAudioStream_IsOpen(self)) {
-    PyErr_SetObject(PyExc_IOError,
-                    Py_BuildValue("(i,s)", paBadStreamPtr, "Stream closed"));
-    return NULL;
-  }
-
-  const PaStreamInfo *stream_info = Pa_GetStreamInfo(self->context.stream);
+  const PaStreamInfo *stream_info = begin_use_stream_info(self);
   if (!stream_info) {
-    PyErr_SetObject(PyExc_IOError,
-                    Py_BuildValue("(i,s)", paInternalError,
-                                  "Could not get stream information"));
     return NULL;
   }
 
-  return PyFloat_FromDouble(stream_info->outputLatency);
+  double latency =
+      stream_info->outputLatency +
+      PyAudioDecoupled_GetOutputLatency(self, stream_info->sampleRate) +
+      PyAudioBatch_GetOutputLatency(self, stream_info->sampleRate) +
+      PyAudioResample_GetOutputLatency(self);
+  PyAudioStream_EndUse(self);
+  return PyFloat_FromDouble(latency);
 }
 
 static PyObject *get_sampleRate(PyAudioStream *self, void *closure) {
-  if (!PyAudioStream_IsOpen(self)) {
-    PyErr_SetObject(PyExc_IOError,
-                    Py_BuildValue("(i,s)", paBadStreamPtr, "Stream closed"));
-    return NULL;
-  }
-
-  const PaStreamInfo *stream_info = Pa_GetStreamInfo(self->context.stream);
+  const PaStreamInfo *stream_info = begin_use_stream_info(self);
   if (!stream_info) {
-    PyErr_SetObject(PyExc_IOError,
-                    Py_BuildValue("(i,s)", paInternalError,
-                                  "Could not get stream information"));
     return NULL;
   }
 
-  return PyFloat_FromDouble(stream_info->sampleRate);
+  double sample_rate = stream_info->sampleRate;
+  PyAudioStream_EndUse(self);
+  return PyFloat_FromDouble(sample_rate);
 }
 
 static int antiset(PyAudioStream *self, PyObject *value, void *closure) {
@@ -106,31 +121,146 @@ static PyGetSetDef get_setters[] = {{"structVersion", (getter)get_structVersion,
 
                                     {NULL}};
 
-PyTypeObject PyAudioStreamType = {
-    // clang-format off
-    PyVarObject_HEAD_INIT(NULL, 0)
-    // clang-format on
-    .tp_name = "_portaudio.Stream",
-    .tp_basicsize = sizeof(PyAudioStream),
-    .tp_itemsize = 0,
-    .tp_dealloc = (destructor)dealloc,
-    .tp_flags = Py_TPFLAGS_DEFAULT,
-    .tp_doc = PyDoc_STR("PyAudio Stream"),
-    .tp_getset = get_setters,
-    .tp_new = PyType_GenericNew,
+static PyType_Slot slots[] = {
+    {Py_tp_dealloc, dealloc},
+    {Py_tp_doc, (void *)PyDoc_STR("PyAudio Stream")},
+    {Py_tp_getset, get_setters},
+    {Py_tp_new, PyType_GenericNew},
+    {0, NULL}};
+
+PyType_Spec PyAudioStreamTypeSpec = {
+    .name = "_portaudio.Stream",
+    .basicsize = sizeof(PyAudioStream),
+    .itemsize = 0,
+    .flags = PYAUDIO_TPFLAGS_DEFAULT,
+    .slots = slots,
 };
 
 int PyAudioStream_IsOpen(PyAudioStream *stream) {
   return (stream) && (stream->context.stream != NULL);
 }
 
-PyAudioStream *PyAudioStream_Create(void) {
-  PyAudioStream *stream =
-      (PyAudioStream *)PyObject_New(PyAudioStream, &PyAudioStreamType);
+int PyAudioStream_BeginUse(PyAudioStream *stream) {
+  PyAudioAtomic_Add(&stream->users, 1);
+  if (PyAudioAtomic_Load(&stream->closing) || !PyAudioStream_IsOpen(stream)) {
+    PyAudioAtomic_Add(&stream->users, -1);
+    return 0;
+  }
+  return 1;
+}
+
+void PyAudioStream_EndUse(PyAudioStream *stream) {
+  PyAudioAtomic_Add(&stream->users, -1);
+}
+
+// Counts one xrun of frames frames for each kind of xrun set in flags.
+void PyAudioStream_CountXruns(PyAudioStream *stream,
+                              PaStreamCallbackFlags flags,
+                              unsigned long frames) {
+  // Most periods have no xrun.
+  if ((flags & ((1 << PYAUDIO_NUM_XRUN_KINDS) - 1)) == 0) {
+    return;
+  }
+  for (int i = 0; i < PYAUDIO_NUM_XRUN_KINDS; i++) {
+    if (flags & ((PaStreamCallbackFlags)1 << i)) {
+      PyAudioAtomic_Add(&stream->context.xruns[i], 1);
+      PyAudioAtomic_Add(&stream->context.xrun_frames[i], (int64_t)frames);
+    }
+  }
+}
+
+// Takes the current exception, normalized and with its traceback attached.
+// Returns NULL if no exception is set.
+static PyObject *fetch_exception(void) {
+#if PY_VERSION_HEX >= 0x030C0000
+  return PyErr_GetRaisedException();
+#else
+  PyObject *type, *value, *traceback;
+  PyErr_Fetch(&type, &value, &traceback);
+  if (type == NULL) {
+    return NULL;
+  }
+  PyErr_NormalizeException(&type, &value, &traceback);
+  if (traceback != NULL) {
+    PyException_SetTraceback(value, traceback);
+  }
+  Py_DECREF(type);
+  Py_XDECREF(traceback);
+  return value;
+#endif
+}
+
+// Sets exc, which this function steals, as the current exception.
+static void restore_exception(PyObject *exc) {
+#if PY_VERSION_HEX >= 0x030C0000
+  PyErr_SetRaisedException(exc);
+#else
+  PyObject *type = (PyObject *)Py_TYPE(exc);
+  Py_INCREF(type);
+  PyErr_Restore(type, exc, PyException_GetTraceback(exc));
+#endif
+}
+
+// Prints error, which this function steals, as an exception that obj raised
+// but that no one handled, and leaves the current exception (if any) alone.
+static void report_unraisable(PyObject *error, PyObject *obj) {
+  PyObject *current = fetch_exception();
+  restore_exception(error);
+  PyErr_WriteUnraisable(obj);
+  if (current != NULL) {
+    restore_exception(current);
+  }
+}
+
+void PyAudioStream_SaveError(PyAudioStream *stream) {
+  PyObject *error = fetch_exception();
+  if (error == NULL) {
+    return;
+  }
+
+  if (stream->context.callback == NULL) {
+    // The callback closed its own stream (in decoupled mode), so no one is
+    // left to take the error.
+    report_unraisable(error, NULL);
+    return;
+  }
+
+  // Keep the first error: later ones are usually consequences of it.
+  if (!PyAudioAtomic_CompareExchange(&stream->context.error, 0,
+                                     (intptr_t)error)) {
+    Py_DECREF(error);
+  }
+}
+
+PyObject *PyAudioStream_TakeError(PyAudioStream *stream) {
+  PyObject *error =
+      (PyObject *)(intptr_t)PyAudioAtomic_Exchange(&stream->context.error, 0);
+  if (error == NULL || stream->context.subinterpreter == NULL) {
+    return error;
+  }
+  return PyAudioSubinterpreter_ExportError(stream, error);
+}
+
+int PyAudioStream_RaiseError(PyAudioStream *stream) {
+  if (PyAudioAtomic_Load(&stream->context.error) == 0) {
+    return 0;
+  }
+
+  PyObject *error = PyAudioStream_TakeError(stream);
+  if (error != NULL) {
+    restore_exception(error);
+  }
+  return PyErr_Occurred() ? -1 : 0;
+}
+
+PyAudioStream *PyAudioStream_Create(PyTypeObject *type) {
+  PyAudioStream *stream = (PyAudioStream *)PyObject_New(PyAudioStream, type);
   if (!stream) {
     return NULL;
   }
   memset(&(stream->context), 0, sizeof(struct StreamContext));
+  stream->users = 0;
+  stream->closing = 0;
   return stream;
 }
 
@@ -139,6 +269,23 @@ void PyAudioStream_Cleanup(PyAudioStream *stream) {
   // For example, stream_lifecycle.c may call this when the user closes the
   // stream, and Python may call it again during deallocation, i.e., when the
   // stream Python object's reference count reaches 0.
+  if (PyAudioAtomic_Exchange(&stream->closing, 1)) {
+    // Already closed, or being closed by another thread.
+    return;
+  }
+
+  // Wait for calls on other threads that are still using the PortAudio
+  // stream (e.g., a blocking read) to return.
+  if (PyAudioAtomic_Load(&stream->users) > 0) {
+    // clang-format off
+    Py_BEGIN_ALLOW_THREADS
+    while (PyAudioAtomic_Load(&stream->users) > 0) {
+      Pa_Sleep(1);
+    }
+    Py_END_ALLOW_THREADS
+    // clang-format on
+  }
+
   if (stream->context.stream != NULL) {
     // clang-format off
     Py_BEGIN_ALLOW_THREADS
@@ -148,35 +295,72 @@ void PyAudioStream_Cleanup(PyAudioStream *stream) {
     stream->context.stream = NULL;
   }
 
-  if (stream->context.callback != NULL) {
-    Py_XDECREF(stream->context.callback);
-    stream->context.callback = NULL;
-  }
+  // Wait for the decoupled callback worker, if any, before dropping the state
+  // that it uses.
+  PyAudioDecoupled_Free(stream);
+  PyAudioBatch_Free(stream);
+  PyAudioCapture_Free(stream);
+  PyAudioPlayback_Free(stream);
+  PyAudioConvert_Free(stream);
+  PyAudioResample_Free(stream);
+  PyAudioMix_Free(stream);
+  PyAudioPlanar_Free(stream);
+  PyAudioAsync_Free(stream);
+
+  // If the callback runs in a subinterpreter, the callback and its arguments
+  // belong to that interpreter, so release them there before ending it.
+  PyAudioSubinterpreter_Free(stream);
+  PyAudioStream_ClearCallback(stream);
 
   // Just in case, zero out the entire struct.
   memset(&(stream->context), 0, sizeof(struct StreamContext));
 }
 
+void PyAudioStream_ClearCallback(PyAudioStream *stream) {
+  // Report the callback's last error if no one took it, rather than lose it.
+  PyObject *error =
+      (PyObject *)(intptr_t)PyAudioAtomic_Exchange(&stream->context.error, 0);
+  if (error != NULL) {
+    report_unraisable(error, stream->context.callback);
+  }
+
+  Py_CLEAR(stream->context.callback);
+  Py_CLEAR(stream->context.input_view);
+  Py_CLEAR(stream->context.input_buffer);
+  Py_CLEAR(stream->context.output_view);
+  Py_CLEAR(stream->context.output_buffer);
+  Py_CLEAR(stream->context.time_info);
+  Py_CLEAR(stream->context.time_info_type);
+  Py_CLEAR(stream->context.py_frame_count);
+}
+
 PyObject *PyAudio_GetStreamTime(PyObject *self, PyObject *args) {
   double time;
 
   PyObject *stream_arg;
-  if (!PyArg_ParseTuple(args, "O!", &PyAudioStreamType, &stream_arg)) {
+  if (!PyArg_ParseTuple(args, "O!", PyAudioModule_GetState(self)->stream_type,
+                        &stream_arg)) {
     return NULL;
   }
 
   PyAudioStream *stream = (PyAudioStream *)stream_arg;
-  if (!PyAudioStream_IsOpen(stream)) {
+  if (!PyAudioStream_BeginUse(stream)) {
     PyErr_SetObject(PyExc_IOError,
                     Py_BuildValue("(i,s)", paBadStreamPtr, "Stream closed"));
     return NULL;
   }
 
+  if (PyAudioStream_RaiseError(stream) < 0) {
+    PyAudioStream_EndUse(stream);
+    return NULL;
+  }
+
   // clang-format off
   Py_BEGIN_ALLOW_THREADS
   time = Pa_GetStreamTime(stream->context.stream);
   Py_END_ALLOW_THREADS
   // clang-format on
+  PyAudioStream_EndUse(stream);
 
   if (time == 0) {
     PyAudioStream_Cleanup(stream);
@@ -192,22 +376,113 @@ PyObject *PyAudio_GetStreamCpuLoad(PyObject *self, PyObject *args) {
   double cpuload;
 
   PyObject *stream_arg;
-  if (!PyArg_ParseTuple(args, "O!", &PyAudioStreamType, &stream_arg)) {
+  if (!PyArg_ParseTuple(args, "O!", PyAudioModule_GetState(self)->stream_type,
+                        &stream_arg)) {
     return NULL;
   }
 
   PyAudioStream *stream = (PyAudioStream *)stream_arg;
-  if (!PyAudioStream_IsOpen(stream)) {
+  if (!PyAudioStream_BeginUse(stream)) {
     PyErr_SetObject(PyExc_IOError,
                     Py_BuildValue("(i,s)", paBadStreamPtr, "Stream closed"));
     return NULL;
   }
 
+  if (PyAudioStream_RaiseError(stream) < 0) {
+    PyAudioStream_EndUse(stream);
+    return NULL;
+  }
+
   // clang-format off
   Py_BEGIN_ALLOW_THREADS
   cpuload = Pa_GetStreamCpuLoad(stream->context.stream);
   Py_END_ALLOW_THREADS
   // clang-format on
+  PyAudioStream_EndUse(stream);
 
   return PyFloat_FromDouble(cpuload);
 }
+
+PyObject *PyAudio_GetStreamError(PyObject *self, PyObject *args) {
+  PyObject *stream_arg;
+  if (!PyArg_ParseTuple(args, "O!", PyAudioModule_GetState(self)->stream_type,
+                        &stream_arg)) {
+    return NULL;
+  }
+
+  // Once the stream closes, it has already reported any pending error.
+  PyAudioStream *stream = (PyAudioStream *)stream_arg;
+  if (!PyAudioStream_BeginUse(stream)) {
+    Py_INCREF(Py_None);
+    return Py_None;
+  }
+
+  PyObject *error = PyAudioStream_TakeError(stream);
+  PyAudioStream_EndUse(stream);
+  if (error == NULL && !PyErr_Occurred()) {
+    Py_INCREF(Py_None);
+    return Py_None;
+  }
+  return error;
+}
+
+PyObject *PyAudio_GetStreamXrunCounts(PyObject *self, PyObject *args) {
+  // Key names, by xrun kind (see PYAUDIO_NUM_XRUN_KINDS).
+  static const char *const kind_names[PYAUDIO_NUM_XRUN_KINDS] = {
+      "input_underflow", "input_overflow", "output_underflow",
+      "output_overflow"};
+  int reset = 0;
+
+  PyObject *stream_arg;
+  if (!PyArg_ParseTuple(args, "O!|i", PyAudioModule_GetState(self)->stream_type,
+                        &stream_arg, &reset)) {
+    return NULL;
+  }
+
+  PyAudioStream *stream = (PyAudioStream *)stream_arg;
+  if (!PyAudioStream_BeginUse(stream)) {
+    PyErr_SetObject(PyExc_IOError,
+                    Py_BuildValue("(i,s)", paBadStreamPtr, "Stream closed"));
+    return NULL;
+  }
+
+  // Take every count up front, so that the counts are as close to a
+  // snapshot as they can be while xruns keep coming.
+  int64_t xruns[PYAUDIO_NUM_XRUN_KINDS];
+  int64_t xrun_frames[PYAUDIO_NUM_XRUN_KINDS];
+  for (int i = 0; i < PYAUDIO_NUM_XRUN_KINDS; i++) {
+    if (reset) {
+      xruns[i] = PyAudioAtomic_Exchange(&stream->context.xruns[i], 0);
+      xrun_frames[i] =
+          PyAudioAtomic_Exchange(&stream->context.xrun_frames[i], 0);
+    } else {
+      xruns[i] = PyAudioAtomic_Load(&stream->context.xruns[i]);
+      xrun_frames[i] = PyAudioAtomic_Load(&stream->context.xrun_frames[i]);
+    }
+  }
+  PyAudioStream_EndUse(stream);
+
+  PyObject *counts = PyDict_New();
+  if (counts == NULL) {
+    return NULL;
+  }
+  for (int i = 0; i < PYAUDIO_NUM_XRUN_KINDS; i++) {
+    PyObject *count = PyLong_FromLongLong(xruns[i]);
+    PyObject *frames = PyLong_FromLongLong(xrun_frames[i]);
+    PyObject *frames_key = PyUnicode_FromFormat("%s_frames", kind_names[i]);
+    PyObject *count_key = PyUnicode_FromFormat("%ss", kind_names[i]);
+    int ok = count != NULL && frames != NULL && frames_key != NULL &&
+             count_key != NULL &&
+             PyDict_SetItem(counts, count_key, count) == 0 &&
+             PyDict_SetItem(counts, frames_key, frames) == 0;
+    Py_XDECREF(count);
+    Py_XDECREF(frames);
+    Py_XDECREF(frames_key);
+    Py_XDECREF(count_key);
+    if (!ok) {
+      Py_DECREF(counts);
+      return NULL;
+    }
+  }
+  return counts;
+}
@@ -7,6 +7,33 @@
 #include "Python.h"
 #include "portaudio.h"
 
+#include "sync.h"
+
+// State for decoupled callback mode (see stream_decoupled.h).
+typedef struct PyAudioDecoupled PyAudioDecoupled;
+// State for batched callbacks (see stream_batch.h).
+typedef struct PyAudioBatch PyAudioBatch;
+// State for callbacks that run in a subinterpreter (see
+// stream_subinterpreter.h).
+typedef struct PyAudioSubinterpreter PyAudioSubinterpreter;
+// State for background capture (see stream_capture.h).
+typedef struct PyAudioCapture PyAudioCapture;
+// State for queued playback (see stream_playback.h).
+typedef struct PyAudioPlayback PyAudioPlayback;
+// State for sample format conversion (see stream_convert.h).
+typedef struct PyAudioConvert PyAudioConvert;
+// State for non-interleaved streams (see stream_planar.h).
+typedef struct PyAudioPlanar PyAudioPlanar;
+// State for sample-rate conversion (see stream_resample.h).
+typedef struct PyAudioResample PyAudioResample;
+// State for channel routing (see stream_mix.h).
+typedef struct PyAudioMix PyAudioMix;
+
+// Kinds of xruns that streams count: one per xrun bit of
+// PaStreamCallbackFlags (paInputUnderflow, paInputOverflow, paOutputUnderflow
+// and paOutputOverflow, in order).
+#define PYAUDIO_NUM_XRUN_KINDS 4
+
 typedef struct {
   // clang-format off
   PyObject_HEAD
@@ -20,27 +47,136 @@ typedef struct {
     // Frame size, in bytes, for input and output. Equal to
     // num channels x bytes per sample.
     unsigned int frame_size;
-    // Main thread ID.
-    long main_thread_id;
+    // Sample size, in bytes.
+    unsigned int sample_size;
+    // The first exception that the callback raised and that no one has taken
+    // yet (see PyAudioStream_SaveError), as a PyObject * owned by the
+    // interpreter that runs the callback, or 0.
+    PyAudioAtomic error;
+    // Whether the callback receives its input through input_view (a reusable
+    // buffer) instead of a new bytes object per period.
+    int reuse_input_buffer;
+    // Reusable input buffer (a bytearray) for callback mode, and a read-only
+    // memoryview over the samples of the most recent period. The stream
+    // replaces both whenever the callback kept a reference to the view (see
+    // PyAudioStream_ReserveInputBuffer). NULL unless reuse_input_buffer is
+    // set.
+    PyObject *input_buffer;
+    PyObject *input_view;
+    // Whether the callback writes its output in place, into output_view,
+    // instead of returning the samples.
+    int output_in_place;
+    // Reusable output buffer (a bytearray) for in-place callbacks, which the
+    // stream copies into PortAudio's buffer after each call, and a writable
+    // memoryview over the samples of the most recent period. Replaced, like
+    // input_buffer and input_view, whenever the callback kept a reference to
+    // the view. NULL unless output_in_place is set.
+    PyObject *output_buffer;
+    PyObject *output_view;
+    // Callback arguments cached across periods, so that steady-state
+    // callbacks do not allocate: the time_info object (see time_info.h), and
+    // the Python int for the most recent frame_count.
+    PyObject *time_info;
+    // Type of the time_info object, from the module state of the interpreter
+    // that runs the callback.
+    PyTypeObject *time_info_type;
+    PyObject *py_frame_count;
+    unsigned long py_frame_count_value;
+    // Ring buffers and worker state when the callback runs in decoupled mode,
+    // off PortAudio's real-time thread. NULL otherwise.
+    PyAudioDecoupled *decoupled;
+    // Input and output buffers when the callback handles several periods per
+    // call. NULL otherwise.
+    PyAudioBatch *batch;
+    // The subinterpreter that runs the callback, and owns the callback and
+    // the objects above, if the stream has one. NULL otherwise.
+    PyAudioSubinterpreter *subinterpreter;
+    // The ring buffer that blocking reads are served from, when the stream
+    // captures input in the background. NULL otherwise.
+    PyAudioCapture *capture;
+    // The ring buffer that blocking writes go to, when the stream queues
+    // output for playback in the background. NULL otherwise.
+    PyAudioPlayback *playback;
+    // Scratch buffers and converters between the application's sample format
+    // and the device's, when they differ. NULL otherwise.
+    PyAudioConvert *convert;
+    // Filters and scratch buffers between the application's sample rate and
+    // the device's, when they differ. NULL otherwise.
+    PyAudioResample *resample;
+    // Mixers and scratch buffers between the application's channels and the
+    // device's, when the stream has a channel matrix. NULL otherwise.
+    PyAudioMix *mix;
+    // Scratch buffers for interleaving, when the application reads and
+    // writes channel-major blocks. NULL for interleaved streams.
+    PyAudioPlanar *planar;
+    // Readiness notifier for event loops (a PyAudioNotifier *, created on
+    // first use), and the number of frames that its waiter needs, or 0 if no
+    // one waits (see stream_async.h).
+    PyAudioAtomic notifier;
+    PyAudioAtomic ready_frames;
+    // Number of frames that blocking reads have returned so far: the
+    // position, in the input, of the next frame to read.
+    PyAudioAtomic frames_read;
+    // For monitoring: the number of xruns of each kind so far, and the frames
+    // that they affected, indexed by the kind's bit in PaStreamCallbackFlags
+    // (see PyAudioStream_CountXruns).
+    PyAudioAtomic xruns[PYAUDIO_NUM_XRUN_KINDS];
+    PyAudioAtomic xrun_frames[PYAUDIO_NUM_XRUN_KINDS];
   } context;
+  // Number of calls that are currently using the PortAudio stream (see
+  // PyAudioStream_BeginUse), and whether the stream is closing. These live
+  // outside of context, which PyAudioStream_Cleanup clears.
+  PyAudioAtomic users;
+  PyAudioAtomic closing;
 } PyAudioStream;
 
-extern PyTypeObject PyAudioStreamType;
+// See module_state.h for the type object.
+extern PyType_Spec PyAudioStreamTypeSpec;
 
 // "Internal" utilities for other stream_*.c modules.
 
-// Creates a PyAudioStream and zeros out the fields. Returns NULL if memory
-// allocation fails.
-PyAudioStream *PyAudioStream_Create(void);
+// Creates a PyAudioStream of the given type (the stream type from the module
+// state) and zeros out the fields. Returns NULL if memory allocation fails.
+PyAudioStream *PyAudioStream_Create(PyTypeObject *type);
 // Closes the PortAudio stream (if open) and garbage collects the fields within
 // a PyAudioStream. May be called multiple times on the same stream.
 void PyAudioStream_Cleanup(PyAudioStream *stream);
+// Releases the callback and the Python objects cached for its arguments.
+// Requires the GIL of the interpreter that owns them.
+void PyAudioStream_ClearCallback(PyAudioStream *stream);
+// Saves the current exception, raised by the callback, as the stream's error
+// without formatting it, and clears it. Keeps the earlier error if one is
+// still pending. Requires the GIL of the interpreter that runs the callback.
+void PyAudioStream_SaveError(PyAudioStream *stream);
+// Takes the stream's pending callback error, converted into an exception of
+// the calling interpreter. Returns a new reference, NULL (without an exception
+// set) if there is no error, or NULL with an exception set on failure. Must be
+// called between PyAudioStream_BeginUse and PyAudioStream_EndUse.
+PyObject *PyAudioStream_TakeError(PyAudioStream *stream);
+// If the stream has a pending callback error, raises it and returns -1.
+// Otherwise, returns 0. As for PyAudioStream_TakeError, the stream must be in
+// use.
+int PyAudioStream_RaiseError(PyAudioStream *stream);
 // Returns whether the stream is open.
 int PyAudioStream_IsOpen(PyAudioStream *stream);
+// Marks the start of a call that uses the PortAudio stream. If the stream is
+// open, returns 1, and the stream stays open until the matching
+// PyAudioStream_EndUse, even if another thread closes it meanwhile. Otherwise,
+// returns 0. Calls on separate threads may use the same stream concurrently.
+int PyAudioStream_BeginUse(PyAudioStream *stream);
+void PyAudioStream_EndUse(PyAudioStream *stream);
+// Counts the xruns in flags (a PaStreamCallbackFlags, as PortAudio passes to
+// stream callbacks), each as affecting `frames` frames. Never blocks, and does
+// not require the GIL.
+void PyAudioStream_CountXruns(PyAudioStream *stream,
+                              PaStreamCallbackFlags flags,
+                              unsigned long frames);
 
 // Exported functions.
 
 PyObject *PyAudio_GetStreamTime(PyObject *self, PyObject *args);
 PyObject *PyAudio_GetStreamCpuLoad(PyObject *self, PyObject *args);
+PyObject *PyAudio_GetStreamError(PyObject *self, PyObject *args);
+PyObject *PyAudio_GetStreamXrunCounts(PyObject *self, PyObject *args);
 
 #endif  // STREAM_H_
@@ -0,0 +1,165 @@
+#include "stream_async.h"
+
+#include <stdint.h>
+
+#ifndef PY_SSIZE_T_CLEAN
+#define PY_SSIZE_T_CLEAN
+#endif
+#include "Python.h"
+#include "portaudio.h"
+
+#include "module_state.h"
+#include "stream.h"
+#include "stream_capture.h"
+#include "stream_playback.h"
+#include "sync.h"
+
+static PyAudioNotifier *load_notifier(PyAudioStream *stream) {
+  return (PyAudioNotifier *)(intptr_t)PyAudioAtomic_Load(
+      &stream->context.notifier);
+}
+
+// Returns the stream's notifier, creating it if needed, or NULL with an
+// exception set.
+static PyAudioNotifier *get_notifier(PyAudioStream *stream) {
+  PyAudioNotifier *notifier = load_notifier(stream);
+  if (notifier) {
+    return notifier;
+  }
+
+  notifier = PyAudioNotifier_New();
+  if (!notifier) {
+#if defined(_WIN32)
+    PyErr_SetString(PyExc_NotImplementedError,
+                    "Stream readiness notifications are not supported on "
+                    "this platform");
+#else
+    PyErr_SetFromErrno(PyExc_OSError);
+#endif
+    return NULL;
+  }
+
+  // Another thread may have created one meanwhile.
+  if (!PyAudioAtomic_CompareExchange(&stream->context.notifier, 0,
+                                     (int64_t)(intptr_t)notifier)) {
+    PyAudioNotifier_Free(notifier);
+    notifier = load_notifier(stream);
+  }
+  return notifier;
+}
+
+// Returns the number of frames that the stream can read or write without
+// waiting, and the most that it ever can, or -1 if the stream has neither a
+// capture buffer nor a playback queue.
+static signed long get_available(PyAudioStream *stream,
+                                 signed long *capacity) {
+  if (stream->context.capture) {
+    *capacity = PyAudioCapture_GetCapacity(stream);
+    return PyAudioCapture_GetReadAvailable(stream);
+  }
+  if (stream->context.playback) {
+    *capacity = PyAudioPlayback_GetCapacity(stream);
+    return PyAudioPlayback_GetWriteAvailable(stream);
+  }
+  return -1;
+}
+
+void PyAudioAsync_Free(PyAudioStream *stream) {
+  PyAudioNotifier_Free(load_notifier(stream));
+  PyAudioAtomic_Store(&stream->context.notifier, 0);
+}
+
+void PyAudioAsync_Notify(PyAudioStream *stream, size_t available_frames) {
+  int64_t ready_frames = PyAudioAtomic_Load(&stream->context.ready_frames);
+  if (ready_frames > 0 && (int64_t)available_frames >= ready_frames &&
+      PyAudioAtomic_CompareExchange(&stream->context.ready_frames,
+                                    ready_frames, 0)) {
+    PyAudioNotifier_Signal(load_notifier(stream));
+  }
+}
+
+// Returns the stream, in use (see PyAudioStream_BeginUse), if it has a
+// capture buffer or a playback queue, or NULL with an exception set.
+static PyAudioStream *begin_use(PyObject *stream_arg) {
+  PyAudioStream *stream = (PyAudioStream *)stream_arg;
+  if (!PyAudioStream_BeginUse(stream)) {
+    PyErr_SetObject(PyExc_IOError,
+                    Py_BuildValue("(i,s)", paBadStreamPtr, "Stream closed"));
+    return NULL;
+  }
+
+  if (!stream->context.capture && !stream->context.playback) {
+    PyAudioStream_EndUse(stream);
+    PyErr_SetString(PyExc_ValueError,
+                    "Stream has neither a capture buffer nor a playback "
+                    "queue");
+    return NULL;
+  }
+  return stream;
+}
+
+PyObject *PyAudio_GetStreamReadyFd(PyObject *self, PyObject *args) {
+  PyObject *stream_arg;
+  if (!PyArg_ParseTuple(args, "O!", PyAudioModule_GetState(self)->stream_type,
+                        &stream_arg)) {
+    return NULL;
+  }
+
+  PyAudioStream *stream = begin_use(stream_arg);
+  if (!stream) {
+    return NULL;
+  }
+
+  PyAudioNotifier *notifier = get_notifier(stream);
+  PyAudioStream_EndUse(stream);
+  if (!notifier) {
+    return NULL;
+  }
+  return PyLong_FromLong(PyAudioNotifier_GetFd(notifier));
+}
+
+PyObject *PyAudio_ArmStreamReady(PyObject *self, PyObject *args) {
+  PyObject *stream_arg;
+  Py_ssize_t num_frames;
+  if (!PyArg_ParseTuple(args, "O!n", PyAudioModule_GetState(self)->stream_type,
+                        &stream_arg, &num_frames)) {
+    return NULL;
+  }
+
+  PyAudioStream *stream = begin_use(stream_arg);
+  if (!stream) {
+    return NULL;
+  }
+
+  PyAudioNotifier *notifier = get_notifier(stream);
+  if (!notifier) {
+    PyAudioStream_EndUse(stream);
+    return NULL;
+  }
+
+  // Never wait for more than the stream can ever hold, and wait for at least
+  // one frame, so that a signal always means progress.
+  signed long capacity = 0;
+  get_available(stream, &capacity);
+  if (num_frames > capacity) {
+    num_frames = capacity;
+  }
+  if (num_frames < 1) {
+    num_frames = 1;
+  }
+
+  // Drop any earlier signal, then ask for a new one before checking, so that
+  // the real-time thread either sees the request or made the frames
+  // available before the check.
+  PyAudioNotifier_Clear(notifier);
+  PyAudioAtomic_Store(&stream->context.ready_frames, num_frames);
+  signed long available = get_available(stream, &capacity);
+  if (available >= num_frames) {
+    PyAudioAtomic_Store(&stream->context.ready_frames, 0);
+  } else {
+    available = 0;
+  }
+  PyAudioStream_EndUse(stream);
+
+  return PyLong_FromLong(available);
+}
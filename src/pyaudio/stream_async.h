@@ -0,0 +1,38 @@
+// Readiness notifications for event loops. A stream with a capture buffer or
+// a playback queue (see stream_capture.h and stream_playback.h) can wake up an
+// event loop, through a file descriptor, once it can read or write a given
+// number of frames without waiting. The real-time thread signals the
+// descriptor only when someone asked, and only once per request.
+
+#ifndef STREAM_ASYNC_H_
+#define STREAM_ASYNC_H_
+
+#ifndef PY_SSIZE_T_CLEAN
+#define PY_SSIZE_T_CLEAN
+#endif
+#include "Python.h"
+
+#include "stream.h"
+
+// Frees the stream's notifier, if any. The PortAudio stream must already be
+// closed.
+void PyAudioAsync_Free(PyAudioStream *stream);
+
+// Signals the stream's notifier if someone waits for available_frames or
+// fewer frames. Called from the real-time thread, after each period, with the
+// number of frames that the stream can now read (for a capture buffer) or
+// write (for a playback queue) without waiting.
+void PyAudioAsync_Notify(PyAudioStream *stream, size_t available_frames);
+
+// Exported functions.
+
+// Returns the file descriptor that becomes readable when the stream is ready
+// (see PyAudio_ArmStreamReady), creating it on first use.
+PyObject *PyAudio_GetStreamReadyFd(PyObject *self, PyObject *args);
+// Asks for a signal once the stream can read or write a number of frames (at
+// most the size of its buffer) without waiting. If it already can, returns the
+// number of frames that it can read or write instead, without asking.
+// Otherwise, returns 0.
+PyObject *PyAudio_ArmStreamReady(PyObject *self, PyObject *args);
+
+#endif  // STREAM_ASYNC_H_
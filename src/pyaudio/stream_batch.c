@@ -0,0 +1,196 @@
+#include "stream_batch.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef PY_SSIZE_T_CLEAN
+#define PY_SSIZE_T_CLEAN
+#endif
+#include "Python.h"
+#include "portaudio.h"
+
+#include "stream.h"
+#include "stream_io.h"
+#include "thread_state.h"
+
+// Output-only streams call the Python callback at the start of each batch, to
+// render the batch's output just in time. Streams with input call it at the
+// end of each batch, once all of its input has arrived; full-duplex streams
+// then play the output that it renders during the next batch.
+struct PyAudioBatch {
+  unsigned long period_frames;
+  unsigned int periods;
+  size_t period_bytes;
+  double sample_rate;
+  int has_input;
+  int has_output;
+  // `periods` periods of input and output, respectively.
+  char *input;
+  char *output;
+  // Index of the current period within the batch.
+  unsigned int position;
+  // Time info from the batch's first period, and the status flags of all of
+  // its periods.
+  PaStreamCallbackTimeInfo time_info;
+  PaStreamCallbackFlags status_flags;
+  // The callback's most recent result. Once it is paComplete, the stream
+  // plays the remaining output_left periods of output, then finishes.
+  int result;
+  unsigned int output_left;
+};
+
+int PyAudioBatch_Create(PyAudioStream *stream, int input, int output,
+                        unsigned long period_frames, unsigned int periods) {
+  PyAudioBatch *batch = (PyAudioBatch *)calloc(1, sizeof(PyAudioBatch));
+  if (!batch) {
+    PyErr_NoMemory();
+    return -1;
+  }
+
+  batch->period_frames = period_frames;
+  batch->periods = periods;
+  batch->period_bytes = period_frames * stream->context.frame_size;
+  batch->has_input = input;
+  batch->has_output = output;
+  batch->result = paContinue;
+
+  const PaStreamInfo *stream_info = Pa_GetStreamInfo(stream->context.stream);
+  batch->sample_rate = stream_info ? stream_info->sampleRate : 0;
+
+  size_t batch_bytes = batch->period_bytes * periods;
+  // Full-duplex streams start out playing a batch of silence.
+  if ((input && !(batch->input = (char *)malloc(batch_bytes))) ||
+      (output && !(batch->output = (char *)calloc(1, batch_bytes)))) {
+    free(batch->input);
+    free(batch);
+    PyErr_NoMemory();
+    return -1;
+  }
+
+  stream->context.batch = batch;
+  return 0;
+}
+
+void PyAudioBatch_Free(PyAudioStream *stream) {
+  PyAudioBatch *batch = stream->context.batch;
+  if (!batch) {
+    return;
+  }
+
+  free(batch->input);
+  free(batch->output);
+  free(batch);
+  stream->context.batch = NULL;
+}
+
+void PyAudioBatch_Restart(PyAudioStream *stream) {
+  PyAudioBatch *batch = stream->context.batch;
+  if (!batch || batch->result == paContinue) {
+    return;
+  }
+
+  batch->position = 0;
+  batch->result = paContinue;
+  batch->output_left = 0;
+  if (batch->has_output) {
+    memset(batch->output, 0, batch->period_bytes * batch->periods);
+  }
+}
+
+double PyAudioBatch_GetInputLatency(PyAudioStream *stream, double sample_rate) {
+  PyAudioBatch *batch = stream->context.batch;
+  if (!batch || !batch->has_input || sample_rate <= 0) {
+    return 0;
+  }
+  // The batch's first frames wait for the rest of the batch.
+  return (double)batch->period_frames * (batch->periods - 1) / sample_rate;
+}
+
+double PyAudioBatch_GetOutputLatency(PyAudioStream *stream,
+                                     double sample_rate) {
+  PyAudioBatch *batch = stream->context.batch;
+  if (!batch || !batch->has_input || !batch->has_output || sample_rate <= 0) {
+    return 0;
+  }
+  // Full-duplex streams start playing a batch one period after rendering it.
+  return (double)batch->period_frames / sample_rate;
+}
+
+static int run_callback(PyAudioStream *stream, PyAudioBatch *batch,
+                        const PaStreamCallbackTimeInfo *time_info) {
+  PyAudioGILState gil_state;
+  PyAudioGIL_Acquire(&gil_state);
+  int result = PyAudioStream_InvokeCallback(
+      stream, batch->input, batch->output,
+      batch->period_frames * batch->periods, time_info, batch->status_flags);
+  PyAudioGIL_Release(&gil_state);
+  return result;
+}
+
+int PyAudioBatch_CallbackCFunc(const void *input, void *output,
+                               unsigned long frame_count,
+                               const PaStreamCallbackTimeInfo *time_info,
+                               PaStreamCallbackFlags status_flags,
+                               void *user_data) {
+  PyAudioStream *stream = (PyAudioStream *)user_data;
+  PyAudioBatch *batch = stream->context.batch;
+  size_t period_bytes = batch->period_bytes;
+  PyAudioStream_CountXruns(stream, status_flags, frame_count);
+
+  if (batch->result == paAbort) {
+    return paAbort;
+  }
+
+  if (batch->result == paComplete) {
+    // Play out the output that the callback already rendered.
+    if (output && batch->output_left > 0) {
+      memcpy(output, batch->output + batch->position * period_bytes,
+             period_bytes);
+      batch->position++;
+      batch->output_left--;
+    }
+    return batch->output_left > 0 ? paContinue : paComplete;
+  }
+
+  if (batch->position == 0) {
+    batch->time_info = *time_info;
+    batch->status_flags = 0;
+  }
+  batch->status_flags |= status_flags;
+
+  int result = paContinue;
+  if (!input && batch->position == 0) {
+    result = run_callback(stream, batch, time_info);
+  }
+
+  if (input) {
+    memcpy(batch->input + batch->position * period_bytes, input,
+           period_bytes);
+  }
+  if (output) {
+    memcpy(output, batch->output + batch->position * period_bytes,
+           period_bytes);
+  }
+
+  if (input && batch->position == batch->periods - 1) {
+    // The batch's input is complete. Time its output from the next period,
+    // which is when the output starts to play.
+    PaStreamCallbackTimeInfo batch_time_info = batch->time_info;
+    batch_time_info.currentTime = time_info->currentTime;
+    if (output && batch->sample_rate > 0) {
+      batch_time_info.outputBufferDacTime =
+          time_info->outputBufferDacTime +
+          batch->period_frames / batch->sample_rate;
+    }
+    result = run_callback(stream, batch, &batch_time_info);
+  }
+
+  batch->position = (batch->position + 1) % batch->periods;
+  batch->result = result;
+  if (result == paComplete && output) {
+    // Output-only streams already played the batch's first period.
+    batch->output_left = input ? batch->periods : batch->periods - 1;
+    return batch->output_left > 0 ? paContinue : paComplete;
+  }
+  return result;
+}
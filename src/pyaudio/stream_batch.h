@@ -0,0 +1,44 @@
+// Batched callbacks. The stream's PortAudio callback collects several device
+// periods of input, and plays back several periods of output, per call to the
+// Python callback, so that a stream can use small device buffers without
+// entering the interpreter every period.
+
+#ifndef STREAM_BATCH_H_
+#define STREAM_BATCH_H_
+
+#ifndef PY_SSIZE_T_CLEAN
+#define PY_SSIZE_T_CLEAN
+#endif
+#include "Python.h"
+#include "portaudio.h"
+
+#include "stream.h"
+
+// Sets up batching for a stream with fixed periods of period_frames frames,
+// calling the Python callback once every `periods` periods. Returns 0 on
+// success, or -1 with an exception set.
+int PyAudioBatch_Create(PyAudioStream *stream, int input, int output,
+                        unsigned long period_frames, unsigned int periods);
+
+// Frees the stream's batching state, if any. The PortAudio stream must already
+// be closed.
+void PyAudioBatch_Free(PyAudioStream *stream);
+
+// Prepares a batched stream to start again after its callback finished it
+// (returned paComplete or paAbort). Call before Pa_StartStream.
+void PyAudioBatch_Restart(PyAudioStream *stream);
+
+// Return the input and output latency, in seconds, that batching adds to the
+// stream (0 if the stream is not batched).
+double PyAudioBatch_GetInputLatency(PyAudioStream *stream, double sample_rate);
+double PyAudioBatch_GetOutputLatency(PyAudioStream *stream,
+                                     double sample_rate);
+
+// PortAudio stream callback for batched streams.
+int PyAudioBatch_CallbackCFunc(const void *input, void *output,
+                               unsigned long frame_count,
+                               const PaStreamCallbackTimeInfo *time_info,
+                               PaStreamCallbackFlags status_flags,
+                               void *user_data);
+
+#endif  // STREAM_BATCH_H_
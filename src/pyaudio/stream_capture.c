@@ -0,0 +1,191 @@
+#include "stream_capture.h"
+
+#include <stdlib.h>
+
+#ifndef PY_SSIZE_T_CLEAN
+#define PY_SSIZE_T_CLEAN
+#endif
+#include "Python.h"
+#include "portaudio.h"
+
+#include "module_state.h"
+#include "ring_buffer.h"
+#include "stream.h"
+#include "stream_async.h"
+#include "stream_resample.h"
+#include "sync.h"
+
+// How long a read waits for the device between checks for a stopped or
+// closing stream, in ms.
+#define READER_POLL_MS 100
+
+struct PyAudioCapture {
+  // Input, device -> readers. Holds a whole number of frames.
+  PyAudioRingBuffer ring;
+  // Posted by the real-time thread after each period while a reader waits.
+  PyAudioSemaphore *frames_ready;
+  // Set while a reader waits for frames_ready.
+  PyAudioAtomic waiting;
+  // Total number of frames dropped because the ring was full.
+  PyAudioAtomic lost_frames;
+  // Set when input was lost, in the ring or in the device, since the last
+  // read.
+  PyAudioAtomic overflowed;
+};
+
+static void free_capture(PyAudioCapture *capture) {
+  PyAudioRingBuffer_Free(&capture->ring);
+  PyAudioSemaphore_Free(capture->frames_ready);
+  free(capture);
+}
+
+int PyAudioCapture_Create(PyAudioStream *stream, unsigned long ring_frames) {
+  PyAudioCapture *capture = (PyAudioCapture *)calloc(1, sizeof(PyAudioCapture));
+  if (!capture) {
+    PyErr_NoMemory();
+    return -1;
+  }
+
+  if (PyAudioRingBuffer_Init(&capture->ring,
+                             (size_t)ring_frames * stream->context.frame_size) <
+          0 ||
+      !(capture->frames_ready = PyAudioSemaphore_New())) {
+    free_capture(capture);
+    PyErr_NoMemory();
+    return -1;
+  }
+
+  stream->context.capture = capture;
+  return 0;
+}
+
+void PyAudioCapture_Free(PyAudioStream *stream) {
+  PyAudioCapture *capture = stream->context.capture;
+  if (!capture) {
+    return;
+  }
+  stream->context.capture = NULL;
+  free_capture(capture);
+}
+
+PaError PyAudioCapture_ReadStream(PyAudioStream *stream, void *buffer,
+                                  unsigned long frames) {
+  PyAudioCapture *capture = stream->context.capture;
+  if (!capture) {
+    PaError err = PyAudioResample_ReadStream(stream, buffer, frames);
+    if (err == paInputOverflowed) {
+      PyAudioStream_CountXruns(stream, paInputOverflow, frames);
+    }
+    return err;
+  }
+
+  PyAudioRingBuffer *ring = &capture->ring;
+  char *dst = (char *)buffer;
+  size_t num_bytes = (size_t)frames * stream->context.frame_size;
+  while (num_bytes > 0) {
+    size_t num_read = PyAudioRingBuffer_Read(ring, dst, num_bytes);
+    dst += num_read;
+    num_bytes -= num_read;
+    if (num_bytes == 0) {
+      break;
+    }
+
+    // Announce the wait before checking the ring again, so that the
+    // real-time thread either sees the announcement or wrote before the
+    // check.
+    PyAudioAtomic_Store(&capture->waiting, 1);
+    if (PyAudioRingBuffer_ReadAvailable(ring) == 0) {
+      PaError active = Pa_IsStreamActive(stream->context.stream);
+      if (active != 1 || PyAudioAtomic_Load(&stream->closing)) {
+        // No more input is coming.
+        PyAudioAtomic_Store(&capture->waiting, 0);
+        return active < 0 ? active : paStreamIsStopped;
+      }
+      PyAudioSemaphore_Wait(capture->frames_ready, READER_POLL_MS);
+    }
+    PyAudioAtomic_Store(&capture->waiting, 0);
+  }
+
+  return PyAudioAtomic_Exchange(&capture->overflowed, 0) ? paInputOverflowed
+                                                        : paNoError;
+}
+
+signed long PyAudioCapture_GetReadAvailable(PyAudioStream *stream) {
+  PyAudioCapture *capture = stream->context.capture;
+  if (!capture) {
+    return PyAudioResample_GetReadAvailable(
+        stream, Pa_GetStreamReadAvailable(stream->context.stream));
+  }
+  return (signed long)(PyAudioRingBuffer_ReadAvailable(&capture->ring) /
+                       stream->context.frame_size);
+}
+
+signed long PyAudioCapture_GetCapacity(PyAudioStream *stream) {
+  return (signed long)(stream->context.capture->ring.capacity /
+                       stream->context.frame_size);
+}
+
+int PyAudioCapture_CallbackCFunc(const void *input, void *output,
+                                 unsigned long frame_count,
+                                 const PaStreamCallbackTimeInfo *time_info,
+                                 PaStreamCallbackFlags status_flags,
+                                 void *user_data) {
+  PyAudioStream *stream = (PyAudioStream *)user_data;
+  PyAudioCapture *capture = stream->context.capture;
+  size_t frame_size = stream->context.frame_size;
+  PyAudioStream_CountXruns(stream, status_flags, frame_count);
+
+  // Keep what fits, and drop the rest of the period.
+  unsigned long num_frames =
+      (unsigned long)(PyAudioRingBuffer_WriteAvailable(&capture->ring) /
+                      frame_size);
+  if (num_frames > frame_count) {
+    num_frames = frame_count;
+  }
+  if (input) {
+    PyAudioRingBuffer_Write(&capture->ring, input, num_frames * frame_size);
+  }
+
+  if (num_frames < frame_count) {
+    PyAudioAtomic_Add(&capture->lost_frames, frame_count - num_frames);
+    PyAudioStream_CountXruns(stream, paInputOverflow,
+                             frame_count - num_frames);
+    PyAudioAtomic_Store(&capture->overflowed, 1);
+  }
+  if (status_flags & paInputOverflow) {
+    PyAudioAtomic_Store(&capture->overflowed, 1);
+  }
+
+  if (PyAudioAtomic_Load(&capture->waiting)) {
+    PyAudioSemaphore_Post(capture->frames_ready);
+  }
+  PyAudioAsync_Notify(stream, PyAudioRingBuffer_ReadAvailable(&capture->ring) /
+                                  frame_size);
+  return paContinue;
+}
+
+PyObject *PyAudio_GetStreamCaptureLostFrames(PyObject *self, PyObject *args) {
+  PyObject *stream_arg;
+  if (!PyArg_ParseTuple(args, "O!", PyAudioModule_GetState(self)->stream_type,
+                        &stream_arg)) {
+    return NULL;
+  }
+
+  PyAudioStream *stream = (PyAudioStream *)stream_arg;
+  if (!PyAudioStream_BeginUse(stream)) {
+    PyErr_SetObject(PyExc_IOError,
+                    Py_BuildValue("(i,s)", paBadStreamPtr, "Stream closed"));
+    return NULL;
+  }
+
+  PyAudioCapture *capture = stream->context.capture;
+  if (!capture) {
+    PyAudioStream_EndUse(stream);
+    PyErr_SetString(PyExc_ValueError, "Stream has no capture buffer");
+    return NULL;
+  }
+
+  long long lost_frames = (long long)PyAudioAtomic_Load(&capture->lost_frames);
+  PyAudioStream_EndUse(stream);
+  return PyLong_FromLongLong(lost_frames);
+}
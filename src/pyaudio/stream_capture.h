@@ -0,0 +1,57 @@
+// Background capture for blocking input streams. PortAudio's real-time thread
+// continuously moves input from the device into a large lock-free ring buffer,
+// without ever waiting for the Python interpreter, and blocking reads are
+// served from that ring. Python threads may then stall for as long as the
+// ring lasts without the device overflowing.
+
+#ifndef STREAM_CAPTURE_H_
+#define STREAM_CAPTURE_H_
+
+#ifndef PY_SSIZE_T_CLEAN
+#define PY_SSIZE_T_CLEAN
+#endif
+#include "Python.h"
+#include "portaudio.h"
+
+#include "stream.h"
+
+// Sets up background capture for an input stream, with a ring buffer of
+// ring_frames frames. Returns 0 on success, or -1 with an exception set.
+int PyAudioCapture_Create(PyAudioStream *stream, unsigned long ring_frames);
+
+// Frees the stream's capture state, if any. The PortAudio stream must already
+// be closed.
+void PyAudioCapture_Free(PyAudioStream *stream);
+
+// Reads exactly `frames` frames, as Pa_ReadStream does: from the capture ring
+// if the stream has one, waiting for the device as needed, or from the
+// PortAudio stream otherwise. Returns paInputOverflowed if input was lost
+// since the previous read. Does not require the GIL, but the stream must be in
+// use (see PyAudioStream_BeginUse).
+PaError PyAudioCapture_ReadStream(PyAudioStream *stream, void *buffer,
+                                  unsigned long frames);
+
+// Returns the number of frames that PyAudioCapture_ReadStream can read without
+// waiting, as Pa_GetStreamReadAvailable does. Same requirements as
+// PyAudioCapture_ReadStream.
+signed long PyAudioCapture_GetReadAvailable(PyAudioStream *stream);
+
+// Returns the size of the stream's capture ring, in frames. The stream must
+// have one.
+signed long PyAudioCapture_GetCapacity(PyAudioStream *stream);
+
+// PortAudio stream callback for streams with background capture. Never
+// acquires the GIL.
+int PyAudioCapture_CallbackCFunc(const void *input, void *output,
+                                 unsigned long frame_count,
+                                 const PaStreamCallbackTimeInfo *time_info,
+                                 PaStreamCallbackFlags status_flags,
+                                 void *user_data);
+
+// Exported functions.
+
+// Returns the total number of frames that the capture ring dropped because it
+// was full.
+PyObject *PyAudio_GetStreamCaptureLostFrames(PyObject *self, PyObject *args);
+
+#endif  // STREAM_CAPTURE_H_
@@ -0,0 +1,181 @@
+#include "stream_convert.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef PY_SSIZE_T_CLEAN
+#define PY_SSIZE_T_CLEAN
+#endif
+#include "Python.h"
+#include "portaudio.h"
+
+#include "convert.h"
+#include "stream.h"
+#include "stream_mix.h"
+
+// The fewest frames that the scratch buffers hold. Blocking transfers convert
+// this many frames at a time, or frames_per_buffer if larger.
+#define MIN_CHUNK_FRAMES 4096
+
+struct PyAudioConvert {
+  // The callback that runs on converted periods, for callback streams.
+  PaStreamCallback *callback;
+  // Device format -> application format, and back.
+  PyAudioConverter input;
+  PyAudioConverter output;
+  unsigned int channels;
+  unsigned int device_frame_size;
+  // Size of the scratch buffers, in frames.
+  unsigned long chunk_frames;
+  // Scratch buffers for input and output, in whichever of the two formats
+  // needs them (the device's for blocking transfers, the application's for
+  // callbacks). Each holds chunk_frames frames of the larger format. NULL
+  // for a direction that the stream does not have.
+  void *input_buffer;
+  void *output_buffer;
+};
+
+static void free_convert(PyAudioConvert *convert) {
+  free(convert->input_buffer);
+  free(convert->output_buffer);
+  free(convert);
+}
+
+int PyAudioConvert_Create(PyAudioStream *stream, PaSampleFormat app_format,
+                          PaSampleFormat device_format, int channels,
+                          int input, int output, PaStreamCallback *callback,
+                          unsigned long frames_per_buffer) {
+  PyAudioConvert *convert = (PyAudioConvert *)calloc(1, sizeof(PyAudioConvert));
+  if (!convert) {
+    PyErr_NoMemory();
+    return -1;
+  }
+
+  convert->callback = callback;
+  PyAudioConverter_Init(&convert->input, device_format, app_format);
+  PyAudioConverter_Init(&convert->output, app_format, device_format);
+  convert->channels = (unsigned int)channels;
+  convert->device_frame_size = convert->output.to_size * channels;
+  convert->chunk_frames = frames_per_buffer > MIN_CHUNK_FRAMES
+                              ? frames_per_buffer
+                              : MIN_CHUNK_FRAMES;
+
+  unsigned int sample_size = convert->input.from_size > convert->input.to_size
+                                 ? convert->input.from_size
+                                 : convert->input.to_size;
+  size_t num_bytes = (size_t)convert->chunk_frames * sample_size * channels;
+  if ((input && !(convert->input_buffer = malloc(num_bytes))) ||
+      (output && !(convert->output_buffer = malloc(num_bytes)))) {
+    free_convert(convert);
+    PyErr_NoMemory();
+    return -1;
+  }
+
+  stream->context.convert = convert;
+  return 0;
+}
+
+void PyAudioConvert_Free(PyAudioStream *stream) {
+  PyAudioConvert *convert = stream->context.convert;
+  if (!convert) {
+    return;
+  }
+  stream->context.convert = NULL;
+  free_convert(convert);
+}
+
+PaError PyAudioConvert_ReadStream(PyAudioStream *stream, void *buffer,
+                                  unsigned long frames) {
+  PyAudioConvert *convert = stream->context.convert;
+  if (!convert) {
+    return PyAudioMix_ReadStream(stream, buffer, frames);
+  }
+
+  // Overflows lose input before the chunk that reports them, so keep
+  // reading, and report the overflow at the end.
+  PaError result = paNoError;
+  char *dst = (char *)buffer;
+  while (frames > 0) {
+    unsigned long n =
+        frames < convert->chunk_frames ? frames : convert->chunk_frames;
+    PaError err = PyAudioMix_ReadStream(stream, convert->input_buffer, n);
+    if (err == paInputOverflowed) {
+      result = err;
+    } else if (err != paNoError) {
+      return err;
+    }
+    PyAudioConverter_Run(&convert->input, dst, convert->input_buffer,
+                         (size_t)n * convert->channels);
+    dst += (size_t)n * stream->context.frame_size;
+    frames -= n;
+  }
+  return result;
+}
+
+PaError PyAudioConvert_WriteStream(PyAudioStream *stream, const void *buffer,
+                                   unsigned long frames) {
+  PyAudioConvert *convert = stream->context.convert;
+  if (!convert) {
+    return PyAudioMix_WriteStream(stream, buffer, frames);
+  }
+
+  // Likewise, underflows happen before the chunk that reports them.
+  PaError result = paNoError;
+  const char *src = (const char *)buffer;
+  while (frames > 0) {
+    unsigned long n =
+        frames < convert->chunk_frames ? frames : convert->chunk_frames;
+    PyAudioConverter_Run(&convert->output, convert->output_buffer, src,
+                         (size_t)n * convert->channels);
+    PaError err = PyAudioMix_WriteStream(stream, convert->output_buffer, n);
+    if (err == paOutputUnderflowed) {
+      result = err;
+    } else if (err != paNoError) {
+      return err;
+    }
+    src += (size_t)n * stream->context.frame_size;
+    frames -= n;
+  }
+  return result;
+}
+
+int PyAudioConvert_CallbackCFunc(const void *input, void *output,
+                                 unsigned long frame_count,
+                                 const PaStreamCallbackTimeInfo *time_info,
+                                 PaStreamCallbackFlags status_flags,
+                                 void *user_data) {
+  PyAudioStream *stream = (PyAudioStream *)user_data;
+  PyAudioConvert *convert = stream->context.convert;
+  const char *src = (const char *)input;
+  char *dst = (char *)output;
+  int result = paContinue;
+
+  while (frame_count > 0 && result == paContinue) {
+    unsigned long n = frame_count < convert->chunk_frames
+                          ? frame_count
+                          : convert->chunk_frames;
+    size_t num_samples = (size_t)n * convert->channels;
+    if (src) {
+      PyAudioConverter_Run(&convert->input, convert->input_buffer, src,
+                           num_samples);
+      src += num_samples * convert->input.from_size;
+    }
+    result = convert->callback(src ? convert->input_buffer : NULL,
+                               dst ? convert->output_buffer : NULL, n,
+                               time_info, status_flags, stream);
+    if (dst) {
+      PyAudioConverter_Run(&convert->output, dst, convert->output_buffer,
+                           num_samples);
+      dst += (size_t)n * convert->device_frame_size;
+    }
+    // Report xruns only once per period.
+    status_flags = 0;
+    frame_count -= n;
+  }
+
+  // The callback finished early: play silence for the rest of the period.
+  if (dst && frame_count > 0) {
+    memset(dst, 0, (size_t)frame_count * convert->device_frame_size);
+  }
+  return result;
+}
@@ -0,0 +1,51 @@
+// Sample format conversion for streams whose device format differs from the
+// format that the application reads and writes (see convert.h). Blocking
+// reads and writes convert a chunk at a time through a scratch buffer, and
+// callbacks of every kind run behind a wrapper that converts each period on
+// PortAudio's real-time thread, so the rest of the stream only ever sees the
+// application's format.
+
+#ifndef STREAM_CONVERT_H_
+#define STREAM_CONVERT_H_
+
+#ifndef PY_SSIZE_T_CLEAN
+#define PY_SSIZE_T_CLEAN
+#endif
+#include "Python.h"
+#include "portaudio.h"
+
+#include "stream.h"
+
+// Sets up conversion between app_format, which the stream's frame_size and
+// sample_size describe, and device_format, which the PortAudio stream was
+// opened with. For callback streams, `callback` is the callback that
+// PyAudioConvert_CallbackCFunc calls with converted periods; NULL otherwise.
+// Returns 0 on success, or -1 with an exception set.
+int PyAudioConvert_Create(PyAudioStream *stream, PaSampleFormat app_format,
+                          PaSampleFormat device_format, int channels,
+                          int input, int output, PaStreamCallback *callback,
+                          unsigned long frames_per_buffer);
+
+// Frees the stream's conversion state, if any. The PortAudio stream must
+// already be closed.
+void PyAudioConvert_Free(PyAudioStream *stream);
+
+// Reads and writes exactly `frames` frames in the application's format, as
+// PyAudioMix_ReadStream and PyAudioMix_WriteStream do in the device's,
+// converting if the stream has a different device format. Does not require the
+// GIL, but the stream must be in use (see PyAudioStream_BeginUse).
+PaError PyAudioConvert_ReadStream(PyAudioStream *stream, void *buffer,
+                                  unsigned long frames);
+PaError PyAudioConvert_WriteStream(PyAudioStream *stream, const void *buffer,
+                                   unsigned long frames);
+
+// PortAudio stream callback for callback streams with conversion. Runs the
+// stream's callback on converted periods, in pieces if PortAudio passes more
+// frames than the scratch buffers hold.
+int PyAudioConvert_CallbackCFunc(const void *input, void *output,
+                                 unsigned long frame_count,
+                                 const PaStreamCallbackTimeInfo *time_info,
+                                 PaStreamCallbackFlags status_flags,
+                                 void *user_data);
+
+#endif  // STREAM_CONVERT_H_
@@ -0,0 +1,336 @@
+#include "stream_decoupled.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef PY_SSIZE_T_CLEAN
+#define PY_SSIZE_T_CLEAN
+#endif
+#include "Python.h"
+#include "portaudio.h"
+#include "pythread.h"
+
+#include "module_state.h"
+#include "ring_buffer.h"
+#include "stream.h"
+#include "stream_io.h"
+#include "sync.h"
+
+// How long the worker sleeps between checks for a closing stream, in ms.
+#define WORKER_POLL_MS 100
+
+// Worker states.
+#define WORKER_IDLE 0
+#define WORKER_RUNNING 1
+
+// Per-period metadata, passed from the real-time thread to the worker.
+typedef struct {
+  PaStreamCallbackTimeInfo time_info;
+  PaStreamCallbackFlags status_flags;
+} PeriodInfo;
+
+struct PyAudioDecoupled {
+  unsigned long period_frames;
+  unsigned int periods;
+  size_t period_bytes;
+  int has_input;
+  int has_output;
+  // Audio, device -> worker and worker -> device.
+  PyAudioRingBuffer input_ring;
+  PyAudioRingBuffer output_ring;
+  // One PeriodInfo per period delivered by the device.
+  PyAudioRingBuffer period_ring;
+  // Worker-side staging buffers, of period_bytes each.
+  char *input_period;
+  char *output_period;
+  // Posted by the real-time thread after each period.
+  PyAudioSemaphore *period_ready;
+  // Posted by the worker when it stops running the callback.
+  PyAudioSemaphore *worker_exited;
+  // Most recent callback result (a PaStreamCallbackResult), which tells the
+  // real-time thread when to finish the stream.
+  PyAudioAtomic result;
+  // WORKER_IDLE or WORKER_RUNNING.
+  PyAudioAtomic worker;
+  // Set when the stream is closing, to stop the worker.
+  PyAudioAtomic stop;
+  // Set when the stream closes from within the callback; the worker then
+  // owns, and frees, this struct.
+  PyAudioAtomic orphaned;
+  unsigned long worker_thread_id;
+};
+
+static void free_decoupled(PyAudioDecoupled *decoupled) {
+  PyAudioRingBuffer_Free(&decoupled->input_ring);
+  PyAudioRingBuffer_Free(&decoupled->output_ring);
+  PyAudioRingBuffer_Free(&decoupled->period_ring);
+  free(decoupled->input_period);
+  free(decoupled->output_period);
+  PyAudioSemaphore_Free(decoupled->period_ready);
+  PyAudioSemaphore_Free(decoupled->worker_exited);
+  free(decoupled);
+}
+
+int PyAudioDecoupled_Create(PyAudioStream *stream, int input, int output,
+                            unsigned long period_frames, unsigned int periods) {
+  PyAudioDecoupled *decoupled =
+      (PyAudioDecoupled *)calloc(1, sizeof(PyAudioDecoupled));
+  if (!decoupled) {
+    PyErr_NoMemory();
+    return -1;
+  }
+
+  decoupled->period_frames = period_frames;
+  decoupled->periods = periods;
+  decoupled->period_bytes = period_frames * stream->context.frame_size;
+  decoupled->has_input = input;
+  decoupled->has_output = output;
+  PyAudioAtomic_Store(&decoupled->result, paContinue);
+
+  size_t ring_bytes = decoupled->period_bytes * periods;
+  if ((input &&
+       (PyAudioRingBuffer_Init(&decoupled->input_ring, ring_bytes) < 0 ||
+        !(decoupled->input_period = malloc(decoupled->period_bytes)))) ||
+      (output &&
+       (PyAudioRingBuffer_Init(&decoupled->output_ring, ring_bytes) < 0 ||
+        !(decoupled->output_period = malloc(decoupled->period_bytes)))) ||
+      PyAudioRingBuffer_Init(&decoupled->period_ring,
+                             sizeof(PeriodInfo) * periods) < 0 ||
+      !(decoupled->period_ready = PyAudioSemaphore_New()) ||
+      !(decoupled->worker_exited = PyAudioSemaphore_New())) {
+    free_decoupled(decoupled);
+    PyErr_NoMemory();
+    return -1;
+  }
+
+  // Start with a full output ring of silence: this is the headroom that lets
+  // the worker fall behind by up to `periods` periods without an underflow.
+  if (output) {
+    PyAudioRingBuffer_Write(&decoupled->output_ring, NULL, ring_bytes);
+  }
+
+  stream->context.decoupled = decoupled;
+  return 0;
+}
+
+void PyAudioDecoupled_Free(PyAudioStream *stream) {
+  PyAudioDecoupled *decoupled = stream->context.decoupled;
+  if (!decoupled) {
+    return;
+  }
+  stream->context.decoupled = NULL;
+
+  PyAudioAtomic_Store(&decoupled->stop, 1);
+  if (PyAudioAtomic_Load(&decoupled->worker) == WORKER_RUNNING) {
+    if (decoupled->worker_thread_id ==
+        (unsigned long)PyThread_get_thread_ident()) {
+      // The callback closed its own stream. The worker frees the state once
+      // the callback returns.
+      PyAudioAtomic_Store(&decoupled->orphaned, 1);
+      return;
+    }
+
+    PyAudioSemaphore_Post(decoupled->period_ready);
+    // clang-format off
+    Py_BEGIN_ALLOW_THREADS
+    PyAudioSemaphore_Wait(decoupled->worker_exited, -1);
+    Py_END_ALLOW_THREADS
+    // clang-format on
+  }
+
+  free_decoupled(decoupled);
+}
+
+void PyAudioDecoupled_Restart(PyAudioStream *stream) {
+  PyAudioDecoupled *decoupled = stream->context.decoupled;
+  if (!decoupled || PyAudioAtomic_Load(&decoupled->result) == paContinue ||
+      PyAudioAtomic_Load(&decoupled->worker) != WORKER_IDLE) {
+    return;
+  }
+
+  // Neither the device thread nor a worker is using the rings, so start over
+  // with the initial headroom.
+  PyAudioRingBuffer *input_ring = &decoupled->input_ring;
+  PyAudioRingBuffer *output_ring = &decoupled->output_ring;
+  PyAudioRingBuffer *period_ring = &decoupled->period_ring;
+  if (decoupled->has_input) {
+    PyAudioRingBuffer_Read(input_ring, NULL,
+                           PyAudioRingBuffer_ReadAvailable(input_ring));
+  }
+  if (decoupled->has_output) {
+    PyAudioRingBuffer_Write(output_ring, NULL,
+                            PyAudioRingBuffer_WriteAvailable(output_ring));
+  }
+  PyAudioRingBuffer_Read(period_ring, NULL,
+                         PyAudioRingBuffer_ReadAvailable(period_ring));
+  PyAudioAtomic_Store(&decoupled->result, paContinue);
+}
+
+double PyAudioDecoupled_GetOutputLatency(PyAudioStream *stream,
+                                         double sample_rate) {
+  PyAudioDecoupled *decoupled = stream->context.decoupled;
+  if (!decoupled || !decoupled->has_output || sample_rate <= 0) {
+    return 0;
+  }
+  return (double)decoupled->period_frames * decoupled->periods / sample_rate;
+}
+
+int PyAudioDecoupled_CallbackCFunc(const void *input, void *output,
+                                   unsigned long frame_count,
+                                   const PaStreamCallbackTimeInfo *time_info,
+                                   PaStreamCallbackFlags status_flags,
+                                   void *user_data) {
+  PyAudioStream *stream = (PyAudioStream *)user_data;
+  PyAudioDecoupled *decoupled = stream->context.decoupled;
+  size_t num_bytes = frame_count * stream->context.frame_size;
+  int64_t result = PyAudioAtomic_Load(&decoupled->result);
+  PyAudioStream_CountXruns(stream, status_flags, frame_count);
+
+  if (result == paAbort) {
+    return paAbort;
+  }
+
+  // Each period needs a PeriodInfo slot; without one, the worker has fallen
+  // more than `periods` periods behind, and the period is dropped.
+  int has_room = PyAudioRingBuffer_WriteAvailable(&decoupled->period_ring) >=
+                 sizeof(PeriodInfo);
+
+  if (input) {
+    if (has_room &&
+        PyAudioRingBuffer_WriteAvailable(&decoupled->input_ring) >= num_bytes) {
+      PyAudioRingBuffer_Write(&decoupled->input_ring, input, num_bytes);
+    } else {
+      status_flags |= paInputOverflow;
+    }
+  }
+
+  if (output) {
+    size_t num_read =
+        PyAudioRingBuffer_Read(&decoupled->output_ring, output, num_bytes);
+    if (num_read < num_bytes) {
+      memset((char *)output + num_read, 0, num_bytes - num_read);
+      if (result == paComplete) {
+        // Played out everything that the callback produced.
+        return paComplete;
+      }
+      status_flags |= paOutputUnderflow;
+    }
+  } else if (result == paComplete) {
+    return paComplete;
+  }
+
+  if (result == paContinue && has_room) {
+    PeriodInfo info;
+    info.time_info = *time_info;
+    info.status_flags = status_flags;
+    PyAudioRingBuffer_Write(&decoupled->period_ring, &info, sizeof(info));
+    PyAudioSemaphore_Post(decoupled->period_ready);
+  }
+
+  return paContinue;
+}
+
+// Runs the callback for every period that is ready. Returns the callback's
+// most recent result.
+static int process_periods(PyAudioStream *stream, PyAudioDecoupled *decoupled) {
+  int result = paContinue;
+  size_t period_bytes = decoupled->period_bytes;
+  PeriodInfo info;
+
+  while (result == paContinue && !PyAudioAtomic_Load(&decoupled->stop) &&
+         PyAudioRingBuffer_ReadAvailable(&decoupled->period_ring) >=
+             sizeof(info)) {
+    if (decoupled->has_output &&
+        PyAudioRingBuffer_WriteAvailable(&decoupled->output_ring) <
+            period_bytes) {
+      break;
+    }
+
+    PyAudioRingBuffer_Read(&decoupled->period_ring, &info, sizeof(info));
+    if (decoupled->has_input) {
+      if (!(info.status_flags & paInputOverflow) &&
+          PyAudioRingBuffer_ReadAvailable(&decoupled->input_ring) >=
+              period_bytes) {
+        PyAudioRingBuffer_Read(&decoupled->input_ring, decoupled->input_period,
+                               period_bytes);
+      } else {
+        memset(decoupled->input_period, 0, period_bytes);
+      }
+    }
+
+    result = PyAudioStream_InvokeCallback(
+        stream, decoupled->input_period, decoupled->output_period,
+        decoupled->period_frames, &info.time_info, info.status_flags);
+
+    if (PyAudioAtomic_Load(&decoupled->orphaned)) {
+      break;
+    }
+
+    if (decoupled->has_output) {
+      PyAudioRingBuffer_Write(&decoupled->output_ring, decoupled->output_period,
+                              period_bytes);
+    }
+  }
+
+  return result;
+}
+
+PyObject *PyAudio_RunDecoupledCallback(PyObject *self, PyObject *args) {
+  PyObject *stream_arg;
+  if (!PyArg_ParseTuple(args, "O!", PyAudioModule_GetState(self)->stream_type,
+                        &stream_arg)) {
+    return NULL;
+  }
+
+  PyAudioStream *stream = (PyAudioStream *)stream_arg;
+  if (!PyAudioStream_IsOpen(stream)) {
+    PyErr_SetObject(PyExc_IOError,
+                    Py_BuildValue("(i,s)", paBadStreamPtr, "Stream closed"));
+    return NULL;
+  }
+
+  PyAudioDecoupled *decoupled = stream->context.decoupled;
+  if (!decoupled) {
+    PyErr_SetString(PyExc_ValueError, "Stream is not in decoupled mode");
+    return NULL;
+  }
+
+  if (PyAudioAtomic_Exchange(&decoupled->worker, WORKER_RUNNING) !=
+      WORKER_IDLE) {
+    PyErr_SetString(PyExc_RuntimeError, "Callback worker already running");
+    return NULL;
+  }
+  decoupled->worker_thread_id = (unsigned long)PyThread_get_thread_ident();
+  // Discard the exit notification from a previous worker, if any.
+  while (PyAudioSemaphore_Wait(decoupled->worker_exited, 0)) {
+  }
+
+  // Keep the stream alive while the worker runs, even if the last Python
+  // reference goes away.
+  Py_INCREF(stream);
+
+  int result = paContinue;
+  while (result == paContinue && !PyAudioAtomic_Load(&decoupled->stop)) {
+    // clang-format off
+    Py_BEGIN_ALLOW_THREADS
+    PyAudioSemaphore_Wait(decoupled->period_ready, WORKER_POLL_MS);
+    Py_END_ALLOW_THREADS
+    // clang-format on
+
+    result = process_periods(stream, decoupled);
+    if (PyAudioAtomic_Load(&decoupled->orphaned)) {
+      free_decoupled(decoupled);
+      Py_DECREF(stream);
+      Py_RETURN_NONE;
+    }
+  }
+
+  if (result != paContinue) {
+    PyAudioAtomic_Store(&decoupled->result, result);
+  }
+  PyAudioAtomic_Store(&decoupled->worker, WORKER_IDLE);
+  PyAudioSemaphore_Post(decoupled->worker_exited);
+
+  Py_DECREF(stream);
+  Py_RETURN_NONE;
+}
@@ -0,0 +1,51 @@
+// Decoupled callback mode. PortAudio's real-time thread only moves audio
+// between the device and lock-free ring buffers, and never waits for the
+// Python interpreter. A separate worker thread runs the stream's Python
+// callback against those rings, with a configurable number of periods of
+// headroom.
+
+#ifndef STREAM_DECOUPLED_H_
+#define STREAM_DECOUPLED_H_
+
+#ifndef PY_SSIZE_T_CLEAN
+#define PY_SSIZE_T_CLEAN
+#endif
+#include "Python.h"
+#include "portaudio.h"
+
+#include "stream.h"
+
+// Sets up decoupled mode for a stream with fixed periods of period_frames
+// frames, buffering up to `periods` periods in each direction. Returns 0 on
+// success, or -1 with an exception set.
+int PyAudioDecoupled_Create(PyAudioStream *stream, int input, int output,
+                            unsigned long period_frames, unsigned int periods);
+
+// Stops the worker and frees the stream's decoupled state, if any. Waits for
+// the worker to finish running the callback, unless called from the worker
+// itself. The PortAudio stream must already be closed. Requires the GIL.
+void PyAudioDecoupled_Free(PyAudioStream *stream);
+
+// Prepares a decoupled stream to start again after its callback finished it
+// (returned paComplete or paAbort). Call before Pa_StartStream.
+void PyAudioDecoupled_Restart(PyAudioStream *stream);
+
+// Returns the output latency, in seconds, that decoupled mode adds to the
+// stream (0 if the stream is not decoupled).
+double PyAudioDecoupled_GetOutputLatency(PyAudioStream *stream,
+                                         double sample_rate);
+
+// PortAudio stream callback for decoupled streams. Never acquires the GIL.
+int PyAudioDecoupled_CallbackCFunc(const void *input, void *output,
+                                   unsigned long frame_count,
+                                   const PaStreamCallbackTimeInfo *time_info,
+                                   PaStreamCallbackFlags status_flags,
+                                   void *user_data);
+
+// Exported functions.
+
+// Runs the worker loop for a decoupled stream, until the callback completes
+// or aborts, or the stream closes.
+PyObject *PyAudio_RunDecoupledCallback(PyObject *self, PyObject *args);
+
+#endif  // STREAM_DECOUPLED_H_
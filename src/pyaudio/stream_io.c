@@ -2,6 +2,7 @@
 
 #include <assert.h>
 #include <stdio.h>
+#include <string.h>
 
 #ifndef PY_SSIZE_T_CLEAN
 #define PY_SSIZE_T_CLEAN
@@ -9,15 +10,260 @@
 #include "Python.h"
 #include "portaudio.h"
 
+#include "convert.h"
+#include "module_state.h"
 #include "stream.h"
+#include "stream_capture.h"
+#include "stream_planar.h"
+#include "stream_playback.h"
+#include "stream_resample.h"
+#include "thread_state.h"
+#include "time_info.h"
+
+// Returns whether nothing but the stream refers to view, or to anything
+// derived from it: the callback kept neither the view, nor a slice or cast of
+// it, nor an export of it (e.g., a NumPy array), and did not release it. Only
+// then may the stream write to the view's memory again.
+static int is_view_unshared(PyObject *view) {
+  PyMemoryViewObject *memoryview = (PyMemoryViewObject *)view;
+  return Py_REFCNT(view) == 1 && memoryview->exports == 0 &&
+         memoryview->mbuf->exports == 1;
+}
+
+// Ensures that *view is a memoryview of exactly num_bytes bytes over the start
+// of *buffer, a bytearray that the stream owns, and that nothing else refers
+// to either (see is_view_unshared). Reuses both from the previous period if
+// possible. Otherwise, leaves them to whatever still refers to them, so that
+// the samples that a callback kept never change, and allocates new ones. The
+// view is read-only if readonly is set (except before Python 3.8, which lacks
+// memoryview.toreadonly). Returns 0 on success, or -1 with an exception set.
+static int reserve_view(PyObject **buffer, PyObject **view,
+                        Py_ssize_t num_bytes, int readonly) {
+  if (*view != NULL && is_view_unshared(*view) &&
+      PyMemoryView_GET_BUFFER(*view)->len == num_bytes) {
+    return 0;
+  }
+
+  // Dropping a view that nothing else refers to also ends its export of the
+  // buffer, so the buffer can be reused.
+  Py_CLEAR(*view);
+  if (*buffer == NULL || ((PyByteArrayObject *)*buffer)->ob_exports != 0 ||
+      PyByteArray_GET_SIZE(*buffer) < num_bytes) {
+    PyObject *new_buffer = PyByteArray_FromStringAndSize(NULL, num_bytes);
+    if (new_buffer == NULL) {
+      return -1;
+    }
+    Py_XDECREF(*buffer);
+    *buffer = new_buffer;
+  }
+
+  PyObject *full_view = PyMemoryView_FromObject(*buffer);
+  if (full_view == NULL) {
+    return -1;
+  }
+  PyObject *new_view = PySequence_GetSlice(full_view, 0, num_bytes);
+  Py_DECREF(full_view);
+#if PY_VERSION_HEX >= 0x03080000
+  if (new_view != NULL && readonly) {
+    PyObject *readonly_view = PyObject_CallMethod(new_view, "toreadonly", NULL);
+    Py_DECREF(new_view);
+    new_view = readonly_view;
+  }
+#endif
+  if (new_view == NULL) {
+    return -1;
+  }
+  *view = new_view;
+  return 0;
+}
+
+int PyAudioStream_ReserveInputBuffer(PyAudioStream *stream,
+                                     unsigned long frame_count) {
+  return reserve_view(&stream->context.input_buffer,
+                      &stream->context.input_view,
+                      (Py_ssize_t)frame_count * stream->context.frame_size, 1);
+}
+
+// Like PyAudioStream_ReserveInputBuffer, for the output of in-place callbacks.
+static int reserve_output_buffer(PyAudioStream *stream,
+                                 unsigned long frame_count) {
+  return reserve_view(&stream->context.output_buffer,
+                      &stream->context.output_view,
+                      (Py_ssize_t)frame_count * stream->context.frame_size, 0);
+}
+
+int PyAudioStream_SetCallback(PyAudioStream *stream, PyObject *callback,
+                              PyTypeObject *time_info_type,
+                              unsigned long max_frame_count) {
+  Py_INCREF(callback);
+  stream->context.callback = callback;
+  Py_INCREF(time_info_type);
+  stream->context.time_info_type = time_info_type;
+
+  // Allocate up front when the period is known, so the callback thread never
+  // has to.
+  if (max_frame_count == 0) {
+    return 0;
+  }
+  if (stream->context.reuse_input_buffer &&
+      PyAudioStream_ReserveInputBuffer(stream, max_frame_count) < 0) {
+    return -1;
+  }
+  if (stream->context.output_in_place &&
+      reserve_output_buffer(stream, max_frame_count) < 0) {
+    return -1;
+  }
+  return 0;
+}
+
+// Deinterleaves frame_count frames of input samples into dst, one plane per
+// channel, for planar streams.
+static void deinterleave_input(PyAudioStream *stream, void *dst,
+                               const void *input, unsigned long frame_count) {
+  unsigned int sample_size = stream->context.sample_size;
+  PyAudioDeinterleave(dst, input, frame_count,
+                      stream->context.frame_size / sample_size, sample_size,
+                      frame_count);
+}
+
+// Copies the input samples into the stream's reusable input buffer,
+// deinterleaving them if the stream is planar, and returns a (new reference
+// to a) read-only memoryview over exactly those samples. Returns NULL with an
+// exception set on failure.
+static PyObject *get_input_view(PyAudioStream *stream, const void *input,
+                                unsigned long frame_count) {
+  // Allocates only if the callback kept the previous period's view, or if
+  // PortAudio hands us a different period than before, which can happen with
+  // paFramesPerBufferUnspecified.
+  if (PyAudioStream_ReserveInputBuffer(stream, frame_count) < 0) {
+    return NULL;
+  }
+
+  char *buffer = PyByteArray_AS_STRING(stream->context.input_buffer);
+  if (stream->context.planar) {
+    deinterleave_input(stream, buffer, input, frame_count);
+  } else {
+    memcpy(buffer, input, (size_t)frame_count * stream->context.frame_size);
+  }
+  Py_INCREF(stream->context.input_view);
+  return stream->context.input_view;
+}
+
+// Gets a view of the audio samples in obj, which may be None (no samples), a
+// str (encoded as UTF-8, for backwards compatibility), or any C-contiguous
+// buffer-protocol object, e.g., bytes, bytearray, memoryview, array.array, or
+// a NumPy array. The items of a typed buffer must either be bytes or have the
+// stream's sample size. On success, returns 0; release the view with
+// PyBuffer_Release. Returns -1 with an exception set on failure.
+static int get_samples_buffer(PyObject *obj, unsigned int sample_size,
+                              Py_buffer *view) {
+  if (obj == Py_None || PyUnicode_Check(obj)) {
+    // No buffer to release, so leave view->obj NULL.
+    Py_ssize_t len = 0;
+    const char *buf =
+        obj == Py_None ? NULL : PyUnicode_AsUTF8AndSize(obj, &len);
+    if (obj != Py_None && buf == NULL) {
+      return -1;
+    }
+    memset(view, 0, sizeof(Py_buffer));
+    view->buf = (void *)buf;
+    view->len = len;
+    view->itemsize = 1;
+    view->readonly = 1;
+    return 0;
+  }
+
+  if (PyObject_GetBuffer(obj, view, PyBUF_FULL_RO) < 0) {
+    return -1;
+  }
+
+  if (!PyBuffer_IsContiguous(view, 'C')) {
+    PyErr_Format(PyExc_ValueError,
+                 "Audio samples must be C-contiguous, but the %.200s object "
+                 "is not",
+                 Py_TYPE(obj)->tp_name);
+    PyBuffer_Release(view);
+    return -1;
+  }
+
+  if (view->itemsize != 1 && view->itemsize != (Py_ssize_t)sample_size) {
+    PyErr_Format(PyExc_ValueError,
+                 "Audio samples have an item size of %zd bytes, which does "
+                 "not match the stream's sample size (%u bytes)",
+                 view->itemsize, sample_size);
+    PyBuffer_Release(view);
+    return -1;
+  }
+
+  return 0;
+}
+
+// Returns the address of a frame in a buffer of the application's samples: of
+// the frame's first sample, and the start of the rest of the first plane, for
+// planar streams.
+static char *frame_address(PyAudioStream *stream, void *buffer,
+                           Py_ssize_t frame) {
+  unsigned int size = stream->context.planar ? stream->context.sample_size
+                                             : stream->context.frame_size;
+  return (char *)buffer + frame * (Py_ssize_t)size;
+}
+
+// Reads frames as PyAudioPlanar_ReadStream does (with the same requirements),
+// and advances the stream's frame position past them. If position is not NULL,
+// sets it to the position of the first frame read.
+static PaError read_frames(PyAudioStream *stream, void *buffer,
+                           unsigned long frames, unsigned long plane_frames,
+                           int64_t *position) {
+  PaError err = PyAudioPlanar_ReadStream(stream, buffer, frames, plane_frames);
+  if (err == paNoError || err == paInputOverflowed) {
+    int64_t end =
+        PyAudioAtomic_Add(&stream->context.frames_read, (int64_t)frames);
+    if (position != NULL) {
+      *position = end - (int64_t)frames;
+    }
+  }
+  return err;
+}
+
+// Returns the stream time at which the ADC captured the first of the `frames`
+// frames that a read just returned: the frames still waiting to be read, and
+// the input latency, came after them. Frame counts are at the application's
+// rate. Same requirements as read_frames.
+static PaTime block_adc_time(PyAudioStream *stream, unsigned long frames) {
+  PaTime now = Pa_GetStreamTime(stream->context.stream);
+  const PaStreamInfo *info = Pa_GetStreamInfo(stream->context.stream);
+  signed long pending = PyAudioCapture_GetReadAvailable(stream);
+  if (info == NULL || info->sampleRate <= 0) {
+    return now;
+  }
+  if (pending < 0) {
+    pending = 0;
+  }
+  return now - info->inputLatency - PyAudioResample_GetInputLatency(stream) -
+         ((double)pending + (double)frames) /
+             PyAudioResample_GetAppRate(stream, info->sampleRate);
+}
 
 int PyAudioStream_CallbackCFunc(const void *input, void *output,
                                 unsigned long frame_count,
                                 const PaStreamCallbackTimeInfo *time_info,
                                 PaStreamCallbackFlags status_flags,
                                 void *user_data) {
-  PyGILState_STATE _state = PyGILState_Ensure();
+  PyAudioStream_CountXruns((PyAudioStream *)user_data, status_flags,
+                           frame_count);
+  PyAudioGILState gil_state;
+  PyAudioGIL_Acquire(&gil_state);
+  int return_val =
+      PyAudioStream_InvokeCallback((PyAudioStream *)user_data, input, output,
+                                   frame_count, time_info, status_flags);
+  PyAudioGIL_Release(&gil_state);
+  return return_val;
+}
 
+int PyAudioStream_InvokeCallback(PyAudioStream *stream, const void *input,
+                                 void *output, unsigned long frame_count,
+                                 const PaStreamCallbackTimeInfo *time_info,
+                                 PaStreamCallbackFlags status_flags) {
 #ifdef VERBOSE
   if (status_flags != 0) {
     printf("Status flag set: ");
@@ -39,26 +285,44 @@ int PyAudioStream_CallbackCFunc(const void *input, void *output,
   }
 #endif
 
+  // Read everything needed from the stream up front: in decoupled mode, the
+  // callback may close the stream, which clears its context.
   int return_val = paAbort;
-  PyAudioStream *stream = (PyAudioStream *)user_data;
   PyObject *py_callback = stream->context.callback;
+  Py_INCREF(py_callback);
   unsigned int bytes_per_frame = stream->context.frame_size;
-  long main_thread_id = stream->context.main_thread_id;
+  unsigned int sample_size = stream->context.sample_size;
+  int output_in_place = stream->context.output_in_place;
+  int planar = stream->context.planar != NULL;
+  // For callbacks that write in place, the stream's output buffer that they
+  // write to, to copy into output afterwards.
+  PyObject *py_output_buffer = NULL;
 
-  // Prepare arguments for calling the python callback:
-  PyObject *py_frame_count = PyLong_FromUnsignedLong(frame_count);
-  // clang-format off
-  PyObject *py_time_info = Py_BuildValue("{s:d,s:d,s:d}",
-                                         "input_buffer_adc_time",
-                                         time_info->inputBufferAdcTime,
-                                         "current_time",
-                                         time_info->currentTime,
-                                         "output_buffer_dac_time",
-                                         time_info->outputBufferDacTime);
-  // clang-format on
+  // Prepare arguments for calling the python callback. Reuse the objects from
+  // the previous period where possible:
+  if (stream->context.py_frame_count == NULL ||
+      stream->context.py_frame_count_value != frame_count) {
+    Py_XDECREF(stream->context.py_frame_count);
+    stream->context.py_frame_count = PyLong_FromUnsignedLong(frame_count);
+    stream->context.py_frame_count_value = frame_count;
+  }
+  PyObject *py_frame_count = stream->context.py_frame_count;
+  Py_XINCREF(py_frame_count);
+  PyObject *py_time_info = PyAudioTimeInfo_Update(
+      stream->context.time_info_type, &stream->context.time_info, time_info);
+  // Status flags are small ints, which Python preallocates.
   PyObject *py_status_flags = PyLong_FromUnsignedLong(status_flags);
   PyObject *py_input_samples;
-  if (input != NULL) {
+  if (input != NULL && stream->context.reuse_input_buffer) {
+    py_input_samples = get_input_view(stream, input, frame_count);
+  } else if (input != NULL && planar) {
+    py_input_samples =
+        PyBytes_FromStringAndSize(NULL, bytes_per_frame * frame_count);
+    if (py_input_samples != NULL) {
+      deinterleave_input(stream, PyBytes_AS_STRING(py_input_samples), input,
+                         frame_count);
+    }
+  } else if (input != NULL) {
     py_input_samples =
         PyBytes_FromStringAndSize(input, bytes_per_frame * frame_count);
   } else {
@@ -67,80 +331,165 @@ int PyAudioStream_CallbackCFunc(const void *input, void *output,
     py_input_samples = Py_None;
   }
 
-  PyObject *callback_result = PyObject_CallFunctionObjArgs(
-      py_callback, py_input_samples, py_frame_count, py_time_info,
-      py_status_flags, NULL);
+  // In output_in_place mode, the callback also receives a writable view of
+  // the stream's output buffer (or None for input-only streams). Never hand
+  // out a view of PortAudio's own buffer, which Python code could keep (e.g.,
+  // as a slice) and write to after PortAudio reuses or frees it.
+  PyObject *py_output_samples = NULL;
+  if (output_in_place) {
+    if (output != NULL) {
+      // Allocates only if the callback kept the previous period's view, or if
+      // the period changed.
+      if (reserve_output_buffer(stream, frame_count) == 0) {
+        py_output_buffer = stream->context.output_buffer;
+        Py_INCREF(py_output_buffer);
+        py_output_samples = stream->context.output_view;
+        Py_INCREF(py_output_samples);
+      }
+    } else {
+      Py_INCREF(Py_None);
+      py_output_samples = Py_None;
+    }
+  }
+
+  PyObject *callback_result = NULL;
+  if (py_input_samples && py_frame_count && py_time_info && py_status_flags &&
+      (py_output_samples || !output_in_place)) {
+    PyObject *callback_args[] = {py_input_samples, py_output_samples,
+                                 py_frame_count, py_time_info,
+                                 py_status_flags};
+    PyObject **args = callback_args;
+    size_t nargs = 5;
+    if (!output_in_place) {
+      // Default signature: callback(in_data, frame_count, time_info, status),
+      // so shift in_data over the unused out_data slot.
+      callback_args[1] = py_input_samples;
+      args++;
+      nargs--;
+    }
+#if PY_VERSION_HEX >= 0x03090000
+    callback_result = PyObject_Vectorcall(py_callback, args, nargs, NULL);
+#elif PY_VERSION_HEX >= 0x03080000
+    callback_result = _PyObject_Vectorcall(py_callback, args, nargs, NULL);
+#else
+    callback_result =
+        nargs == 5
+            ? PyObject_CallFunctionObjArgs(py_callback, args[0], args[1],
+                                           args[2], args[3], args[4], NULL)
+            : PyObject_CallFunctionObjArgs(py_callback, args[0], args[1],
+                                           args[2], args[3], NULL);
+#endif
+  }
   if (callback_result == NULL) {
 #ifdef VERBOSE
     fprintf(stderr, "An error occured while using the portaudio stream\n");
     fprintf(stderr, "Error message: Could not call callback function\n");
 #endif
-    PyObject *err = PyErr_Occurred();
-    if (err) {
-      PyThreadState_SetAsyncExc(main_thread_id, err);
-      // Print out a stack trace to help debugging.
-      // TODO: make VERBOSE a runtime flag so users can control
-      // the amount of logging.
-      PyErr_Print();
-    }
+    PyAudioStream_SaveError(stream);
     goto end;
   }
 
-  // Parse the callback's response, which should be the samples to playback (if
-  // output stream; ignored otherwise) and the desired next stream state
-  // (paContinue, pAbort, or paComplete):
-  const char *samples_for_output;
-  Py_ssize_t output_len;
-  // clang-format off
-  if (!PyArg_ParseTuple(callback_result,
-                        "z#i",
-                        &samples_for_output,
-                        &output_len,
-                        &return_val)) {
+  // The samples for playback, if any. Unused views have a NULL obj, which
+  // PyBuffer_Release ignores.
+  Py_buffer output_buffer = {0};
+  if (output_in_place) {
+    // The callback already wrote its samples, so the response is just the
+    // desired next stream state.
+    return_val = (int)PyLong_AsLong(callback_result);
+    if (return_val == -1 && PyErr_Occurred()) {
+#ifdef VERBOSE
+      fprintf(stderr, "An error occured while using the portaudio stream\n");
+      fprintf(stderr, "Error message: Could not parse callback return value\n");
+#endif
+      PyAudioStream_SaveError(stream);
+      Py_DECREF(callback_result);
+      return_val = paAbort;  // Quit the callback loop
+      goto end;
+    }
+  } else {
+    // Parse the callback's response, which should be the samples to playback
+    // (if output stream; ignored otherwise) and the desired next stream state
+    // (paContinue, pAbort, or paComplete):
+    PyObject *samples_for_output;
+    // clang-format off
+    if (!PyArg_ParseTuple(callback_result,
+                          "Oi",
+                          &samples_for_output,
+                          &return_val) ||
+        (output && get_samples_buffer(samples_for_output,
+                                      sample_size,
+                                      &output_buffer) < 0)) {
 // clang-format on
 #ifdef VERBOSE
-    fprintf(stderr, "An error occured while using the portaudio stream\n");
-    fprintf(stderr, "Error message: Could not parse callback return value\n");
+      fprintf(stderr, "An error occured while using the portaudio stream\n");
+      fprintf(stderr, "Error message: Could not parse callback return value\n");
 #endif
-    PyObject *err = PyErr_Occurred();
-    if (err) {
-      PyThreadState_SetAsyncExc(main_thread_id, err);
-      // Print out a stack trace to help debugging.
-      // TODO: make VERBOSE a runtime flag so users can control
-      // the amount of logging.
-      PyErr_Print();
+      PyAudioStream_SaveError(stream);
+      Py_XDECREF(callback_result);
+      return_val = paAbort;  // Quit the callback loop
+      goto end;
     }
-
-    Py_XDECREF(callback_result);
-    return_val = paAbort;  // Quit the callback loop
-    goto end;
   }
 
   if ((return_val != paComplete) && (return_val != paAbort) &&
       (return_val != paContinue)) {
     PyErr_SetString(PyExc_ValueError,
                     "Invalid PaStreamCallbackResult from callback");
-    PyThreadState_SetAsyncExc(main_thread_id, PyErr_Occurred());
-    PyErr_Print();
+    PyAudioStream_SaveError(stream);
 
+    PyBuffer_Release(&output_buffer);
     Py_XDECREF(callback_result);
     return_val = paAbort;  // Quit the callback loop
     goto end;
   }
 
-  // Copy bytes for playback only if this is an output stream:
-  if (output) {
+  // Copy what the callback wrote in place into PortAudio's buffer,
+  // interleaving it for planar streams.
+  if (py_output_buffer != NULL) {
+    const char *written = PyByteArray_AS_STRING(py_output_buffer);
+    if (planar) {
+      PyAudioInterleave(output, written, frame_count,
+                        bytes_per_frame / sample_size, sample_size,
+                        frame_count);
+    } else {
+      memcpy(output, written, (size_t)bytes_per_frame * frame_count);
+    }
+  }
+
+  // Planar output holds as many frames as its planes, which may be fewer than
+  // PortAudio wants, as for interleaved output.
+  if (output && !output_in_place && planar) {
+    unsigned long frames_returned =
+        (unsigned long)(output_buffer.len / bytes_per_frame);
+    if (frames_returned > frame_count) {
+      frames_returned = frame_count;
+    }
+    if (output_buffer.buf != NULL && frames_returned > 0) {
+      PyAudioInterleave(output, output_buffer.buf, frames_returned,
+                        bytes_per_frame / sample_size, sample_size,
+                        (size_t)(output_buffer.len / bytes_per_frame));
+    }
+    if (frames_returned < frame_count) {
+      memset((char *)output + (size_t)frames_returned * bytes_per_frame, 0,
+             (size_t)(frame_count - frames_returned) * bytes_per_frame);
+      return_val = paComplete;
+    }
+  }
+
+  // Copy bytes for playback only if this is an output stream (and the
+  // callback did not already write them in place):
+  if (output && !output_in_place && !planar) {
     char *output_data = (char *)output;
     size_t pa_max_num_bytes = bytes_per_frame * frame_count;
-    // Though PyArg_ParseTuple returns the size of samples_for_output in
-    // output_len, a signed Py_ssize_t, that value should never be negative.
-    assert(output_len >= 0);
-    // Only copy min(output_len, pa_max_num_bytes) bytes.
-    size_t bytes_to_copy = (size_t)output_len < pa_max_num_bytes
-                               ? (size_t)output_len
+    // Though Py_buffer stores its size in a signed Py_ssize_t, that value
+    // should never be negative.
+    assert(output_buffer.len >= 0);
+    // Only copy min(output_buffer.len, pa_max_num_bytes) bytes.
+    size_t bytes_to_copy = (size_t)output_buffer.len < pa_max_num_bytes
+                               ? (size_t)output_buffer.len
                                : pa_max_num_bytes;
-    if (samples_for_output != NULL && bytes_to_copy > 0) {
-      memcpy(output_data, samples_for_output, bytes_to_copy);
+    if (output_buffer.buf != NULL && bytes_to_copy > 0) {
+      memcpy(output_data, output_buffer.buf, bytes_to_copy);
     }
     // If callback returned too few frames, pad out the rest of the buffer with
     // 0s and assume the stream is done (paComplete).
@@ -149,17 +498,20 @@ int PyAudioStream_CallbackCFunc(const void *input, void *output,
       return_val = paComplete;
     }
   }
+  PyBuffer_Release(&output_buffer);
   Py_DECREF(callback_result);
 
 end:
   // Decrement py_input_samples at the end, after the memcpy above, in case the
   // user returns py_input_samples (from the callback) for playback.
   Py_XDECREF(py_input_samples);
+  Py_XDECREF(py_output_samples);
+  Py_XDECREF(py_output_buffer);
   Py_XDECREF(py_frame_count);
   Py_XDECREF(py_time_info);
   Py_XDECREF(py_status_flags);
+  Py_DECREF(py_callback);
 
-  PyGILState_Release(_state);
   return return_val;
 }
 
@@ -168,42 +520,71 @@ end:
  *************************************************************/
 
 PyObject *PyAudio_WriteStream(PyObject *self, PyObject *args) {
-  const char *data;
-  Py_ssize_t total_size;
-  int total_frames;
+  PyObject *frames_arg;
+  PyObject *num_frames_arg = Py_None;
   int err;
   int should_throw_exception = 0;
 
   PyObject *stream_arg;
   // clang-format off
-  if (!PyArg_ParseTuple(args, "O!s#i|i",
-                        &PyAudioStreamType,
+  if (!PyArg_ParseTuple(args, "O!O|Oi",
+                        PyAudioModule_GetState(self)->stream_type,
                         &stream_arg,
-                        &data,
-                        &total_size,
-                        &total_frames,
+                        &frames_arg,
+                        &num_frames_arg,
                         &should_throw_exception)) {
     return NULL;
   }
   // clang-format on
 
-  if (total_frames < 0) {
-    PyErr_SetString(PyExc_ValueError, "Invalid number of frames");
-    return NULL;
-  }
-
   PyAudioStream *stream = (PyAudioStream *)stream_arg;
-  if (!PyAudioStream_IsOpen(stream)) {
+  if (!PyAudioStream_BeginUse(stream)) {
     PyErr_SetObject(PyExc_IOError,
                     Py_BuildValue("(i,s)", paBadStreamPtr, "Stream closed"));
     return NULL;
   }
 
+  if (PyAudioStream_RaiseError(stream) < 0) {
+    PyAudioStream_EndUse(stream);
+    return NULL;
+  }
+
+  // Write straight from the caller's buffer, holding it (so that it cannot be
+  // resized or freed) until PortAudio is done with it.
+  Py_buffer buffer;
+  if (get_samples_buffer(frames_arg, stream->context.sample_size, &buffer) <
+      0) {
+    PyAudioStream_EndUse(stream);
+    return NULL;
+  }
+
+  // Write all whole frames in the buffer, unless told otherwise.
+  Py_ssize_t max_frames = buffer.len / stream->context.frame_size;
+  Py_ssize_t total_frames = max_frames;
+  if (num_frames_arg != Py_None) {
+    total_frames = PyLong_AsSsize_t(num_frames_arg);
+    if ((total_frames == -1 && PyErr_Occurred()) || total_frames < 0 ||
+        total_frames > max_frames) {
+      PyAudioStream_EndUse(stream);
+      PyBuffer_Release(&buffer);
+      if (!PyErr_Occurred()) {
+        PyErr_Format(PyExc_ValueError,
+                     "Invalid number of frames: %zd (the buffer holds %zd)",
+                     total_frames, max_frames);
+      }
+      return NULL;
+    }
+  }
+
   // clang-format off
   Py_BEGIN_ALLOW_THREADS
-  err = Pa_WriteStream(stream->context.stream, data, total_frames);
+  err = PyAudioPlanar_WriteStream(stream, buffer.buf,
+                                  (unsigned long)total_frames,
+                                  (unsigned long)max_frames);
   Py_END_ALLOW_THREADS
   // clang-format on
+  PyAudioStream_EndUse(stream);
+  PyBuffer_Release(&buffer);
 
   if (err != paNoError) {
     if (err == paOutputUnderflowed) {
@@ -235,14 +616,18 @@ PyObject *PyAudio_ReadStream(PyObject *self, PyObject *args) {
   int err;
   int total_frames;
   int should_raise_exception = 0;
+  int with_timestamp = 0;
+  int64_t position = 0;
+  PaTime adc_time = 0;
 
   PyObject *stream_arg;
   // clang-format off
-  if (!PyArg_ParseTuple(args, "O!i|i",
-                        &PyAudioStreamType,
+  if (!PyArg_ParseTuple(args, "O!i|ii",
+                        PyAudioModule_GetState(self)->stream_type,
                         &stream_arg,
                         &total_frames,
-                        &should_raise_exception)) {
+                        &should_raise_exception,
+                        &with_timestamp)) {
     return NULL;
   }
   // clang-format on
@@ -253,12 +638,17 @@ PyObject *PyAudio_ReadStream(PyObject *self, PyObject *args) {
   }
 
   PyAudioStream *stream = (PyAudioStream *)stream_arg;
-  if (!PyAudioStream_IsOpen(stream)) {
+  if (!PyAudioStream_BeginUse(stream)) {
     PyErr_SetObject(PyExc_IOError,
                     Py_BuildValue("(i,s)", paBadStreamPtr, "Stream closed"));
     return NULL;
   }
 
+  if (PyAudioStream_RaiseError(stream) < 0) {
+    PyAudioStream_EndUse(stream);
+    return NULL;
+  }
+
   int num_bytes = total_frames * stream->context.frame_size;
 #ifdef VERBOSE
   fprintf(stderr, "Allocating %d bytes\n", num_bytes);
@@ -267,6 +657,7 @@ PyObject *PyAudio_ReadStream(PyObject *self, PyObject *args) {
   short *sample_block = (short *)PyBytes_AsString(rv);
 
   if (sample_block == NULL) {
+    PyAudioStream_EndUse(stream);
     PyErr_SetObject(PyExc_IOError, Py_BuildValue("(i,s)", paInsufficientMemory,
                                                  "Out of memory"));
     return NULL;
@@ -274,9 +665,15 @@ PyObject *PyAudio_ReadStream(PyObject *self, PyObject *args) {
 
   // clang-format off
   Py_BEGIN_ALLOW_THREADS
-  err = Pa_ReadStream(stream->context.stream, sample_block, total_frames);
+  err = read_frames(stream, sample_block, total_frames, total_frames,
+                    &position);
+  // Take the time as soon as the read completes.
+  if (with_timestamp && (err == paNoError || err == paInputOverflowed)) {
+    adc_time = block_adc_time(stream, total_frames);
+  }
   Py_END_ALLOW_THREADS
   // clang-format on
+  PyAudioStream_EndUse(stream);
 
   if (err != paNoError) {
     if (err == paInputOverflowed) {
@@ -288,6 +685,9 @@ PyObject *PyAudio_ReadStream(PyObject *self, PyObject *args) {
     }
   }
 
+  if (with_timestamp) {
+    return Py_BuildValue("(NdL)", rv, adc_time, (long long)position);
+  }
   return rv;
 
 error:
@@ -305,26 +705,563 @@ error:
   return NULL;
 }
 
+PyObject *PyAudio_ReadStreamInto(PyObject *self, PyObject *args) {
+  int err;
+  Py_buffer buffer;
+  PyObject *num_frames_arg = Py_None;
+  int should_raise_exception = 0;
+  Py_ssize_t first_frame = 0;
+
+  PyObject *stream_arg;
+  // clang-format off
+  if (!PyArg_ParseTuple(args, "O!w*|Oin",
+                        PyAudioModule_GetState(self)->stream_type,
+                        &stream_arg,
+                        &buffer,
+                        &num_frames_arg,
+                        &should_raise_exception,
+                        &first_frame)) {
+    return NULL;
+  }
+  // clang-format on
+
+  PyAudioStream *stream = (PyAudioStream *)stream_arg;
+  if (!PyAudioStream_BeginUse(stream)) {
+    PyBuffer_Release(&buffer);
+    PyErr_SetObject(PyExc_IOError,
+                    Py_BuildValue("(i,s)", paBadStreamPtr, "Stream closed"));
+    return NULL;
+  }
+
+  if (PyAudioStream_RaiseError(stream) < 0) {
+    PyAudioStream_EndUse(stream);
+    PyBuffer_Release(&buffer);
+    return NULL;
+  }
+
+  // Read as many whole frames as fit after first_frame, unless told
+  // otherwise. For planar streams, each plane spans the whole buffer.
+  Py_ssize_t plane_frames = buffer.len / stream->context.frame_size;
+  if (first_frame < 0 || first_frame > plane_frames) {
+    PyAudioStream_EndUse(stream);
+    PyBuffer_Release(&buffer);
+    PyErr_Format(PyExc_ValueError,
+                 "Invalid first frame: %zd (the buffer holds %zd)",
+                 first_frame, plane_frames);
+    return NULL;
+  }
+  Py_ssize_t max_frames = plane_frames - first_frame;
+  Py_ssize_t total_frames = max_frames;
+  if (num_frames_arg != Py_None) {
+    total_frames = PyLong_AsSsize_t(num_frames_arg);
+    if (total_frames == -1 && PyErr_Occurred()) {
+      PyAudioStream_EndUse(stream);
+      PyBuffer_Release(&buffer);
+      return NULL;
+    }
+    if (total_frames < 0 || total_frames > max_frames) {
+      PyAudioStream_EndUse(stream);
+      PyBuffer_Release(&buffer);
+      PyErr_Format(PyExc_ValueError,
+                   "Invalid number of frames: %zd (the buffer holds %zd)",
+                   total_frames, max_frames);
+      return NULL;
+    }
+  }
+
+  // Holding the buffer keeps it from being resized or freed while PortAudio
+  // writes into it without the GIL.
+  // clang-format off
+  Py_BEGIN_ALLOW_THREADS
+  err = read_frames(stream, frame_address(stream, buffer.buf, first_frame),
+                    (unsigned long)total_frames, (unsigned long)plane_frames,
+                    NULL);
+  Py_END_ALLOW_THREADS
+  // clang-format on
+  PyAudioStream_EndUse(stream);
+  PyBuffer_Release(&buffer);
+
+  if (err != paNoError &&
+      (err != paInputOverflowed || should_raise_exception)) {
+    PyAudioStream_Cleanup(stream);
+
+#ifdef VERBOSE
+    fprintf(stderr, "An error occured while using the portaudio stream\n");
+    fprintf(stderr, "Error number: %d\n", err);
+    fprintf(stderr, "Error message: %s\n", Pa_GetErrorText(err));
+#endif
+
+    PyErr_SetObject(PyExc_IOError,
+                    Py_BuildValue("(i,s)", err, Pa_GetErrorText(err)));
+    return NULL;
+  }
+
+  return PyLong_FromSsize_t(total_frames);
+}
+
+PyObject *PyAudio_ReadStreamNowait(PyObject *self, PyObject *args) {
+  long err;
+  Py_ssize_t max_frames;
+  int should_raise_exception = 0;
+
+  PyObject *stream_arg;
+  // clang-format off
+  if (!PyArg_ParseTuple(args, "O!n|i",
+                        PyAudioModule_GetState(self)->stream_type,
+                        &stream_arg,
+                        &max_frames,
+                        &should_raise_exception)) {
+    return NULL;
+  }
+  // clang-format on
+
+  if (max_frames < 0) {
+    PyErr_SetString(PyExc_ValueError, "Invalid number of frames");
+    return NULL;
+  }
+
+  PyAudioStream *stream = (PyAudioStream *)stream_arg;
+  if (!PyAudioStream_BeginUse(stream)) {
+    PyErr_SetObject(PyExc_IOError,
+                    Py_BuildValue("(i,s)", paBadStreamPtr, "Stream closed"));
+    return NULL;
+  }
+
+  if (PyAudioStream_RaiseError(stream) < 0) {
+    PyAudioStream_EndUse(stream);
+    return NULL;
+  }
+
+  // Read the frame size while the stream is in use: once it is not, another
+  // thread may close the stream, which clears its context.
+  Py_ssize_t frame_size = stream->context.frame_size;
+  if (max_frames > PY_SSIZE_T_MAX / frame_size) {
+    PyAudioStream_EndUse(stream);
+    return PyErr_NoMemory();
+  }
+
+  // Allocate for max_frames up front, so that checking for available frames
+  // and reading them take a single trip without the GIL.
+  PyObject *rv = PyBytes_FromStringAndSize(NULL, max_frames * frame_size);
+  if (rv == NULL) {
+    PyAudioStream_EndUse(stream);
+    return NULL;
+  }
+
+  signed long num_frames = 0;
+  // clang-format off
+  Py_BEGIN_ALLOW_THREADS
+  err = PyAudioCapture_GetReadAvailable(stream);
+  if (err > 0) {
+    num_frames = err < max_frames ? err : (signed long)max_frames;
+    err = num_frames > 0 ? read_frames(stream, PyBytes_AS_STRING(rv),
+                                       (unsigned long)num_frames,
+                                       (unsigned long)num_frames, NULL)
+                         : paNoError;
+  }
+  Py_END_ALLOW_THREADS
+  // clang-format on
+  PyAudioStream_EndUse(stream);
+
+  if (err < 0 && (err != paInputOverflowed || should_raise_exception)) {
+    PyAudioStream_Cleanup(stream);
+    Py_DECREF(rv);
+
+#ifdef VERBOSE
+    fprintf(stderr, "An error occured while using the portaudio stream\n");
+    fprintf(stderr, "Error number: %ld\n", err);
+    fprintf(stderr, "Error message: %s\n", Pa_GetErrorText((PaError)err));
+#endif
+
+    PyErr_SetObject(PyExc_IOError,
+                    Py_BuildValue("(i,s)", (int)err,
+                                  Pa_GetErrorText((PaError)err)));
+    return NULL;
+  }
+
+  if (_PyBytes_Resize(&rv, num_frames * frame_size) < 0) {
+    return NULL;
+  }
+  return rv;
+}
+
+PyObject *PyAudio_WriteStreamNowait(PyObject *self, PyObject *args) {
+  long err;
+  PyObject *frames_arg;
+  int should_throw_exception = 0;
+  Py_ssize_t first_frame = 0;
+
+  PyObject *stream_arg;
+  // clang-format off
+  if (!PyArg_ParseTuple(args, "O!O|in",
+                        PyAudioModule_GetState(self)->stream_type,
+                        &stream_arg,
+                        &frames_arg,
+                        &should_throw_exception,
+                        &first_frame)) {
+    return NULL;
+  }
+  // clang-format on
+
+  PyAudioStream *stream = (PyAudioStream *)stream_arg;
+  if (!PyAudioStream_BeginUse(stream)) {
+    PyErr_SetObject(PyExc_IOError,
+                    Py_BuildValue("(i,s)", paBadStreamPtr, "Stream closed"));
+    return NULL;
+  }
+
+  if (PyAudioStream_RaiseError(stream) < 0) {
+    PyAudioStream_EndUse(stream);
+    return NULL;
+  }
+
+  Py_buffer buffer;
+  if (get_samples_buffer(frames_arg, stream->context.sample_size, &buffer) <
+      0) {
+    PyAudioStream_EndUse(stream);
+    return NULL;
+  }
+  // Write the whole frames after first_frame. For planar streams, each plane
+  // spans the whole buffer.
+  Py_ssize_t plane_frames = buffer.len / stream->context.frame_size;
+  if (first_frame < 0 || first_frame > plane_frames) {
+    PyAudioStream_EndUse(stream);
+    PyBuffer_Release(&buffer);
+    PyErr_Format(PyExc_ValueError,
+                 "Invalid first frame: %zd (the buffer holds %zd)",
+                 first_frame, plane_frames);
+    return NULL;
+  }
+  Py_ssize_t max_frames = plane_frames - first_frame;
+
+  signed long num_frames = 0;
+  // clang-format off
+  Py_BEGIN_ALLOW_THREADS
+  err = PyAudioPlayback_GetWriteAvailable(stream);
+  if (err > 0) {
+    num_frames = err < max_frames ? err : (signed long)max_frames;
+    err = num_frames > 0
+              ? PyAudioPlanar_WriteStream(
+                    stream, frame_address(stream, buffer.buf, first_frame),
+                    (unsigned long)num_frames, (unsigned long)plane_frames)
+              : paNoError;
+  }
+  Py_END_ALLOW_THREADS
+  // clang-format on
+  PyAudioStream_EndUse(stream);
+  PyBuffer_Release(&buffer);
+
+  if (err < 0 && (err != paOutputUnderflowed || should_throw_exception)) {
+    PyAudioStream_Cleanup(stream);
+
+#ifdef VERBOSE
+    fprintf(stderr, "An error occured while using the portaudio stream\n");
+    fprintf(stderr, "Error number: %ld\n", err);
+    fprintf(stderr, "Error message: %s\n", Pa_GetErrorText((PaError)err));
+#endif
+
+    PyErr_SetObject(PyExc_IOError,
+                    Py_BuildValue("(i,s)", (int)err,
+                                  Pa_GetErrorText((PaError)err)));
+    return NULL;
+  }
+
+  return PyLong_FromLong(num_frames);
+}
+
+PyObject *PyAudio_WriteStreamV(PyObject *self, PyObject *args) {
+  PyObject *buffers_arg;
+  int should_throw_exception = 0;
+
+  PyObject *stream_arg;
+  // clang-format off
+  if (!PyArg_ParseTuple(args, "O!O|i",
+                        PyAudioModule_GetState(self)->stream_type,
+                        &stream_arg,
+                        &buffers_arg,
+                        &should_throw_exception)) {
+    return NULL;
+  }
+  // clang-format on
+
+  PyObject *buffers = PySequence_Fast(buffers_arg, "Expected an iterable of "
+                                                   "buffers");
+  if (buffers == NULL) {
+    return NULL;
+  }
+  Py_ssize_t num_buffers = PySequence_Fast_GET_SIZE(buffers);
+
+  PyAudioStream *stream = (PyAudioStream *)stream_arg;
+  if (!PyAudioStream_BeginUse(stream)) {
+    Py_DECREF(buffers);
+    PyErr_SetObject(PyExc_IOError,
+                    Py_BuildValue("(i,s)", paBadStreamPtr, "Stream closed"));
+    return NULL;
+  }
+
+  if (PyAudioStream_RaiseError(stream) < 0) {
+    PyAudioStream_EndUse(stream);
+    Py_DECREF(buffers);
+    return NULL;
+  }
+
+  // Hold views of all buffers, so that none can change until PortAudio is
+  // done with it.
+  Py_buffer *views = PyMem_New(Py_buffer, num_buffers ? num_buffers : 1);
+  if (views == NULL) {
+    PyAudioStream_EndUse(stream);
+    Py_DECREF(buffers);
+    return PyErr_NoMemory();
+  }
+
+  unsigned int frame_size = stream->context.frame_size;
+  Py_ssize_t num_views = 0;
+  for (; num_views < num_buffers; num_views++) {
+    Py_buffer *view = &views[num_views];
+    if (get_samples_buffer(PySequence_Fast_GET_ITEM(buffers, num_views),
+                           stream->context.sample_size, view) < 0) {
+      break;
+    }
+    if (view->len % frame_size != 0) {
+      PyErr_Format(PyExc_ValueError,
+                   "Buffer %zd holds %zd bytes, which is not a whole number "
+                   "of frames (of %u bytes each)",
+                   num_views, view->len, frame_size);
+      PyBuffer_Release(view);
+      break;
+    }
+  }
+
+  PaError err = paNoError;
+  Py_ssize_t frames_written = 0;
+  if (num_views == num_buffers) {
+    // clang-format off
+    Py_BEGIN_ALLOW_THREADS
+    for (Py_ssize_t i = 0; i < num_buffers; i++) {
+      unsigned long num_frames = (unsigned long)(views[i].len / frame_size);
+      err = PyAudioPlanar_WriteStream(stream, views[i].buf, num_frames,
+                                      num_frames);
+      if (err != paNoError &&
+          (err != paOutputUnderflowed || should_throw_exception)) {
+        // PortAudio still plays the buffer that reports an underflow.
+        if (err == paOutputUnderflowed) {
+          frames_written += num_frames;
+        }
+        break;
+      }
+      frames_written += num_frames;
+      err = paNoError;
+    }
+    Py_END_ALLOW_THREADS
+    // clang-format on
+  }
+  PyAudioStream_EndUse(stream);
+
+  for (Py_ssize_t i = 0; i < num_views; i++) {
+    PyBuffer_Release(&views[i]);
+  }
+  PyMem_Free(views);
+  Py_DECREF(buffers);
+
+  if (num_views < num_buffers) {
+    return NULL;
+  }
+
+  if (err != paNoError) {
+    // An underflow leaves the stream usable, so that the caller can write the
+    // rest.
+    if (err != paOutputUnderflowed) {
+      PyAudioStream_Cleanup(stream);
+    }
+
+#ifdef VERBOSE
+    fprintf(stderr, "An error occured while using the portaudio stream\n");
+    fprintf(stderr, "Error number: %d\n", err);
+    fprintf(stderr, "Error message: %s\n", Pa_GetErrorText(err));
+#endif
+
+    // Report how far the write got, in a frames_written attribute.
+    PyObject *exc = PyObject_CallFunction(PyExc_IOError, "is", err,
+                                          Pa_GetErrorText(err));
+    if (exc != NULL) {
+      PyObject *frames = PyLong_FromSsize_t(frames_written);
+      if (frames != NULL &&
+          PyObject_SetAttrString(exc, "frames_written", frames) == 0) {
+        PyErr_SetObject((PyObject *)Py_TYPE(exc), exc);
+      }
+      Py_XDECREF(frames);
+      Py_DECREF(exc);
+    }
+    return NULL;
+  }
+
+  return PyLong_FromSsize_t(frames_written);
+}
+
+PyObject *PyAudio_ProcessStream(PyObject *self, PyObject *args) {
+  PyObject *frames_arg;
+  Py_buffer in_buffer;
+  PyObject *num_frames_arg = Py_None;
+  int read_first = 0;
+  int should_raise_on_overflow = 0;
+  int should_raise_on_underflow = 0;
+
+  PyObject *stream_arg;
+  // clang-format off
+  if (!PyArg_ParseTuple(args, "O!Ow*|Oiii",
+                        PyAudioModule_GetState(self)->stream_type,
+                        &stream_arg,
+                        &frames_arg,
+                        &in_buffer,
+                        &num_frames_arg,
+                        &read_first,
+                        &should_raise_on_overflow,
+                        &should_raise_on_underflow)) {
+    return NULL;
+  }
+  // clang-format on
+
+  PyAudioStream *stream = (PyAudioStream *)stream_arg;
+  if (!PyAudioStream_BeginUse(stream)) {
+    PyBuffer_Release(&in_buffer);
+    PyErr_SetObject(PyExc_IOError,
+                    Py_BuildValue("(i,s)", paBadStreamPtr, "Stream closed"));
+    return NULL;
+  }
+
+  if (PyAudioStream_RaiseError(stream) < 0) {
+    PyAudioStream_EndUse(stream);
+    PyBuffer_Release(&in_buffer);
+    return NULL;
+  }
+
+  Py_buffer out_buffer;
+  if (get_samples_buffer(frames_arg, stream->context.sample_size,
+                         &out_buffer) < 0) {
+    PyAudioStream_EndUse(stream);
+    PyBuffer_Release(&in_buffer);
+    return NULL;
+  }
+
+  // Process all whole frames of output, unless told otherwise; either way,
+  // the input buffer must hold as many.
+  unsigned int frame_size = stream->context.frame_size;
+  Py_ssize_t total_frames = out_buffer.len / frame_size;
+  if (num_frames_arg != Py_None) {
+    Py_ssize_t max_frames = total_frames;
+    total_frames = PyLong_AsSsize_t(num_frames_arg);
+    if (total_frames == -1 && PyErr_Occurred()) {
+      goto error_release;
+    }
+    if (total_frames < 0 || total_frames > max_frames) {
+      PyErr_Format(PyExc_ValueError,
+                   "Invalid number of frames: %zd (the output holds %zd)",
+                   total_frames, max_frames);
+      goto error_release;
+    }
+  }
+  if (total_frames > in_buffer.len / frame_size) {
+    PyErr_Format(PyExc_ValueError,
+                 "Invalid number of frames: %zd (the input buffer holds %zd)",
+                 total_frames, in_buffer.len / frame_size);
+    goto error_release;
+  }
+
+  // For planar streams, each buffer's planes span the whole buffer.
+  unsigned long out_plane_frames = (unsigned long)(out_buffer.len / frame_size);
+  unsigned long in_plane_frames = (unsigned long)(in_buffer.len / frame_size);
+
+  // Both transfers share one trip without the GIL. The second one only
+  // happens if the first one succeeded, or merely had an xrun to ignore.
+  PaError write_err = paNoError;
+  PaError read_err = paNoError;
+  // clang-format off
+  Py_BEGIN_ALLOW_THREADS
+  if (read_first) {
+    read_err = read_frames(stream, in_buffer.buf, (unsigned long)total_frames,
+                           in_plane_frames, NULL);
+    if (read_err == paNoError ||
+        (read_err == paInputOverflowed && !should_raise_on_overflow)) {
+      write_err = PyAudioPlanar_WriteStream(stream, out_buffer.buf,
+                                            (unsigned long)total_frames,
+                                            out_plane_frames);
+    }
+  } else {
+    write_err = PyAudioPlanar_WriteStream(stream, out_buffer.buf,
+                                          (unsigned long)total_frames,
+                                          out_plane_frames);
+    if (write_err == paNoError ||
+        (write_err == paOutputUnderflowed && !should_raise_on_underflow)) {
+      read_err = read_frames(stream, in_buffer.buf,
+                             (unsigned long)total_frames, in_plane_frames,
+                             NULL);
+    }
+  }
+  Py_END_ALLOW_THREADS
+  // clang-format on
+  PyAudioStream_EndUse(stream);
+  PyBuffer_Release(&out_buffer);
+  PyBuffer_Release(&in_buffer);
+
+  PaError err = paNoError;
+  if (write_err != paNoError &&
+      (write_err != paOutputUnderflowed || should_raise_on_underflow)) {
+    err = write_err;
+  } else if (read_err != paNoError &&
+             (read_err != paInputOverflowed || should_raise_on_overflow)) {
+    err = read_err;
+  }
+
+  if (err != paNoError) {
+    PyAudioStream_Cleanup(stream);
+
+#ifdef VERBOSE
+    fprintf(stderr, "An error occured while using the portaudio stream\n");
+    fprintf(stderr, "Error number: %d\n", err);
+    fprintf(stderr, "Error message: %s\n", Pa_GetErrorText(err));
+#endif
+
+    PyErr_SetObject(PyExc_IOError,
+                    Py_BuildValue("(i,s)", err, Pa_GetErrorText(err)));
+    return NULL;
+  }
+
+  return PyLong_FromSsize_t(total_frames);
+
+error_release:
+  PyAudioStream_EndUse(stream);
+  PyBuffer_Release(&out_buffer);
+  PyBuffer_Release(&in_buffer);
+  return NULL;
+}
+
 PyObject *PyAudio_GetStreamWriteAvailable(PyObject *self, PyObject *args) {
   signed long frames;
   PyObject *stream_arg;
-  if (!PyArg_ParseTuple(args, "O!", &PyAudioStreamType, &stream_arg)) {
+  if (!PyArg_ParseTuple(args, "O!", PyAudioModule_GetState(self)->stream_type,
+                        &stream_arg)) {
     return NULL;
   }
 
   PyAudioStream *stream = (PyAudioStream *)stream_arg;
 
-  if (!PyAudioStream_IsOpen(stream)) {
+  if (!PyAudioStream_BeginUse(stream)) {
     PyErr_SetObject(PyExc_IOError,
                     Py_BuildValue("(i,s)", paBadStreamPtr, "Stream closed"));
     return NULL;
   }
 
+  if (PyAudioStream_RaiseError(stream) < 0) {
+    PyAudioStream_EndUse(stream);
+    return NULL;
+  }
+
   // clang-format off
   Py_BEGIN_ALLOW_THREADS
-  frames = Pa_GetStreamWriteAvailable(stream->context.stream);
+  frames = PyAudioPlayback_GetWriteAvailable(stream);
   Py_END_ALLOW_THREADS
   // clang-format on
+  PyAudioStream_EndUse(stream);
 
   return PyLong_FromLong(frames);
 }
@@ -332,22 +1269,29 @@ PyObject *PyAudio_GetStreamWriteAvailable(PyObject *self, PyObject *args) {
 PyObject *PyAudio_GetStreamReadAvailable(PyObject *self, PyObject *args) {
   signed long frames;
   PyObject *stream_arg;
-  if (!PyArg_ParseTuple(args, "O!", &PyAudioStreamType, &stream_arg)) {
+  if (!PyArg_ParseTuple(args, "O!", PyAudioModule_GetState(self)->stream_type,
+                        &stream_arg)) {
     return NULL;
   }
 
   PyAudioStream *stream = (PyAudioStream *)stream_arg;
-  if (!PyAudioStream_IsOpen(stream)) {
+  if (!PyAudioStream_BeginUse(stream)) {
     PyErr_SetObject(PyExc_IOError,
                     Py_BuildValue("(i,s)", paBadStreamPtr, "Stream closed"));
     return NULL;
   }
 
+  if (PyAudioStream_RaiseError(stream) < 0) {
+    PyAudioStream_EndUse(stream);
+    return NULL;
+  }
+
   // clang-format off
   Py_BEGIN_ALLOW_THREADS
-  frames = Pa_GetStreamReadAvailable(stream->context.stream);
+  frames = PyAudioCapture_GetReadAvailable(stream);
   Py_END_ALLOW_THREADS
   // clang-format on
+  PyAudioStream_EndUse(stream);
 
   return PyLong_FromLong(frames);
 }
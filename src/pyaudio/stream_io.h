@@ -7,14 +7,49 @@
 #include "Python.h"
 #include "portaudio.h"
 
+#include "stream.h"
+
+// Sets the stream's Python callback, and the type for its time_info argument
+// (both owned by the interpreter that will run the callback, whose GIL the
+// caller must hold). If the stream reuses its input buffer and
+// max_frame_count is not 0, also allocates the buffer for max_frame_count
+// frames up front. Returns 0 on success, or -1 with an exception set.
+int PyAudioStream_SetCallback(PyAudioStream *stream, PyObject *callback,
+                              PyTypeObject *time_info_type,
+                              unsigned long max_frame_count);
+
+// Ensures the stream's reusable callback input buffer and its view hold
+// exactly frame_count frames, and that the callback kept no reference to them
+// from an earlier period, replacing them otherwise. Returns 0 on success, or
+// -1 with an exception set.
+int PyAudioStream_ReserveInputBuffer(PyAudioStream *stream,
+                                     unsigned long frame_count);
+
+// PortAudio stream callback for streams opened with a stream_callback. Runs
+// the callback (see PyAudioStream_InvokeCallback) with the GIL held, using a
+// thread state that persists across periods (see thread_state.h).
 int PyAudioStream_CallbackCFunc(const void *input, void *output,
                                 unsigned long frameCount,
                                 const PaStreamCallbackTimeInfo *timeInfo,
                                 PaStreamCallbackFlags statusFlags,
                                 void *userData);
 
+// Runs the stream's Python callback for one buffer of frame_count frames:
+// passes it the input samples (if any), and copies its output samples (if
+// any) to output. Returns the PaStreamCallbackResult for PortAudio. The
+// caller must hold the GIL.
+int PyAudioStream_InvokeCallback(PyAudioStream *stream, const void *input,
+                                 void *output, unsigned long frame_count,
+                                 const PaStreamCallbackTimeInfo *time_info,
+                                 PaStreamCallbackFlags status_flags);
+
 PyObject *PyAudio_WriteStream(PyObject *self, PyObject *args);
 PyObject *PyAudio_ReadStream(PyObject *self, PyObject *args);
+PyObject *PyAudio_ReadStreamInto(PyObject *self, PyObject *args);
+PyObject *PyAudio_ReadStreamNowait(PyObject *self, PyObject *args);
+PyObject *PyAudio_WriteStreamNowait(PyObject *self, PyObject *args);
+PyObject *PyAudio_WriteStreamV(PyObject *self, PyObject *args);
+PyObject *PyAudio_ProcessStream(PyObject *self, PyObject *args);
 PyObject *PyAudio_GetStreamWriteAvailable(PyObject *self, PyObject *args);
 PyObject *PyAudio_GetStreamReadAvailable(PyObject *self, PyObject *args);
 
@@ -1,5 +1,6 @@
 #include "stream_lifecycle.h"
 
+#include <math.h>
 #include <stdio.h>
 
 #ifndef PY_SSIZE_T_CLEAN
@@ -8,13 +9,27 @@
 #include "Python.h"
 #include "portaudio.h"
 
+#include "convert.h"
 #include "mac_core_stream_info.h"
+#include "mix.h"
+#include "module_state.h"
+#include "resample.h"
 #include "stream.h"
+#include "stream_batch.h"
+#include "stream_capture.h"
+#include "stream_convert.h"
+#include "stream_decoupled.h"
 #include "stream_io.h"
+#include "stream_mix.h"
+#include "stream_planar.h"
+#include "stream_playback.h"
+#include "stream_resample.h"
+#include "stream_subinterpreter.h"
 
 #define DEFAULT_FRAMES_PER_BUFFER paFramesPerBufferUnspecified
 
 PyObject *PyAudio_OpenStream(PyObject *self, PyObject *args, PyObject *kwargs) {
+  PyAudioModuleState *state = PyAudioModule_GetState(self);
   int rate, channels;
   int input_device_index = -1;
   int output_device_index = -1;
@@ -37,6 +52,19 @@ PyObject *PyAudio_OpenStream(PyObject *self, PyObject *args, PyObject *kwargs) {
                            "input_host_api_specific_stream_info",
                            "output_host_api_specific_stream_info",
                            "stream_callback",
+                           "reuse_input_buffer",
+                           "output_in_place",
+                           "decoupled_callback_periods",
+                           "callback_batch_periods",
+                           "callback_in_subinterpreter",
+                           "capture_buffer_seconds",
+                           "playback_queue_seconds",
+                           "device_format",
+                           "non_interleaved",
+                           "app_rate",
+                           "resample_quality",
+                           "device_channels",
+                           "channel_matrix",
                            NULL};
 
 #ifdef MACOS
@@ -52,13 +80,30 @@ PyObject *PyAudio_OpenStream(PyObject *self, PyObject *args, PyObject *kwargs) {
   int input = 0;
   int output = 0;
   int frames_per_buffer = DEFAULT_FRAMES_PER_BUFFER;
+  int reuse_input_buffer = 0;
+  int output_in_place = 0;
+  int decoupled_callback_periods = 0;
+  int callback_batch_periods = 1;
+  int callback_in_subinterpreter = 0;
+  double capture_buffer_seconds = 0;
+  double playback_queue_seconds = 0;
+  // 0 for the same as format.
+  PaSampleFormat device_format = 0;
+  int non_interleaved = 0;
+  // 0 for the same as rate.
+  unsigned long app_rate = 0;
+  int resample_quality = PYAUDIO_RESAMPLE_MEDIUM;
+  // A flat, row-major sequence of channels x device_channels gains, or NULL
+  // (or None) for the same channels on the device.
+  int device_channels = 0;
+  PyObject *channel_matrix = NULL;
 
   // clang-format off
   if (!PyArg_ParseTupleAndKeywords(args, kwargs,
 #ifdef MACOS
-                                   "iik|iiOOiO!O!O",
+                                   "iik|iiOOiO!O!OiiiiiddkikiiO",
 #else
-                                   "iik|iiOOiOOO",
+                                   "iik|iiOOiOOOiiiiiddkikiiO",
 #endif
                                    kwlist,
                                    &rate, &channels, &format,
@@ -67,24 +112,181 @@ PyObject *PyAudio_OpenStream(PyObject *self, PyObject *args, PyObject *kwargs) {
                                    &output_device_index_arg,
                                    &frames_per_buffer,
 #ifdef MACOS
-                                   &PyAudioMacCoreStreamInfoType,
+                                   state->mac_core_stream_info_type,
 #endif
                                    &input_host_specific_stream_info,
 #ifdef MACOS
-                                   &PyAudioMacCoreStreamInfoType,
+                                   state->mac_core_stream_info_type,
 #endif
                                    &output_host_specific_stream_info,
-                                   &stream_callback)) {
+                                   &stream_callback,
+                                   &reuse_input_buffer,
+                                   &output_in_place,
+                                   &decoupled_callback_periods,
+                                   &callback_batch_periods,
+                                   &callback_in_subinterpreter,
+                                   &capture_buffer_seconds,
+                                   &playback_queue_seconds,
+                                   &device_format,
+                                   &non_interleaved,
+                                   &app_rate,
+                                   &resample_quality,
+                                   &device_channels,
+                                   &channel_matrix)) {
 
     return NULL;
   }
   // clang-format on
 
-  if (stream_callback && (PyCallable_Check(stream_callback) == 0)) {
+  if (callback_in_subinterpreter) {
+    if (!stream_callback || !PyUnicode_Check(stream_callback)) {
+      PyErr_SetString(PyExc_TypeError,
+                      "callback_in_subinterpreter requires a stream_callback "
+                      "of the form 'module:function'");
+      return NULL;
+    }
+  } else if (stream_callback && (PyCallable_Check(stream_callback) == 0)) {
     PyErr_SetString(PyExc_TypeError, "stream_callback must be callable");
     return NULL;
   }
 
+#if PY_VERSION_HEX >= 0x030C0000
+  // PortAudio's callback thread enters the main interpreter to run ordinary
+  // callbacks (see thread_state.h), so streams opened in other interpreters
+  // must bring their own thread for the callback.
+  if (stream_callback && !callback_in_subinterpreter &&
+      decoupled_callback_periods == 0 &&
+      PyInterpreterState_Get() != PyInterpreterState_Main()) {
+    PyErr_SetString(PyExc_RuntimeError,
+                    "Outside of the main interpreter, stream_callback "
+                    "requires decoupled_callback_periods or "
+                    "callback_in_subinterpreter");
+    return NULL;
+  }
+#endif
+
+  if (decoupled_callback_periods < 0) {
+    PyErr_SetString(PyExc_ValueError,
+                    "decoupled_callback_periods must be non-negative");
+    return NULL;
+  }
+
+  if (decoupled_callback_periods > 0 &&
+      (!stream_callback ||
+       frames_per_buffer == (int)paFramesPerBufferUnspecified)) {
+    PyErr_SetString(PyExc_ValueError,
+                    "decoupled_callback_periods requires a stream_callback "
+                    "and frames_per_buffer");
+    return NULL;
+  }
+
+  if (callback_batch_periods < 1) {
+    PyErr_SetString(PyExc_ValueError,
+                    "callback_batch_periods must be positive");
+    return NULL;
+  }
+
+  if (callback_batch_periods > 1 &&
+      (!stream_callback ||
+       frames_per_buffer == (int)paFramesPerBufferUnspecified)) {
+    PyErr_SetString(PyExc_ValueError,
+                    "callback_batch_periods requires a stream_callback "
+                    "and frames_per_buffer");
+    return NULL;
+  }
+
+  if (callback_batch_periods > 1 && decoupled_callback_periods > 0) {
+    PyErr_SetString(PyExc_ValueError,
+                    "callback_batch_periods and decoupled_callback_periods "
+                    "cannot be combined");
+    return NULL;
+  }
+
+  if (callback_in_subinterpreter &&
+      (callback_batch_periods > 1 || decoupled_callback_periods > 0)) {
+    PyErr_SetString(PyExc_ValueError,
+                    "callback_in_subinterpreter cannot be combined with "
+                    "callback_batch_periods or decoupled_callback_periods");
+    return NULL;
+  }
+
+  if (capture_buffer_seconds < 0) {
+    PyErr_SetString(PyExc_ValueError,
+                    "capture_buffer_seconds must be non-negative");
+    return NULL;
+  }
+
+  // Capture runs PortAudio in callback mode on behalf of blocking reads, so it
+  // cannot serve blocking writes, or a stream_callback.
+  if (capture_buffer_seconds > 0 && (!input || output || stream_callback)) {
+    PyErr_SetString(PyExc_ValueError,
+                    "capture_buffer_seconds requires an input-only stream "
+                    "without a stream_callback");
+    return NULL;
+  }
+
+  if (playback_queue_seconds < 0) {
+    PyErr_SetString(PyExc_ValueError,
+                    "playback_queue_seconds must be non-negative");
+    return NULL;
+  }
+
+  // Likewise, queued playback cannot serve blocking reads.
+  if (playback_queue_seconds > 0 && (!output || input || stream_callback)) {
+    PyErr_SetString(PyExc_ValueError,
+                    "playback_queue_seconds requires an output-only stream "
+                    "without a stream_callback");
+    return NULL;
+  }
+
+  // The application's samples may be planar, but the device's are always
+  // interleaved (see stream_planar.h).
+  if (format & paNonInterleaved) {
+    non_interleaved = 1;
+    format &= ~paNonInterleaved;
+  }
+  device_format &= ~paNonInterleaved;
+  if (device_format == 0) {
+    device_format = format;
+  }
+  if (device_format != format &&
+      (!PyAudioConverter_IsSupported(format) ||
+       !PyAudioConverter_IsSupported(device_format))) {
+    PyErr_SetString(PyExc_ValueError,
+                    "Conversions between format and device_format support "
+                    "paFloat32, paInt32, paInt24, paInt16, paInt8 and "
+                    "paUInt8");
+    return NULL;
+  }
+
+  if (app_rate == 0) {
+    app_rate = (unsigned long)rate;
+  }
+  if (app_rate != (unsigned long)rate) {
+    if (rate <= 0) {
+      PyErr_SetString(PyExc_ValueError, "Invalid rate");
+      return NULL;
+    }
+    if (!PyAudioConverter_IsSupported(format)) {
+      PyErr_SetString(PyExc_ValueError,
+                      "app_rate supports paFloat32, paInt32, paInt24, paInt16, "
+                      "paInt8 and paUInt8");
+      return NULL;
+    }
+    if (resample_quality < PYAUDIO_RESAMPLE_LOW ||
+        resample_quality > PYAUDIO_RESAMPLE_HIGH) {
+      PyErr_SetString(PyExc_ValueError, "Invalid resample_quality");
+      return NULL;
+    }
+    // Decoupled and batched callbacks count periods in device frames.
+    if (decoupled_callback_periods > 0 || callback_batch_periods > 1) {
+      PyErr_SetString(PyExc_ValueError,
+                      "app_rate cannot be combined with "
+                      "decoupled_callback_periods or callback_batch_periods");
+      return NULL;
+    }
+  }
+
   if ((input_device_index_arg == NULL) || (input_device_index_arg == Py_None)) {
 #ifdef VERBOSE
     printf("Using default input device\n");
@@ -141,6 +343,22 @@ PyObject *PyAudio_OpenStream(PyObject *self, PyObject *args, PyObject *kwargs) {
     return NULL;
   }
 
+  if (channel_matrix == Py_None) {
+    channel_matrix = NULL;
+  }
+  if (!channel_matrix) {
+    device_channels = channels;
+  } else if (device_channels < 1) {
+    PyErr_SetString(PyExc_ValueError,
+                    "channel_matrix requires device_channels");
+    return NULL;
+  } else if (!PyAudioConverter_IsSupported(device_format)) {
+    PyErr_SetString(PyExc_ValueError,
+                    "channel_matrix supports paFloat32, paInt32, paInt24, "
+                    "paInt16, paInt8 and paUInt8");
+    return NULL;
+  }
+
   PaStreamParameters output_parameters;
   if (output) {
     if (output_device_index < 0) {
@@ -159,8 +377,8 @@ PyObject *PyAudio_OpenStream(PyObject *self, PyObject *args, PyObject *kwargs) {
       return NULL;
     }
 
-    output_parameters.channelCount = channels;
-    output_parameters.sampleFormat = format;
+    output_parameters.channelCount = device_channels;
+    output_parameters.sampleFormat = device_format;
     output_parameters.suggestedLatency =
         Pa_GetDeviceInfo(output_parameters.device)->defaultLowOutputLatency;
     output_parameters.hostApiSpecificStreamInfo = NULL;
@@ -189,8 +407,8 @@ PyObject *PyAudio_OpenStream(PyObject *self, PyObject *args, PyObject *kwargs) {
       return NULL;
     }
 
-    input_parameters.channelCount = channels;
-    input_parameters.sampleFormat = format;
+    input_parameters.channelCount = device_channels;
+    input_parameters.sampleFormat = device_format;
     input_parameters.suggestedLatency =
         Pa_GetDeviceInfo(input_parameters.device)->defaultLowInputLatency;
     input_parameters.hostApiSpecificStreamInfo = NULL;
@@ -202,12 +420,38 @@ PyObject *PyAudio_OpenStream(PyObject *self, PyObject *args, PyObject *kwargs) {
 #endif
   }
 
-  PyAudioStream *stream = PyAudioStream_Create();
+  PyAudioStream *stream = PyAudioStream_Create(state->stream_type);
   if (!stream) {
     PyErr_SetString(PyExc_MemoryError, "Cannot allocate stream object");
     return NULL;
   }
 
+  // clang-format off
+  PaStreamCallback *callback =
+      capture_buffer_seconds > 0
+          ? PyAudioCapture_CallbackCFunc
+      : playback_queue_seconds > 0
+          ? PyAudioPlayback_CallbackCFunc
+      : !stream_callback ? NULL
+      : decoupled_callback_periods > 0
+          ? PyAudioDecoupled_CallbackCFunc
+      : callback_batch_periods > 1
+          ? PyAudioBatch_CallbackCFunc
+      : callback_in_subinterpreter
+          ? PyAudioSubinterpreter_CallbackCFunc
+          : PyAudioStream_CallbackCFunc;
+  // clang-format on
+
+  // Resampling, conversion, and then routing wrap the callback.
+  PaStreamCallback *resampled_callback =
+      callback && app_rate != (unsigned long)rate
+          ? PyAudioResample_CallbackCFunc
+          : callback;
+  PaStreamCallback *converted_callback =
+      resampled_callback && device_format != format
+          ? PyAudioConvert_CallbackCFunc
+          : resampled_callback;
+
   PaStream *pa_stream = NULL;
   // clang-format off
   Py_BEGIN_ALLOW_THREADS
@@ -223,8 +467,10 @@ PyObject *PyAudio_OpenStream(PyObject *self, PyObject *args, PyObject *kwargs) {
                       /* we won't output out of range samples
                          so don't bother clipping them */
                       paClipOff,
-                      /* callback, if specified */
-                      stream_callback ? PyAudioStream_CallbackCFunc : NULL,
+                      /* callback, if specified, behind the conversion */
+                      converted_callback && channel_matrix
+                          ? PyAudioMix_CallbackCFunc
+                          : converted_callback,
                       /* callback userData, if applicable */
                       stream);
   Py_END_ALLOW_THREADS
@@ -245,12 +491,114 @@ PyObject *PyAudio_OpenStream(PyObject *self, PyObject *args, PyObject *kwargs) {
   }
 
   stream->context.stream = pa_stream;
-  stream->context.frame_size = Pa_GetSampleSize(format) * channels;
-  stream->context.main_thread_id = PyThreadState_Get()->thread_id;
+  stream->context.sample_size = Pa_GetSampleSize(format);
+  stream->context.frame_size = stream->context.sample_size * channels;
   stream->context.callback = NULL;
+  if (channel_matrix) {
+    size_t count = (size_t)channels * device_channels;
+    float *gains = (float *)PyMem_Malloc(count * sizeof(float));
+    int rv = -1;
+    if (!gains) {
+      PyErr_NoMemory();
+    } else if (PyAudioMixer_ParseGains(channel_matrix, count, gains) == 0) {
+      rv = PyAudioMix_Create(
+          stream, gains, channels, device_channels, device_format, input,
+          output, converted_callback,
+          frames_per_buffer == (int)paFramesPerBufferUnspecified
+              ? 0
+              : (unsigned long)frames_per_buffer);
+    }
+    PyMem_Free(gains);
+    if (rv < 0) {
+      Py_DECREF(stream);
+      return NULL;
+    }
+  }
+
+  if (device_format != format &&
+      PyAudioConvert_Create(
+          stream, format, device_format, channels, input, output,
+          resampled_callback,
+          frames_per_buffer == (int)paFramesPerBufferUnspecified
+              ? 0
+              : (unsigned long)frames_per_buffer) < 0) {
+    Py_DECREF(stream);
+    return NULL;
+  }
+  if (app_rate != (unsigned long)rate &&
+      PyAudioResample_Create(
+          stream, app_rate, (unsigned long)rate, format, channels, input,
+          output, resample_quality, callback,
+          frames_per_buffer == (int)paFramesPerBufferUnspecified
+              ? 0
+              : (unsigned long)frames_per_buffer) < 0) {
+    Py_DECREF(stream);
+    return NULL;
+  }
+
+  if (capture_buffer_seconds > 0) {
+    if (PyAudioCapture_Create(
+            stream, (unsigned long)ceil(capture_buffer_seconds * app_rate)) <
+        0) {
+      Py_DECREF(stream);
+      return NULL;
+    }
+  }
+
+  if (playback_queue_seconds > 0) {
+    if (PyAudioPlayback_Create(
+            stream, (unsigned long)ceil(playback_queue_seconds * app_rate)) <
+        0) {
+      Py_DECREF(stream);
+      return NULL;
+    }
+  }
+
+  // The most frames that the callback receives at once, if known.
+  unsigned long max_frame_count =
+      stream->context.resample
+          ? PyAudioResample_GetMaxFrameCount(stream)
+      : frames_per_buffer == (int)paFramesPerBufferUnspecified
+          ? 0
+          : (unsigned long)frames_per_buffer * callback_batch_periods;
   if (stream_callback) {
-    Py_INCREF(stream_callback);
-    stream->context.callback = stream_callback;
+    stream->context.output_in_place = output_in_place;
+    stream->context.reuse_input_buffer = input && reuse_input_buffer;
+
+    int rv = callback_in_subinterpreter
+                 ? PyAudioSubinterpreter_Create(stream, stream_callback,
+                                                max_frame_count)
+                 : PyAudioStream_SetCallback(stream, stream_callback,
+                                             state->time_info_type,
+                                             max_frame_count);
+    if (rv < 0) {
+      Py_DECREF(stream);
+      return NULL;
+    }
+
+    if (decoupled_callback_periods > 0 &&
+        PyAudioDecoupled_Create(stream, input, output, frames_per_buffer,
+                                decoupled_callback_periods) < 0) {
+      Py_DECREF(stream);
+      return NULL;
+    }
+
+    if (callback_batch_periods > 1 &&
+        PyAudioBatch_Create(stream, input, output, frames_per_buffer,
+                            callback_batch_periods) < 0) {
+      Py_DECREF(stream);
+      return NULL;
+    }
+  }
+
+  if (non_interleaved &&
+      PyAudioPlanar_Create(
+          stream, channels, input, output,
+          frames_per_buffer == (int)paFramesPerBufferUnspecified
+              ? 0
+              : (unsigned long)frames_per_buffer) < 0) {
+    Py_DECREF(stream);
+    return NULL;
   }
 
   return (PyObject *)stream;
@@ -258,7 +606,8 @@ PyObject *PyAudio_OpenStream(PyObject *self, PyObject *args, PyObject *kwargs) {
 
 PyObject *PyAudio_CloseStream(PyObject *self, PyObject *args) {
   PyObject *stream_arg;
-  if (!PyArg_ParseTuple(args, "O!", &PyAudioStreamType, &stream_arg)) {
+  if (!PyArg_ParseTuple(args, "O!", PyAudioModule_GetState(self)->stream_type,
+                        &stream_arg)) {
     return NULL;
   }
 
@@ -277,22 +626,33 @@ PyObject *PyAudio_CloseStream(PyObject *self, PyObject *args) {
 PyObject *PyAudio_StartStream(PyObject *self, PyObject *args) {
   int err;
   PyObject *stream_arg;
-  if (!PyArg_ParseTuple(args, "O!", &PyAudioStreamType, &stream_arg)) {
+  if (!PyArg_ParseTuple(args, "O!", PyAudioModule_GetState(self)->stream_type,
+                        &stream_arg)) {
     return NULL;
   }
 
   PyAudioStream *stream = (PyAudioStream *)stream_arg;
-  if (!PyAudioStream_IsOpen(stream)) {
+  if (!PyAudioStream_BeginUse(stream)) {
     PyErr_SetObject(PyExc_IOError,
                     Py_BuildValue("(i,s)", paBadStreamPtr, "Stream closed"));
     return NULL;
   }
 
+  if (PyAudioStream_RaiseError(stream) < 0) {
+    PyAudioStream_EndUse(stream);
+    return NULL;
+  }
+
+  PyAudioDecoupled_Restart(stream);
+  PyAudioBatch_Restart(stream);
+  PyAudioResample_Restart(stream);
+
   // clang-format off
   Py_BEGIN_ALLOW_THREADS
   err = Pa_StartStream(stream->context.stream);
   Py_END_ALLOW_THREADS
   // clang-format on
+  PyAudioStream_EndUse(stream);
 
   if ((err != paNoError) && (err != paStreamIsNotStopped)) {
     PyAudioStream_Cleanup(stream);
@@ -315,12 +675,13 @@ PyObject *PyAudio_StartStream(PyObject *self, PyObject *args) {
 PyObject *PyAudio_StopStream(PyObject *self, PyObject *args) {
   int err;
   PyObject *stream_arg;
-  if (!PyArg_ParseTuple(args, "O!", &PyAudioStreamType, &stream_arg)) {
+  if (!PyArg_ParseTuple(args, "O!", PyAudioModule_GetState(self)->stream_type,
+                        &stream_arg)) {
     return NULL;
   }
 
   PyAudioStream *stream = (PyAudioStream *)stream_arg;
-  if (!PyAudioStream_IsOpen(stream)) {
+  if (!PyAudioStream_BeginUse(stream)) {
     PyErr_SetString(PyExc_IOError, "Stream not open");
     return NULL;
   }
@@ -331,6 +692,14 @@ PyObject *PyAudio_StopStream(PyObject *self, PyObject *args) {
   Py_END_ALLOW_THREADS
   // clang-format on
 
+  // Stop first, so that the stream stops even if the callback failed.
+  if ((err == paNoError || err == paStreamIsStopped) &&
+      PyAudioStream_RaiseError(stream) < 0) {
+    PyAudioStream_EndUse(stream);
+    return NULL;
+  }
+  PyAudioStream_EndUse(stream);
+
   if ((err != paNoError) && (err != paStreamIsStopped)) {
     PyAudioStream_Cleanup(stream);
 
@@ -352,12 +721,13 @@ PyObject *PyAudio_StopStream(PyObject *self, PyObject *args) {
 PyObject *PyAudio_AbortStream(PyObject *self, PyObject *args) {
   int err;
   PyObject *stream_arg;
-  if (!PyArg_ParseTuple(args, "O!", &PyAudioStreamType, &stream_arg)) {
+  if (!PyArg_ParseTuple(args, "O!", PyAudioModule_GetState(self)->stream_type,
+                        &stream_arg)) {
     return NULL;
   }
 
   PyAudioStream *stream = (PyAudioStream *)stream_arg;
-  if (!PyAudioStream_IsOpen(stream)) {
+  if (!PyAudioStream_BeginUse(stream)) {
     PyErr_SetString(PyExc_IOError, "Stream not open");
     return NULL;
   }
@@ -368,6 +738,14 @@ PyObject *PyAudio_AbortStream(PyObject *self, PyObject *args) {
   Py_END_ALLOW_THREADS
   // clang-format on
 
+  // Stop first, so that the stream stops even if the callback failed.
+  if ((err == paNoError || err == paStreamIsStopped) &&
+      PyAudioStream_RaiseError(stream) < 0) {
+    PyAudioStream_EndUse(stream);
+    return NULL;
+  }
+  PyAudioStream_EndUse(stream);
+
   if ((err != paNoError) && (err != paStreamIsStopped)) {
     PyAudioStream_Cleanup(stream);
 
@@ -389,22 +767,29 @@ PyObject *PyAudio_AbortStream(PyObject *self, PyObject *args) {
 PyObject *PyAudio_IsStreamStopped(PyObject *self, PyObject *args) {
   int err;
   PyObject *stream_arg;
-  if (!PyArg_ParseTuple(args, "O!", &PyAudioStreamType, &stream_arg)) {
+  if (!PyArg_ParseTuple(args, "O!", PyAudioModule_GetState(self)->stream_type,
+                        &stream_arg)) {
     return NULL;
   }
 
   PyAudioStream *stream = (PyAudioStream *)stream_arg;
-  if (!PyAudioStream_IsOpen(stream)) {
+  if (!PyAudioStream_BeginUse(stream)) {
     PyErr_SetObject(PyExc_IOError,
                     Py_BuildValue("(i,s)", paBadStreamPtr, "Stream closed"));
     return NULL;
   }
 
+  if (PyAudioStream_RaiseError(stream) < 0) {
+    PyAudioStream_EndUse(stream);
+    return NULL;
+  }
+
   // clang-format off
   Py_BEGIN_ALLOW_THREADS
   err = Pa_IsStreamStopped(stream->context.stream);
   Py_END_ALLOW_THREADS
   // clang-format on
+  PyAudioStream_EndUse(stream);
 
   if (err < 0) {
     PyAudioStream_Cleanup(stream);
@@ -432,21 +817,28 @@ PyObject *PyAudio_IsStreamStopped(PyObject *self, PyObject *args) {
 PyObject *PyAudio_IsStreamActive(PyObject *self, PyObject *args) {
   int is_active;
   PyObject *stream_arg;
-  if (!PyArg_ParseTuple(args, "O!", &PyAudioStreamType, &stream_arg)) {
+  if (!PyArg_ParseTuple(args, "O!", PyAudioModule_GetState(self)->stream_type,
+                        &stream_arg)) {
     return NULL;
   }
 
   PyAudioStream *stream = (PyAudioStream *)stream_arg;
-  if (!PyAudioStream_IsOpen(stream)) {
+  if (!PyAudioStream_BeginUse(stream)) {
     PyErr_SetString(PyExc_IOError, "Stream not open");
     return NULL;
   }
 
+  if (PyAudioStream_RaiseError(stream) < 0) {
+    PyAudioStream_EndUse(stream);
+    return NULL;
+  }
+
   // clang-format off
   Py_BEGIN_ALLOW_THREADS
   is_active = Pa_IsStreamActive(stream->context.stream);
   Py_END_ALLOW_THREADS
   // clang-format on
+  PyAudioStream_EndUse(stream);
 
   if (is_active < 0) {
     PaError err = is_active;
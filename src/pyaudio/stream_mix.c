@@ -0,0 +1,268 @@
+#include "stream_mix.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef PY_SSIZE_T_CLEAN
+#define PY_SSIZE_T_CLEAN
+#endif
+#include "Python.h"
+#include "portaudio.h"
+
+#include "convert.h"
+#include "mix.h"
+#include "stream.h"
+
+// The fewest frames that the scratch buffers hold. Blocking transfers route
+// this many frames at a time, or frames_per_buffer if larger.
+#define MIN_CHUNK_FRAMES 4096
+
+// One direction's mixer and scratch buffers, each chunk_frames frames long.
+typedef struct {
+  PyAudioMixer *mixer;
+  // Frames of the device's channels, for blocking transfers, and of the
+  // application's, for callbacks.
+  void *device_buffer;
+  void *app_buffer;
+  // Float32 frames of both channel counts, for matrices that mix. NULL for
+  // selections.
+  float *float_buffer;
+} Route;
+
+struct PyAudioMix {
+  // The callback that runs on routed periods, for callback streams.
+  PaStreamCallback *callback;
+  // Device format -> float32, and back.
+  PyAudioConverter to_float;
+  PyAudioConverter from_float;
+  unsigned int sample_size;
+  // One sample of silence in the device's format.
+  char silence[4];
+  unsigned int app_channels;
+  unsigned int device_channels;
+  // Size of the scratch buffers, in frames.
+  unsigned long chunk_frames;
+  // Device channels -> application channels, and back. Zeroed for a
+  // direction that the stream does not have.
+  Route input;
+  Route output;
+};
+
+static void free_route(Route *route) {
+  PyAudioMixer_Free(route->mixer);
+  free(route->device_buffer);
+  free(route->app_buffer);
+  free(route->float_buffer);
+}
+
+static void free_mix(PyAudioMix *mix) {
+  free_route(&mix->input);
+  free_route(&mix->output);
+  free(mix);
+}
+
+static int init_route(PyAudioMix *mix, Route *route, const float *gains,
+                      unsigned int in_channels, unsigned int out_channels) {
+  size_t frames = mix->chunk_frames;
+  route->mixer = PyAudioMixer_New(gains, in_channels, out_channels);
+  if (!route->mixer ||
+      !(route->device_buffer = malloc(frames * mix->device_channels *
+                                      mix->sample_size)) ||
+      !(route->app_buffer =
+            malloc(frames * mix->app_channels * mix->sample_size))) {
+    return -1;
+  }
+  if (!PyAudioMixer_IsSelection(route->mixer) &&
+      !(route->float_buffer = (float *)malloc(
+            frames * (in_channels + out_channels) * sizeof(float)))) {
+    return -1;
+  }
+  return 0;
+}
+
+int PyAudioMix_Create(PyAudioStream *stream, const float *gains,
+                      int app_channels, int device_channels,
+                      PaSampleFormat device_format, int input, int output,
+                      PaStreamCallback *callback,
+                      unsigned long frames_per_buffer) {
+  PyAudioMix *mix = (PyAudioMix *)calloc(1, sizeof(PyAudioMix));
+  if (!mix) {
+    PyErr_NoMemory();
+    return -1;
+  }
+
+  mix->callback = callback;
+  PyAudioConverter_Init(&mix->to_float, device_format, paFloat32);
+  PyAudioConverter_Init(&mix->from_float, paFloat32, device_format);
+  mix->sample_size = mix->to_float.from_size;
+  float zero = 0;
+  PyAudioConverter_Run(&mix->from_float, mix->silence, &zero, 1);
+  mix->app_channels = (unsigned int)app_channels;
+  mix->device_channels = (unsigned int)device_channels;
+  mix->chunk_frames = frames_per_buffer > MIN_CHUNK_FRAMES
+                          ? frames_per_buffer
+                          : MIN_CHUNK_FRAMES;
+
+  // Output runs the matrix transposed.
+  float *transposed = NULL;
+  if (output) {
+    size_t count = (size_t)app_channels * device_channels;
+    transposed = (float *)malloc(count * sizeof(float));
+    if (transposed) {
+      for (int i = 0; i < app_channels; i++) {
+        for (int j = 0; j < device_channels; j++) {
+          transposed[(size_t)j * app_channels + i] =
+              gains[(size_t)i * device_channels + j];
+        }
+      }
+    }
+  }
+
+  if ((input && init_route(mix, &mix->input, gains, mix->device_channels,
+                           mix->app_channels) < 0) ||
+      (output && (!transposed ||
+                  init_route(mix, &mix->output, transposed, mix->app_channels,
+                             mix->device_channels) < 0))) {
+    free(transposed);
+    free_mix(mix);
+    PyErr_NoMemory();
+    return -1;
+  }
+  free(transposed);
+
+  stream->context.mix = mix;
+  return 0;
+}
+
+void PyAudioMix_Free(PyAudioStream *stream) {
+  PyAudioMix *mix = stream->context.mix;
+  if (!mix) {
+    return;
+  }
+  stream->context.mix = NULL;
+  free_mix(mix);
+}
+
+// Routes n frames from src, of in_channels channels, into dst.
+static void route_frames(PyAudioMix *mix, Route *route, void *dst,
+                         const void *src, unsigned long n,
+                         unsigned int in_channels, unsigned int out_channels) {
+  if (!route->float_buffer) {
+    PyAudioMixer_Select(route->mixer, dst, src, n, mix->sample_size,
+                        mix->silence);
+    return;
+  }
+  float *mixed = route->float_buffer + (size_t)mix->chunk_frames * in_channels;
+  PyAudioConverter_Run(&mix->to_float, route->float_buffer, src,
+                       (size_t)n * in_channels);
+  PyAudioMixer_Run(route->mixer, mixed, route->float_buffer, n);
+  PyAudioConverter_Run(&mix->from_float, dst, mixed,
+                       (size_t)n * out_channels);
+}
+
+// Fills `frames` frames of the device's channels with silence.
+static void fill_silence(PyAudioMix *mix, void *dst, unsigned long frames) {
+  size_t num_samples = (size_t)frames * mix->device_channels;
+  char *d = (char *)dst;
+  for (size_t k = 0; k < num_samples; k++) {
+    memcpy(d, mix->silence, mix->sample_size);
+    d += mix->sample_size;
+  }
+}
+
+PaError PyAudioMix_ReadStream(PyAudioStream *stream, void *buffer,
+                              unsigned long frames) {
+  PyAudioMix *mix = stream->context.mix;
+  if (!mix) {
+    return Pa_ReadStream(stream->context.stream, buffer, frames);
+  }
+
+  // As for conversions, report an overflow at the end, after reading
+  // everything.
+  PaError result = paNoError;
+  char *dst = (char *)buffer;
+  while (frames > 0) {
+    unsigned long n =
+        frames < mix->chunk_frames ? frames : mix->chunk_frames;
+    PaError err =
+        Pa_ReadStream(stream->context.stream, mix->input.device_buffer, n);
+    if (err == paInputOverflowed) {
+      result = err;
+    } else if (err != paNoError) {
+      return err;
+    }
+    route_frames(mix, &mix->input, dst, mix->input.device_buffer, n,
+                 mix->device_channels, mix->app_channels);
+    dst += (size_t)n * mix->app_channels * mix->sample_size;
+    frames -= n;
+  }
+  return result;
+}
+
+PaError PyAudioMix_WriteStream(PyAudioStream *stream, const void *buffer,
+                               unsigned long frames) {
+  PyAudioMix *mix = stream->context.mix;
+  if (!mix) {
+    return Pa_WriteStream(stream->context.stream, buffer, frames);
+  }
+
+  // Likewise, underflows happen before the chunk that reports them.
+  PaError result = paNoError;
+  const char *src = (const char *)buffer;
+  while (frames > 0) {
+    unsigned long n =
+        frames < mix->chunk_frames ? frames : mix->chunk_frames;
+    route_frames(mix, &mix->output, mix->output.device_buffer, src, n,
+                 mix->app_channels, mix->device_channels);
+    PaError err =
+        Pa_WriteStream(stream->context.stream, mix->output.device_buffer, n);
+    if (err == paOutputUnderflowed) {
+      result = err;
+    } else if (err != paNoError) {
+      return err;
+    }
+    src += (size_t)n * mix->app_channels * mix->sample_size;
+    frames -= n;
+  }
+  return result;
+}
+
+int PyAudioMix_CallbackCFunc(const void *input, void *output,
+                             unsigned long frame_count,
+                             const PaStreamCallbackTimeInfo *time_info,
+                             PaStreamCallbackFlags status_flags,
+                             void *user_data) {
+  PyAudioStream *stream = (PyAudioStream *)user_data;
+  PyAudioMix *mix = stream->context.mix;
+  size_t device_frame_size = (size_t)mix->device_channels * mix->sample_size;
+  const char *src = (const char *)input;
+  char *dst = (char *)output;
+  int result = paContinue;
+
+  while (frame_count > 0 && result == paContinue) {
+    unsigned long n =
+        frame_count < mix->chunk_frames ? frame_count : mix->chunk_frames;
+    if (src) {
+      route_frames(mix, &mix->input, mix->input.app_buffer, src, n,
+                   mix->device_channels, mix->app_channels);
+      src += (size_t)n * device_frame_size;
+    }
+    result = mix->callback(src ? mix->input.app_buffer : NULL,
+                           dst ? mix->output.app_buffer : NULL, n, time_info,
+                           status_flags, stream);
+    if (dst) {
+      route_frames(mix, &mix->output, dst, mix->output.app_buffer, n,
+                   mix->app_channels, mix->device_channels);
+      dst += (size_t)n * device_frame_size;
+    }
+    // Report xruns only once per period.
+    status_flags = 0;
+    frame_count -= n;
+  }
+
+  // The callback finished early: play silence for the rest of the period.
+  if (dst && frame_count > 0) {
+    fill_silence(mix, dst, frame_count);
+  }
+  return result;
+}
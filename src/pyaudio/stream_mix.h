@@ -0,0 +1,57 @@
+// Channel routing for streams whose device has a different number of
+// channels than the application reads and writes (see mix.h). The stream's
+// channel matrix maps device channels to the application's on input, and its
+// transpose maps the application's channels to the device's on output.
+// Routing runs closest to the device, in the device's sample format: blocking
+// reads and writes route a chunk at a time through a scratch buffer, and
+// callbacks of every kind run behind a wrapper that routes each period on
+// PortAudio's real-time thread, so the rest of the stream only ever sees the
+// application's channels.
+
+#ifndef STREAM_MIX_H_
+#define STREAM_MIX_H_
+
+#ifndef PY_SSIZE_T_CLEAN
+#define PY_SSIZE_T_CLEAN
+#endif
+#include "Python.h"
+#include "portaudio.h"
+
+#include "stream.h"
+
+// Sets up routing between app_channels channels, which the stream's layers
+// above this one see, and device_channels channels, which the PortAudio
+// stream was opened with, through `gains`, a row-major matrix of app_channels
+// x device_channels gains. device_format must be one that PyAudioConverter
+// supports. For callback streams, `callback` is the callback that
+// PyAudioMix_CallbackCFunc calls with routed periods; NULL otherwise. Returns
+// 0 on success, or -1 with an exception set.
+int PyAudioMix_Create(PyAudioStream *stream, const float *gains,
+                      int app_channels, int device_channels,
+                      PaSampleFormat device_format, int input, int output,
+                      PaStreamCallback *callback,
+                      unsigned long frames_per_buffer);
+
+// Frees the stream's routing state, if any. The PortAudio stream must already
+// be closed.
+void PyAudioMix_Free(PyAudioStream *stream);
+
+// Reads and writes exactly `frames` frames of the application's channels, in
+// the device's sample format, as Pa_ReadStream and Pa_WriteStream do,
+// routing if the stream has a channel matrix. Same requirements as
+// PyAudioConvert_ReadStream.
+PaError PyAudioMix_ReadStream(PyAudioStream *stream, void *buffer,
+                              unsigned long frames);
+PaError PyAudioMix_WriteStream(PyAudioStream *stream, const void *buffer,
+                               unsigned long frames);
+
+// PortAudio stream callback for callback streams with a channel matrix. Runs
+// the stream's callback on routed periods, in pieces if PortAudio passes more
+// frames than the scratch buffers hold.
+int PyAudioMix_CallbackCFunc(const void *input, void *output,
+                             unsigned long frame_count,
+                             const PaStreamCallbackTimeInfo *time_info,
+                             PaStreamCallbackFlags status_flags,
+                             void *user_data);
+
+#endif  // STREAM_MIX_H_
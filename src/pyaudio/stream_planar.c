@@ -0,0 +1,126 @@
+#include "stream_planar.h"
+
+#include <stdlib.h>
+
+#ifndef PY_SSIZE_T_CLEAN
+#define PY_SSIZE_T_CLEAN
+#endif
+#include "Python.h"
+#include "portaudio.h"
+
+#include "convert.h"
+#include "stream.h"
+#include "stream_capture.h"
+#include "stream_playback.h"
+
+// The fewest frames that the scratch buffers hold. Blocking transfers
+// interleave this many frames at a time, or frames_per_buffer if larger.
+#define MIN_CHUNK_FRAMES 4096
+
+struct PyAudioPlanar {
+  unsigned int channels;
+  // Size of the scratch buffers, in frames.
+  unsigned long chunk_frames;
+  // Scratch buffers of interleaved frames for blocking reads and writes, each
+  // chunk_frames frames long. NULL for a direction that the stream does not
+  // have.
+  void *input_buffer;
+  void *output_buffer;
+};
+
+static void free_planar(PyAudioPlanar *planar) {
+  free(planar->input_buffer);
+  free(planar->output_buffer);
+  free(planar);
+}
+
+int PyAudioPlanar_Create(PyAudioStream *stream, int channels, int input,
+                         int output, unsigned long frames_per_buffer) {
+  PyAudioPlanar *planar = (PyAudioPlanar *)calloc(1, sizeof(PyAudioPlanar));
+  if (!planar) {
+    PyErr_NoMemory();
+    return -1;
+  }
+
+  planar->channels = (unsigned int)channels;
+  planar->chunk_frames = frames_per_buffer > MIN_CHUNK_FRAMES
+                             ? frames_per_buffer
+                             : MIN_CHUNK_FRAMES;
+  size_t num_bytes = (size_t)planar->chunk_frames * stream->context.frame_size;
+  if ((input && !(planar->input_buffer = malloc(num_bytes))) ||
+      (output && !(planar->output_buffer = malloc(num_bytes)))) {
+    free_planar(planar);
+    PyErr_NoMemory();
+    return -1;
+  }
+
+  stream->context.planar = planar;
+  return 0;
+}
+
+void PyAudioPlanar_Free(PyAudioStream *stream) {
+  PyAudioPlanar *planar = stream->context.planar;
+  if (!planar) {
+    return;
+  }
+  stream->context.planar = NULL;
+  free_planar(planar);
+}
+
+PaError PyAudioPlanar_ReadStream(PyAudioStream *stream, void *buffer,
+                                 unsigned long frames,
+                                 unsigned long plane_frames) {
+  PyAudioPlanar *planar = stream->context.planar;
+  if (!planar) {
+    return PyAudioCapture_ReadStream(stream, buffer, frames);
+  }
+
+  // As for conversions, report an overflow at the end, after reading
+  // everything.
+  PaError result = paNoError;
+  unsigned int sample_size = stream->context.sample_size;
+  char *dst = (char *)buffer;
+  while (frames > 0) {
+    unsigned long n =
+        frames < planar->chunk_frames ? frames : planar->chunk_frames;
+    PaError err = PyAudioCapture_ReadStream(stream, planar->input_buffer, n);
+    if (err == paInputOverflowed) {
+      result = err;
+    } else if (err != paNoError) {
+      return err;
+    }
+    PyAudioDeinterleave(dst, planar->input_buffer, n, planar->channels,
+                        sample_size, plane_frames);
+    dst += (size_t)n * sample_size;
+    frames -= n;
+  }
+  return result;
+}
+
+PaError PyAudioPlanar_WriteStream(PyAudioStream *stream, const void *buffer,
+                                  unsigned long frames,
+                                  unsigned long plane_frames) {
+  PyAudioPlanar *planar = stream->context.planar;
+  if (!planar) {
+    return PyAudioPlayback_WriteStream(stream, buffer, frames);
+  }
+
+  PaError result = paNoError;
+  unsigned int sample_size = stream->context.sample_size;
+  const char *src = (const char *)buffer;
+  while (frames > 0) {
+    unsigned long n =
+        frames < planar->chunk_frames ? frames : planar->chunk_frames;
+    PyAudioInterleave(planar->output_buffer, src, n, planar->channels,
+                      sample_size, plane_frames);
+    PaError err = PyAudioPlayback_WriteStream(stream, planar->output_buffer, n);
+    if (err == paOutputUnderflowed) {
+      result = err;
+    } else if (err != paNoError) {
+      return err;
+    }
+    src += (size_t)n * sample_size;
+    frames -= n;
+  }
+  return result;
+}
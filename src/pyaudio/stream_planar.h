@@ -0,0 +1,41 @@
+// Non-interleaved (planar) streams. The application reads, writes and passes
+// to and from callbacks one channel-major buffer per block: all of the
+// block's samples of the first channel, then all of the second channel's,
+// and so on. Everything below the application keeps interleaved frames, and
+// native kernels (see convert.h) interleave and deinterleave at the edge:
+// here for blocking reads and writes, which go through scratch buffers a
+// chunk at a time, and in PyAudioStream_InvokeCallback for callbacks.
+
+#ifndef STREAM_PLANAR_H_
+#define STREAM_PLANAR_H_
+
+#ifndef PY_SSIZE_T_CLEAN
+#define PY_SSIZE_T_CLEAN
+#endif
+#include "Python.h"
+#include "portaudio.h"
+
+#include "stream.h"
+
+// Sets up planar transfers for a stream, whose frame_size and sample_size
+// must already be set. Returns 0 on success, or -1 with an exception set.
+int PyAudioPlanar_Create(PyAudioStream *stream, int channels, int input,
+                         int output, unsigned long frames_per_buffer);
+
+// Frees the stream's planar state, if any. The PortAudio stream must already
+// be closed.
+void PyAudioPlanar_Free(PyAudioStream *stream);
+
+// Reads and writes exactly `frames` frames, as PyAudioCapture_ReadStream and
+// PyAudioPlayback_WriteStream do. For planar streams, buffer holds the first
+// frame of each channel's plane, plane_frames samples apart; otherwise, it
+// holds interleaved frames, and plane_frames is unused. Does not require the
+// GIL, but the stream must be in use (see PyAudioStream_BeginUse).
+PaError PyAudioPlanar_ReadStream(PyAudioStream *stream, void *buffer,
+                                 unsigned long frames,
+                                 unsigned long plane_frames);
+PaError PyAudioPlanar_WriteStream(PyAudioStream *stream, const void *buffer,
+                                  unsigned long frames,
+                                  unsigned long plane_frames);
+
+#endif  // STREAM_PLANAR_H_
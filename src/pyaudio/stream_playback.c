@@ -0,0 +1,241 @@
+#include "stream_playback.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef PY_SSIZE_T_CLEAN
+#define PY_SSIZE_T_CLEAN
+#endif
+#include "Python.h"
+#include "portaudio.h"
+
+#include "module_state.h"
+#include "ring_buffer.h"
+#include "stream.h"
+#include "stream_async.h"
+#include "stream_resample.h"
+#include "sync.h"
+
+// How long a writer waits for the device between checks for a stopped or
+// closing stream, in ms.
+#define WRITER_POLL_MS 100
+
+struct PyAudioPlayback {
+  // Output, writers -> device. Holds a whole number of frames.
+  PyAudioRingBuffer ring;
+  // Posted by the real-time thread after each period while a writer waits.
+  PyAudioSemaphore *frames_played;
+  // Set while a writer waits for frames_played.
+  PyAudioAtomic waiting;
+  // Set when the device ran out of queued samples since the last write.
+  PyAudioAtomic underflowed;
+  // Whether the previous period played queued samples throughout. Only the
+  // real-time thread uses this.
+  int playing;
+};
+
+static void free_playback(PyAudioPlayback *playback) {
+  PyAudioRingBuffer_Free(&playback->ring);
+  PyAudioSemaphore_Free(playback->frames_played);
+  free(playback);
+}
+
+// Waits until the ring has room for num_bytes. Returns paNoError, or an error
+// if the stream stopped first. Does not require the GIL.
+static PaError wait_for_room(PyAudioStream *stream, PyAudioPlayback *playback,
+                             size_t num_bytes) {
+  PaError err = paNoError;
+  // Announce the wait before checking the ring, so that the real-time thread
+  // either sees the announcement or played its period before the check.
+  PyAudioAtomic_Store(&playback->waiting, 1);
+  while (PyAudioRingBuffer_WriteAvailable(&playback->ring) < num_bytes) {
+    PaError active = Pa_IsStreamActive(stream->context.stream);
+    if (active != 1 || PyAudioAtomic_Load(&stream->closing)) {
+      // The queue is not going to drain.
+      err = active < 0 ? active : paStreamIsStopped;
+      break;
+    }
+    PyAudioSemaphore_Wait(playback->frames_played, WRITER_POLL_MS);
+  }
+  PyAudioAtomic_Store(&playback->waiting, 0);
+  return err;
+}
+
+int PyAudioPlayback_Create(PyAudioStream *stream, unsigned long ring_frames) {
+  PyAudioPlayback *playback =
+      (PyAudioPlayback *)calloc(1, sizeof(PyAudioPlayback));
+  if (!playback) {
+    PyErr_NoMemory();
+    return -1;
+  }
+
+  if (PyAudioRingBuffer_Init(&playback->ring,
+                             (size_t)ring_frames * stream->context.frame_size) <
+          0 ||
+      !(playback->frames_played = PyAudioSemaphore_New())) {
+    free_playback(playback);
+    PyErr_NoMemory();
+    return -1;
+  }
+
+  stream->context.playback = playback;
+  return 0;
+}
+
+void PyAudioPlayback_Free(PyAudioStream *stream) {
+  PyAudioPlayback *playback = stream->context.playback;
+  if (!playback) {
+    return;
+  }
+  stream->context.playback = NULL;
+  free_playback(playback);
+}
+
+PaError PyAudioPlayback_WriteStream(PyAudioStream *stream, const void *buffer,
+                                    unsigned long frames) {
+  PyAudioPlayback *playback = stream->context.playback;
+  if (!playback) {
+    PaError err = PyAudioResample_WriteStream(stream, buffer, frames);
+    if (err == paOutputUnderflowed) {
+      PyAudioStream_CountXruns(stream, paOutputUnderflow, frames);
+    }
+    return err;
+  }
+
+  const char *src = (const char *)buffer;
+  size_t frame_size = stream->context.frame_size;
+  size_t num_bytes = (size_t)frames * frame_size;
+  while (num_bytes > 0) {
+    size_t num_written =
+        PyAudioRingBuffer_Write(&playback->ring, src, num_bytes);
+    src += num_written;
+    num_bytes -= num_written;
+    if (num_bytes > 0) {
+      PaError err = wait_for_room(stream, playback, frame_size);
+      if (err != paNoError) {
+        return err;
+      }
+    }
+  }
+
+  return PyAudioAtomic_Exchange(&playback->underflowed, 0)
+             ? paOutputUnderflowed
+             : paNoError;
+}
+
+signed long PyAudioPlayback_GetWriteAvailable(PyAudioStream *stream) {
+  PyAudioPlayback *playback = stream->context.playback;
+  if (!playback) {
+    return PyAudioResample_GetWriteAvailable(
+        stream, Pa_GetStreamWriteAvailable(stream->context.stream));
+  }
+  return (signed long)(PyAudioRingBuffer_WriteAvailable(&playback->ring) /
+                       stream->context.frame_size);
+}
+
+signed long PyAudioPlayback_GetCapacity(PyAudioStream *stream) {
+  return (signed long)(stream->context.playback->ring.capacity /
+                       stream->context.frame_size);
+}
+
+int PyAudioPlayback_CallbackCFunc(const void *input, void *output,
+                                  unsigned long frame_count,
+                                  const PaStreamCallbackTimeInfo *time_info,
+                                  PaStreamCallbackFlags status_flags,
+                                  void *user_data) {
+  PyAudioStream *stream = (PyAudioStream *)user_data;
+  PyAudioPlayback *playback = stream->context.playback;
+  size_t num_bytes = frame_count * stream->context.frame_size;
+  PyAudioStream_CountXruns(stream, status_flags, frame_count);
+
+  size_t num_read = PyAudioRingBuffer_Read(&playback->ring, output, num_bytes);
+  if (num_read < num_bytes) {
+    memset((char *)output + num_read, 0, num_bytes - num_read);
+    // Running out in the middle of the queued samples is an underflow; an
+    // idle queue just plays silence.
+    if (num_read > 0 || playback->playing) {
+      PyAudioAtomic_Store(&playback->underflowed, 1);
+      PyAudioStream_CountXruns(stream, paOutputUnderflow,
+                               (num_bytes - num_read) /
+                                   stream->context.frame_size);
+    }
+  }
+  playback->playing = num_read == num_bytes;
+  if (status_flags & paOutputUnderflow) {
+    PyAudioAtomic_Store(&playback->underflowed, 1);
+  }
+
+  if (PyAudioAtomic_Load(&playback->waiting)) {
+    PyAudioSemaphore_Post(playback->frames_played);
+  }
+  PyAudioAsync_Notify(stream,
+                      PyAudioRingBuffer_WriteAvailable(&playback->ring) /
+                          stream->context.frame_size);
+  return paContinue;
+}
+
+// Returns the stream's playback state after PyAudioStream_BeginUse, or NULL
+// with an exception set.
+static PyAudioPlayback *begin_use_playback(PyObject *self, PyObject *args,
+                                           PyAudioStream **stream_out) {
+  PyObject *stream_arg;
+  if (!PyArg_ParseTuple(args, "O!", PyAudioModule_GetState(self)->stream_type,
+                        &stream_arg)) {
+    return NULL;
+  }
+
+  PyAudioStream *stream = (PyAudioStream *)stream_arg;
+  if (!PyAudioStream_BeginUse(stream)) {
+    PyErr_SetObject(PyExc_IOError,
+                    Py_BuildValue("(i,s)", paBadStreamPtr, "Stream closed"));
+    return NULL;
+  }
+
+  PyAudioPlayback *playback = stream->context.playback;
+  if (!playback) {
+    PyAudioStream_EndUse(stream);
+    PyErr_SetString(PyExc_ValueError, "Stream has no playback queue");
+    return NULL;
+  }
+
+  *stream_out = stream;
+  return playback;
+}
+
+PyObject *PyAudio_DrainStream(PyObject *self, PyObject *args) {
+  PyAudioStream *stream;
+  PyAudioPlayback *playback = begin_use_playback(self, args, &stream);
+  if (!playback) {
+    return NULL;
+  }
+
+  PaError err;
+  // clang-format off
+  Py_BEGIN_ALLOW_THREADS
+  err = wait_for_room(stream, playback, playback->ring.capacity);
+  Py_END_ALLOW_THREADS
+  // clang-format on
+  PyAudioStream_EndUse(stream);
+
+  // A stopped stream keeps its queue, so it can still play it out later.
+  if (err != paNoError) {
+    PyErr_SetObject(PyExc_IOError,
+                    Py_BuildValue("(i,s)", err, Pa_GetErrorText(err)));
+    return NULL;
+  }
+
+  Py_RETURN_NONE;
+}
+
+PyObject *PyAudio_GetStreamQueuedFrames(PyObject *self, PyObject *args) {
+  PyAudioStream *stream;
+  PyAudioPlayback *playback = begin_use_playback(self, args, &stream);
+  if (!playback) {
+    return NULL;
+  }
+
+  size_t num_frames = PyAudioRingBuffer_ReadAvailable(&playback->ring) /
+                      stream->context.frame_size;
+  PyAudioStream_EndUse(stream);
+  return PyLong_FromSize_t(num_frames);
+}
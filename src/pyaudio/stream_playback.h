@@ -0,0 +1,58 @@
+// Queued playback for blocking output streams. Blocking writes copy their
+// samples into a large lock-free ring buffer and return as soon as the samples
+// fit, and PortAudio's real-time thread plays the ring out to the device
+// without ever waiting for the Python interpreter. One thread may then keep
+// many output streams fed without blocking on any of them.
+
+#ifndef STREAM_PLAYBACK_H_
+#define STREAM_PLAYBACK_H_
+
+#ifndef PY_SSIZE_T_CLEAN
+#define PY_SSIZE_T_CLEAN
+#endif
+#include "Python.h"
+#include "portaudio.h"
+
+#include "stream.h"
+
+// Sets up queued playback for an output stream, with a ring buffer of
+// ring_frames frames. Returns 0 on success, or -1 with an exception set.
+int PyAudioPlayback_Create(PyAudioStream *stream, unsigned long ring_frames);
+
+// Frees the stream's playback state, if any. The PortAudio stream must already
+// be closed.
+void PyAudioPlayback_Free(PyAudioStream *stream);
+
+// Writes exactly `frames` frames, as Pa_WriteStream does: into the playback
+// ring if the stream has one, waiting for room as needed, or to the PortAudio
+// stream otherwise. Returns paOutputUnderflowed if the device ran out of
+// queued samples since the previous write. Does not require the GIL, but the
+// stream must be in use (see PyAudioStream_BeginUse).
+PaError PyAudioPlayback_WriteStream(PyAudioStream *stream, const void *buffer,
+                                    unsigned long frames);
+
+// Returns the number of frames that PyAudioPlayback_WriteStream can write
+// without waiting, as Pa_GetStreamWriteAvailable does. Same requirements as
+// PyAudioPlayback_WriteStream.
+signed long PyAudioPlayback_GetWriteAvailable(PyAudioStream *stream);
+
+// Returns the size of the stream's playback ring, in frames. The stream must
+// have one.
+signed long PyAudioPlayback_GetCapacity(PyAudioStream *stream);
+
+// PortAudio stream callback for streams with queued playback. Never acquires
+// the GIL.
+int PyAudioPlayback_CallbackCFunc(const void *input, void *output,
+                                  unsigned long frame_count,
+                                  const PaStreamCallbackTimeInfo *time_info,
+                                  PaStreamCallbackFlags status_flags,
+                                  void *user_data);
+
+// Exported functions.
+
+// Waits until the device has taken every queued frame.
+PyObject *PyAudio_DrainStream(PyObject *self, PyObject *args);
+// Returns the number of frames queued for playback.
+PyObject *PyAudio_GetStreamQueuedFrames(PyObject *self, PyObject *args);
+
+#endif  // STREAM_PLAYBACK_H_
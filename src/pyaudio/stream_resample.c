@@ -0,0 +1,381 @@
+#include "stream_resample.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef PY_SSIZE_T_CLEAN
+#define PY_SSIZE_T_CLEAN
+#endif
+#include "Python.h"
+#include "portaudio.h"
+
+#include "convert.h"
+#include "resample.h"
+#include "stream.h"
+#include "stream_convert.h"
+
+// The fewest frames that the scratch buffers hold. Blocking transfers and
+// callbacks resample this many frames at a time, at either rate, or
+// frames_per_buffer if larger.
+#define MIN_CHUNK_FRAMES 4096
+
+struct PyAudioResample {
+  // The callback that runs on resampled periods, for callback streams.
+  PaStreamCallback *callback;
+  unsigned long app_rate;
+  unsigned long device_rate;
+  unsigned int channels;
+  // Application format <-> float32, which the resamplers work in.
+  PyAudioConverter to_float;
+  PyAudioConverter from_float;
+  // Device rate -> application rate, and back. NULL for a direction that the
+  // stream does not have.
+  PyAudioResampler *input;
+  PyAudioResampler *output;
+  // Frames of silence that the output starts with, for full-duplex
+  // callbacks (see stream_resample.h).
+  unsigned long output_prefill;
+  // Size of the scratch buffers, in frames.
+  unsigned long chunk_frames;
+  // Scratch buffers for each direction, of chunk_frames frames in float32
+  // and in the application's format. NULL for a direction that the stream
+  // does not have.
+  float *input_float;
+  float *output_float;
+  void *input_buffer;
+  void *output_buffer;
+};
+
+static void free_resample(PyAudioResample *resample) {
+  PyAudioResampler_Free(resample->input);
+  PyAudioResampler_Free(resample->output);
+  free(resample->input_float);
+  free(resample->output_float);
+  free(resample->input_buffer);
+  free(resample->output_buffer);
+  free(resample);
+}
+
+int PyAudioResample_Create(PyAudioStream *stream, unsigned long app_rate,
+                           unsigned long device_rate,
+                           PaSampleFormat app_format, int channels, int input,
+                           int output, int quality, PaStreamCallback *callback,
+                           unsigned long frames_per_buffer) {
+  PyAudioResample *resample =
+      (PyAudioResample *)calloc(1, sizeof(PyAudioResample));
+  if (!resample) {
+    PyErr_NoMemory();
+    return -1;
+  }
+
+  resample->callback = callback;
+  resample->app_rate = app_rate;
+  resample->device_rate = device_rate;
+  resample->channels = (unsigned int)channels;
+  PyAudioConverter_Init(&resample->to_float, app_format, paFloat32);
+  PyAudioConverter_Init(&resample->from_float, paFloat32, app_format);
+  resample->chunk_frames = frames_per_buffer > MIN_CHUNK_FRAMES
+                               ? frames_per_buffer
+                               : MIN_CHUNK_FRAMES;
+
+  unsigned long chunk = resample->chunk_frames;
+  size_t float_bytes = (size_t)chunk * channels * sizeof(float);
+  size_t app_bytes = (size_t)chunk * stream->context.frame_size;
+  if (input &&
+      (!(resample->input = PyAudioResampler_New(device_rate, app_rate,
+                                                resample->channels, quality,
+                                                chunk)) ||
+       !(resample->input_float = (float *)malloc(float_bytes)) ||
+       !(resample->input_buffer = malloc(app_bytes)))) {
+    free_resample(resample);
+    PyErr_NoMemory();
+    return -1;
+  }
+
+  // A callback's output filter takes each device chunk's worth of frames,
+  // on top of the silence that full-duplex streams start with, before the
+  // chunk's output is read. Blocking writes take up to a chunk at a time.
+  unsigned long long held_back =
+      input ? 3ull * PyAudioResampler_GetDelay(resample->input) : 0;
+  size_t max_output_frames =
+      (size_t)((chunk + held_back) * app_rate / device_rate) + 4;
+  if (max_output_frames < chunk) {
+    max_output_frames = chunk;
+  }
+  if (output &&
+      (!(resample->output = PyAudioResampler_New(
+             app_rate, device_rate, resample->channels, quality,
+             max_output_frames)) ||
+       !(resample->output_float = (float *)malloc(float_bytes)) ||
+       !(resample->output_buffer = malloc(app_bytes)))) {
+    free_resample(resample);
+    PyErr_NoMemory();
+    return -1;
+  }
+
+  // The input filter delivers each frame its delay after the device captures
+  // it, and the output filter needs its delay's worth of frames before the
+  // device plays one, so full-duplex callbacks start that far behind.
+  if (input && output && callback) {
+    resample->output_prefill =
+        (unsigned long)(((unsigned long long)PyAudioResampler_GetDelay(
+                             resample->input) *
+                             app_rate +
+                         device_rate - 1) /
+                        device_rate) +
+        PyAudioResampler_GetDelay(resample->output) + 2;
+  }
+
+  stream->context.resample = resample;
+  PyAudioResample_Restart(stream);
+  return 0;
+}
+
+void PyAudioResample_Free(PyAudioStream *stream) {
+  PyAudioResample *resample = stream->context.resample;
+  if (!resample) {
+    return;
+  }
+  stream->context.resample = NULL;
+  free_resample(resample);
+}
+
+void PyAudioResample_Restart(PyAudioStream *stream) {
+  PyAudioResample *resample = stream->context.resample;
+  if (!resample) {
+    return;
+  }
+
+  if (resample->input) {
+    PyAudioResampler_Reset(resample->input);
+  }
+  if (resample->output) {
+    PyAudioResampler_Reset(resample->output);
+    unsigned long silence = resample->output_prefill;
+    memset(resample->output_float, 0,
+           (size_t)resample->chunk_frames * resample->channels *
+               sizeof(float));
+    while (silence > 0) {
+      unsigned long n = silence < resample->chunk_frames
+                            ? silence
+                            : resample->chunk_frames;
+      PyAudioResampler_Write(resample->output, resample->output_float, n);
+      silence -= n;
+    }
+  }
+}
+
+PaError PyAudioResample_ReadStream(PyAudioStream *stream, void *buffer,
+                                   unsigned long frames) {
+  PyAudioResample *resample = stream->context.resample;
+  if (!resample) {
+    return PyAudioConvert_ReadStream(stream, buffer, frames);
+  }
+
+  // As for conversions, report an overflow at the end, after reading
+  // everything.
+  PaError result = paNoError;
+  unsigned long chunk = resample->chunk_frames;
+  size_t frame_size = stream->context.frame_size;
+  char *dst = (char *)buffer;
+  while (frames > 0) {
+    unsigned long n = frames < chunk ? frames : chunk;
+    size_t got = PyAudioResampler_Read(resample->input, resample->input_float,
+                                       n);
+    if (got > 0) {
+      PyAudioConverter_Run(&resample->from_float, dst, resample->input_float,
+                           got * resample->channels);
+      dst += got * frame_size;
+      frames -= (unsigned long)got;
+      continue;
+    }
+
+    // Read just enough from the device for the rest, so that the read does
+    // not wait for input that it does not return.
+    size_t needed = PyAudioResampler_GetInputNeeded(resample->input, n);
+    unsigned long m = needed < chunk ? (unsigned long)needed : chunk;
+    PaError err = PyAudioConvert_ReadStream(stream, resample->input_buffer, m);
+    if (err == paInputOverflowed) {
+      result = err;
+    } else if (err != paNoError) {
+      return err;
+    }
+    PyAudioConverter_Run(&resample->to_float, resample->input_float,
+                         resample->input_buffer,
+                         (size_t)m * resample->channels);
+    PyAudioResampler_Write(resample->input, resample->input_float, m);
+  }
+  return result;
+}
+
+PaError PyAudioResample_WriteStream(PyAudioStream *stream, const void *buffer,
+                                    unsigned long frames) {
+  PyAudioResample *resample = stream->context.resample;
+  if (!resample) {
+    return PyAudioConvert_WriteStream(stream, buffer, frames);
+  }
+
+  // Likewise, underflows happen before the chunk that reports them.
+  PaError result = paNoError;
+  unsigned long chunk = resample->chunk_frames;
+  const char *src = (const char *)buffer;
+  while (frames > 0) {
+    unsigned long n = frames < chunk ? frames : chunk;
+    PyAudioConverter_Run(&resample->to_float, resample->output_float, src,
+                         (size_t)n * resample->channels);
+    PyAudioResampler_Write(resample->output, resample->output_float, n);
+    src += (size_t)n * stream->context.frame_size;
+    frames -= n;
+
+    size_t got;
+    while ((got = PyAudioResampler_Read(resample->output,
+                                        resample->output_float, chunk)) > 0) {
+      PyAudioConverter_Run(&resample->from_float, resample->output_buffer,
+                           resample->output_float, got * resample->channels);
+      PaError err = PyAudioConvert_WriteStream(
+          stream, resample->output_buffer, (unsigned long)got);
+      if (err == paOutputUnderflowed) {
+        result = err;
+      } else if (err != paNoError) {
+        return err;
+      }
+    }
+  }
+  return result;
+}
+
+signed long PyAudioResample_GetReadAvailable(PyAudioStream *stream,
+                                             signed long device_frames) {
+  PyAudioResample *resample = stream->context.resample;
+  if (!resample || device_frames < 0) {
+    return device_frames;
+  }
+  return (signed long)PyAudioResampler_GetAvailable(resample->input,
+                                                    (size_t)device_frames);
+}
+
+signed long PyAudioResample_GetWriteAvailable(PyAudioStream *stream,
+                                              signed long device_frames) {
+  PyAudioResample *resample = stream->context.resample;
+  if (!resample || device_frames < 0) {
+    return device_frames;
+  }
+  // The most frames whose output fits, after what the filter holds back.
+  size_t frames = (size_t)((unsigned long long)device_frames *
+                           resample->app_rate / resample->device_rate);
+  while (frames > 0 &&
+         PyAudioResampler_GetAvailable(resample->output, frames) >
+             (size_t)device_frames) {
+    frames--;
+  }
+  return (signed long)frames;
+}
+
+unsigned long PyAudioResample_GetMaxFrameCount(PyAudioStream *stream) {
+  return stream->context.resample->chunk_frames;
+}
+
+double PyAudioResample_GetAppRate(PyAudioStream *stream, double device_rate) {
+  PyAudioResample *resample = stream->context.resample;
+  return resample ? (double)resample->app_rate : device_rate;
+}
+
+double PyAudioResample_GetInputLatency(PyAudioStream *stream) {
+  PyAudioResample *resample = stream->context.resample;
+  if (!resample || !resample->input) {
+    return 0;
+  }
+  return (double)PyAudioResampler_GetDelay(resample->input) /
+         resample->device_rate;
+}
+
+double PyAudioResample_GetOutputLatency(PyAudioStream *stream) {
+  PyAudioResample *resample = stream->context.resample;
+  if (!resample || !resample->output) {
+    return 0;
+  }
+  // Full-duplex callbacks render each frame once the input filter delivers
+  // the input at the same time, and the silence before the output covers
+  // both filters' delays.
+  if (resample->output_prefill > 0) {
+    return (double)resample->output_prefill / resample->app_rate -
+           PyAudioResample_GetInputLatency(stream);
+  }
+  // Otherwise, frames wait for the output filter's delay's worth of frames
+  // after them.
+  return (double)PyAudioResampler_GetDelay(resample->output) /
+         resample->app_rate;
+}
+
+int PyAudioResample_CallbackCFunc(const void *input, void *output,
+                                  unsigned long frame_count,
+                                  const PaStreamCallbackTimeInfo *time_info,
+                                  PaStreamCallbackFlags status_flags,
+                                  void *user_data) {
+  PyAudioStream *stream = (PyAudioStream *)user_data;
+  PyAudioResample *resample = stream->context.resample;
+  unsigned int channels = resample->channels;
+  unsigned long chunk = resample->chunk_frames;
+  size_t frame_size = stream->context.frame_size;
+  const char *src = (const char *)input;
+  char *dst = (char *)output;
+  int result = paContinue;
+
+  while (frame_count > 0 && result == paContinue) {
+    unsigned long n = frame_count < chunk ? frame_count : chunk;
+
+    // Input drives the callback when there is any: it runs on whatever the
+    // period's input resamples to. Otherwise, it renders just enough for the
+    // period's output.
+    size_t app_frames;
+    if (src) {
+      PyAudioConverter_Run(&resample->to_float, resample->input_float, src,
+                           (size_t)n * channels);
+      PyAudioResampler_Write(resample->input, resample->input_float, n);
+      src += (size_t)n * frame_size;
+      app_frames = PyAudioResampler_GetAvailable(resample->input, 0);
+    } else {
+      app_frames = PyAudioResampler_GetInputNeeded(resample->output, n);
+    }
+
+    while (app_frames > 0 && result == paContinue) {
+      unsigned long m =
+          app_frames < chunk ? (unsigned long)app_frames : chunk;
+      if (src) {
+        PyAudioResampler_Read(resample->input, resample->input_float, m);
+        PyAudioConverter_Run(&resample->from_float, resample->input_buffer,
+                             resample->input_float, (size_t)m * channels);
+      }
+      result = resample->callback(src ? resample->input_buffer : NULL,
+                                  dst ? resample->output_buffer : NULL, m,
+                                  time_info, status_flags, stream);
+      if (dst) {
+        PyAudioConverter_Run(&resample->to_float, resample->output_float,
+                             resample->output_buffer, (size_t)m * channels);
+        PyAudioResampler_Write(resample->output, resample->output_float, m);
+      }
+      // Report xruns only once per period.
+      status_flags = 0;
+      app_frames -= m;
+    }
+
+    if (dst) {
+      size_t got = PyAudioResampler_Read(resample->output,
+                                         resample->output_float, n);
+      PyAudioConverter_Run(&resample->from_float, dst, resample->output_float,
+                           got * channels);
+      // Only a callback that finished early leaves the output short.
+      if (got < n) {
+        memset(dst + got * frame_size, 0, (n - got) * frame_size);
+      }
+      dst += (size_t)n * frame_size;
+    }
+    frame_count -= n;
+  }
+
+  // The callback finished early: play silence for the rest of the period.
+  if (dst && frame_count > 0) {
+    memset(dst, 0, (size_t)frame_count * frame_size);
+  }
+  return result;
+}
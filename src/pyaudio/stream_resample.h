@@ -0,0 +1,82 @@
+// Sample-rate conversion for streams that the application reads and writes at
+// a different rate than the device runs at (see resample.h). Blocking reads
+// and writes resample a chunk at a time below the capture and playback rings,
+// and callbacks run behind a wrapper that resamples each period on
+// PortAudio's real-time thread, so the rest of the stream only ever sees the
+// application's rate. Frame counts above this layer are in frames at the
+// application's rate.
+//
+// For full-duplex callbacks, the input drives the callback, and the output
+// starts with enough silence to cover the filters' delay, so that each
+// period's output never waits for the next callback.
+
+#ifndef STREAM_RESAMPLE_H_
+#define STREAM_RESAMPLE_H_
+
+#ifndef PY_SSIZE_T_CLEAN
+#define PY_SSIZE_T_CLEAN
+#endif
+#include "Python.h"
+#include "portaudio.h"
+
+#include "stream.h"
+
+// Sets up resampling between app_rate, at which the application reads and
+// writes samples of app_format, and device_rate, at which the PortAudio stream
+// was opened. app_format must be one that PyAudioConverter supports. For
+// callback streams, `callback` is the callback that
+// PyAudioResample_CallbackCFunc calls with resampled periods; NULL otherwise.
+// Returns 0 on success, or -1 with an exception set.
+int PyAudioResample_Create(PyAudioStream *stream, unsigned long app_rate,
+                           unsigned long device_rate,
+                           PaSampleFormat app_format, int channels, int input,
+                           int output, int quality, PaStreamCallback *callback,
+                           unsigned long frames_per_buffer);
+
+// Frees the stream's resampling state, if any. The PortAudio stream must
+// already be closed.
+void PyAudioResample_Free(PyAudioStream *stream);
+
+// Clears the filters' state before the stream (re)starts. Requires the stream
+// to be stopped.
+void PyAudioResample_Restart(PyAudioStream *stream);
+
+// Reads and writes exactly `frames` frames at the application's rate, as
+// PyAudioConvert_ReadStream and PyAudioConvert_WriteStream do at the device's.
+// Writes hold back the last few frames, which the filter needs the next
+// write's frames to finish. Same requirements as PyAudioConvert_ReadStream.
+PaError PyAudioResample_ReadStream(PyAudioStream *stream, void *buffer,
+                                   unsigned long frames);
+PaError PyAudioResample_WriteStream(PyAudioStream *stream, const void *buffer,
+                                    unsigned long frames);
+
+// Converts the frames that the device can read or write without waiting (as
+// Pa_GetStreamReadAvailable and Pa_GetStreamWriteAvailable return them, or
+// negative error codes, which pass through) into frames at the application's
+// rate.
+signed long PyAudioResample_GetReadAvailable(PyAudioStream *stream,
+                                             signed long device_frames);
+signed long PyAudioResample_GetWriteAvailable(PyAudioStream *stream,
+                                              signed long device_frames);
+
+// Returns the most frames that the stream's callback receives at once.
+unsigned long PyAudioResample_GetMaxFrameCount(PyAudioStream *stream);
+
+// Returns the application's rate, or device_rate if the stream does not
+// resample.
+double PyAudioResample_GetAppRate(PyAudioStream *stream, double device_rate);
+
+// Returns the latency that resampling adds to each direction, in seconds.
+double PyAudioResample_GetInputLatency(PyAudioStream *stream);
+double PyAudioResample_GetOutputLatency(PyAudioStream *stream);
+
+// PortAudio stream callback for callback streams with resampling. Runs the
+// stream's callback on resampled periods, which may be shorter or longer than
+// PortAudio's, and in pieces if they do not fit the scratch buffers.
+int PyAudioResample_CallbackCFunc(const void *input, void *output,
+                                  unsigned long frame_count,
+                                  const PaStreamCallbackTimeInfo *time_info,
+                                  PaStreamCallbackFlags status_flags,
+                                  void *user_data);
+
+#endif  // STREAM_RESAMPLE_H_
@@ -0,0 +1,462 @@
+#include "stream_subinterpreter.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef PY_SSIZE_T_CLEAN
+#define PY_SSIZE_T_CLEAN
+#endif
+#include "Python.h"
+#include "portaudio.h"
+#include "pythread.h"
+
+#include "module_state.h"
+#include "stream.h"
+#include "stream_io.h"
+
+#if PY_VERSION_HEX >= 0x030C0000
+
+struct PyAudioSubinterpreter {
+  PyInterpreterState *interp;
+  // The thread state that Py_NewInterpreterFromConfig created, and the ID of
+  // the thread that created it, which the subinterpreter's threading module
+  // considers its main thread. (Keeping the thread state also means that the
+  // subinterpreter never runs out of thread states, which Python 3.12 does
+  // not handle.)
+  PyThreadState *initial_tstate;
+  unsigned long initial_thread;
+  // Thread state for PortAudio's callback thread, created on that thread, and
+  // the thread's ID. NULL until the first callback.
+  PyThreadState *tstate;
+  unsigned long tstate_thread;
+};
+
+// The calling interpreter's sys.path, copied for the subinterpreter: `count`
+// consecutive NUL-terminated UTF-8 strings.
+typedef struct {
+  char *entries;
+  Py_ssize_t count;
+} SysPath;
+
+// Copies sys.path (its str entries) into path. Returns 0 on success, or -1
+// with an exception set.
+static int copy_sys_path(SysPath *path) {
+  path->entries = NULL;
+  path->count = 0;
+
+  PyObject *sys_path = PySys_GetObject("path");  // Borrowed.
+  if (sys_path == NULL || !PyList_Check(sys_path)) {
+    return 0;
+  }
+
+  // Hold on to the list: other threads may change sys.path meanwhile.
+  PyObject *items = PySequence_Tuple(sys_path);
+  if (items == NULL) {
+    return -1;
+  }
+
+  size_t size = 0;
+  for (Py_ssize_t i = 0; i < PyTuple_GET_SIZE(items); i++) {
+    Py_ssize_t len;
+    PyObject *item = PyTuple_GET_ITEM(items, i);
+    if (PyUnicode_Check(item) && PyUnicode_AsUTF8AndSize(item, &len)) {
+      size += len + 1;
+    }
+    // Entries that are not valid UTF-8 (e.g., undecodable bytes in a file
+    // system path) cannot be imported from anyway.
+    PyErr_Clear();
+  }
+
+  path->entries = (char *)malloc(size + 1);
+  if (path->entries == NULL) {
+    Py_DECREF(items);
+    PyErr_NoMemory();
+    return -1;
+  }
+
+  char *end = path->entries;
+  for (Py_ssize_t i = 0; i < PyTuple_GET_SIZE(items); i++) {
+    Py_ssize_t len;
+    PyObject *item = PyTuple_GET_ITEM(items, i);
+    const char *entry =
+        PyUnicode_Check(item) ? PyUnicode_AsUTF8AndSize(item, &len) : NULL;
+    if (entry == NULL) {
+      PyErr_Clear();
+      continue;
+    }
+    memcpy(end, entry, len + 1);
+    end += len + 1;
+    path->count++;
+  }
+
+  Py_DECREF(items);
+  return 0;
+}
+
+// Replaces sys.path (in the current interpreter) with path. Returns 0 on
+// success, or -1 with an exception set.
+static int set_sys_path(const SysPath *path) {
+  PyObject *sys_path = PyList_New(path->count);
+  if (sys_path == NULL) {
+    return -1;
+  }
+
+  const char *entry = path->entries;
+  for (Py_ssize_t i = 0; i < path->count; i++) {
+    PyObject *item = PyUnicode_FromString(entry);
+    if (item == NULL) {
+      Py_DECREF(sys_path);
+      return -1;
+    }
+    PyList_SET_ITEM(sys_path, i, item);
+    entry += strlen(entry) + 1;
+  }
+
+  int rv = PySys_SetObject("path", sys_path);
+  Py_DECREF(sys_path);
+  return rv;
+}
+
+// An exception raised in the subinterpreter, described in a form that the
+// calling interpreter can raise again, since exception objects cannot cross
+// interpreters.
+typedef struct {
+  // A built-in exception type, which all interpreters share.
+  PyObject *type;
+  // The exception's message, and its formatted traceback (or NULL), as
+  // malloc'ed UTF-8 strings.
+  char *message;
+  char *traceback;
+} ExportedError;
+
+// Returns a malloc'ed copy of str, or NULL.
+static char *copy_str(PyObject *str) {
+  const char *text = str ? PyUnicode_AsUTF8(str) : NULL;
+  char *copy = text ? (char *)malloc(strlen(text) + 1) : NULL;
+  if (copy != NULL) {
+    strcpy(copy, text);
+  }
+  return copy;
+}
+
+// Describes exc (an exception of the subinterpreter, or NULL) in error, and
+// clears any exception raised meanwhile. If format_traceback is set, also
+// formats the traceback.
+static void export_error(PyObject *exc, int format_traceback,
+                         ExportedError *error) {
+  // Keep the type of common errors (the most specific first); report others
+  // by name.
+  PyObject *known_types[] = {PyExc_ModuleNotFoundError, PyExc_ImportError,
+                             PyExc_AttributeError, PyExc_TypeError,
+                             PyExc_ValueError};
+  error->type = PyExc_RuntimeError;
+  for (size_t i = 0; i < sizeof(known_types) / sizeof(known_types[0]); i++) {
+    if (exc && PyErr_GivenExceptionMatches(exc, known_types[i])) {
+      error->type = known_types[i];
+      break;
+    }
+  }
+
+  PyObject *message = NULL;
+  if (exc && error->type == PyExc_RuntimeError) {
+    message = PyUnicode_FromFormat("%s: %S", Py_TYPE(exc)->tp_name, exc);
+  } else if (exc) {
+    message = PyObject_Str(exc);
+  }
+  error->message = copy_str(message);
+  Py_XDECREF(message);
+
+  error->traceback = NULL;
+  if (exc && format_traceback) {
+    PyObject *lines = NULL;
+    PyObject *traceback = PyImport_ImportModule("traceback");
+    if (traceback != NULL) {
+      lines = PyObject_CallMethod(traceback, "format_exception", "O", exc);
+    }
+    PyObject *empty = PyUnicode_FromString("");
+    PyObject *text = lines && empty ? PyUnicode_Join(empty, lines) : NULL;
+    error->traceback = copy_str(text);
+    Py_XDECREF(text);
+    Py_XDECREF(empty);
+    Py_XDECREF(lines);
+    Py_XDECREF(traceback);
+  }
+  PyErr_Clear();
+}
+
+static void free_exported_error(ExportedError *error) {
+  free(error->message);
+  free(error->traceback);
+}
+
+// Imports the callback that spec names, and sets it as the stream's callback.
+// Runs in the subinterpreter. Returns 0 on success, or -1 with error set.
+static int load_callback(PyAudioStream *stream, const char *spec,
+                         const SysPath *path, unsigned long max_frame_count,
+                         ExportedError *error) {
+  PyObject *portaudio = NULL;
+  PyObject *module = NULL;
+  PyObject *callback = NULL;
+  int rv = -1;
+
+  if (set_sys_path(path) < 0) {
+    goto end;
+  }
+
+  // The time_info objects that the callback receives must come from this
+  // interpreter's copy of the module.
+  portaudio = PyImport_ImportModule("pyaudio._portaudio");
+  if (portaudio == NULL) {
+    goto end;
+  }
+
+  const char *colon = strchr(spec, ':');
+  PyObject *module_name = PyUnicode_FromStringAndSize(spec, colon - spec);
+  if (module_name == NULL) {
+    goto end;
+  }
+  module = PyImport_Import(module_name);
+  Py_DECREF(module_name);
+  if (module == NULL) {
+    goto end;
+  }
+
+  callback = PyObject_GetAttrString(module, colon + 1);
+  if (callback == NULL) {
+    goto end;
+  }
+  if (!PyCallable_Check(callback)) {
+    PyErr_Format(PyExc_TypeError, "stream_callback '%s' is not callable",
+                 spec);
+    goto end;
+  }
+
+  rv = PyAudioStream_SetCallback(
+      stream, callback, PyAudioModule_GetState(portaudio)->time_info_type,
+      max_frame_count);
+
+end:
+  if (rv < 0) {
+    PyObject *exc = PyErr_GetRaisedException();
+    export_error(exc, 0, error);
+    Py_XDECREF(exc);
+    PyAudioStream_ClearCallback(stream);
+  }
+  Py_XDECREF(callback);
+  Py_XDECREF(module);
+  Py_XDECREF(portaudio);
+  return rv;
+}
+
+int PyAudioSubinterpreter_Create(PyAudioStream *stream,
+                                 PyObject *callback_spec,
+                                 unsigned long max_frame_count) {
+  const char *spec = PyUnicode_AsUTF8(callback_spec);
+  if (spec == NULL) {
+    return -1;
+  }
+  const char *colon = strchr(spec, ':');
+  if (colon == NULL || colon == spec || colon[1] == '\0') {
+    PyErr_Format(PyExc_ValueError,
+                 "stream_callback must be of the form 'module:function', not "
+                 "%R",
+                 callback_spec);
+    return -1;
+  }
+
+  SysPath path;
+  if (copy_sys_path(&path) < 0) {
+    return -1;
+  }
+
+  PyAudioSubinterpreter *subinterpreter =
+      (PyAudioSubinterpreter *)calloc(1, sizeof(PyAudioSubinterpreter));
+  if (subinterpreter == NULL) {
+    free(path.entries);
+    PyErr_NoMemory();
+    return -1;
+  }
+
+  // An isolated interpreter with its own GIL, as for the interpreters module.
+  const PyInterpreterConfig config = {
+      .use_main_obmalloc = 0,
+      .allow_fork = 0,
+      .allow_exec = 0,
+      .allow_threads = 1,
+      .allow_daemon_threads = 0,
+      .check_multi_interp_extensions = 1,
+      .gil = PyInterpreterConfig_OWN_GIL,
+  };
+  PyThreadState *caller = PyThreadState_Get();
+  PyThreadState *tstate = NULL;
+  // On success, switches to the new interpreter, releasing the caller's GIL.
+  // On failure, stays in the calling interpreter.
+  PyStatus status = Py_NewInterpreterFromConfig(&tstate, &config);
+  if (PyStatus_Exception(status)) {
+    free(path.entries);
+    free(subinterpreter);
+    PyErr_Format(PyExc_RuntimeError, "Could not create subinterpreter: %s",
+                 status.err_msg ? status.err_msg : "unknown error");
+    return -1;
+  }
+
+  ExportedError error;
+  int rv = load_callback(stream, spec, &path, max_frame_count, &error);
+  free(path.entries);
+  if (rv < 0) {
+    Py_EndInterpreter(tstate);
+  } else {
+    subinterpreter->interp = PyThreadState_GetInterpreter(tstate);
+    subinterpreter->initial_tstate = tstate;
+    subinterpreter->initial_thread = PyThread_get_thread_ident();
+    PyEval_SaveThread();
+  }
+  PyEval_RestoreThread(caller);
+
+  if (rv < 0) {
+    free(subinterpreter);
+    PyErr_Format(error.type,
+                 "%s (while loading stream_callback '%s' in a subinterpreter)",
+                 error.message ? error.message : "", spec);
+    free_exported_error(&error);
+    return -1;
+  }
+
+  stream->context.subinterpreter = subinterpreter;
+  return 0;
+}
+
+void PyAudioSubinterpreter_Free(PyAudioStream *stream) {
+  PyAudioSubinterpreter *subinterpreter = stream->context.subinterpreter;
+  if (subinterpreter == NULL) {
+    return;
+  }
+  stream->context.subinterpreter = NULL;
+
+  // The subinterpreter's threading module expects to shut down either on its
+  // main thread, with that thread's thread state, or on another thread once
+  // the main thread's thread state is gone (otherwise, it waits for the main
+  // thread to exit).
+  PyThreadState *tstate = subinterpreter->initial_tstate;
+  if (PyThread_get_thread_ident() != subinterpreter->initial_thread) {
+    tstate = PyThreadState_New(subinterpreter->interp);
+    if (tstate == NULL) {
+      // Out of memory. Leak the subinterpreter rather than hang.
+      free(subinterpreter);
+      return;
+    }
+  }
+
+  PyThreadState *caller = PyEval_SaveThread();
+  PyEval_RestoreThread(tstate);
+
+  PyAudioStream_ClearCallback(stream);
+  if (subinterpreter->tstate != NULL) {
+    // The PortAudio stream is closed, so its callback thread no longer uses
+    // the thread state (and may be gone).
+    PyThreadState_Clear(subinterpreter->tstate);
+    PyThreadState_Delete(subinterpreter->tstate);
+  }
+  if (tstate != subinterpreter->initial_tstate) {
+    PyThreadState_Clear(subinterpreter->initial_tstate);
+    PyThreadState_Delete(subinterpreter->initial_tstate);
+  }
+  Py_EndInterpreter(tstate);
+
+  PyEval_RestoreThread(caller);
+  free(subinterpreter);
+}
+
+PyObject *PyAudioSubinterpreter_ExportError(PyAudioStream *stream,
+                                            PyObject *error) {
+  PyAudioSubinterpreter *subinterpreter = stream->context.subinterpreter;
+  // A temporary thread state for this thread in the subinterpreter.
+  PyThreadState *tstate = PyThreadState_New(subinterpreter->interp);
+  if (tstate == NULL) {
+    // Without a thread state, error cannot be released either.
+    return PyErr_NoMemory();
+  }
+
+  PyThreadState *caller = PyEval_SaveThread();
+  PyEval_RestoreThread(tstate);
+  ExportedError exported;
+  export_error(error, 1, &exported);
+  Py_DECREF(error);
+  PyThreadState_Clear(tstate);
+  PyThreadState_DeleteCurrent();
+  PyEval_RestoreThread(caller);
+
+  PyObject *exc = PyObject_CallFunction(
+      exported.type, "s", exported.message ? exported.message : "");
+  if (exc != NULL && exported.traceback != NULL) {
+    PyObject *rv =
+        PyObject_CallMethod(exc, "add_note", "s", exported.traceback);
+    if (rv == NULL) {
+      Py_CLEAR(exc);
+    }
+    Py_XDECREF(rv);
+  }
+  free_exported_error(&exported);
+  return exc;
+}
+
+int PyAudioSubinterpreter_CallbackCFunc(
+    const void *input, void *output, unsigned long frame_count,
+    const PaStreamCallbackTimeInfo *time_info,
+    PaStreamCallbackFlags status_flags, void *user_data) {
+  PyAudioStream *stream = (PyAudioStream *)user_data;
+  PyAudioSubinterpreter *subinterpreter = stream->context.subinterpreter;
+  PyAudioStream_CountXruns(stream, status_flags, frame_count);
+
+  // PortAudio calls back on the same thread every period, but may use a new
+  // thread each time the stream starts.
+  unsigned long thread = PyThread_get_thread_ident();
+  PyThreadState *stale_tstate = NULL;
+  if (subinterpreter->tstate == NULL ||
+      subinterpreter->tstate_thread != thread) {
+    PyThreadState *tstate = PyThreadState_New(subinterpreter->interp);
+    if (tstate == NULL) {
+      return paAbort;
+    }
+    stale_tstate = subinterpreter->tstate;
+    subinterpreter->tstate = tstate;
+    subinterpreter->tstate_thread = thread;
+  }
+
+  PyEval_RestoreThread(subinterpreter->tstate);
+  if (stale_tstate != NULL) {
+    PyThreadState_Clear(stale_tstate);
+    PyThreadState_Delete(stale_tstate);
+  }
+  int return_val = PyAudioStream_InvokeCallback(
+      stream, input, output, frame_count, time_info, status_flags);
+  PyEval_SaveThread();
+  return return_val;
+}
+
+#else  // PY_VERSION_HEX < 0x030C0000
+
+int PyAudioSubinterpreter_Create(PyAudioStream *stream,
+                                 PyObject *callback_spec,
+                                 unsigned long max_frame_count) {
+  PyErr_SetString(PyExc_RuntimeError,
+                  "callback_in_subinterpreter requires Python 3.12 or later");
+  return -1;
+}
+
+void PyAudioSubinterpreter_Free(PyAudioStream *stream) {}
+
+PyObject *PyAudioSubinterpreter_ExportError(PyAudioStream *stream,
+                                            PyObject *error) {
+  return error;
+}
+
+int PyAudioSubinterpreter_CallbackCFunc(
+    const void *input, void *output, unsigned long frame_count,
+    const PaStreamCallbackTimeInfo *time_info,
+    PaStreamCallbackFlags status_flags, void *user_data) {
+  return paAbort;
+}
+
+#endif  // PY_VERSION_HEX >= 0x030C0000
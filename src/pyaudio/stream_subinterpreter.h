@@ -0,0 +1,48 @@
+// Subinterpreter callback mode. The stream owns a subinterpreter with its own
+// GIL (Python 3.12 and later), imports the stream's callback there, and runs
+// it on PortAudio's real-time thread under that GIL only, so that threads
+// holding the main interpreter's GIL cannot delay the callback.
+
+#ifndef STREAM_SUBINTERPRETER_H_
+#define STREAM_SUBINTERPRETER_H_
+
+#ifndef PY_SSIZE_T_CLEAN
+#define PY_SSIZE_T_CLEAN
+#endif
+#include "Python.h"
+#include "portaudio.h"
+
+#include "stream.h"
+
+// Creates the stream's subinterpreter, and sets the stream's callback (see
+// PyAudioStream_SetCallback) to the function that callback_spec, a str of the
+// form "module:function", names in the subinterpreter. The subinterpreter
+// imports the module using the calling interpreter's sys.path. Returns 0 on
+// success, or -1 with an exception set. Requires the GIL.
+int PyAudioSubinterpreter_Create(PyAudioStream *stream,
+                                 PyObject *callback_spec,
+                                 unsigned long max_frame_count);
+
+// Releases the stream's callback (see PyAudioStream_ClearCallback) in the
+// stream's subinterpreter, if any, and ends the subinterpreter. The PortAudio
+// stream must already be closed. Requires the GIL.
+void PyAudioSubinterpreter_Free(PyAudioStream *stream);
+
+// Converts error, an exception that the callback raised in the stream's
+// subinterpreter, into an exception of the same built-in type (or a
+// RuntimeError) in the calling interpreter, with the subinterpreter's
+// traceback as a note. Steals error. Returns a new reference, or NULL with an
+// exception set. Requires the GIL, and the stream must be in use (see
+// PyAudioStream_BeginUse).
+PyObject *PyAudioSubinterpreter_ExportError(PyAudioStream *stream,
+                                            PyObject *error);
+
+// PortAudio stream callback for streams with a subinterpreter. Runs the
+// callback (see PyAudioStream_InvokeCallback) with the subinterpreter's GIL
+// held, using a thread state that persists across periods.
+int PyAudioSubinterpreter_CallbackCFunc(
+    const void *input, void *output, unsigned long frame_count,
+    const PaStreamCallbackTimeInfo *time_info,
+    PaStreamCallbackFlags status_flags, void *user_data);
+
+#endif  // STREAM_SUBINTERPRETER_H_
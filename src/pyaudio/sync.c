@@ -0,0 +1,204 @@
+#include "sync.h"
+
+#include <stdlib.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#elif defined(__APPLE__)
+#include <dispatch/dispatch.h>
+#else
+#include <semaphore.h>
+#include <time.h>
+#endif
+
+#if !defined(_WIN32)
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__)
+#include <sys/eventfd.h>
+#endif
+
+struct PyAudioSemaphore {
+#if defined(_WIN32)
+  HANDLE handle;
+#elif defined(__APPLE__)
+  // macOS does not implement unnamed POSIX semaphores.
+  dispatch_semaphore_t handle;
+#else
+  sem_t handle;
+#endif
+};
+
+PyAudioSemaphore *PyAudioSemaphore_New(void) {
+  PyAudioSemaphore *sem = (PyAudioSemaphore *)malloc(sizeof(PyAudioSemaphore));
+  if (!sem) {
+    return NULL;
+  }
+
+#if defined(_WIN32)
+  sem->handle = CreateSemaphore(NULL, 0, LONG_MAX, NULL);
+  if (sem->handle == NULL) {
+    free(sem);
+    return NULL;
+  }
+#elif defined(__APPLE__)
+  sem->handle = dispatch_semaphore_create(0);
+  if (sem->handle == NULL) {
+    free(sem);
+    return NULL;
+  }
+#else
+  if (sem_init(&sem->handle, 0, 0) != 0) {
+    free(sem);
+    return NULL;
+  }
+#endif
+  return sem;
+}
+
+void PyAudioSemaphore_Free(PyAudioSemaphore *sem) {
+  if (!sem) {
+    return;
+  }
+
+#if defined(_WIN32)
+  CloseHandle(sem->handle);
+#elif defined(__APPLE__)
+  dispatch_release(sem->handle);
+#else
+  sem_destroy(&sem->handle);
+#endif
+  free(sem);
+}
+
+void PyAudioSemaphore_Post(PyAudioSemaphore *sem) {
+#if defined(_WIN32)
+  ReleaseSemaphore(sem->handle, 1, NULL);
+#elif defined(__APPLE__)
+  dispatch_semaphore_signal(sem->handle);
+#else
+  sem_post(&sem->handle);
+#endif
+}
+
+int PyAudioSemaphore_Wait(PyAudioSemaphore *sem, long timeout_ms) {
+#if defined(_WIN32)
+  return WaitForSingleObject(sem->handle, timeout_ms < 0 ? INFINITE
+                                                        : (DWORD)timeout_ms) ==
+         WAIT_OBJECT_0;
+#elif defined(__APPLE__)
+  return dispatch_semaphore_wait(
+             sem->handle,
+             timeout_ms < 0 ? DISPATCH_TIME_FOREVER
+                            : dispatch_time(DISPATCH_TIME_NOW,
+                                            (int64_t)timeout_ms *
+                                                NSEC_PER_MSEC)) == 0;
+#else
+  int rv;
+  if (timeout_ms < 0) {
+    while ((rv = sem_wait(&sem->handle)) != 0 && errno == EINTR) {
+    }
+    return rv == 0;
+  }
+
+  struct timespec deadline;
+  clock_gettime(CLOCK_REALTIME, &deadline);
+  deadline.tv_sec += timeout_ms / 1000;
+  deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+  if (deadline.tv_nsec >= 1000000000L) {
+    deadline.tv_sec++;
+    deadline.tv_nsec -= 1000000000L;
+  }
+
+  while ((rv = sem_timedwait(&sem->handle, &deadline)) != 0 && errno == EINTR) {
+  }
+  return rv == 0;
+#endif
+}
+
+struct PyAudioNotifier {
+  // The end to poll, and the end to signal (the same eventfd on Linux).
+  int read_fd;
+  int write_fd;
+};
+
+PyAudioNotifier *PyAudioNotifier_New(void) {
+#if defined(_WIN32)
+  return NULL;
+#else
+  PyAudioNotifier *notifier =
+      (PyAudioNotifier *)malloc(sizeof(PyAudioNotifier));
+  if (!notifier) {
+    errno = ENOMEM;
+    return NULL;
+  }
+
+#if defined(__linux__)
+  notifier->read_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (notifier->read_fd < 0) {
+    free(notifier);
+    return NULL;
+  }
+  notifier->write_fd = notifier->read_fd;
+#else
+  int fds[2];
+  if (pipe(fds) != 0) {
+    free(notifier);
+    return NULL;
+  }
+  for (int i = 0; i < 2; i++) {
+    fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+    fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+  }
+  notifier->read_fd = fds[0];
+  notifier->write_fd = fds[1];
+#endif
+  return notifier;
+#endif
+}
+
+void PyAudioNotifier_Free(PyAudioNotifier *notifier) {
+  if (!notifier) {
+    return;
+  }
+
+#if !defined(_WIN32)
+  close(notifier->read_fd);
+  if (notifier->write_fd != notifier->read_fd) {
+    close(notifier->write_fd);
+  }
+#endif
+  free(notifier);
+}
+
+int PyAudioNotifier_GetFd(PyAudioNotifier *notifier) {
+  return notifier->read_fd;
+}
+
+void PyAudioNotifier_Signal(PyAudioNotifier *notifier) {
+#if !defined(_WIN32)
+  // If the write fails because the descriptor is already full, it is
+  // already readable.
+#if defined(__linux__)
+  uint64_t value = 1;
+#else
+  char value = 1;
+#endif
+  ssize_t rv;
+  while ((rv = write(notifier->write_fd, &value, sizeof(value))) < 0 &&
+         errno == EINTR) {
+  }
+#endif
+}
+
+void PyAudioNotifier_Clear(PyAudioNotifier *notifier) {
+#if !defined(_WIN32)
+  char buffer[64];
+  // An eventfd resets with one read; a pipe may hold several signals.
+  while (read(notifier->read_fd, buffer, sizeof(buffer)) > 0) {
+  }
+#endif
+}
@@ -0,0 +1,91 @@
+// Portable synchronization primitives that are safe to use from PortAudio's
+// real-time callback thread, which must never block or take locks.
+
+#ifndef SYNC_H_
+#define SYNC_H_
+
+#include <stdint.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+// Atomic 64-bit integers. All operations are sequentially consistent.
+// PyAudioAtomic_CompareExchange sets *a to value if it equals expected, and
+// returns whether it did.
+typedef volatile int64_t PyAudioAtomic;
+
+#if defined(_MSC_VER)
+static __inline int64_t PyAudioAtomic_Load(PyAudioAtomic *a) {
+  return InterlockedOr64((volatile LONG64 *)a, 0);
+}
+static __inline void PyAudioAtomic_Store(PyAudioAtomic *a, int64_t value) {
+  InterlockedExchange64((volatile LONG64 *)a, value);
+}
+static __inline int64_t PyAudioAtomic_Add(PyAudioAtomic *a, int64_t value) {
+  return InterlockedExchangeAdd64((volatile LONG64 *)a, value) + value;
+}
+static __inline int64_t PyAudioAtomic_Exchange(PyAudioAtomic *a,
+                                               int64_t value) {
+  return InterlockedExchange64((volatile LONG64 *)a, value);
+}
+static __inline int PyAudioAtomic_CompareExchange(PyAudioAtomic *a,
+                                                  int64_t expected,
+                                                  int64_t value) {
+  return InterlockedCompareExchange64((volatile LONG64 *)a, value,
+                                      expected) == expected;
+}
+#else
+static inline int64_t PyAudioAtomic_Load(PyAudioAtomic *a) {
+  return __atomic_load_n(a, __ATOMIC_SEQ_CST);
+}
+static inline void PyAudioAtomic_Store(PyAudioAtomic *a, int64_t value) {
+  __atomic_store_n(a, value, __ATOMIC_SEQ_CST);
+}
+static inline int64_t PyAudioAtomic_Add(PyAudioAtomic *a, int64_t value) {
+  return __atomic_add_fetch(a, value, __ATOMIC_SEQ_CST);
+}
+static inline int64_t PyAudioAtomic_Exchange(PyAudioAtomic *a,
+                                             int64_t value) {
+  return __atomic_exchange_n(a, value, __ATOMIC_SEQ_CST);
+}
+static inline int PyAudioAtomic_CompareExchange(PyAudioAtomic *a,
+                                                int64_t expected,
+                                                int64_t value) {
+  return __atomic_compare_exchange_n(a, &expected, value, 0, __ATOMIC_SEQ_CST,
+                                     __ATOMIC_SEQ_CST);
+}
+#endif
+
+// Counting semaphore. PyAudioSemaphore_Post never blocks, so the real-time
+// thread may use it to wake up a waiting thread.
+typedef struct PyAudioSemaphore PyAudioSemaphore;
+
+// Returns a new semaphore with a count of 0, or NULL on failure.
+PyAudioSemaphore *PyAudioSemaphore_New(void);
+void PyAudioSemaphore_Free(PyAudioSemaphore *sem);
+void PyAudioSemaphore_Post(PyAudioSemaphore *sem);
+// Waits until the semaphore count is positive and decrements it, or until
+// timeout_ms elapses (or indefinitely, if timeout_ms is negative). Returns 1 if
+// the count was decremented, 0 on timeout.
+// Do not call while holding the GIL.
+int PyAudioSemaphore_Wait(PyAudioSemaphore *sem, long timeout_ms);
+
+// Readiness notification for event loops, through a file descriptor that
+// becomes readable once the notifier is signaled (an eventfd on Linux, or a
+// pipe on other POSIX platforms). PyAudioNotifier_Signal never blocks, so the
+// real-time thread may use it to wake up an event loop.
+typedef struct PyAudioNotifier PyAudioNotifier;
+
+// Returns a new, unsignaled notifier, or NULL with errno set on failure.
+// Always fails on Windows, whose default event loop cannot poll such a file
+// descriptor.
+PyAudioNotifier *PyAudioNotifier_New(void);
+void PyAudioNotifier_Free(PyAudioNotifier *notifier);
+// Returns the file descriptor to poll for readability.
+int PyAudioNotifier_GetFd(PyAudioNotifier *notifier);
+void PyAudioNotifier_Signal(PyAudioNotifier *notifier);
+// Makes the file descriptor unreadable again.
+void PyAudioNotifier_Clear(PyAudioNotifier *notifier);
+
+#endif  // SYNC_H_
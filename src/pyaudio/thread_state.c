@@ -0,0 +1,125 @@
+#include "thread_state.h"
+
+#ifndef PY_SSIZE_T_CLEAN
+#define PY_SSIZE_T_CLEAN
+#endif
+#include "Python.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+#if PY_VERSION_HEX >= 0x030D0000
+#define IS_FINALIZING() Py_IsFinalizing()
+#elif PY_VERSION_HEX >= 0x03070000
+#define IS_FINALIZING() _Py_IsFinalizing()
+#else
+#define IS_FINALIZING() (_Py_Finalizing != NULL)
+#endif
+
+// Thread-local slot for each thread's persistent thread state, with a
+// destructor that runs on the thread as it exits. A thread state may only be
+// safely deleted by its own thread: deleting it elsewhere leaves the thread's
+// PyGILState binding dangling (and, since Python 3.12, clears the deleting
+// thread's own binding instead).
+#ifdef _WIN32
+static DWORD tstate_key = FLS_OUT_OF_INDEXES;
+#else
+static pthread_key_t tstate_key;
+#endif
+static int tstate_key_ok = 0;
+
+#ifdef _WIN32
+static void WINAPI delete_tstate(void *value) {
+#else
+static void delete_tstate(void *value) {
+#endif
+  // During and after finalization, the interpreter frees all thread states
+  // itself, and other threads can no longer acquire the GIL.
+  if (value == NULL || !Py_IsInitialized() || IS_FINALIZING()) {
+    return;
+  }
+
+  // Python's own PyGILState binding for this thread may already be gone, so
+  // delete the thread state directly (as PyGILState_Release would).
+  PyThreadState *tstate = (PyThreadState *)value;
+  PyEval_RestoreThread(tstate);
+  PyThreadState_Clear(tstate);
+  PyThreadState_DeleteCurrent();
+}
+
+#ifdef _WIN32
+static INIT_ONCE tstate_key_once = INIT_ONCE_STATIC_INIT;
+
+static BOOL CALLBACK create_tstate_key(PINIT_ONCE once, PVOID param,
+                                       PVOID *context) {
+  tstate_key = FlsAlloc(delete_tstate);
+  tstate_key_ok = tstate_key != FLS_OUT_OF_INDEXES;
+  return TRUE;
+}
+#else
+static pthread_once_t tstate_key_once = PTHREAD_ONCE_INIT;
+
+static void create_tstate_key(void) {
+  tstate_key_ok = pthread_key_create(&tstate_key, delete_tstate) == 0;
+}
+#endif
+
+void PyAudioThreadState_Init(void) {
+#ifdef PYAUDIO_GILSTATE_ENSURE
+  // Builds for benchmarks/gil_overhead.py's baseline use the plain
+  // PyGILState_Ensure path.
+  return;
+#endif
+  // Interpreters with their own GIL may import the module concurrently.
+#ifdef _WIN32
+  InitOnceExecuteOnce(&tstate_key_once, create_tstate_key, NULL, NULL);
+#else
+  pthread_once(&tstate_key_once, create_tstate_key);
+#endif
+}
+
+static PyThreadState *get_tstate(void) {
+#ifdef _WIN32
+  return (PyThreadState *)FlsGetValue(tstate_key);
+#else
+  return (PyThreadState *)pthread_getspecific(tstate_key);
+#endif
+}
+
+static int set_tstate(PyThreadState *tstate) {
+#ifdef _WIN32
+  return FlsSetValue(tstate_key, tstate) ? 0 : -1;
+#else
+  return pthread_setspecific(tstate_key, tstate) == 0 ? 0 : -1;
+#endif
+}
+
+void PyAudioGIL_Acquire(PyAudioGILState *state) {
+  state->tstate = tstate_key_ok ? get_tstate() : NULL;
+  if (state->tstate != NULL) {
+    PyEval_RestoreThread(state->tstate);
+    return;
+  }
+
+  // Threads that Python already knows about (e.g., Python threads, or
+  // threads with a persistent thread state of their own) keep using it.
+  int is_new_thread = tstate_key_ok && PyGILState_GetThisThreadState() == NULL;
+  state->gilstate = PyGILState_Ensure();
+  if (is_new_thread && set_tstate(PyThreadState_Get()) == 0) {
+    // Keep the PyGILState reference from PyGILState_Ensure, so that the new
+    // thread state outlives this call. (Nested PyGILState_Ensure calls, e.g.,
+    // from extension modules used by the callback, also find and reuse it.)
+    state->tstate = PyThreadState_Get();
+  }
+}
+
+void PyAudioGIL_Release(PyAudioGILState *state) {
+  if (state->tstate != NULL) {
+    PyEval_SaveThread();
+  } else {
+    PyGILState_Release(state->gilstate);
+  }
+}
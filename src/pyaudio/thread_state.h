@@ -0,0 +1,34 @@
+// Python thread states for threads that PortAudio creates, such as the one
+// that runs stream callbacks.
+//
+// PyGILState_Ensure creates a new thread state each time a thread that Python
+// does not know about acquires the GIL, and PyGILState_Release destroys it
+// again. Instead, PyAudioGIL_Acquire gives each such thread one thread state
+// on first use, and keeps it until the thread exits.
+
+#ifndef THREAD_STATE_H_
+#define THREAD_STATE_H_
+
+#ifndef PY_SSIZE_T_CLEAN
+#define PY_SSIZE_T_CLEAN
+#endif
+#include "Python.h"
+
+typedef struct {
+  // The calling thread's persistent thread state, or NULL if gilstate is in
+  // use instead.
+  PyThreadState *tstate;
+  PyGILState_STATE gilstate;
+} PyAudioGILState;
+
+// Sets up thread-exit cleanup; call from module initialization. If this fails,
+// or the module is built with PYAUDIO_GILSTATE_ENSURE defined,
+// PyAudioGIL_Acquire falls back to PyGILState_Ensure.
+void PyAudioThreadState_Init(void);
+
+// Acquires the GIL for the calling thread, which must not hold it.
+void PyAudioGIL_Acquire(PyAudioGILState *state);
+// Releases the GIL acquired by PyAudioGIL_Acquire.
+void PyAudioGIL_Release(PyAudioGILState *state);
+
+#endif  // THREAD_STATE_H_
@@ -0,0 +1,193 @@
+#include "time_info.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#ifndef PY_SSIZE_T_CLEAN
+#define PY_SSIZE_T_CLEAN
+#endif
+#include "Python.h"
+#include "portaudio.h"
+#include "structmember.h"
+
+#include "module_state.h"
+
+static const char *const keys[] = {"input_buffer_adc_time", "current_time",
+                                   "output_buffer_dac_time"};
+#define NUM_KEYS (sizeof(keys) / sizeof(keys[0]))
+
+static double value_at(PyAudioTimeInfo *self, size_t index) {
+  switch (index) {
+    case 0:
+      return self->input_buffer_adc_time;
+    case 1:
+      return self->current_time;
+    default:
+      return self->output_buffer_dac_time;
+  }
+}
+
+// Returns the index of key in keys, or -1 if key is not a valid key.
+static Py_ssize_t key_index(PyObject *key) {
+  if (!PyUnicode_Check(key)) {
+    return -1;
+  }
+  for (size_t i = 0; i < NUM_KEYS; i++) {
+    if (PyUnicode_CompareWithASCIIString(key, keys[i]) == 0) {
+      return (Py_ssize_t)i;
+    }
+  }
+  return -1;
+}
+
+// Mapping protocol, for compatibility with the dictionary interface:
+
+static Py_ssize_t length(PyAudioTimeInfo *self) { return NUM_KEYS; }
+
+static PyObject *subscript(PyAudioTimeInfo *self, PyObject *key) {
+  Py_ssize_t index = key_index(key);
+  if (index < 0) {
+    PyErr_SetObject(PyExc_KeyError, key);
+    return NULL;
+  }
+  return PyFloat_FromDouble(value_at(self, index));
+}
+
+static int contains(PyAudioTimeInfo *self, PyObject *key) {
+  return key_index(key) >= 0;
+}
+
+static PyObject *get_keys(PyAudioTimeInfo *self, PyObject *args) {
+  PyObject *rv = PyList_New(NUM_KEYS);
+  for (size_t i = 0; rv && i < NUM_KEYS; i++) {
+    PyObject *key = PyUnicode_FromString(keys[i]);
+    if (!key) {
+      Py_CLEAR(rv);
+      break;
+    }
+    PyList_SET_ITEM(rv, i, key);
+  }
+  return rv;
+}
+
+static PyObject *iter(PyAudioTimeInfo *self) {
+  PyObject *key_list = get_keys(self, NULL);
+  if (!key_list) {
+    return NULL;
+  }
+  PyObject *it = PyObject_GetIter(key_list);
+  Py_DECREF(key_list);
+  return it;
+}
+
+static PyObject *get_values(PyAudioTimeInfo *self, PyObject *args) {
+  return Py_BuildValue("[d,d,d]", self->input_buffer_adc_time,
+                       self->current_time, self->output_buffer_dac_time);
+}
+
+static PyObject *get_items(PyAudioTimeInfo *self, PyObject *args) {
+  return Py_BuildValue("[(s,d),(s,d),(s,d)]", keys[0],
+                       self->input_buffer_adc_time, keys[1],
+                       self->current_time, keys[2],
+                       self->output_buffer_dac_time);
+}
+
+static PyObject *get(PyAudioTimeInfo *self, PyObject *args) {
+  PyObject *key;
+  PyObject *default_value = Py_None;
+  if (!PyArg_ParseTuple(args, "O|O", &key, &default_value)) {
+    return NULL;
+  }
+
+  Py_ssize_t index = key_index(key);
+  if (index < 0) {
+    Py_INCREF(default_value);
+    return default_value;
+  }
+  return PyFloat_FromDouble(value_at(self, index));
+}
+
+static PyObject *repr(PyAudioTimeInfo *self) {
+  PyObject *items = get_items(self, NULL);
+  if (!items) {
+    return NULL;
+  }
+  PyObject *as_dict = PyDict_New();
+  if (as_dict && PyDict_MergeFromSeq2(as_dict, items, 1) < 0) {
+    Py_CLEAR(as_dict);
+  }
+  Py_DECREF(items);
+  if (!as_dict) {
+    return NULL;
+  }
+  PyObject *rv = PyUnicode_FromFormat("TimeInfo(%R)", as_dict);
+  Py_DECREF(as_dict);
+  return rv;
+}
+
+static void dealloc(PyAudioTimeInfo *self) {
+  PyTypeObject *type = Py_TYPE(self);
+  type->tp_free((PyObject *)self);
+  PYAUDIO_DECREF_HEAP_TYPE(type);
+}
+
+static PyMethodDef methods[] = {
+    {"keys", (PyCFunction)get_keys, METH_NOARGS, "List of field names"},
+    {"values", (PyCFunction)get_values, METH_NOARGS, "List of field values"},
+    {"items", (PyCFunction)get_items, METH_NOARGS,
+     "List of (name, value) pairs"},
+    {"get", (PyCFunction)get, METH_VARARGS,
+     "Value for a field name, or a default if the name is unknown"},
+    {NULL, NULL, 0, NULL}};
+
+static PyMemberDef members[] = {
+    {"input_buffer_adc_time", T_DOUBLE,
+     offsetof(PyAudioTimeInfo, input_buffer_adc_time), READONLY,
+     "ADC capture time of the first sample in the input buffer"},
+    {"current_time", T_DOUBLE, offsetof(PyAudioTimeInfo, current_time),
+     READONLY, "Time when the stream callback was invoked"},
+    {"output_buffer_dac_time", T_DOUBLE,
+     offsetof(PyAudioTimeInfo, output_buffer_dac_time), READONLY,
+     "DAC output time of the first sample in the output buffer"},
+    {NULL}};
+
+static PyType_Slot slots[] = {
+    {Py_tp_dealloc, dealloc},
+    {Py_tp_repr, repr},
+    {Py_sq_contains, contains},
+    {Py_mp_length, length},
+    {Py_mp_subscript, subscript},
+    {Py_tp_doc, (void *)PyDoc_STR("PortAudio PaStreamCallbackTimeInfo")},
+    {Py_tp_iter, iter},
+    {Py_tp_methods, methods},
+    {Py_tp_members, members},
+    {0, NULL}};
+
+PyType_Spec PyAudioTimeInfoTypeSpec = {
+    .name = "_portaudio.TimeInfo",
+    .basicsize = sizeof(PyAudioTimeInfo),
+    .itemsize = 0,
+    .flags = PYAUDIO_TPFLAGS_DEFAULT,
+    .slots = slots,
+};
+
+PyObject *PyAudioTimeInfo_Update(PyTypeObject *type, PyObject **cached,
+                                 const PaStreamCallbackTimeInfo *time_info) {
+  PyAudioTimeInfo *info = (PyAudioTimeInfo *)*cached;
+  // If the callback kept a reference to the previous time_info, leave that
+  // object untouched: it must not change under the callback's feet.
+  if (info == NULL || Py_REFCNT(info) != 1) {
+    info = PyObject_New(PyAudioTimeInfo, type);
+    if (!info) {
+      return NULL;
+    }
+    Py_XDECREF(*cached);
+    *cached = (PyObject *)info;
+  }
+
+  info->input_buffer_adc_time = time_info->inputBufferAdcTime;
+  info->current_time = time_info->currentTime;
+  info->output_buffer_dac_time = time_info->outputBufferDacTime;
+  Py_INCREF(info);
+  return (PyObject *)info;
+}
@@ -0,0 +1,36 @@
+// Python wrapper for PortAudio's PaStreamCallbackTimeInfo, passed to stream
+// callbacks as the time_info argument.
+
+#ifndef TIME_INFO_H_
+#define TIME_INFO_H_
+
+#ifndef PY_SSIZE_T_CLEAN
+#define PY_SSIZE_T_CLEAN
+#endif
+#include "Python.h"
+#include "portaudio.h"
+
+// Read-only to Python. Supports both attribute access
+// (time_info.current_time) and, for compatibility with the dictionary that
+// callbacks used to receive, mapping access (time_info['current_time']).
+typedef struct {
+  // clang-format off
+  PyObject_HEAD
+  // clang-format on
+  double input_buffer_adc_time;
+  double current_time;
+  double output_buffer_dac_time;
+} PyAudioTimeInfo;
+
+// See module_state.h for the type object.
+extern PyType_Spec PyAudioTimeInfoTypeSpec;
+
+// Returns a PyAudioTimeInfo (of the given type) holding the values in
+// time_info. Reuses *cached
+// (updating it in place) when the stream holds the only reference to it, so
+// that steady-state callbacks allocate nothing; otherwise replaces *cached
+// with a new object. Returns a new reference, or NULL on failure.
+PyObject *PyAudioTimeInfo_Update(PyTypeObject *type, PyObject **cached,
+                                 const PaStreamCallbackTimeInfo *time_info);
+
+#endif  // TIME_INFO_H_
@@ -1,5 +1,8 @@
 """PyAudio misc tests."""
 
+import array
+import math
+import struct
 import unittest
 
 import pyaudio
@@ -48,6 +51,140 @@ class MiscTests(unittest.TestCase):
 
         p.terminate()
 
+    def test_convert_format(self):
+        formats = [pyaudio.paFloat32, pyaudio.paInt32, pyaudio.paInt24,
+                   pyaudio.paInt16, pyaudio.paInt8, pyaudio.paUInt8]
+        # Long enough for the SIMD kernels, with a tail for the scalar ones.
+        samples = array.array('h', [0, 1, -1, 256, -256, 32767, -32768, 12345]
+                              * 5)
+        floats = pyaudio.convert_format(samples, pyaudio.paInt16,
+                                        pyaudio.paFloat32)
+        self.assertEqual(array.array('f', floats).tolist(),
+                         [s / 32768 for s in samples])
+
+        # Through any format at least as wide, and back, is exact.
+        for fmt in formats[:4]:
+            converted = pyaudio.convert_format(samples, pyaudio.paInt16, fmt)
+            self.assertEqual(len(converted),
+                             len(samples) * pyaudio.get_sample_size(fmt))
+            self.assertEqual(
+                pyaudio.convert_format(converted, fmt, pyaudio.paInt16),
+                samples.tobytes())
+
+        # Narrower formats round to the nearest sample.
+        self.assertEqual(
+            pyaudio.convert_format(array.array('h', [383, 385, -32768]),
+                                   pyaudio.paInt16, pyaudio.paInt8),
+            struct.pack('3b', 1, 2, -128))
+        self.assertEqual(
+            pyaudio.convert_format(struct.pack('3b', -128, 0, 127),
+                                   pyaudio.paInt8, pyaudio.paUInt8),
+            bytes([0, 128, 255]))
+
+        # Floats clip to the range of the format.
+        floats = array.array('f', [2.0, -2.0, 0.5, -0.5] * 5)
+        self.assertEqual(
+            array.array('h', pyaudio.convert_format(
+                floats, pyaudio.paFloat32, pyaudio.paInt16)).tolist(),
+            [32767, -32768, 16384, -16384] * 5)
+        self.assertEqual(
+            array.array('i', pyaudio.convert_format(
+                floats, pyaudio.paFloat32, pyaudio.paInt32)).tolist(),
+            [2147483520, -2147483648, 1073741824, -1073741824] * 5)
+
+        with self.assertRaises(ValueError):
+            pyaudio.convert_format(b'\0' * 3, pyaudio.paInt16,
+                                   pyaudio.paFloat32)
+        with self.assertRaises(ValueError):
+            pyaudio.convert_format(b'', pyaudio.paCustomFormat,
+                                   pyaudio.paFloat32)
+
+    def test_resample(self):
+        # A 1 kHz sine in the left channel, and DC in the right.
+        from_rate = 48000
+        frames = [(math.sin(2 * math.pi * 1000 * i / from_rate), 0.5)
+                  for i in range(4800)]
+        samples = array.array('f', [s for frame in frames for s in frame])
+
+        for to_rate in [16000, 44100, 96000]:
+            for quality in ['low', 'medium', 'high']:
+                resampled = array.array('f', pyaudio.resample(
+                    samples, pyaudio.paFloat32, 2, from_rate, to_rate,
+                    quality))
+                # The output spans as long as the input, and lines up with
+                # it.
+                self.assertEqual(len(resampled), 2 * 4800 * to_rate // 48000)
+                tolerance = 1e-2 if quality == 'low' else 1e-3
+                # Away from the edges, where the filter sees silence.
+                for k in range(100, len(resampled) // 2 - 100):
+                    self.assertAlmostEqual(
+                        resampled[2 * k],
+                        math.sin(2 * math.pi * 1000 * k / to_rate),
+                        delta=tolerance)
+                    self.assertAlmostEqual(resampled[2 * k + 1], 0.5,
+                                           delta=tolerance)
+
+        # Integer formats round trip through the same filter.
+        ints = pyaudio.convert_format(samples, pyaudio.paFloat32,
+                                      pyaudio.paInt16)
+        self.assertEqual(
+            len(pyaudio.resample(ints, pyaudio.paInt16, 2, 48000, 16000)),
+            2 * 2 * 1600)
+
+        # Equal rates pass the signal through.
+        resampled = array.array('f', pyaudio.resample(
+            samples, pyaudio.paFloat32, 2, 48000, 48000))
+        for a, b in zip(resampled, samples):
+            self.assertAlmostEqual(a, b, delta=1e-6)
+
+        self.assertEqual(pyaudio.resample(b'', pyaudio.paInt16, 1, 48000,
+                                          16000), b'')
+        with self.assertRaises(ValueError):
+            pyaudio.resample(b'\0' * 3, pyaudio.paInt16, 1, 48000, 16000)
+        with self.assertRaises(ValueError):
+            pyaudio.resample(b'', pyaudio.paInt16, 1, 48000, 16000, 'best')
+        with self.assertRaises(ValueError):
+            pyaudio.resample(b'', pyaudio.paCustomFormat, 1, 48000, 16000)
+
+    def test_mix_channels(self):
+        # Four channels, each frame counting up from a different base.
+        frames = [[100 * c + i for c in range(4)] for i in range(300)]
+        samples = array.array('h', [s for frame in frames for s in frame])
+
+        # Selections copy samples, in any order, silencing nothing.
+        for fmt, typecode in [(pyaudio.paInt16, 'h'),
+                              (pyaudio.paInt32, 'i'),
+                              (pyaudio.paFloat32, 'f')]:
+            data = pyaudio.convert_format(samples, pyaudio.paInt16, fmt)
+            selected = array.array(typecode, pyaudio.mix_channels(
+                data, fmt, 4, [3, 0]))
+            expected = array.array(typecode, pyaudio.convert_format(
+                array.array('h', [s for frame in frames
+                                  for s in (frame[3], frame[0])]),
+                pyaudio.paInt16, fmt))
+            self.assertEqual(selected, expected)
+
+        # Matrices mix, with silence for rows of zeros.
+        mixed = array.array('h', pyaudio.mix_channels(
+            samples, pyaudio.paInt16, 4,
+            [[0.5, 0.5, 0, 0], [0, 0, 0, 0], [0, -1, 0, 2]]))
+        self.assertEqual(mixed.tolist(),
+                         [s for frame in frames
+                          for s in ((frame[0] + frame[1]) / 2, 0,
+                                    2 * frame[3] - frame[1])])
+
+        # Unsigned samples stay silent at their midpoint.
+        silent = pyaudio.mix_channels(bytes([1, 2, 3]), pyaudio.paUInt8, 3,
+                                      [[0, 0, 0], [0, 1, 0]])
+        self.assertEqual(silent, bytes([128, 2]))
+
+        with self.assertRaises(ValueError):
+            pyaudio.mix_channels(samples, pyaudio.paInt16, 4, [4])
+        with self.assertRaises(ValueError):
+            pyaudio.mix_channels(samples, pyaudio.paInt16, 4, [[1, 0, 0]])
+        with self.assertRaises(ValueError):
+            pyaudio.mix_channels(samples[:3], pyaudio.paInt16, 4, [0])
+
     def test_get_portaudio_version(self):
         self.assertGreater(pyaudio.get_portaudio_version(), 0)
 
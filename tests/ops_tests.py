@@ -0,0 +1,117 @@
+"""PyAudio sample operation (pyaudio.ops) tests."""
+
+import array
+import random
+import unittest
+import warnings
+
+from pyaudio import ops
+
+try:
+    with warnings.catch_warnings():
+        warnings.simplefilter('ignore', DeprecationWarning)
+        import audioop
+except ImportError:
+    audioop = None
+
+
+def _fragment(width, num_samples, seed):
+    """Returns random samples, with the extremes of the width mixed in."""
+    rng = random.Random(seed)
+    top = (1 << (8 * width - 1)) - 1
+    values = [rng.choice([top, -top - 1, 0, -1, rng.randint(-top - 1, top)])
+              for _ in range(num_samples)]
+    return b''.join(v.to_bytes(width, 'little', signed=True) for v in values)
+
+
+class OpsTests(unittest.TestCase):
+
+    def test_add_mul(self):
+        a = array.array('h', [1000, -32768, 32767, 20000])
+        b = array.array('h', [-1, -1, 1, 20000])
+        self.assertEqual(array.array('h', ops.add(a, b, 2)).tolist(),
+                         [999, -32768, 32767, 32767])
+        self.assertEqual(array.array('h', ops.mul(a, 2, -1.5)).tolist(),
+                         [-1500, 32767, -32768, -30000])
+
+        # In place.
+        ops.mul(a, 2, 0.5, out=a)
+        self.assertEqual(a.tolist(), [500, -16384, 16383, 10000])
+
+        with self.assertRaises(ops.error):
+            ops.add(a, b[:3], 2)
+        with self.assertRaises(ops.error):
+            ops.mul(b'\0\0\0', 2, 1.0)
+        with self.assertRaises(ops.error):
+            ops.mul(a, 5, 1.0)
+        with self.assertRaises(ops.error):
+            ops.mul(a, 2, 1.0, out=bytearray(4))
+
+    def test_rms_max(self):
+        samples = array.array('h', [3, -4] * 10 + [-32768])
+        self.assertEqual(ops.max(samples, 2), 32768)
+        self.assertEqual(ops.rms(samples[:20], 2), 3)
+        self.assertEqual(ops.rms(b'', 2), 0)
+        self.assertEqual(ops.max(b'', 4), 0)
+
+    def test_channels_and_widths(self):
+        stereo = array.array('h', [100, 300, -100, -301])
+        mono = ops.tomono(stereo, 2, 0.5, 0.5)
+        self.assertEqual(array.array('h', mono).tolist(), [200, -201])
+        out = bytearray(2 * len(mono))
+        self.assertIs(ops.tostereo(mono, 2, 1.0, -1.0, out=out), out)
+        self.assertEqual(array.array('h', out).tolist(),
+                         [200, -200, -201, 201])
+
+        self.assertEqual(ops.lin2lin(b'\x01\x80', 1, 2), b'\0\x01\0\x80')
+        self.assertEqual(ops.lin2lin(b'\x34\x12\xff\x7f', 2, 1), b'\x12\x7f')
+        self.assertEqual(ops.lin2ulaw(array.array('h', [0, -1, 32767]), 2),
+                         b'\xff\x7e\x80')
+
+    def test_ratecv(self):
+        ramp = array.array('h', range(0, 8000, 100))
+        up, state = ops.ratecv(ramp, 2, 1, 8000, 16000, None)
+        # Output frames interpolate halfway between input frames, up to the
+        # last input frame, which waits for the next fragment.
+        self.assertEqual(array.array('h', up).tolist(),
+                         list(range(0, 7901, 50)))
+
+        # Fragments continue from the state.
+        head, state = ops.ratecv(ramp[:40], 2, 1, 8000, 16000, None)
+        tail, _ = ops.ratecv(ramp[40:], 2, 1, 8000, 16000, state)
+        self.assertEqual(head + tail, up)
+
+        with self.assertRaises(ops.error):
+            ops.ratecv(ramp, 2, 1, 0, 16000, None)
+        with self.assertRaises(ops.error):
+            ops.ratecv(ramp, 2, 1, 8000, 16000, (0, ((0, 0),)))
+
+    @unittest.skipIf(audioop is None, 'audioop required.')
+    def test_matches_audioop(self):
+        for width in (1, 2, 3, 4):
+            for num_samples in (0, 1, 9, 1000):
+                a = _fragment(width, 2 * num_samples, width)
+                b = _fragment(width, 2 * num_samples, width + 4)
+                for name, args in [('add', (a, b, width)),
+                                   ('mul', (a, width, 0.7)),
+                                   ('mul', (a, width, -2.25)),
+                                   ('rms', (a, width)),
+                                   ('max', (a, width)),
+                                   ('lin2lin', (a, width, 1)),
+                                   ('lin2lin', (a, width, 3)),
+                                   ('lin2lin', (a, width, 4)),
+                                   ('tomono', (a, width, 0.6, 0.7)),
+                                   ('tostereo', (a, width, 1.5, -0.5)),
+                                   ('lin2ulaw', (a, width)),
+                                   ('ratecv', (a, width, 2, 44100, 48000,
+                                               None)),
+                                   ('ratecv', (a, width, 1, 48000, 16000,
+                                               None, 3, 1))]:
+                    with self.subTest(name=name, width=width,
+                                      num_samples=num_samples):
+                        self.assertEqual(getattr(ops, name)(*args),
+                                         getattr(audioop, name)(*args))
+
+        every_sample = array.array('h', range(-32768, 32768))
+        self.assertEqual(ops.lin2ulaw(every_sample, 2),
+                         audioop.lin2ulaw(every_sample, 2))
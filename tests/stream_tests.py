@@ -1,8 +1,14 @@
 """Stream tests."""
 
+import array
+import asyncio
 import os
+import sys
+import tempfile
+import textwrap
 import time
 import threading
+import tracemalloc
 import unittest
 
 import pyaudio
@@ -189,6 +195,38 @@ class StreamTests(unittest.TestCase):
 
         out_stream.close()
 
+    @unittest.skipIf(SKIP_HW_TESTS, 'Hardware device required.')
+    def test_output_blocking_buffer_protocol(self):
+        """Ensure write accepts any contiguous buffer without copying."""
+        channels = 2
+        frame_size = 2 * channels
+        out_stream = self.p.open(
+            format=pyaudio.paInt16,
+            channels=channels,
+            rate=44100,
+            output=True)
+
+        pcm = memoryview(bytearray(4096 * frame_size))
+        for offset in range(0, len(pcm), 1024 * frame_size):
+            out_stream.write(pcm[offset:offset + 1024 * frame_size])
+        out_stream.write(array.array('h', [0] * 256 * channels))
+        out_stream.write(bytearray(100 * frame_size), num_frames=50)
+        # Partial frames are ignored.
+        out_stream.write(b'\0' * (frame_size + 1))
+
+        with self.assertRaises(ValueError):
+            out_stream.write(pcm[:frame_size], num_frames=2)
+        with self.assertRaises(ValueError):
+            out_stream.write(pcm[::2])
+        with self.assertRaises(ValueError):
+            out_stream.write(array.array('i', [0] * 10))
+        # write releases the buffer once PortAudio is done with it.
+        samples = bytearray(frame_size)
+        out_stream.write(samples)
+        samples.extend(b'\0')
+
+        out_stream.close()
+
     @unittest.skipIf(SKIP_HW_TESTS, 'Hardware device required.')
     def test_input_blocking(self):
         width = 2
@@ -205,6 +243,703 @@ class StreamTests(unittest.TestCase):
         in_stream.close()
         self.assertEqual(len(samples), 512 * width * self.input_channels)
 
+    @unittest.skipIf(SKIP_HW_TESTS, 'Hardware device required.')
+    def test_input_blocking_read_into(self):
+        """Ensure read_into reads into caller-supplied buffers."""
+        width = 2
+        frame_size = width * self.input_channels
+        in_stream = self.p.open(
+            format=self.p.get_format_from_width(width),
+            channels=self.input_channels,
+            rate=44100,
+            input=True)
+
+        # By default, reads as many frames as fit, ignoring partial frames.
+        buffer = bytearray(512 * frame_size + 1)
+        self.assertEqual(in_stream.read_into(buffer), 512)
+        # Into part of a buffer.
+        view = memoryview(buffer)
+        self.assertEqual(
+            in_stream.read_into(view[frame_size:], num_frames=100), 100)
+        # Into typed buffers.
+        samples = array.array('h', [0] * 256 * self.input_channels)
+        self.assertEqual(in_stream.read_into(samples), 256)
+
+        with self.assertRaises(ValueError):
+            in_stream.read_into(buffer, num_frames=513)
+        with self.assertRaises(ValueError):
+            in_stream.read_into(buffer, num_frames=-1)
+        with self.assertRaises(TypeError):
+            in_stream.read_into(bytes(buffer))
+        with self.assertRaises(TypeError):
+            in_stream.read_into(view[::2])
+
+        # A steady-state read loop allocates no sample buffers.
+        tracemalloc.start()
+        try:
+            for _ in range(100):
+                in_stream.read_into(buffer)
+            _, peak = tracemalloc.get_traced_memory()
+        finally:
+            tracemalloc.stop()
+        self.assertLess(peak, len(buffer))
+
+        in_stream.close()
+        with self.assertRaises(IOError):
+            in_stream.read_into(buffer)
+
+    @unittest.skipIf(SKIP_HW_TESTS, 'Hardware device required.')
+    def test_nowait_read_write(self):
+        """Ensure read_nowait and write_nowait transfer what is available."""
+        width = 2
+        in_stream = self.p.open(
+            format=self.p.get_format_from_width(width),
+            channels=self.input_channels,
+            rate=44100,
+            input=True)
+        in_frame_size = width * self.input_channels
+        out_stream = self.p.open(
+            format=self.p.get_format_from_width(width),
+            channels=2,
+            rate=44100,
+            output=True)
+        out_frame_size = width * 2
+
+        for max_frames in [0, 1, 100]:
+            samples = in_stream.read_nowait(max_frames)
+            self.assertEqual(len(samples) % in_frame_size, 0)
+            self.assertLessEqual(len(samples), max_frames * in_frame_size)
+
+            written = out_stream.write_nowait(
+                bytes(max_frames * out_frame_size + 1))
+            self.assertGreaterEqual(written, 0)
+            self.assertLessEqual(written, max_frames)
+
+        # Larger requests are limited to what is available.
+        samples = in_stream.read_nowait(100000)
+        self.assertLess(len(samples), 100000 * in_frame_size)
+        self.assertLess(out_stream.write_nowait(bytes(100000 * out_frame_size)),
+                        100000)
+
+        with self.assertRaises(IOError):
+            in_stream.write_nowait(b'\0' * 4)
+        with self.assertRaises(IOError):
+            out_stream.read_nowait(1)
+        with self.assertRaises(ValueError):
+            in_stream.read_nowait(-1)
+
+        in_stream.close()
+        out_stream.close()
+        with self.assertRaises(IOError):
+            in_stream.read_nowait(1)
+
+    @unittest.skipIf(SKIP_HW_TESTS, 'Hardware device required.')
+    def test_output_writev(self):
+        """Ensure writev plays a sequence of buffers, and reports progress."""
+        width = 2
+        rate = 44100
+        frame_size = width * 2
+        stream = self.p.open(
+            format=self.p.get_format_from_width(width),
+            channels=2,
+            rate=rate,
+            output=True,
+            frames_per_buffer=256,
+            playback_queue_seconds=0.5)
+
+        chunks = [bytes(100 * frame_size), bytearray(200 * frame_size),
+                  memoryview(bytes(300 * frame_size)),
+                  array.array('h', bytes(400 * frame_size))]
+        self.assertEqual(stream.writev(chunks), 1000)
+        self.assertEqual(stream.writev(iter(chunks)), 1000)
+        self.assertEqual(stream.writev([]), 0)
+
+        # Nothing is written if any buffer holds a partial frame.
+        queued = stream.get_queued_frames()
+        with self.assertRaises(ValueError):
+            stream.writev([bytes(frame_size), bytes(frame_size + 1)])
+        self.assertLessEqual(stream.get_queued_frames(), queued)
+
+        # Let the queue run dry: the next write reports the underflow, after
+        # writing its buffer, and the stream stays open for the rest.
+        stream.drain()
+        time.sleep(0.1)
+        with self.assertRaises(IOError) as context:
+            stream.writev(chunks, exception_on_underflow=True)
+        self.assertEqual(context.exception.errno, pyaudio.paOutputUnderflowed)
+        self.assertEqual(context.exception.frames_written, 100)
+        self.assertEqual(stream.writev(chunks[1:]), 900)
+        stream.drain()
+        stream.close()
+
+    @unittest.skipIf(SKIP_HW_TESTS, 'Hardware device required.')
+    def test_full_duplex_process(self):
+        """Ensure process writes and reads a block in one call."""
+        width = 2
+        channels = self.input_channels
+        frame_size = width * channels
+        stream = self.p.open(
+            format=self.p.get_format_from_width(width),
+            channels=channels,
+            rate=44100,
+            input=True,
+            output=True)
+
+        # The same buffer carries each block out and the next one in.
+        block = bytearray(256 * frame_size)
+        for read_first in [False, True]:
+            self.assertEqual(stream.process(block, block,
+                                            read_first=read_first), 256)
+        in_buffer = bytearray(256 * frame_size)
+        self.assertEqual(stream.process(bytes(block), in_buffer,
+                                        num_frames=100), 100)
+
+        with self.assertRaises(ValueError):
+            stream.process(block, bytearray(10 * frame_size))
+        with self.assertRaises(ValueError):
+            stream.process(block, in_buffer, num_frames=257)
+        stream.close()
+
+        out_stream = self.p.open(
+            format=self.p.get_format_from_width(width),
+            channels=channels,
+            rate=44100,
+            output=True)
+        with self.assertRaises(IOError):
+            out_stream.process(block, block)
+        out_stream.close()
+
+    @unittest.skipIf(SKIP_HW_TESTS, 'Hardware device required.')
+    def test_device_format_conversion(self):
+        """Ensure streams convert between format and device_format."""
+        channels = self.input_channels
+        num_frames = 5000
+        stream = self.p.open(
+            format=pyaudio.paFloat32,
+            device_format=pyaudio.paInt16,
+            channels=channels,
+            rate=44100,
+            input=True,
+            output=True,
+            frames_per_buffer=256)
+        self.assertEqual(stream.get_device_format(), pyaudio.paInt16)
+
+        # Float samples that came from 16-bit ones.
+        samples = array.array('f', stream.read(num_frames))
+        self.assertEqual(len(samples), num_frames * channels)
+        for sample in samples:
+            self.assertTrue(-1.0 <= sample < 1.0)
+            self.assertEqual(sample * 32768, int(sample * 32768))
+        stream.write(samples)
+        stream.close()
+
+        # Callbacks see the stream's format, whatever the device's.
+        periods = []
+
+        def callback(in_data, frame_count, time_info, status):
+            periods.append((len(in_data), frame_count))
+            out_data = array.array('f', [0.25]) * (frame_count * channels)
+            return (out_data.tobytes(), pyaudio.paContinue)
+
+        stream = self.p.open(
+            format=pyaudio.paFloat32,
+            device_format=pyaudio.paInt24,
+            channels=channels,
+            rate=44100,
+            input=True,
+            output=True,
+            frames_per_buffer=256,
+            stream_callback=callback)
+        time.sleep(0.2)
+        stream.close()
+        self.assertGreater(len(periods), 0)
+        for in_len, frame_count in periods:
+            self.assertEqual(in_len, frame_count * channels * 4)
+
+        # Auto keeps the format when the device supports it.
+        stream = self.p.open(
+            format=pyaudio.paInt16,
+            device_format='auto',
+            channels=channels,
+            rate=44100,
+            input=True)
+        self.assertEqual(stream.get_device_format(), pyaudio.paInt16)
+        stream.close()
+
+        with self.assertRaises(ValueError):
+            self.p.open(format=pyaudio.paCustomFormat,
+                        device_format=pyaudio.paInt16,
+                        channels=channels,
+                        rate=44100,
+                        input=True)
+
+    @unittest.skipIf(SKIP_HW_TESTS, 'Hardware device required.')
+    def test_non_interleaved(self):
+        """Ensure planar streams transfer one plane per channel."""
+        width = 2
+        channels = self.input_channels
+        num_frames = 1000
+        plane_size = num_frames * width
+        stream = self.p.open(
+            format=pyaudio.paInt16,
+            non_interleaved=True,
+            channels=channels,
+            rate=44100,
+            input=True,
+            frames_per_buffer=256)
+        self.assertEqual(len(stream.read(num_frames)), plane_size * channels)
+
+        # Partial reads fill the first frames of each plane, and leave the
+        # rest alone.
+        buffer = bytearray(b'\x7f' * plane_size * channels)
+        self.assertEqual(stream.read_into(buffer, num_frames=100), 100)
+        for c in range(channels):
+            rest = buffer[c * plane_size + 100 * width:(c + 1) * plane_size]
+            self.assertEqual(rest, b'\x7f' * len(rest))
+        stream.close()
+
+        # Setting paNonInterleaved in the format works the same.
+        periods = []
+
+        def callback(in_data, frame_count, time_info, status):
+            periods.append((len(in_data), frame_count))
+            return (in_data, pyaudio.paContinue)
+
+        stream = self.p.open(
+            format=pyaudio.paInt16 | pyaudio.paNonInterleaved,
+            channels=channels,
+            rate=44100,
+            input=True,
+            output=True,
+            frames_per_buffer=256,
+            stream_callback=callback)
+        time.sleep(0.2)
+        stream.close()
+        self.assertGreater(len(periods), 0)
+        for in_len, frame_count in periods:
+            self.assertEqual(in_len, frame_count * channels * width)
+
+    @unittest.skipIf(SKIP_HW_TESTS, 'Hardware device required.')
+    def test_app_rate(self):
+        """Ensure streams resample between app_rate and the device's rate."""
+        width = 2
+        channels = self.input_channels
+        frame_size = width * channels
+        stream = self.p.open(
+            format=self.p.get_format_from_width(width),
+            channels=channels,
+            rate=48000,
+            app_rate=16000,
+            input=True,
+            output=True,
+            frames_per_buffer=480)
+        # The filters add latency on top of the device's.
+        device = self.p.open(
+            format=self.p.get_format_from_width(width),
+            channels=channels,
+            rate=48000,
+            input=True,
+            output=True,
+            frames_per_buffer=480,
+            start=False)
+        self.assertGreater(stream.get_input_latency(),
+                           device.get_input_latency())
+        self.assertGreater(stream.get_output_latency(),
+                           device.get_output_latency())
+        device.close()
+
+        # Blocking transfers count frames at the application's rate: a
+        # second of input takes about a second.
+        start = time.time()
+        data = stream.read(16000)
+        self.assertEqual(len(data), 16000 * frame_size)
+        self.assertAlmostEqual(time.time() - start, 1.0, delta=0.25)
+        stream.write(data)
+        stream.close()
+
+        # Callbacks receive about app_rate frames per second.
+        frames = []
+
+        def callback(in_data, frame_count, time_info, status):
+            self.assertEqual(len(in_data), frame_count * frame_size)
+            frames.append(frame_count)
+            return (in_data, pyaudio.paContinue)
+
+        for quality in ['low', 'medium', 'high']:
+            frames.clear()
+            stream = self.p.open(
+                format=self.p.get_format_from_width(width),
+                channels=channels,
+                rate=44100,
+                app_rate=16000,
+                resample_quality=quality,
+                input=True,
+                output=True,
+                frames_per_buffer=441,
+                stream_callback=callback)
+            time.sleep(1.0)
+            stream.close()
+            self.assertAlmostEqual(sum(frames), 16000, delta=2000)
+
+        with self.assertRaises(ValueError):
+            self.p.open(format=self.p.get_format_from_width(width),
+                        channels=channels,
+                        rate=48000,
+                        app_rate=16000,
+                        resample_quality='best',
+                        input=True)
+        with self.assertRaises(ValueError):
+            self.p.open(format=self.p.get_format_from_width(width),
+                        channels=channels,
+                        rate=48000,
+                        app_rate=16000,
+                        input=True,
+                        frames_per_buffer=480,
+                        stream_callback=callback,
+                        callback_batch_periods=2)
+
+    @unittest.skipIf(SKIP_HW_TESTS, 'Hardware device required.')
+    def test_channel_matrix(self):
+        """Ensure streams route the device's channels to the stream's."""
+        width = 2
+        device_channels = self.input_channels
+        num_frames = 1000
+
+        # Selecting the last channel reads one channel of each frame.
+        stream = self.p.open(
+            format=self.p.get_format_from_width(width),
+            channels=1,
+            channel_matrix=[device_channels - 1],
+            rate=44100,
+            input=True,
+            frames_per_buffer=256)
+        self.assertEqual(len(stream.read(num_frames)), num_frames * width)
+        stream.close()
+
+        # Callbacks see the downmix, and write the stream's channels.
+        periods = []
+
+        def callback(in_data, frame_count, time_info, status):
+            periods.append((len(in_data), frame_count))
+            return (in_data, pyaudio.paContinue)
+
+        stream = self.p.open(
+            format=pyaudio.paFloat32,
+            channels=1,
+            channel_matrix=[[1 / device_channels] * device_channels],
+            rate=44100,
+            input=True,
+            output=True,
+            frames_per_buffer=256,
+            stream_callback=callback)
+        time.sleep(0.2)
+        stream.close()
+        self.assertGreater(len(periods), 0)
+        for in_len, frame_count in periods:
+            self.assertEqual(in_len, frame_count * 4)
+
+        with self.assertRaises(ValueError):
+            self.p.open(format=self.p.get_format_from_width(width),
+                        channels=2,
+                        channel_matrix=[0],
+                        rate=44100,
+                        input=True)
+
+    @unittest.skipIf(SKIP_HW_TESTS, 'Hardware device required.')
+    def test_input_read_with_timestamp(self):
+        """Ensure timestamped reads return the capture time and position."""
+        width = 2
+        rate = 44100
+        frame_size = width * self.input_channels
+        num_frames = 256
+        stream = self.p.open(
+            format=self.p.get_format_from_width(width),
+            channels=self.input_channels,
+            rate=rate,
+            input=True,
+            frames_per_buffer=num_frames)
+
+        data, adc_time, position = stream.read(num_frames,
+                                               with_timestamp=True)
+        self.assertEqual(len(data), num_frames * frame_size)
+        self.assertEqual(position, 0)
+        self.assertLess(adc_time, stream.get_time())
+
+        # Every read method advances the position.
+        stream.read(num_frames)
+        stream.read_into(bytearray(num_frames * frame_size))
+        last_adc_time = adc_time
+        for i in range(3, 10):
+            data, adc_time, position = stream.read(num_frames,
+                                                   with_timestamp=True)
+            self.assertEqual(position, i * num_frames)
+            self.assertGreaterEqual(adc_time, last_adc_time)
+            self.assertLess(adc_time, stream.get_time())
+            last_adc_time = adc_time
+        stream.close()
+
+    @unittest.skipIf(SKIP_HW_TESTS, 'Hardware device required.')
+    def test_xrun_counts(self):
+        """Ensure streams count xruns, without raising or closing."""
+        width = 2
+        rate = 44100
+        in_stream = self.p.open(
+            format=self.p.get_format_from_width(width),
+            channels=self.input_channels,
+            rate=rate,
+            input=True,
+            frames_per_buffer=256,
+            capture_buffer_seconds=0.01)
+        out_stream = self.p.open(
+            format=self.p.get_format_from_width(width),
+            channels=2,
+            rate=rate,
+            output=True,
+            frames_per_buffer=256,
+            playback_queue_seconds=0.5)
+        self.assertEqual(set(in_stream.get_xrun_counts().keys()),
+                         {'input_overflows', 'input_overflow_frames',
+                          'input_underflows', 'input_underflow_frames',
+                          'output_underflows', 'output_underflow_frames',
+                          'output_overflows', 'output_overflow_frames'})
+
+        # Let the capture buffer overflow, and the playback queue run dry.
+        out_stream.write(bytes(1000 * width * 2))
+        time.sleep(0.3)
+        in_stream.stop_stream()
+        out_stream.stop_stream()
+
+        counts = in_stream.get_xrun_counts()
+        self.assertGreater(counts['input_overflows'], 0)
+        self.assertEqual(counts['input_overflow_frames'],
+                         in_stream.get_capture_lost_frames())
+        self.assertEqual(in_stream.get_xrun_counts(reset=True), counts)
+        self.assertEqual(in_stream.get_xrun_counts()['input_overflows'], 0)
+        in_stream.read(256, exception_on_overflow=False)
+        self.assertTrue(in_stream.is_stopped())
+
+        counts = out_stream.get_xrun_counts()
+        self.assertEqual(counts['output_underflows'], 1)
+        self.assertGreater(counts['output_underflow_frames'], 0)
+        self.assertLessEqual(counts['output_underflow_frames'], 256)
+        self.assertEqual(counts['input_overflows'], 0)
+        in_stream.close()
+        out_stream.close()
+
+    @unittest.skipIf(SKIP_HW_TESTS, 'Hardware device required.')
+    def test_input_capture_buffer(self):
+        """Ensure capture_buffer_seconds keeps input across reader stalls."""
+        width = 2
+        rate = 44100
+        frame_size = width * self.input_channels
+        stream = self.p.open(
+            format=self.p.get_format_from_width(width),
+            channels=self.input_channels,
+            rate=rate,
+            input=True,
+            frames_per_buffer=256,
+            capture_buffer_seconds=10)
+
+        # Stall the reader; the device keeps filling the buffer meanwhile.
+        time.sleep(0.3)
+        self.assertEqual(stream.get_capture_lost_frames(), 0)
+        num_frames = stream.get_read_available()
+        self.assertGreater(num_frames, int(0.25 * rate))
+        self.assertLessEqual(num_frames, 10 * rate)
+
+        # Reads past what is buffered wait for the device.
+        samples = stream.read(num_frames + 1024)
+        self.assertEqual(len(samples), (num_frames + 1024) * frame_size)
+        stream.close()
+
+        # A buffer that is too small drops input, and says how much.
+        stream = self.p.open(
+            format=self.p.get_format_from_width(width),
+            channels=self.input_channels,
+            rate=rate,
+            input=True,
+            frames_per_buffer=256,
+            capture_buffer_seconds=0.01)
+        time.sleep(0.3)
+        self.assertLessEqual(stream.get_read_available(), int(0.01 * rate) + 1)
+        self.assertGreater(stream.get_capture_lost_frames(), 0)
+        stream.read(1024, exception_on_overflow=False)
+        stream.close()
+
+        with self.assertRaises(ValueError):
+            self.p.open(
+                format=self.p.get_format_from_width(width),
+                channels=self.input_channels,
+                rate=rate,
+                input=True,
+                output=True,
+                capture_buffer_seconds=1)
+
+        stream = self.p.open(
+            format=self.p.get_format_from_width(width),
+            channels=self.input_channels,
+            rate=rate,
+            input=True)
+        with self.assertRaises(ValueError):
+            stream.get_capture_lost_frames()
+        stream.close()
+
+    @unittest.skipIf(SKIP_HW_TESTS, 'Hardware device required.')
+    def test_output_playback_queue(self):
+        """Ensure playback_queue_seconds lets one thread feed many streams."""
+        width = 2
+        rate = 44100
+        frame_size = width * 2
+        num_frames = int(0.2 * rate)
+        streams = [
+            self.p.open(
+                format=self.p.get_format_from_width(width),
+                channels=2,
+                rate=rate,
+                output=True,
+                frames_per_buffer=256,
+                playback_queue_seconds=0.1)
+            for _ in range(8)]
+        capacity = streams[0].get_write_available()
+        self.assertGreaterEqual(capacity, int(0.1 * rate))
+
+        # Feed every stream from this thread, without blocking on any.
+        pending = [memoryview(bytes(num_frames * frame_size))] * len(streams)
+        while any(pending):
+            for i, stream in enumerate(streams):
+                written = stream.write_nowait(pending[i])
+                pending[i] = pending[i][written * frame_size:]
+                self.assertLessEqual(stream.get_queued_frames(), capacity)
+            time.sleep(0.001)
+
+        for stream in streams:
+            stream.drain()
+            self.assertEqual(stream.get_queued_frames(), 0)
+            self.assertEqual(stream.get_write_available(), capacity)
+
+        # Blocking writes larger than the queue wait for room.
+        streams[0].write(bytes(num_frames * frame_size))
+        streams[0].drain()
+        for stream in streams:
+            stream.close()
+
+        with self.assertRaises(ValueError):
+            self.p.open(
+                format=self.p.get_format_from_width(width),
+                channels=2,
+                rate=rate,
+                input=True,
+                playback_queue_seconds=1)
+
+        stream = self.p.open(
+            format=self.p.get_format_from_width(width),
+            channels=2,
+            rate=rate,
+            output=True)
+        with self.assertRaises(ValueError):
+            stream.drain()
+        with self.assertRaises(ValueError):
+            stream.get_queued_frames()
+        stream.close()
+
+    @unittest.skipIf(SKIP_HW_TESTS, 'Hardware device required.')
+    def test_asyncio_read_write(self):
+        """Ensure aread and awrite wait on the event loop, without threads."""
+        width = 2
+        rate = 44100
+        in_frame_size = width * self.input_channels
+        out_frame_size = width * 2
+        in_stream = self.p.open(
+            format=self.p.get_format_from_width(width),
+            channels=self.input_channels,
+            rate=rate,
+            input=True,
+            frames_per_buffer=256,
+            capture_buffer_seconds=0.1)
+        out_stream = self.p.open(
+            format=self.p.get_format_from_width(width),
+            channels=2,
+            rate=rate,
+            output=True,
+            frames_per_buffer=256,
+            playback_queue_seconds=0.1)
+        num_threads = threading.active_count()
+
+        async def read_blocks():
+            # Includes a read larger than the capture buffer.
+            for num_frames in [1024, 1024, int(0.3 * rate)]:
+                samples = await in_stream.aread(num_frames,
+                                                exception_on_overflow=False)
+                self.assertEqual(len(samples), num_frames * in_frame_size)
+                self.assertEqual(threading.active_count(), num_threads)
+
+        async def write_blocks():
+            for _ in range(4):
+                await out_stream.awrite(bytes(int(0.1 * rate) *
+                                              out_frame_size))
+                self.assertEqual(threading.active_count(), num_threads)
+
+        async def main():
+            await asyncio.gather(read_blocks(), write_blocks())
+
+            # Stopping the stream wakes up a pending read.
+            task = loop.create_task(in_stream.aread(int(0.1 * rate)))
+            await asyncio.sleep(0)
+            in_stream.stop_stream()
+            with self.assertRaises(IOError):
+                await task
+
+        loop = asyncio.new_event_loop()
+        try:
+            loop.run_until_complete(main())
+        finally:
+            loop.close()
+
+        in_stream.close()
+        out_stream.close()
+
+    @unittest.skipIf(SKIP_HW_TESTS, 'Sound hardware required.')
+    def test_concurrent_blocking_streams(self):
+        """Ensure streams can be read and closed from several threads."""
+        width = 2
+        num_threads = 4
+        streams = [
+            self.p.open(format=self.p.get_format_from_width(width),
+                        channels=self.input_channels,
+                        rate=44100,
+                        input=True,
+                        input_device_index=self.input_device)
+            for _ in range(num_threads)
+        ]
+        num_reads = [0] * num_threads
+        errors = []
+
+        def read_until_closed(index):
+            try:
+                while True:
+                    streams[index].read(256)
+                    num_reads[index] += 1
+            except IOError:
+                # Closed by the main thread.
+                pass
+            except Exception as err:
+                errors.append(err)
+
+        threads = [threading.Thread(target=read_until_closed, args=(i,))
+                   for i in range(num_threads)]
+        for thread in threads:
+            thread.start()
+        time.sleep(0.5)
+        # Close each stream while its thread may be in the middle of a read.
+        for stream in streams:
+            stream.close()
+        for thread in threads:
+            thread.join()
+
+        self.assertEqual(errors, [])
+        for count in num_reads:
+            self.assertGreater(count, 0)
+
     @unittest.skipIf(SKIP_HW_TESTS, 'Sound hardware required.')
     def test_return_none_callback(self):
         """Ensure that return None ends the stream."""
@@ -257,6 +992,381 @@ class StreamTests(unittest.TestCase):
         out_stream.stop_stream()
         self.assertEqual(num_times_called, 2)
 
+    @unittest.skipIf(SKIP_HW_TESTS, 'Sound hardware required.')
+    def test_buffer_protocol_output_callback(self):
+        """Ensure callbacks may return any contiguous buffer for playback."""
+        channels = 2
+        frames_per_buffer = 256
+        samples = array.array('h', [1] * (frames_per_buffer * channels))
+        outputs = [
+            bytearray(samples.tobytes()),
+            memoryview(samples.tobytes()),
+            samples,
+            # Not contiguous: aborts the stream.
+            memoryview(samples)[::2],
+        ]
+        num_times_called = 0
+
+        def out_callback(_, frame_count, time_info, status):
+            nonlocal num_times_called
+            num_times_called += 1
+            return (outputs[num_times_called - 1], pyaudio.paContinue)
+
+        out_stream = self.p.open(
+            format=pyaudio.paInt16,
+            channels=channels,
+            rate=44100,
+            output=True,
+            frames_per_buffer=frames_per_buffer,
+            output_device_index=self.output_device,
+            stream_callback=out_callback)
+        # The callback error is raised by the next stream method.
+        time.sleep(0.5)
+        with self.assertRaises(ValueError):
+            out_stream.stop_stream()
+        self.assertEqual(num_times_called, len(outputs))
+        out_stream.close()
+
+    @unittest.skipIf(SKIP_HW_TESTS, 'Sound hardware required.')
+    def test_deferred_callback_error(self):
+        """Ensure callback errors are kept until a stream method takes them."""
+        channels = 1
+        frames_per_buffer = 256
+        num_times_called = 0
+
+        def out_callback(_, frame_count, time_info, status):
+            nonlocal num_times_called
+            num_times_called += 1
+            if num_times_called == 3:
+                raise ZeroDivisionError('first')
+            return (b'\0' * frame_count * 2 * channels, pyaudio.paContinue)
+
+        def open_stream():
+            return self.p.open(format=pyaudio.paInt16,
+                               channels=channels,
+                               rate=44100,
+                               output=True,
+                               frames_per_buffer=frames_per_buffer,
+                               output_device_index=self.output_device,
+                               stream_callback=out_callback)
+
+        # The next stream method raises the error, once.
+        out_stream = open_stream()
+        with self.assertRaises(ZeroDivisionError) as err:
+            for _ in range(500):
+                out_stream.is_active()
+                time.sleep(0.01)
+        self.assertEqual(str(err.exception), 'first')
+        self.assertFalse(out_stream.is_active())
+        self.assertIsNone(out_stream.get_error())
+        out_stream.close()
+
+        # Or get_error returns it.
+        num_times_called = 0
+        out_stream = open_stream()
+        for _ in range(500):
+            error = out_stream.get_error()
+            if error is not None:
+                break
+            time.sleep(0.01)
+        self.assertIsInstance(error, ZeroDivisionError)
+        self.assertIsNotNone(error.__traceback__)
+        self.assertIsNone(out_stream.get_error())
+        self.assertFalse(out_stream.is_active())
+        out_stream.close()
+        self.assertIsNone(out_stream.get_error())
+
+        # Errors that no one takes are reported when the stream closes.
+        if hasattr(sys, 'unraisablehook'):
+            num_times_called = 0
+            unraisable = []
+            hook = sys.unraisablehook
+            sys.unraisablehook = unraisable.append
+            self.addCleanup(setattr, sys, 'unraisablehook', hook)
+            out_stream = open_stream()
+            time.sleep(0.5)
+            out_stream.close()
+            self.assertEqual(len(unraisable), 1)
+            self.assertIsInstance(unraisable[0].exc_value, ZeroDivisionError)
+            self.assertIs(unraisable[0].object, out_callback)
+
+    @unittest.skipIf(SKIP_HW_TESTS, 'Sound hardware required.')
+    def test_reuse_input_buffer_callback(self):
+        """Ensure in_data is a read-only view over a reused buffer."""
+        width = 2
+        frames_per_buffer = 256
+        num_bytes = frames_per_buffer * width * self.input_channels
+        view_ids = []
+        kept = []
+
+        def in_callback(in_data, frame_count, time_info, status):
+            self.assertIsInstance(in_data, memoryview)
+            # memoryview.toreadonly() is new in Python 3.8.
+            if sys.version_info >= (3, 8):
+                self.assertTrue(in_data.readonly)
+            self.assertEqual(len(in_data), num_bytes)
+            view_ids.append(id(in_data))
+            if len(view_ids) == 3:
+                # Keep a slice, along with a copy of what it holds now.
+                kept.append((in_data[:4], bytes(in_data[:4])))
+            return (None, (pyaudio.paComplete
+                           if len(view_ids) == 5 else pyaudio.paContinue))
+
+        in_stream = self.p.open(
+            format=self.p.get_format_from_width(width),
+            channels=self.input_channels,
+            rate=44100,
+            input=True,
+            frames_per_buffer=frames_per_buffer,
+            input_device_index=self.input_device,
+            stream_callback=in_callback,
+            reuse_input_buffer=True)
+        time.sleep(0.5)
+        in_stream.close()
+
+        self.assertEqual(len(view_ids), 5)
+        # The stream reuses the view until the callback keeps part of it...
+        self.assertEqual(view_ids[0], view_ids[1])
+        self.assertEqual(view_ids[1], view_ids[2])
+        # ...and then leaves the kept samples alone.
+        kept_slice, kept_bytes = kept[0]
+        self.assertEqual(bytes(kept_slice), kept_bytes)
+        self.assertEqual(view_ids[3], view_ids[4])
+
+    @unittest.skipIf(SKIP_HW_TESTS, 'Sound hardware required.')
+    def test_output_in_place_callback(self):
+        """Ensure in-place callbacks get a writable view of the output."""
+        width = 2
+        channels = 2
+        frames_per_buffer = 256
+        views = []
+
+        def out_callback(in_data, out_data, frame_count, time_info, status):
+            self.assertIsNone(in_data)
+            self.assertEqual(len(out_data), frame_count * width * channels)
+            out_data[:] = b'\1' * len(out_data)
+            views.append(out_data)
+            return (pyaudio.paComplete
+                    if len(views) == 3 else pyaudio.paContinue)
+
+        out_stream = self.p.open(
+            format=self.p.get_format_from_width(width),
+            channels=channels,
+            rate=44100,
+            output=True,
+            frames_per_buffer=frames_per_buffer,
+            output_device_index=self.output_device,
+            stream_callback=out_callback,
+            output_in_place=True)
+        time.sleep(0.5)
+        out_stream.close()
+
+        self.assertEqual(len(views), 3)
+        # Kept views are over buffers that the stream no longer uses, so they
+        # stay safe to use once the stream closes.
+        for view in views:
+            self.assertEqual(bytes(view), b'\1' * len(view))
+            view[:] = b'\2' * len(view)
+
+    @unittest.skipIf(SKIP_HW_TESTS, 'Sound hardware required.')
+    def test_callback_thread_state_persists(self):
+        """Ensure the callback thread keeps one Python thread state."""
+        width = 2
+        channels = 2
+        local = threading.local()
+        counts = []
+
+        def out_callback(in_data, frame_count, time_info, status):
+            # Thread-local data lives in the thread state, so it only
+            # survives across periods if the thread state does.
+            local.count = getattr(local, 'count', 0) + 1
+            counts.append(local.count)
+            return (b'\0' * frame_count * width * channels,
+                    pyaudio.paComplete
+                    if len(counts) == 5 else pyaudio.paContinue)
+
+        out_stream = self.p.open(
+            format=self.p.get_format_from_width(width),
+            channels=channels,
+            rate=44100,
+            output=True,
+            frames_per_buffer=256,
+            output_device_index=self.output_device,
+            stream_callback=out_callback)
+        time.sleep(0.5)
+        out_stream.close()
+
+        self.assertEqual(counts, [1, 2, 3, 4, 5])
+
+    @unittest.skipIf(SKIP_HW_TESTS, 'Sound hardware required.')
+    def test_decoupled_callback(self):
+        """Ensure decoupled callbacks run off the audio thread."""
+        width = 2
+        channels = 2
+        rate = 44100
+        frames_per_buffer = 256
+        periods = 4
+        threads = []
+
+        def out_callback(in_data, frame_count, time_info, status):
+            threads.append(threading.get_ident())
+            return (b'\1' * frame_count * width * channels,
+                    pyaudio.paContinue)
+
+        out_stream = self.p.open(
+            format=self.p.get_format_from_width(width),
+            channels=channels,
+            rate=rate,
+            output=True,
+            frames_per_buffer=frames_per_buffer,
+            output_device_index=self.output_device,
+            stream_callback=out_callback,
+            decoupled_callback_periods=periods)
+        self.assertGreaterEqual(out_stream.get_output_latency(),
+                                periods * frames_per_buffer / rate)
+        time.sleep(0.5)
+        out_stream.close()
+
+        # Every period ran on the stream's worker thread.
+        self.assertGreater(len(threads), 0)
+        self.assertEqual(len(set(threads)), 1)
+        self.assertNotIn(threading.get_ident(), threads)
+
+        with self.assertRaises(ValueError):
+            self.p.open(format=self.p.get_format_from_width(width),
+                        channels=channels,
+                        rate=rate,
+                        output=True,
+                        output_device_index=self.output_device,
+                        stream_callback=out_callback,
+                        decoupled_callback_periods=periods)
+
+    @unittest.skipIf(SKIP_HW_TESTS, 'Sound hardware required.')
+    def test_batched_callback(self):
+        """Ensure batched callbacks get several periods per call."""
+        width = 2
+        rate = 44100
+        frames_per_buffer = 64
+        periods = 4
+        frame_counts = []
+        in_lengths = []
+
+        def duplex_callback(in_data, frame_count, time_info, status):
+            frame_counts.append(frame_count)
+            in_lengths.append(len(in_data))
+            return (in_data, pyaudio.paComplete
+                    if len(frame_counts) == 3 else pyaudio.paContinue)
+
+        duplex_stream = self.p.open(
+            format=self.p.get_format_from_width(width),
+            channels=1,
+            rate=rate,
+            input=True,
+            output=True,
+            frames_per_buffer=frames_per_buffer,
+            input_device_index=self.input_device,
+            output_device_index=self.output_device,
+            stream_callback=duplex_callback,
+            callback_batch_periods=periods)
+        self.assertGreaterEqual(duplex_stream.get_input_latency(),
+                                (periods - 1) * frames_per_buffer / rate)
+        self.assertGreaterEqual(duplex_stream.get_output_latency(),
+                                frames_per_buffer / rate)
+        time.sleep(0.5)
+        duplex_stream.close()
+
+        self.assertEqual(frame_counts, [frames_per_buffer * periods] * 3)
+        self.assertEqual(in_lengths,
+                         [frames_per_buffer * periods * width] * 3)
+
+    @unittest.skipIf(SKIP_HW_TESTS, 'Sound hardware required.')
+    @unittest.skipIf(sys.version_info < (3, 12), 'Python 3.12+ required.')
+    def test_subinterpreter_callback(self):
+        """Ensure callbacks can run in the stream's own subinterpreter."""
+        width = 2
+        frames_per_buffer = 256
+        module_dir = tempfile.TemporaryDirectory()
+        self.addCleanup(module_dir.cleanup)
+        log_path = os.path.join(module_dir.name, 'calls.log')
+        with open(os.path.join(module_dir.name, 'subinterp_callback.py'),
+                  'w') as module_file:
+            # The callback cannot share objects with this interpreter, so it
+            # logs its calls to a file.
+            module_file.write(textwrap.dedent("""\
+                import pyaudio
+
+                calls = 0
+
+                def callback(in_data, frame_count, time_info, status):
+                    global calls
+                    calls += 1
+                    with open(%r, 'a') as log:
+                        log.write('%%d %%s\\n' %% (frame_count,
+                                                 type(time_info).__name__))
+                    return (b'\\0' * frame_count * %d,
+                            pyaudio.paComplete if calls == 5
+                            else pyaudio.paContinue)
+
+                def failing_callback(in_data, frame_count, time_info, status):
+                    raise ValueError('callback failed')
+                """ % (log_path, width)))
+        # The subinterpreter imports the callback using this sys.path.
+        sys.path.insert(0, module_dir.name)
+        self.addCleanup(sys.path.remove, module_dir.name)
+        self.addCleanup(sys.modules.pop, 'subinterp_callback', None)
+
+        def open_stream(stream_callback, **kwargs):
+            return self.p.open(format=self.p.get_format_from_width(width),
+                               channels=1,
+                               rate=44100,
+                               output=True,
+                               frames_per_buffer=frames_per_buffer,
+                               output_device_index=self.output_device,
+                               stream_callback=stream_callback,
+                               callback_in_subinterpreter=True,
+                               **kwargs)
+
+        out_stream = open_stream('subinterp_callback:callback')
+        while out_stream.is_active():
+            time.sleep(0.01)
+        # Any thread may close the stream, and so end the subinterpreter.
+        close_thread = threading.Thread(target=out_stream.close)
+        close_thread.start()
+        close_thread.join(timeout=10)
+        self.assertFalse(close_thread.is_alive())
+
+        with open(log_path) as log:
+            self.assertEqual(log.read().splitlines(),
+                             [f'{frames_per_buffer} TimeInfo'] * 5)
+        # This interpreter's copy of the module is separate.
+        import subinterp_callback  # pylint: disable=import-outside-toplevel
+        self.assertEqual(subinterp_callback.calls, 0)
+
+        # Callback errors reach this interpreter as built-in exceptions, with
+        # the subinterpreter's traceback as a note.
+        out_stream = open_stream('subinterp_callback:failing_callback')
+        for _ in range(500):
+            error = out_stream.get_error()
+            if error is not None:
+                break
+            time.sleep(0.01)
+        out_stream.close()
+        self.assertIsInstance(error, ValueError)
+        self.assertEqual(str(error), 'callback failed')
+        self.assertIn('failing_callback', error.__notes__[0])
+
+        with self.assertRaises(ModuleNotFoundError):
+            open_stream('no_such_module:callback')
+        with self.assertRaises(AttributeError):
+            open_stream('subinterp_callback:no_such_callback')
+        with self.assertRaises(ValueError):
+            open_stream('subinterp_callback')
+        with self.assertRaises(TypeError):
+            open_stream(subinterp_callback.callback)
+        with self.assertRaises(ValueError):
+            open_stream('subinterp_callback:callback',
+                        callback_batch_periods=2)
+
     @unittest.skipIf(SKIP_HW_TESTS, 'Sound hardware required.')
     def test_device_lock_gil_order(self):
         """Ensure no deadlock between Pa_{Open,Start,Stop}Stream and GIL."""